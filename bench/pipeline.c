@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Reference software receiver pipeline for throughput benchmarking.
+ *
+ * Runs a recorded IF capture through acquisition, tracking, navigation
+ * message decoding, measurement generation and PVT, timing each stage, and
+ * reports the sample throughput, the share of the time spent in each stage
+ * and the real-time factor achieved. All the channels are correlated in one
+ * pass over each block of samples with track_correlate_multi(), packed
+ * samples are unpacked for it first.
+ *
+ * Measurements and PVT only run once at least four channels have decoded
+ * their TOW and a full ephemeris, which takes 18 to 30 s of a real capture.
+ * On shorter captures, or synthetic ones without valid ephemerides, the
+ * measurements and PVT stage is never reached and the throughput reported
+ * covers acquisition, tracking and nav decoding only.
+ *
+ * Usage: pipeline_bench [options] capture_file
+ *   -f fs      Sample rate in Hz, default 16.368e6.
+ *   -i if      Intermediate frequency in Hz, default 4.092e6.
+ *   -t format  Sample format, s8, 1bit or 2bit, default s8.
+ *   -m ms      Milliseconds of the capture to process, default all of it.
+ *   -s snr     Acquisition SNR threshold, default 25.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <acq.h>
+#include <acq_sched.h>
+#include <constants.h>
+#include <correlate.h>
+#include <nav_msg.h>
+#include <prns.h>
+#include <pvt.h>
+#include <sample_source.h>
+#include <track.h>
+#include <track_batch.h>
+
+#define N_PRNS 32
+
+/* Acquisition search, over the first few milliseconds of the capture. */
+#define ACQ_DOPPLER_MAX 5000.0
+#define ACQ_BIN_WIDTH 500.0
+#define ACQ_N_COHERENT 1
+#define ACQ_N_NONCOHERENT 4
+
+/* Tracking loop parameters, bandwidths in Hz. */
+#define LOOP_FREQ 1e3
+#define CODE_BW 1.0
+#define CODE_ZETA 0.7
+#define CODE_K 1.0
+#define CARR_BW 25.0
+#define CARR_ZETA 0.7
+#define CARR_K 1.0
+#define CARR_FLL_AIDING 5.0
+#define CN0_CUTOFF 5.0
+#define CN0_INIT 40.0
+
+/* L1 carrier cycles per C/A code chip. */
+#define CARR_TO_CODE 1540.0
+
+/* Measurements and a PVT solution are made at this interval. */
+#define MEAS_INTERVAL_MS 100
+
+/* Time of week marking an unknown TOW. */
+#define TOW_INVALID -1
+
+#define GPS_WEEK_MS (7*24*3600*1000)
+
+enum {
+  STAGE_ACQ = 0,
+  STAGE_CORR,
+  STAGE_LOOP,
+  STAGE_NAV,
+  STAGE_PVT,
+  N_STAGES
+};
+
+static const char *stage_names[N_STAGES] = {
+  "acquisition", "correlation", "loop filters", "nav decoding",
+  "measurements and PVT",
+};
+
+static double stage_time[N_STAGES];
+
+typedef struct {
+  u8 prn;
+  const s8 *code;     /* Expanded code replica. */
+  u64 sample;         /* Sample count of the start of the next code period. */
+  double code_phase;  /* Code phase of `sample` in chips. */
+  double carr_phase;  /* Carrier phase of `sample` in radians. */
+  double carr_cycles; /* Accumulated carrier phase in cycles. */
+  float carr_freq;    /* Doppler found by acquisition in Hz. */
+  s32 TOW_ms;         /* TOW at `sample`, once decoded. */
+  nav_msg_t nav;
+  ephemeris_t eph;
+} channel_t;
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-f fs] [-i if] [-t s8|1bit|2bit] [-m ms] "
+                  "[-s snr] capture_file\n", name);
+}
+
+/* Search the start of the capture for all the satellites, returning the
+ * number found. */
+static u8 acquire(sample_source_t *src, double fs, double if_freq,
+                  float snr_threshold, u8 n_bits, channel_t channels[])
+{
+  acq_plan_t plan;
+  if (acq_plan_init(&plan, fs) != 0) {
+    fprintf(stderr, "Sample rate %g Hz not usable for acquisition\n", fs);
+    return 0;
+  }
+
+  u32 n = acq_samples_needed(&plan, ACQ_N_COHERENT, ACQ_N_NONCOHERENT);
+  sample_window_t w;
+  if (sample_source_window(src, 0, n, &w) != 0) {
+    fprintf(stderr, "Capture too short for acquisition\n");
+    acq_plan_free(&plan);
+    return 0;
+  }
+
+  /* The scheduler wants s8 samples, the acquisition window is short so
+   * packed samples are unpacked for it. */
+  s8 *unpacked = 0;
+  const s8 *samples = w.data;
+  if (n_bits) {
+    unpacked = malloc(n);
+    if (!unpacked) {
+      fprintf(stderr, "Out of memory\n");
+      acq_plan_free(&plan);
+      return 0;
+    }
+    packed_samples_unpack(w.data, n_bits, w.start, n, unpacked);
+    samples = unpacked;
+  }
+
+  u8 prns[N_PRNS];
+  acq_sched_result_t results[N_PRNS];
+  for (u8 i=0; i<N_PRNS; i++)
+    prns[i] = i;
+  acq_sched_config_t config = {
+    .cf_min = if_freq - ACQ_DOPPLER_MAX,
+    .cf_max = if_freq + ACQ_DOPPLER_MAX,
+    .cf_bin_width = ACQ_BIN_WIDTH,
+    .n_coherent = ACQ_N_COHERENT,
+    .n_noncoherent = ACQ_N_NONCOHERENT,
+    .n_chunks = 1,
+    .snr_threshold = snr_threshold,
+  };
+  acq_sched_search(&plan, samples, &config, N_PRNS, prns, results, 0, 0);
+
+  u8 n_found = 0;
+  for (u8 i=0; i<N_PRNS; i++) {
+    if (results[i].status != ACQ_SCHED_FOUND ||
+        n_found == TRACK_BATCH_MAX_CHANNELS)
+      continue;
+    channel_t *c = &channels[n_found++];
+    memset(c, 0, sizeof(*c));
+    c->prn = results[i].prn;
+    c->code = ca_code_replica(c->prn);
+    c->TOW_ms = TOW_INVALID;
+    c->carr_freq = results[i].result.cf - if_freq;
+
+    /* Start tracking at the first code period boundary. */
+    double code_step = GPS_CA_CHIPPING_RATE / fs;
+    c->sample = (u64)ceil((1023 - results[i].result.cp) / code_step);
+    c->code_phase = results[i].result.cp + c->sample * code_step - 1023;
+    c->carr_phase = fmod(2*M_PI * results[i].result.cf * c->sample / fs,
+                         2*M_PI);
+    nav_msg_init(&c->nav);
+    printf("Acquired PRN %2d: code phase %7.2f chips, Doppler %6.0f Hz, "
+           "SNR %5.1f\n", c->prn + 1, results[i].result.cp,
+           results[i].result.cf - if_freq, results[i].result.snr);
+  }
+
+  free(unpacked);
+  acq_plan_free(&plan);
+  return n_found;
+}
+
+/* Make measurements from all the channels with a known TOW and ephemeris
+ * and compute a PVT solution, returning whether it succeeded. */
+static bool solve(u8 n_channels, channel_t channels[], const track_batch_t *b,
+                  double fs, gnss_solution *soln)
+{
+  channel_measurement_t meas[TRACK_BATCH_MAX_CHANNELS];
+  navigation_measurement_t nav_meas[TRACK_BATCH_MAX_CHANNELS];
+  ephemeris_t ephs[TRACK_BATCH_MAX_CHANNELS];
+  u8 n = 0;
+  double nav_time = 0;
+
+  for (u8 i=0; i<n_channels; i++) {
+    channel_t *c = &channels[i];
+    if (c->TOW_ms == TOW_INVALID || !c->eph.valid || !c->eph.healthy)
+      continue;
+    meas[n].prn = c->prn;
+    meas[n].code_phase_chips = c->code_phase;
+    meas[n].code_phase_rate = GPS_CA_CHIPPING_RATE + b->code_freq[i];
+    meas[n].carrier_phase = c->carr_cycles;
+    meas[n].carrier_freq = b->carr_freq[i];
+    meas[n].time_of_week_ms = c->TOW_ms;
+    meas[n].receiver_time = c->sample / fs;
+    meas[n].snr = b->cn0[i];
+    meas[n].lock_counter = 0;
+    ephs[n] = c->eph;
+    if (meas[n].receiver_time > nav_time)
+      nav_time = meas[n].receiver_time;
+    n++;
+  }
+
+  if (n < 4)
+    return false;
+
+  calc_navigation_measurement(n, meas, nav_meas, nav_time, ephs);
+  dops_t dops;
+  return calc_PVT(n, nav_meas, soln, &dops) >= 0;
+}
+
+int main(int argc, char *argv[])
+{
+  double fs = 16.368e6, if_freq = 4.092e6;
+  float snr_threshold = 25;
+  u64 max_ms = 0;
+  sample_format_t format = SAMPLE_FORMAT_S8;
+  u8 n_bits = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:i:t:m:s:")) != -1) {
+    switch (opt) {
+    case 'f': fs = atof(optarg); break;
+    case 'i': if_freq = atof(optarg); break;
+    case 'm': max_ms = strtoull(optarg, 0, 10); break;
+    case 's': snr_threshold = atof(optarg); break;
+    case 't':
+      if (strcmp(optarg, "s8") == 0) {
+        format = SAMPLE_FORMAT_S8;
+        n_bits = 0;
+      } else if (strcmp(optarg, "1bit") == 0) {
+        format = SAMPLE_FORMAT_PACKED_1BIT;
+        n_bits = 1;
+      } else if (strcmp(optarg, "2bit") == 0) {
+        format = SAMPLE_FORMAT_PACKED_2BIT;
+        n_bits = 2;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  sample_source_t src;
+  if (sample_source_file_init(&src, argv[optind], format, fs) != 0) {
+    fprintf(stderr, "Can't open capture %s\n", argv[optind]);
+    return 1;
+  }
+  u64 n_samples = sample_source_available(&src);
+  if (max_ms && (u64)(max_ms * fs / 1000) < n_samples)
+    n_samples = (u64)(max_ms * fs / 1000);
+
+  double t_start = now();
+
+  channel_t channels[TRACK_BATCH_MAX_CHANNELS];
+  u8 n_channels = acquire(&src, fs, if_freq, snr_threshold, n_bits,
+                          channels);
+  double t_acq = now();
+  stage_time[STAGE_ACQ] = t_acq - t_start;
+
+  track_batch_t batch;
+  track_batch_init(&batch, TRACK_LOOP_AIDED, n_channels);
+  for (u8 i=0; i<n_channels; i++) {
+    aided_tl_state_t tl;
+    cn0_est_state_t cn0;
+    aided_tl_init(&tl, LOOP_FREQ, channels[i].carr_freq / CARR_TO_CODE,
+                  CODE_BW, CODE_ZETA, CODE_K,
+                  channels[i].carr_freq, CARR_BW, CARR_ZETA, CARR_K,
+                  CARR_FLL_AIDING);
+    cn0_est_init(&cn0, LOOP_FREQ, CN0_INIT, CN0_CUTOFF, LOOP_FREQ);
+    track_batch_set_aided(&batch, i, &tl, &cn0);
+  }
+
+  /* Longest code period in samples, with margin for the code Doppler. */
+  u32 window = (u32)ceil(1.01 * 1023 * fs / GPS_CA_CHIPPING_RATE) + 1;
+
+  /* Unpacked samples for packed captures, grown as the channels drift
+   * apart. */
+  s8 *unpacked = 0;
+  u32 unpacked_len = 0;
+
+  u64 n_ms = 0, n_subframes = 0, n_ephs = 0, n_solns = 0;
+  gnss_solution soln;
+  bool running = n_channels > 0;
+  while (running) {
+    double t0 = now();
+
+    /* One block covering the next code period of every channel. */
+    u64 first = channels[0].sample, last = channels[0].sample;
+    for (u8 i=1; i<n_channels; i++) {
+      if (channels[i].sample < first)
+        first = channels[i].sample;
+      if (channels[i].sample > last)
+        last = channels[i].sample;
+    }
+    u32 len = (u32)(last - first) + window;
+    sample_window_t w;
+    if (last + window > n_samples ||
+        sample_source_window(&src, first, len, &w) != 0)
+      break;
+
+    const s8 *samples = w.data;
+    if (n_bits) {
+      if (len > unpacked_len) {
+        s8 *p = realloc(unpacked, len);
+        if (!p) {
+          fprintf(stderr, "Out of memory\n");
+          break;
+        }
+        unpacked = p;
+        unpacked_len = len;
+      }
+      packed_samples_unpack(w.data, n_bits, w.start, len, unpacked);
+      samples = unpacked;
+    }
+
+    corr_channel_t mc[TRACK_BATCH_MAX_CHANNELS];
+    for (u8 i=0; i<n_channels; i++) {
+      channel_t *c = &channels[i];
+      mc[i] = (corr_channel_t){
+        .code = c->code,
+        .start = (u32)(c->sample - first),
+        .code_phase = c->code_phase,
+        .code_step = (GPS_CA_CHIPPING_RATE + batch.code_freq[i]) / fs,
+        .carr_phase = c->carr_phase,
+        .carr_step = 2*M_PI * (if_freq + batch.carr_freq[i]) / fs,
+      };
+    }
+    track_correlate_multi(samples, n_channels, mc);
+
+    correlation_t cs[TRACK_BATCH_MAX_CHANNELS][3];
+    for (u8 i=0; i<n_channels; i++) {
+      channel_t *c = &channels[i];
+      c->code_phase = mc[i].code_phase;
+      c->carr_phase = mc[i].carr_phase;
+      c->sample += mc[i].num_samples;
+      c->carr_cycles += mc[i].num_samples * (if_freq + batch.carr_freq[i]) / fs;
+      cs[i][0] = (correlation_t){.I = mc[i].I_E, .Q = mc[i].Q_E};
+      cs[i][1] = (correlation_t){.I = mc[i].I_P, .Q = mc[i].Q_P};
+      cs[i][2] = (correlation_t){.I = mc[i].I_L, .Q = mc[i].Q_L};
+    }
+    double t1 = now();
+
+    track_batch_update(&batch, cs);
+    double t2 = now();
+
+    for (u8 i=0; i<n_channels; i++) {
+      channel_t *c = &channels[i];
+      if (c->TOW_ms != TOW_INVALID)
+        c->TOW_ms = (c->TOW_ms + 1) % GPS_WEEK_MS;
+      s32 TOW_ms = nav_msg_update(&c->nav, cs[i][1].I, 1);
+      if (TOW_ms >= 0) {
+        if (c->TOW_ms != TOW_INVALID && c->TOW_ms != TOW_ms)
+          printf("PRN %2d TOW mismatch, %d ms decoded, %d ms expected\n",
+                 c->prn + 1, TOW_ms, c->TOW_ms);
+        c->TOW_ms = TOW_ms;
+      }
+      if (subframe_ready(&c->nav)) {
+        n_subframes++;
+        if (process_subframe(&c->nav, &c->eph) > 0)
+          n_ephs++;
+      }
+    }
+    double t3 = now();
+
+    n_ms++;
+    if (n_ms % MEAS_INTERVAL_MS == 0 &&
+        solve(n_channels, channels, &batch, fs, &soln)) {
+      n_solns++;
+      printf("%6.1f s: PVT %.6f %.6f %.1f, %d satellites\n",
+             n_ms * 1e-3, soln.pos_llh[0] * R2D, soln.pos_llh[1] * R2D,
+             soln.pos_llh[2], soln.n_used);
+    }
+    double t4 = now();
+
+    stage_time[STAGE_CORR] += t1 - t0;
+    stage_time[STAGE_LOOP] += t2 - t1;
+    stage_time[STAGE_NAV] += t3 - t2;
+    stage_time[STAGE_PVT] += t4 - t3;
+  }
+
+  double wall = now() - t_start;
+  double processed = n_channels ? n_ms * 1e-3 : 0;
+
+  for (u8 i=0; i<n_channels; i++)
+    printf("PRN %2d: C/N0 %4.1f dB-Hz, Doppler %7.1f Hz, TOW %s\n",
+           channels[i].prn + 1, batch.cn0[i], batch.carr_freq[i],
+           channels[i].TOW_ms == TOW_INVALID ? "unknown" : "decoded");
+
+  printf("\n%d channels, %.3f s of signal in %.3f s\n",
+         n_channels, processed, wall);
+  printf("%llu subframes, %llu ephemerides, %llu PVT solutions\n",
+         (unsigned long long)n_subframes, (unsigned long long)n_ephs,
+         (unsigned long long)n_solns);
+  printf("Throughput: %.3g samples/s, real-time factor %.2f\n",
+         processed * fs / wall, processed / wall);
+  for (u8 i=0; i<N_STAGES; i++)
+    printf("  %-22s %8.3f s %5.1f %%\n", stage_names[i], stage_time[i],
+           100 * stage_time[i] / wall);
+
+  free(unpacked);
+  sample_source_free(&src);
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ACQ_H
+#define LIBSWIFTNAV_ACQ_H
+
+#include "common.h"
+#include "fft.h"
+#include "prns.h"
+
+/** \addtogroup acq
+ * \{ */
+
+/** Acquisition plan for a fixed sample rate.
+ * Initialise with acq_plan_init(). Once initialised a plan can be shared
+ * between threads, each call to acq_search() uses its own scratch memory. */
+typedef struct {
+  double fs;                 /**< Sample rate in Hz. */
+  u32 n;                     /**< Samples per code period. */
+  u32 n_fft;                 /**< FFT length, `n` rounded up to a power of
+                                  two. */
+  double bin_hz;             /**< FFT bin spacing in Hz. */
+  fft_plan_t *fft;           /**< FFT plan of length `n_fft`. */
+  ca_code_resampled_t codes; /**< Code replicas at `n_fft` samples per code
+                                  period. */
+  fft_cpx_t *code_fft;       /**< Conjugated code spectra for all PRNs. */
+  u8 code_fft_state[32];     /**< Whether each code spectrum is built. */
+} acq_plan_t;
+
+/** Result of an acquisition search. */
+typedef struct {
+  float cp;  /**< Code phase of the first sample in chips. */
+  float cf;  /**< Carrier frequency in Hz. */
+  float snr; /**< Peak power to mean power ratio. */
+} acq_result_t;
+
+/** Configuration of a warm re-acquisition, see acq_reacquire(). */
+typedef struct {
+  float if_freq;       /**< Intermediate frequency of the samples in Hz. */
+  float cp_window;     /**< Code phase searched either side of the
+                            prediction in chips. */
+  float cf_window;     /**< Carrier frequency searched either side of the
+                            prediction in Hz. */
+  float cf_bin_width;  /**< Carrier frequency step in Hz. */
+  u32 n_coherent;      /**< Code periods integrated coherently. */
+  u32 n_noncoherent;   /**< Coherent integrations summed non-coherently. */
+  float snr_threshold; /**< SNR at which the satellite is declared found
+                            in the window. */
+  float cf_min;        /**< Lowest carrier frequency of the full search
+                            in Hz. */
+  float cf_max;        /**< Highest carrier frequency of the full search
+                            in Hz. */
+} acq_reacq_config_t;
+
+/** \} */
+
+s8 acq_plan_init(acq_plan_t *plan, double fs);
+void acq_plan_free(acq_plan_t *plan);
+u32 acq_samples_needed(const acq_plan_t *plan,
+                       u32 n_coherent, u32 n_noncoherent);
+s8 acq_search(acq_plan_t *plan, const s8 *samples, u8 prn,
+              float cf_min, float cf_max, float cf_bin_width,
+              u32 n_coherent, u32 n_noncoherent,
+              acq_result_t *result);
+s8 acq_search_packed(acq_plan_t *plan, const u64 *packed, u8 bits,
+                     u32 start, u8 prn,
+                     float cf_min, float cf_max, float cf_bin_width,
+                     u32 n_coherent, u32 n_noncoherent,
+                     acq_result_t *result);
+s8 acq_reacquire(acq_plan_t *plan, const s8 *samples, u8 prn,
+                 float code_phase, float code_freq, float carr_freq,
+                 double elapsed, const acq_reacq_config_t *config,
+                 acq_result_t *result);
+
+#endif /* LIBSWIFTNAV_ACQ_H */
+
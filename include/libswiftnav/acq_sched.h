@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ACQ_SCHED_H
+#define LIBSWIFTNAV_ACQ_SCHED_H
+
+#include "common.h"
+#include "acq.h"
+
+/** \addtogroup acq_sched
+ * \{ */
+
+/** Outcome of the search for one PRN. */
+typedef enum {
+  ACQ_SCHED_NOT_FOUND = 0, /**< Searched fully, no peak above threshold. */
+  ACQ_SCHED_FOUND,         /**< Peak found above the threshold. */
+  ACQ_SCHED_CANCELLED,     /**< Search stopped before it was complete. */
+} acq_sched_status_t;
+
+/** Configuration of a scheduled acquisition search. */
+typedef struct {
+  float cf_min;        /**< Lowest carrier frequency to search in Hz. */
+  float cf_max;        /**< Highest carrier frequency to search in Hz. */
+  float cf_bin_width;  /**< Carrier frequency step in Hz. */
+  u32 n_coherent;      /**< Code periods integrated coherently. */
+  u32 n_noncoherent;   /**< Coherent integrations summed non-coherently. */
+  u32 n_chunks;        /**< Doppler sub-ranges each PRN is split into. */
+  float snr_threshold; /**< SNR at which a satellite is declared found. */
+  u8 n_wanted;         /**< Stop once this many are found, 0 for all. */
+  u8 n_threads;        /**< Worker threads, 0 for one per online CPU. */
+} acq_sched_config_t;
+
+/** Result of the search for one PRN. */
+typedef struct {
+  u8 prn;                    /**< PRN searched for. */
+  acq_sched_status_t status; /**< Outcome of the search. */
+  acq_result_t result;       /**< Best peak over the searched chunks. */
+} acq_sched_result_t;
+
+/** Called from the thread running acq_sched_search() as each PRN is
+ * resolved, see acq_sched_search(). */
+typedef void (*acq_sched_callback_t)(const acq_sched_result_t *result,
+                                     void *context);
+
+/** \} */
+
+s8 acq_sched_search(acq_plan_t *plan, const s8 *samples,
+                    const acq_sched_config_t *config,
+                    u8 n_prns, const u8 prns[],
+                    acq_sched_result_t results[],
+                    acq_sched_callback_t callback, void *context);
+
+#endif /* LIBSWIFTNAV_ACQ_SCHED_H */
+
@@ -37,6 +37,36 @@ typedef struct {
   u8 valid;     /**< Almanac is valid. */
 } almanac_t;
 
+/** Satellite states of all the almanacs over a grid of times, see
+ * almanac_grid_init(). */
+typedef struct {
+  double t0;        /**< GPS time of week of the first time [s]. */
+  s16 week;         /**< GPS week number modulo 1024, or -1, see
+                         calc_sat_state_almanac(). */
+  double dt;        /**< Time between grid times [s]. */
+  u32 n_times;      /**< Number of grid times. */
+  u32 sats;         /**< Bit mask of the PRNs with a valid, healthy
+                         almanac, bit 0 for PRN 0. */
+  double (*pos)[3]; /**< ECEF position of PRN `p` at grid time `i`, at
+                         index `i*32 + p` [m]. */
+  double (*vel)[3]; /**< ECEF velocity, indexed as `pos` [m/s]. */
+} almanac_grid_t;
+
+/** Satellite as seen from a location at one grid time. */
+typedef struct {
+  float az;      /**< Azimuth [rad]. */
+  float el;      /**< Elevation [rad]. */
+  float doppler; /**< Doppler shift [Hz]. */
+} almanac_look_t;
+
+/** Pass of a satellite over a location. */
+typedef struct {
+  u8 prn;       /**< PRN of the satellite, counting from 0. */
+  u32 rise;     /**< First grid time the satellite is above the mask. */
+  u32 set;      /**< One past the last grid time above the mask. */
+  float max_el; /**< Highest elevation of the pass [rad]. */
+} almanac_pass_t;
+
 /** \} */
 
 void calc_sat_state_almanac(almanac_t* alm, double t, s16 week,
@@ -46,4 +76,12 @@ void calc_sat_az_el_almanac(almanac_t* alm, double t, s16 week,
 double calc_sat_doppler_almanac(almanac_t* alm, double t, s16 week,
                                 double ref[3]);
 
+s8 almanac_grid_init(almanac_grid_t *g, const almanac_t alm[32],
+                     double t0, s16 week, double dt, u32 n_times);
+void almanac_grid_free(almanac_grid_t *g);
+void almanac_grid_look(const almanac_grid_t *g, const double ref[3],
+                       almanac_look_t look[]);
+u32 almanac_grid_passes(const almanac_grid_t *g, const almanac_look_t look[],
+                        double mask, almanac_pass_t passes[], u32 max_passes);
+
 #endif /* LIBSWIFTNAV_ALMANAC_H */
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ALMANAC_SURVEY_H
+#define LIBSWIFTNAV_ALMANAC_SURVEY_H
+
+#include "common.h"
+#include "almanac.h"
+
+s8 almanac_survey(const almanac_grid_t *g, u32 n_locs,
+                  const double refs[][3], double mask, u8 n_threads,
+                  u8 n_visible[], almanac_look_t looks[]);
+
+#endif /* LIBSWIFTNAV_ALMANAC_SURVEY_H */
+
@@ -22,14 +22,15 @@
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define CLAMP_DIFF(a,b) (MAX((a),(b)) - (b))
 
+/* Trace function entry and exit when `cond` is true, see DIAG(). */
 #define DEBUG_ENTRY(cond) \
   if (cond) { \
-    printf("<%s>\n", __func__); \
+    DIAG(DIAG_DEBUG, DIAG_EVENT_TRACE, "<%s>", __func__); \
   }
 
 #define DEBUG_EXIT(cond) \
   if (cond) { \
-    printf("</%s>\n", __func__); \
+    DIAG(DIAG_DEBUG, DIAG_EVENT_TRACE, "</%s>", __func__); \
   }
 
 
@@ -65,5 +66,9 @@ typedef uint64_t u64;
 
 /** \} */
 
+/* DEBUG_ENTRY() and DEBUG_EXIT() expand to DIAG(). diag.h includes this
+ * header for the integer types, so it is included only after them. */
+#include "diag.h"
+
 #endif /* LIBSWIFTNAV_COMMON_H */
 
@@ -14,14 +14,95 @@
 #define LIBSWIFTNAV_CORRELATE_H
 
 #include "common.h"
+#include "track.h"
 
-void track_correlate(s8* samples, s8* code,
+/** \addtogroup corr
+ * \{ */
+
+/** Arithmetic used by the correlators, see track_correlate_set_mode(). */
+typedef enum {
+  CORR_MODE_FLOAT = 0, /**< Floating point carrier and accumulation. */
+  CORR_MODE_FIXED,     /**< Integer NCOs, carrier table and accumulation. */
+} corr_mode_t;
+
+/** State of one channel correlated by track_correlate_multi().
+ * The code and carrier NCO fields have the same meaning as the corresponding
+ * arguments of track_correlate() and are updated in the same way.
+ */
+typedef struct {
+  const s8* code;     /**< Code replica, indexed as for track_correlate(). */
+  u32 start;          /**< Index of the first sample to correlate. */
+  double code_phase;  /**< Code phase in chips. */
+  double code_step;   /**< Code phase increment per sample in chips. */
+  double carr_phase;  /**< Carrier phase in radians. */
+  double carr_step;   /**< Carrier phase increment per sample in radians. */
+  double I_E;         /**< Early in-phase correlation. */
+  double Q_E;         /**< Early quadrature correlation. */
+  double I_P;         /**< Prompt in-phase correlation. */
+  double Q_P;         /**< Prompt quadrature correlation. */
+  double I_L;         /**< Late in-phase correlation. */
+  double Q_L;         /**< Late quadrature correlation. */
+  u32 num_samples;    /**< Number of samples correlated. */
+} corr_channel_t;
+
+/** Correlations of one code period, or of a whole integration, from
+ * track_correlate_periods(). */
+typedef struct {
+  double I_E;      /**< Early in-phase correlation. */
+  double Q_E;      /**< Early quadrature correlation. */
+  double I_P;      /**< Prompt in-phase correlation. */
+  double Q_P;      /**< Prompt quadrature correlation. */
+  double I_L;      /**< Late in-phase correlation. */
+  double Q_L;      /**< Late quadrature correlation. */
+  u32 num_samples; /**< Number of samples correlated. */
+} corr_period_t;
+
+/** Maximum number of code periods integrated by one call to
+ * track_correlate_periods(), one per bit of the sign mask. */
+#define CORR_MAX_PERIODS 32
+
+/** Maximum number of taps correlated by track_correlate_taps(). */
+#define CORR_MAX_TAPS 16
+
+/** Number of words holding `n` samples of `bits` bits each, see
+ * packed_samples_pack(). */
+#define PACKED_SAMPLES_WORDS(n, bits) ((((n) + 63) / 64) * (bits))
+
+/** \} */
+
+void track_correlate(const s8* samples, const s8* code,
                      double* init_code_phase, double code_step,
                      double* init_carr_phase, double carr_step,
                      double* I_E, double* Q_E,
                      double* I_P, double* Q_P,
                      double* I_L, double* Q_L,
                      u32* num_samples);
+u8 track_correlate_periods(const s8* samples, const s8* code,
+                           double* init_code_phase, double code_step,
+                           double* init_carr_phase, double carr_step,
+                           u8 n_periods, u32 max_samples, u32 bit_signs,
+                           corr_period_t periods[], corr_period_t* total);
+void track_correlate_taps(const s8* samples, const s8* code,
+                          double* init_code_phase, double code_step,
+                          double* init_carr_phase, double carr_step,
+                          u8 n_taps, const float tap_offsets[],
+                          correlation_t corrs[], u32* num_samples);
+void track_correlate_multi(const s8* samples,
+                           u8 n_channels, corr_channel_t channels[]);
+void track_correlate_set_mode(corr_mode_t mode);
+corr_mode_t track_correlate_get_mode(void);
+
+void packed_samples_pack(const s8* samples, u32 n, u8 bits, u64* packed);
+void packed_samples_unpack(const u64* packed, u8 bits, u32 start, u32 n,
+                           s8* samples);
+void track_correlate_packed(const u64* packed, u8 bits, u32 start,
+                            const u8* code,
+                            double* init_code_phase, double code_step,
+                            double* init_carr_phase, double carr_step,
+                            double* I_E, double* Q_E,
+                            double* I_P, double* Q_P,
+                            double* I_L, double* Q_L,
+                            u32* num_samples);
 
 #endif /* LIBSWIFTNAV_CORRELATE_H */
 
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_CPU_FEATURES_H
+#define LIBSWIFTNAV_CPU_FEATURES_H
+
+#include "common.h"
+
+/** \addtogroup cpu_features
+ * \{ */
+
+/* Runtime selected SIMD kernels are only built where the compiler lets us
+ * target instruction sets beyond the baseline build flags. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_FEATURES_X86 1
+#endif
+
+#define CPU_FEATURE_SSSE3  (1 << 0) /**< SSSE3. */
+#define CPU_FEATURE_POPCNT (1 << 1) /**< POPCNT instruction. */
+#define CPU_FEATURE_AVX2   (1 << 2) /**< AVX2 and FMA. */
+#define CPU_FEATURE_AVX512 (1 << 3) /**< AVX-512 F, BW, DQ and VL. */
+#define CPU_FEATURE_AVX512_VPOPCNTDQ (1 << 4) /**< AVX-512 VPOPCNTDQ. */
+
+#define CPU_FEATURES_ALL 0xFFFFFFFF
+
+/** \} */
+
+u32 cpu_features(void);
+void cpu_features_set_mask(u32 mask);
+
+#endif /* LIBSWIFTNAV_CPU_FEATURES_H */
+
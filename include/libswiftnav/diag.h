@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_DIAG_H
+#define LIBSWIFTNAV_DIAG_H
+
+#include "common.h"
+
+/** \addtogroup diag
+ * \{ */
+
+/** Severity of a diagnostic message. */
+typedef enum {
+  DIAG_DEBUG = 0, /**< Tracing, only of use when debugging. */
+  DIAG_INFO,      /**< Progress of the algorithms. */
+  DIAG_WARN,      /**< Recoverable problems with the input data. */
+  DIAG_ERROR,     /**< Failures and misuse of the library. */
+  DIAG_NONE,      /**< Above all levels, to filter out every message. */
+} diag_level_t;
+
+/** Numeric code of the event a diagnostic message reports. */
+typedef enum {
+  DIAG_EVENT_TRACE = 0,          /**< Function entry or exit. */
+  DIAG_EVENT_NAV_PHASE_FLIP,     /**< Nav bit polarity changed. */
+  DIAG_EVENT_NAV_PARITY_ERROR,   /**< Subframe word failed parity. */
+  DIAG_EVENT_NAV_NO_EPHEMERIS,   /**< process_subframe() without ephemeris. */
+  DIAG_EVENT_EPHEMERIS_STALE,    /**< Ephemeris used over 4 hours from toe. */
+  DIAG_EVENT_IAR_RESET,          /**< Ambiguity test started again. */
+  DIAG_EVENT_IAR_HYPOTHESES,     /**< Ambiguity hypothesis count changed. */
+  DIAG_EVENT_IAR_INVALID_SDIFFS, /**< Ambiguity test given invalid sdiffs. */
+  DIAG_EVENT_IAR_SATS_DISORDER,  /**< Ambiguity test sats out of order. */
+  DIAG_EVENT_IAR_MISUSE,         /**< Ambiguity test method misused. */
+  DIAG_EVENT_LAMBDA_LD_ERROR,    /**< LAMBDA LD factorization failed. */
+  DIAG_EVENT_LAMBDA_OVERFLOW,    /**< LAMBDA search loop count overflow. */
+  DIAG_EVENT_MATRIX_SINGULAR,    /**< Singular matrix column. */
+  DIAG_EVENT_FILTER_UPDATE,      /**< Float filter reinitialised. */
+  DIAG_N_EVENTS                  /**< Number of event codes. */
+} diag_event_t;
+
+/** Diagnostic message passed to the sink. */
+typedef struct {
+  diag_level_t level; /**< Severity. */
+  diag_event_t event; /**< Event code. */
+  const char *func;   /**< Function reporting the event. */
+  const char *text;   /**< Message text, without a trailing newline. */
+  u32 suppressed;     /**< Messages from the same call site dropped by the
+                           rate limit since the previous one. */
+} diag_msg_t;
+
+/** Diagnostics sink, see diag_set_sink(). */
+typedef void (*diag_sink_t)(const diag_msg_t *msg, void *context);
+
+/** Rate limiting state of a DIAG() call site. */
+typedef struct {
+  u32 count;  /**< Messages reaching the call site. */
+  u32 passed; /**< Value of `count` at the last message passed on. */
+} diag_site_t;
+
+/** Messages below this level are compiled out, leaving only their event
+ * counts. Define before including this header, or on the command line. */
+#ifndef DIAG_MIN_LEVEL
+#define DIAG_MIN_LEVEL DIAG_DEBUG
+#endif
+
+/** Report a diagnostic event with a printf style message.
+ *
+ * The event is always counted, see diag_event_count(). The message is
+ * formatted and passed to the sink only if there is one, its level is at
+ * least that set with diag_set_level(), and the call site is within its
+ * rate limit. The message arguments are only evaluated when there is a sink
+ * and the level passes, so they may be costly to compute.
+ *
+ * There is no sink by default, so until one is registered with
+ * diag_set_sink(), e.g. diag_sink_stdio(), messages are dropped and only
+ * the events are counted. */
+#define DIAG(level, event, ...) \
+  do { \
+    diag_count(event); \
+    if ((level) >= DIAG_MIN_LEVEL && diag_enabled(level)) { \
+      static diag_site_t diag_site_; \
+      diag_log(&diag_site_, (level), (event), __func__, __VA_ARGS__); \
+    } \
+  } while (0)
+
+/** \} */
+
+void diag_set_sink(diag_sink_t sink, void *context);
+void diag_set_level(diag_level_t level);
+void diag_set_rate_limit(u32 burst);
+void diag_sink_stdio(const diag_msg_t *msg, void *context);
+bool diag_enabled(diag_level_t level);
+void diag_log(diag_site_t *site, diag_level_t level, diag_event_t event,
+              const char *func, const char *fmt, ...)
+  __attribute__((format(printf, 5, 6)));
+void diag_count(diag_event_t event);
+u32 diag_event_count(diag_event_t event);
+void diag_reset_counts(void);
+const char *diag_event_name(diag_event_t event);
+
+#endif /* LIBSWIFTNAV_DIAG_H */
+
@@ -16,23 +16,75 @@
 #include "gpstime.h"
 #include "common.h"
 
+/** Constants derived from the broadcast parameters of an ephemeris, see
+ * ephemeris_prepare(). */
+typedef struct {
+  u64 key;            /**< Hash of the parameters they were derived from. */
+  double a;           /**< Semi-major axis [m]. */
+  double ma_dot;      /**< Corrected mean motion [rad/s]. */
+  double sqrt_1_ecc2; /**< `sqrt(1 - ecc^2)`. */
+  double rel;         /**< Relativistic clock term divided by `sin(E)`. */
+  double om0;         /**< Longitude of the ascending node at toe, ECEF. */
+  double om_dot;      /**< Its rate, ECEF [rad/s]. */
+  double sin_w;       /**< Sine of the argument of perigee. */
+  double cos_w;       /**< Cosine of the argument of perigee. */
+} ephemeris_prepared_t;
+
 typedef struct {
   double tgd;
   double crs, crc, cuc, cus, cic, cis;
   double dn, m0, ecc, sqrta, omega0, omegadot, w, inc, inc_dot;
   double af0, af1, af2;
   gps_time_t toe, toc;
+  u16 iodc;
+  u8 iode;
   u8 valid;
   u8 healthy;
   u8 prn;
+  ephemeris_prepared_t prepared; /**< See ephemeris_prepare(). */
 } ephemeris_t;
 
+/** Maximum number of satellites in an ephemeris_batch_t. */
+#define EPHEMERIS_BATCH_MAX 32
+
+/** Ephemerides of a batch of satellites, stored one array per parameter
+ * for calc_sat_pos_batch(). Filled in with ephemeris_batch_set(), along
+ * with the constants of ephemeris_prepare(). */
+typedef struct {
+  u8 n; /**< Number of satellites in the batch. */
+  double a[EPHEMERIS_BATCH_MAX];          /**< Semi-major axis [m]. */
+  double ma_dot[EPHEMERIS_BATCH_MAX];     /**< Corrected mean motion. */
+  double m0[EPHEMERIS_BATCH_MAX];
+  double ecc[EPHEMERIS_BATCH_MAX];
+  double sqrt_1_ecc2[EPHEMERIS_BATCH_MAX]; /**< `sqrt(1 - ecc^2)`. */
+  double rel[EPHEMERIS_BATCH_MAX];        /**< Relativistic clock term
+                                               divided by `sin(E)`. */
+  double sin_w[EPHEMERIS_BATCH_MAX], cos_w[EPHEMERIS_BATCH_MAX];
+  double crs[EPHEMERIS_BATCH_MAX], crc[EPHEMERIS_BATCH_MAX];
+  double cus[EPHEMERIS_BATCH_MAX], cuc[EPHEMERIS_BATCH_MAX];
+  double cis[EPHEMERIS_BATCH_MAX], cic[EPHEMERIS_BATCH_MAX];
+  double inc[EPHEMERIS_BATCH_MAX], inc_dot[EPHEMERIS_BATCH_MAX];
+  double om0[EPHEMERIS_BATCH_MAX];        /**< Longitude of the ascending
+                                               node at toe, ECEF. */
+  double om_dot[EPHEMERIS_BATCH_MAX];     /**< Its rate, ECEF. */
+  double af0[EPHEMERIS_BATCH_MAX], af1[EPHEMERIS_BATCH_MAX];
+  double af2[EPHEMERIS_BATCH_MAX], tgd[EPHEMERIS_BATCH_MAX];
+  gps_time_t toe[EPHEMERIS_BATCH_MAX], toc[EPHEMERIS_BATCH_MAX];
+} ephemeris_batch_t;
+
 
+void ephemeris_prepare(ephemeris_t *e);
 int calc_sat_pos(double pos[3], double vel[3],
                  double *clock_err, double *clock_rate_err,
                  const ephemeris_t *ephemeris,
                  gps_time_t tot);
 
+s8 ephemeris_batch_set(ephemeris_batch_t *b, u8 n,
+                       ephemeris_t *ephemerides[]);
+void calc_sat_pos_batch(const ephemeris_batch_t *b, const gps_time_t tot[],
+                        double pos[][3], double vel[][3],
+                        double clock_err[], double clock_rate_err[]);
+
 double predict_range(double rx_pos[3],
                      gps_time_t tot,
                      ephemeris_t *ephemeris);
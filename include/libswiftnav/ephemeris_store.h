@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_EPHEMERIS_STORE_H
+#define LIBSWIFTNAV_EPHEMERIS_STORE_H
+
+#include "common.h"
+#include "ephemeris.h"
+#include "gpstime.h"
+
+/** \addtogroup ephemeris_store
+ * \{ */
+
+/** Satellites in the store, indexed by PRN counting from 0. */
+#define EPHEMERIS_STORE_N_SATS 32
+
+/** Issues kept per satellite, the current one and the one before. */
+#define EPHEMERIS_STORE_ISSUES 2
+
+/** Records per satellite, the published one and the one being written. */
+#define EPHEMERIS_STORE_VERSIONS 2
+
+/** Longest time from toe an ephemeris is used for [s], as
+ * ephemeris_good(). */
+#define EPHEMERIS_STORE_MAX_AGE (4*3600)
+
+/** Issues of one satellite's ephemeris, as published together. */
+typedef struct {
+  u32 version;  /**< Version of the record, `0` while it is written. */
+  u8 n_issues;  /**< Number of issues stored. */
+  ephemeris_t issue[EPHEMERIS_STORE_ISSUES]; /**< Latest toe first. */
+} ephemeris_store_record_t;
+
+/** Ephemerides of one satellite. */
+typedef struct {
+  u32 version; /**< Version of the published record, `0` if none. */
+  ephemeris_store_record_t rec[EPHEMERIS_STORE_VERSIONS];
+} ephemeris_store_sat_t;
+
+/** Ephemeris store, see ephemeris_store_init(). */
+typedef struct {
+  ephemeris_store_sat_t sat[EPHEMERIS_STORE_N_SATS];
+} ephemeris_store_t;
+
+/** \} */
+
+void ephemeris_store_init(ephemeris_store_t *s);
+s8 ephemeris_store_update(ephemeris_store_t *s, const ephemeris_t *e);
+s8 ephemeris_store_get(const ephemeris_store_t *s, u8 prn, gps_time_t t,
+                       ephemeris_t *e);
+s8 ephemeris_store_get_iode(const ephemeris_store_t *s, u8 prn, u8 iode,
+                            ephemeris_t *e);
+
+#endif /* LIBSWIFTNAV_EPHEMERIS_STORE_H */
+
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_EXCISION_H
+#define LIBSWIFTNAV_EXCISION_H
+
+#include "common.h"
+#include "fft.h"
+
+/** \addtogroup excision
+ * \{ */
+
+/** Maximum number of interferers reported. */
+#define EXCISION_MAX_INTERFERERS 8
+
+/** Narrowband interferer found by the excision stage. */
+typedef struct {
+  float freq;  /**< Frequency of the peak in Hz. */
+  float power; /**< Peak power above the noise floor in dB. */
+  u32 n_bins;  /**< Number of frequency bins excised. */
+} excision_interferer_t;
+
+/** Frequency domain interference excision state.
+ * Initialise with excision_init(). */
+typedef struct {
+  double fs;       /**< Sample rate in Hz. */
+  u32 n;           /**< Block length, the FFT length. */
+  float threshold; /**< Excision threshold as a power ratio. */
+  fft_plan_t *fft; /**< FFT plan of length `n`. */
+  float *window;   /**< Square root Hann window. */
+  float *buf;      /**< Input samples of the blocks being collected. */
+  float *ola;      /**< Overlap-add output accumulator. */
+  float *avg;      /**< Averaged power spectrum. */
+  fft_cpx_t *spec; /**< FFT buffer. */
+  fft_cpx_t *work; /**< FFT scratch buffer. */
+  s8 *out;         /**< Finished output samples. */
+  u32 fill;        /**< Samples in `buf`. */
+  bool avg_init;   /**< The averaged spectrum has been initialised. */
+
+  u8 n_interferers; /**< Number of interferers found in the latest block. */
+  excision_interferer_t interferers[EXCISION_MAX_INTERFERERS];
+                    /**< Interferers found, strongest first. */
+} excision_t;
+
+/** \} */
+
+s8 excision_init(excision_t *ex, double fs, u32 n, float threshold_db);
+void excision_free(excision_t *ex);
+void excision_process(excision_t *ex, const s8 *in, u32 n, s8 *out);
+
+#endif /* LIBSWIFTNAV_EXCISION_H */
+
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_FFT_H
+#define LIBSWIFTNAV_FFT_H
+
+#include "common.h"
+
+/** \addtogroup fft
+ * \{ */
+
+/** Maximum number of radix stages in an FFT plan. */
+#define FFT_MAX_STAGES 32
+
+/** Single precision complex value, interleaved real and imaginary parts. */
+typedef struct {
+  float re; /**< Real part. */
+  float im; /**< Imaginary part. */
+} fft_cpx_t;
+
+/** One radix stage of an FFT plan. */
+typedef struct {
+  u32 radix;        /**< Radix of the stage. */
+  u32 m;            /**< Butterflies per stride group. */
+  u32 s;            /**< Stride, product of the radices of earlier stages. */
+  fft_cpx_t *tw;    /**< Twiddle factors, `radix - 1` per butterfly. */
+  fft_cpx_t *roots; /**< `radix` roots of unity, used by odd radices. */
+} fft_stage_t;
+
+/** Plan for FFTs of a fixed length.
+ * Create with fft_plan_new(). A plan is read-only once created and can be
+ * shared between threads. */
+typedef struct {
+  u32 n;                              /**< Transform length. */
+  u8 n_stages;                        /**< Number of radix stages. */
+  fft_stage_t stages[FFT_MAX_STAGES]; /**< Radix stages, in execution order. */
+  fft_cpx_t *buf;                     /**< Storage for twiddles and roots. */
+} fft_plan_t;
+
+/** \} */
+
+fft_plan_t *fft_plan_new(u32 n);
+void fft_plan_destroy(fft_plan_t *plan);
+void fft_forward(const fft_plan_t *plan, fft_cpx_t *x, fft_cpx_t *work);
+void fft_inverse(const fft_plan_t *plan, fft_cpx_t *x, fft_cpx_t *work);
+
+#endif /* LIBSWIFTNAV_FFT_H */
+
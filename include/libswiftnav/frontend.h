@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_FRONTEND_H
+#define LIBSWIFTNAV_FRONTEND_H
+
+#include "common.h"
+
+/** \addtogroup frontend
+ * \{ */
+
+/** Maximum number of FIR filter taps. */
+#define FRONTEND_MAX_TAPS 256
+
+/** Input samples mixed down to baseband at a time. */
+#define FRONTEND_BLOCK_LEN 1024
+
+/** Down-conversion, filtering and decimation stage state.
+ * Initialise with frontend_init(). */
+typedef struct {
+  double fs;      /**< Input sample rate in Hz. */
+  double fs_out;  /**< Output sample rate in Hz. */
+  double if_out;  /**< Output intermediate frequency in Hz. */
+  u32 decimation; /**< Input samples per output sample. */
+  u32 n_taps;     /**< FIR length, padded to a multiple of 8. */
+  float *taps;    /**< FIR coefficients, scaled by the output gain. */
+
+  double lo_phase;  /**< LO phase of the next input sample in radians. */
+  double lo_step;   /**< LO phase increment per input sample in radians. */
+  float *lo_sin;    /**< LO rotation over a block of samples, sine. */
+  float *lo_cos;    /**< LO rotation over a block of samples, cosine. */
+
+  float *buf_I; /**< Baseband history and block, in-phase. */
+  float *buf_Q; /**< Baseband history and block, quadrature. */
+  u32 n_buf;    /**< Samples in the buffers. */
+  u32 next;     /**< Buffer index of the first tap of the next output. */
+  u8 quarter;   /**< Output sample count modulo 4, see frontend_process(). */
+} frontend_t;
+
+/** \} */
+
+s8 frontend_init(frontend_t *fe, double fs, double if_freq,
+                 u32 decimation, double bandwidth, u32 n_taps);
+void frontend_free(frontend_t *fe);
+u32 frontend_process(frontend_t *fe, const s8 *in, u32 n, s8 *out);
+
+#endif /* LIBSWIFTNAV_FRONTEND_H */
+
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_NAV_ARCHIVE_H
+#define LIBSWIFTNAV_NAV_ARCHIVE_H
+
+#include "common.h"
+#include "ephemeris.h"
+#include "nav_msg.h"
+
+/** \addtogroup nav_archive
+ * \{ */
+
+/** Subframe archive file, open for appending with nav_archive_open() or
+ * mapped for reading with nav_archive_map(). */
+typedef struct {
+  int fd;                            /**< File open for appending, or -1. */
+  void *map;                         /**< Mapped file, or NULL. */
+  u64 map_size;                      /**< Bytes mapped. */
+  const nav_msg_subframe_t *records; /**< Subframes in the mapped file. */
+  u64 n_records;                     /**< Number of mapped subframes. */
+} nav_archive_t;
+
+/** \} */
+
+s8 nav_archive_open(nav_archive_t *ar, const char *path);
+s8 nav_archive_append(nav_archive_t *ar, const nav_msg_subframe_t *sf);
+s8 nav_archive_map(nav_archive_t *ar, const char *path);
+void nav_archive_close(nav_archive_t *ar);
+u64 nav_archive_replay(const nav_archive_t *ar, u64 first,
+                       nav_msg_replay_t *r, ephemeris_t e[32],
+                       nav_msg_almanac_t *a);
+
+#endif /* LIBSWIFTNAV_NAV_ARCHIVE_H */
+
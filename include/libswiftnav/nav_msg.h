@@ -14,10 +14,20 @@
 #define LIBSWIFTNAV_NAV_MSG_H
 
 #include "common.h"
+#include "almanac.h"
 #include "ephemeris.h"
 
 #define NAV_MSG_SUBFRAME_BITS_LEN 12 /* Buffer 384 nav bits. */
 
+/** Method used to find the nav bit edges. */
+typedef enum {
+  /** Lock after NAV_MSG_BIT_PHASE_THRES sign changes in a row whole bits
+   * apart. */
+  NAV_MSG_BIT_SYNC_EDGES = 0,
+  /** Lock when one bit phase stands out in a histogram of sign changes. */
+  NAV_MSG_BIT_SYNC_HISTOGRAM,
+} nav_msg_bit_sync_t;
+
 typedef struct {
   u32 subframe_bits[NAV_MSG_SUBFRAME_BITS_LEN];
   u16 subframe_bit_index;
@@ -31,16 +41,147 @@ typedef struct {
   u8 bit_phase_ref;
   u8 bit_phase_count;
   s32 nav_bit_integrate;
+  u8 bit_sync;          /**< Bit sync method, see nav_msg_bit_sync_t. */
+  u8 bit_sync_hist[20]; /**< Sign changes at each bit phase. */
+  u8 tow_single;        /**< Report the TOW from single subframes, see
+                             nav_msg_update(). Off after nav_msg_init(). */
 
   u32 frame_words[3][8];
   u8 next_subframe_id;
   u8 inverted;
 } nav_msg_t;
 
+/** \addtogroup nav_msg_batch
+ * \{ */
+
+/** Maximum number of channels in a batch. */
+#define NAV_MSG_BATCH_MAX_CHANNELS 32
+
+/** Navigation message decoder state of a batch of channels, stored one
+ * array per field with the bit buffers of all the channels in one dense
+ * array. Initialise with nav_msg_batch_init(), the fields have the same
+ * meaning as in nav_msg_t, the bit sync fields are widened to 32 bits to
+ * share vector lanes with the integrators. */
+typedef struct {
+  u8 n_channels; /**< Number of channels. */
+
+  u32 subframe_bits[NAV_MSG_BATCH_MAX_CHANNELS][NAV_MSG_SUBFRAME_BITS_LEN];
+    /**< Circular buffers of nav bits. */
+  u32 preambles[NAV_MSG_BATCH_MAX_CHANNELS][NAV_MSG_SUBFRAME_BITS_LEN];
+    /**< Bit positions in `subframe_bits` where a preamble starts. */
+  u16 subframe_bit_index[NAV_MSG_BATCH_MAX_CHANNELS];   /**< Next bit. */
+  s16 subframe_start_index[NAV_MSG_BATCH_MAX_CHANNELS]; /**< Subframe start. */
+  s32 bit_phase[NAV_MSG_BATCH_MAX_CHANNELS];       /**< Bit sync. */
+  s32 bit_phase_ref[NAV_MSG_BATCH_MAX_CHANNELS];   /**< Bit sync. */
+  s32 bit_phase_count[NAV_MSG_BATCH_MAX_CHANNELS]; /**< Bit sync. */
+  s32 nav_bit_integrate[NAV_MSG_BATCH_MAX_CHANNELS]; /**< Bit integrator. */
+  u8 bit_sync[NAV_MSG_BATCH_MAX_CHANNELS];           /**< Bit sync method. */
+  u8 bit_sync_hist[NAV_MSG_BATCH_MAX_CHANNELS][20];  /**< Bit sync. */
+  u8 tow_single[NAV_MSG_BATCH_MAX_CHANNELS];         /**< TOW option. */
+
+  u32 frame_words[NAV_MSG_BATCH_MAX_CHANNELS][3][8]; /**< Subframes 1-3. */
+  u8 next_subframe_id[NAV_MSG_BATCH_MAX_CHANNELS];   /**< Next subframe. */
+  u8 inverted[NAV_MSG_BATCH_MAX_CHANNELS];           /**< Bit polarity. */
+} nav_msg_batch_t;
+
+/** \} */
+
+/** \addtogroup nav_msg_almanac
+ * \{ */
+
+/** Klobuchar ionospheric model parameters, as broadcast in subframe 4
+ * page 18. */
+typedef struct {
+  double a0; /**< Alpha 0 in seconds. */
+  double a1; /**< Alpha 1 in seconds/semi-circle. */
+  double a2; /**< Alpha 2 in seconds/semi-circle^2. */
+  double a3; /**< Alpha 3 in seconds/semi-circle^3. */
+  double b0; /**< Beta 0 in seconds. */
+  double b1; /**< Beta 1 in seconds/semi-circle. */
+  double b2; /**< Beta 2 in seconds/semi-circle^2. */
+  double b3; /**< Beta 3 in seconds/semi-circle^3. */
+  u8 valid;  /**< Parameters are valid. */
+} ionosphere_t;
+
+/** GPS to UTC conversion parameters, as broadcast in subframe 4 page 18. */
+typedef struct {
+  double a0;  /**< Constant term of the GPS - UTC polynomial in seconds. */
+  double a1;  /**< First order term of the polynomial in seconds/second. */
+  u32 tot;    /**< Reference time of week of the polynomial in seconds. */
+  u8 wnt;     /**< Reference week of the polynomial, modulo 256. */
+  s8 dt_ls;   /**< Leap seconds before the leap second event. */
+  u8 wn_lsf;  /**< Week of the leap second event, modulo 256. */
+  u8 dn;      /**< Day of the week of the leap second event, 1 to 7. */
+  s8 dt_lsf;  /**< Leap seconds after the leap second event. */
+  u8 valid;   /**< Parameters are valid. */
+} utc_params_t;
+
+/** Data decoded from subframes 4 and 5, shared by all the channels as
+ * every satellite broadcasts the same almanac. Initialise with
+ * nav_msg_almanac_init(). */
+typedef struct {
+  almanac_t almanac[32]; /**< Almanac of each satellite, indexed by PRN
+                              counting from 0. */
+  ionosphere_t iono;     /**< Ionospheric model. */
+  utc_params_t utc;      /**< UTC parameters. */
+  s16 week;  /**< GPS week number modulo 1024 from subframe 1, or -1. */
+  s16 wna;   /**< Almanac week number modulo 256 from subframe 5 page 25,
+                  or -1. */
+  u32 toa;   /**< Almanac time of applicability from subframe 5 page 25,
+                  in seconds. */
+} nav_msg_almanac_t;
+
+/** \} */
+
+/** \addtogroup nav_msg_replay
+ * \{ */
+
+/** Parity checked subframe, see nav_msg_subframe_get(). */
+typedef struct {
+  u32 tow;     /**< GPS time of week of the start of the subframe in
+                    seconds. */
+  u8 prn;      /**< PRN of the satellite, counting from 0. */
+  u8 sf_id;    /**< Subframe ID, 1 to 5. */
+  u8 data[30]; /**< The 24 data bits of each of the ten words, most
+                    significant byte first, inverted if the parity check
+                    called for it. */
+} nav_msg_subframe_t;
+
+/** Subframe decoding state of each satellite for nav_msg_replay_subframe(),
+ * initialise with nav_msg_replay_init(). */
+typedef struct {
+  u32 frame_words[32][3][8]; /**< Subframes 1 to 3 of each satellite. */
+  u8 next_subframe_id[32];   /**< Next subframe expected. */
+  u32 next_tow[32];          /**< Time of week of the next subframe. */
+} nav_msg_replay_t;
+
+/** \} */
+
 void nav_msg_init(nav_msg_t *n);
+void nav_msg_init_bit_sync(nav_msg_t *n, nav_msg_bit_sync_t bit_sync);
 s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms);
 bool subframe_ready(nav_msg_t *n);
+u8 nav_msg_tow_check(u8 n, const s32 TOW_ms[], s32 TOW_apriori_ms,
+                     u32 tolerance_ms, bool ok[]);
 s8 process_subframe(nav_msg_t *n, ephemeris_t *e);
+void nav_msg_almanac_init(nav_msg_almanac_t *a);
+s8 process_subframe_almanac(nav_msg_t *n, ephemeris_t *e,
+                            nav_msg_almanac_t *a);
+int nav_parity(u32 *word);
+
+s8 nav_msg_subframe_get(const nav_msg_t *n, u8 prn, nav_msg_subframe_t *sf);
+void nav_msg_replay_init(nav_msg_replay_t *r);
+s8 nav_msg_replay_subframe(nav_msg_replay_t *r, const nav_msg_subframe_t *sf,
+                           ephemeris_t *e, nav_msg_almanac_t *a);
+
+s8 nav_msg_batch_init(nav_msg_batch_t *b, u8 n_channels);
+void nav_msg_batch_set(nav_msg_batch_t *b, u8 i, const nav_msg_t *n);
+void nav_msg_batch_get(const nav_msg_batch_t *b, u8 i, nav_msg_t *n);
+void nav_msg_batch_update(nav_msg_batch_t *b, const s32 corr_prompt_real[],
+                          u8 ms, s32 TOW_ms[]);
+u32 nav_msg_batch_process(nav_msg_batch_t *b, ephemeris_t e[],
+                          nav_msg_almanac_t *a, s8 ret[]);
+void nav_parity_batch(u32 n, u32 words[], u8 errors[]);
 
 #endif /* LIBSWIFTNAV_NAV_MSG_H */
 
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ORBIT_CACHE_H
+#define LIBSWIFTNAV_ORBIT_CACHE_H
+
+#include "common.h"
+#include "ephemeris.h"
+#include "gpstime.h"
+
+/** \addtogroup orbit_cache
+ * \{ */
+
+/** Default length of the fit windows [s]. */
+#define ORBIT_CACHE_WINDOW 900.0
+
+/** Coefficients of each Chebyshev series, one more than its degree. */
+#define ORBIT_CACHE_N_COEFFS 11
+
+/** Largest position error of a fit at the check points [m]. Windows whose
+ * fit is worse, or outside any of the bounds below, are evaluated with the
+ * full orbit model instead. */
+#define ORBIT_CACHE_MAX_POS_ERR 1e-3
+
+/** Largest velocity error of a fit at the check points [m/s]. */
+#define ORBIT_CACHE_MAX_VEL_ERR 1e-6
+
+/** Largest clock error of a fit at the check points [s], 0.3 mm. */
+#define ORBIT_CACHE_MAX_CLOCK_ERR 1e-12
+
+/** Largest clock rate error of a fit at the check points [s/s]. */
+#define ORBIT_CACHE_MAX_CLOCK_RATE_ERR 1e-15
+
+/** Series fitted per satellite: position, velocity, clock error and clock
+ * rate error. */
+#define ORBIT_CACHE_N_SERIES 8
+
+/** State of the cache entry of a satellite. */
+typedef enum {
+  ORBIT_CACHE_EMPTY = 0, /**< Nothing fitted. */
+  ORBIT_CACHE_FITTED,    /**< Series fitted to the window. */
+  ORBIT_CACHE_UNFIT,     /**< Fit out of bounds, using the full model. */
+} orbit_cache_state_t;
+
+/** Cached orbit of one satellite. */
+typedef struct {
+  /** Chebyshev coefficients by degree, the series of each degree kept
+   * together so all are evaluated in one pass. */
+  double c[ORBIT_CACHE_N_COEFFS][ORBIT_CACHE_N_SERIES];
+  gps_time_t t0;             /**< Start of the window. */
+  double max_err;            /**< Position error of the fit [m]. */
+  double max_vel_err;        /**< Velocity error of the fit [m/s]. */
+  double max_clock_err;      /**< Clock error of the fit [s]. */
+  double max_clock_rate_err; /**< Clock rate error of the fit [s/s]. */
+  orbit_cache_state_t state;
+  ephemeris_t eph;           /**< Ephemeris the series were fitted to. */
+} orbit_cache_sat_t;
+
+/** Orbit cache of all the satellites, see orbit_cache_init(). */
+typedef struct {
+  double window; /**< Length of the fit windows [s]. */
+  u32 n_fits;    /**< Number of fits since initialisation. */
+  orbit_cache_sat_t sat[32]; /**< Indexed by PRN counting from 0. */
+} orbit_cache_t;
+
+/** \} */
+
+void orbit_cache_init(orbit_cache_t *c, double window);
+int orbit_cache_sat_pos(orbit_cache_t *c, const ephemeris_t *e,
+                        gps_time_t tot, double pos[3], double vel[3],
+                        double *clock_err, double *clock_rate_err);
+
+#endif /* LIBSWIFTNAV_ORBIT_CACHE_H */
+
@@ -15,8 +15,34 @@
 
 #include "common.h"
 
+/** \addtogroup prns
+ * \{ */
+
+/** Length of an expanded code replica including the guard chips. */
+#define CA_CODE_REPLICA_LEN 1025
+
+/** C/A code replicas for all PRNs, resampled at a fixed sample rate.
+ * Initialise with ca_code_resampled_init(). */
+typedef struct {
+  double fs;               /**< Sample rate in Hz. */
+  double samples_per_chip; /**< Samples per chip. */
+  u32 length;              /**< Samples per code period, rounded up. */
+  u32 guard;               /**< Guard samples at each end of a replica. */
+  u32 stride;              /**< Distance between replicas in `buf`. */
+  s8 *buf;                 /**< Replica storage for all PRNs. */
+} ca_code_resampled_t;
+
+/** \} */
+
 const u8* ca_code(u8 prn);
 s8 get_chip(u8* code, u32 chip_num);
 
+const s8* ca_code_replica(u8 prn);
+void ca_code_replicas_init(void);
+
+s8 ca_code_resampled_init(ca_code_resampled_t *r, double fs);
+const s8* ca_code_resampled(const ca_code_resampled_t *r, u8 prn);
+void ca_code_resampled_free(ca_code_resampled_t *r);
+
 #endif /* LIBSWIFTNAV_PRNS_H */
 
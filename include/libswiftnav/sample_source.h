@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_SAMPLE_SOURCE_H
+#define LIBSWIFTNAV_SAMPLE_SOURCE_H
+
+#include "common.h"
+
+/** \addtogroup sample_source
+ * \{ */
+
+/** Layout of the samples of a source. */
+typedef enum {
+  SAMPLE_FORMAT_S8 = 0,      /**< One signed byte per sample. */
+  SAMPLE_FORMAT_PACKED_1BIT, /**< 1-bit, see packed_samples_pack(). */
+  SAMPLE_FORMAT_PACKED_2BIT, /**< 2-bit, see packed_samples_pack(). */
+  SAMPLE_FORMAT_IQ_S16,      /**< Interleaved I and Q, native endian s16. */
+} sample_format_t;
+
+/** Where the samples of a source are stored. */
+typedef enum {
+  SAMPLE_SOURCE_FILE = 0, /**< Memory mapped capture file. */
+  SAMPLE_SOURCE_RING,     /**< Ring buffer filled by a live producer. */
+} sample_source_type_t;
+
+/** Sample source, initialise with sample_source_file_init() or
+ * sample_source_ring_init().
+ *
+ * Samples are identified by their sample count since the start of the
+ * source, which is used as their timestamp. A ring buffer source may be
+ * filled by one producer thread and read by one consumer thread. */
+typedef struct {
+  sample_source_type_t type; /**< Backend. */
+  sample_format_t format;    /**< Sample format. */
+  double fs;                 /**< Sample rate in Hz. */
+  u8 *data;                  /**< Mapped file or ring buffer storage. */
+  u64 size;                  /**< Bytes of sample data, excluding the ring
+                                  buffer's mirrored tail. */
+  u32 window_max;            /**< Longest window in samples. */
+  u64 head;                  /**< Samples written, i.e. available. */
+  u64 tail;                  /**< Samples released by the consumer. */
+} sample_source_t;
+
+/** Window of consecutive samples, a view into the source's storage that
+ * stays valid until the samples are released. */
+typedef struct {
+  u64 t;                  /**< Sample count of the first sample. */
+  u32 n;                  /**< Number of samples. */
+  sample_format_t format; /**< Sample format. */
+  const void *data;       /**< Samples, for packed formats starting with
+                               the 64 sample group holding sample `t`. */
+  u32 start;              /**< Index of sample `t` within `data`, only
+                               non-zero for packed formats. */
+} sample_window_t;
+
+/** \} */
+
+s8 sample_source_file_init(sample_source_t *src, const char *path,
+                           sample_format_t format, double fs);
+s8 sample_source_ring_init(sample_source_t *src, sample_format_t format,
+                           double fs, u32 capacity, u32 window_max);
+void sample_source_free(sample_source_t *src);
+s8 sample_source_write(sample_source_t *src, const void *data, u32 n);
+u64 sample_source_available(const sample_source_t *src);
+s8 sample_source_window(sample_source_t *src, u64 t, u32 n,
+                        sample_window_t *w);
+s8 sample_source_window_ms(sample_source_t *src, u64 ms, u32 n_ms,
+                           sample_window_t *w);
+void sample_source_release(sample_source_t *src, u64 t);
+
+#endif /* LIBSWIFTNAV_SAMPLE_SOURCE_H */
+
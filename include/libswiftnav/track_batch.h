@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_TRACK_BATCH_H
+#define LIBSWIFTNAV_TRACK_BATCH_H
+
+#include "common.h"
+#include "track.h"
+
+/** \addtogroup track_batch
+ * \{ */
+
+/** Maximum number of channels in a batch. */
+#define TRACK_BATCH_MAX_CHANNELS 32
+
+/** Tracking loop run by every channel of a batch. */
+typedef enum {
+  TRACK_LOOP_SIMPLE = 0, /**< See simple_tl_update(). */
+  TRACK_LOOP_AIDED,      /**< See aided_tl_update(). */
+  TRACK_LOOP_COMP,       /**< See comp_tl_update(). */
+} track_loop_type_t;
+
+/** Tracking loop and \f$ C / N_0 \f$ estimator state of a batch of channels,
+ * stored one array per field so that the channels can be updated together.
+ * Initialise with track_batch_init(), the fields have the same meaning as
+ * in the per-channel state structs. */
+typedef struct {
+  track_loop_type_t type; /**< Loop run by all the channels. */
+  u8 n_channels;          /**< Number of channels. */
+
+  float code_freq[TRACK_BATCH_MAX_CHANNELS]; /**< Code phase rate. */
+  float carr_freq[TRACK_BATCH_MAX_CHANNELS]; /**< Carrier frequency. */
+  float cn0[TRACK_BATCH_MAX_CHANNELS];       /**< Latest \f$ C / N_0 \f$. */
+
+  float code_b0[TRACK_BATCH_MAX_CHANNELS];         /**< Code filter. */
+  float code_b1[TRACK_BATCH_MAX_CHANNELS];         /**< Code filter. */
+  float code_prev_error[TRACK_BATCH_MAX_CHANNELS]; /**< Code filter. */
+  float code_y[TRACK_BATCH_MAX_CHANNELS];          /**< Code filter. */
+
+  float carr_b0[TRACK_BATCH_MAX_CHANNELS];         /**< Carrier filter. */
+  float carr_b1[TRACK_BATCH_MAX_CHANNELS];         /**< Carrier filter. */
+  float carr_prev_error[TRACK_BATCH_MAX_CHANNELS]; /**< Carrier filter. */
+  float carr_y[TRACK_BATCH_MAX_CHANNELS];          /**< Carrier filter. */
+
+  float aiding_igain[TRACK_BATCH_MAX_CHANNELS]; /**< Aided loop only. */
+  float prev_I[TRACK_BATCH_MAX_CHANNELS];       /**< Aided loop only. */
+  float prev_Q[TRACK_BATCH_MAX_CHANNELS];       /**< Aided loop only. */
+
+  u32 comp_n[TRACK_BATCH_MAX_CHANNELS];        /**< Comp. loop only. */
+  u32 comp_sched[TRACK_BATCH_MAX_CHANNELS];    /**< Comp. loop only. */
+  float comp_A[TRACK_BATCH_MAX_CHANNELS];      /**< Comp. loop only. */
+  float carr_to_code[TRACK_BATCH_MAX_CHANNELS]; /**< Comp. loop only. */
+
+  float cn0_log_bw[TRACK_BATCH_MAX_CHANNELS];     /**< Estimator state. */
+  float cn0_A[TRACK_BATCH_MAX_CHANNELS];          /**< Estimator state. */
+  float cn0_I_prev_abs[TRACK_BATCH_MAX_CHANNELS]; /**< Estimator state. */
+  float cn0_nsr[TRACK_BATCH_MAX_CHANNELS];        /**< Estimator state. */
+} track_batch_t;
+
+/** \} */
+
+s8 track_batch_init(track_batch_t *b, track_loop_type_t type, u8 n_channels);
+
+void track_batch_set_simple(track_batch_t *b, u8 i,
+                            const simple_tl_state_t *s,
+                            const cn0_est_state_t *cn0);
+void track_batch_get_simple(const track_batch_t *b, u8 i,
+                            simple_tl_state_t *s, cn0_est_state_t *cn0);
+void track_batch_set_aided(track_batch_t *b, u8 i,
+                           const aided_tl_state_t *s,
+                           const cn0_est_state_t *cn0);
+void track_batch_get_aided(const track_batch_t *b, u8 i,
+                           aided_tl_state_t *s, cn0_est_state_t *cn0);
+void track_batch_set_comp(track_batch_t *b, u8 i,
+                          const comp_tl_state_t *s,
+                          const cn0_est_state_t *cn0);
+void track_batch_get_comp(const track_batch_t *b, u8 i,
+                          comp_tl_state_t *s, cn0_est_state_t *cn0);
+
+void track_batch_update(track_batch_t *b, const correlation_t cs[][3]);
+
+#endif /* LIBSWIFTNAV_TRACK_BATCH_H */
+
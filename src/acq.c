@@ -0,0 +1,569 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE3__
+#include <pmmintrin.h>
+#endif
+
+#include "constants.h"
+#include "correlate.h"
+#include "acq.h"
+
+/** \defgroup acq Acquisition
+ * Parallel code phase acquisition using FFT circular correlation.
+ *
+ * For each Doppler bin the samples are mixed down to baseband and
+ * correlated against the code replica at every code phase at once by
+ * multiplying their spectrum with the conjugated code spectrum and
+ * transforming back.
+ *
+ * The mixing is split into a whole number of FFT bins, which is a circular
+ * shift of the sample spectrum, and a mix in the time domain to near the
+ * middle of the searched band. All the Doppler bins that differ from this
+ * by a whole number of FFT bins then share one forward FFT of the samples,
+ * so the cost of a search is dominated by one FFT per Doppler bin.
+ *
+ * Each code period is resampled onto a power of two FFT length, so common
+ * sample rates such as 4.092 MHz and 16.368 MHz, whose code periods of 4092
+ * and 16368 samples have prime factors 11 and 31, still use the fast radix
+ * 2 and 4 FFT stages. The samples are mixed before they are resampled, so
+ * the resampling only adds timing jitter to the few kHz left after mixing
+ * rather than to the intermediate frequency.
+ * \{ */
+
+/** Expansion state of each code spectrum, see code_spectrum(). */
+enum {
+  CODE_FFT_EMPTY = 0,
+  CODE_FFT_BUILDING,
+  CODE_FFT_READY,
+};
+
+/** Initialise an acquisition plan for a sample rate.
+ *
+ * The sample rate should be a multiple of 1 kHz so that the C/A code period
+ * is a whole number of samples. Each code period is resampled to the next
+ * power of two FFT length by repeating the nearest sample, and the code
+ * replicas are generated at the same length.
+ *
+ * \param plan Acquisition plan to initialise.
+ * \param fs   Sample rate in Hz.
+ * \return `0` on success, `-1` if an allocation failed.
+ */
+s8 acq_plan_init(acq_plan_t *plan, double fs)
+{
+  plan->fs = fs;
+  plan->n = (u32)lround(fs * 1023 / GPS_CA_CHIPPING_RATE);
+  plan->bin_hz = fs / plan->n;
+  memset(plan->code_fft_state, CODE_FFT_EMPTY, sizeof(plan->code_fft_state));
+
+  plan->n_fft = 1;
+  while (plan->n_fft < plan->n)
+    plan->n_fft <<= 1;
+
+  plan->fft = fft_plan_new(plan->n_fft);
+  if (!plan->fft)
+    return -1;
+
+  if (ca_code_resampled_init(&plan->codes, fs * plan->n_fft / plan->n) < 0) {
+    fft_plan_destroy(plan->fft);
+    return -1;
+  }
+
+  plan->code_fft = malloc(32 * plan->n_fft * sizeof(fft_cpx_t));
+  if (!plan->code_fft) {
+    ca_code_resampled_free(&plan->codes);
+    fft_plan_destroy(plan->fft);
+    return -1;
+  }
+
+  return 0;
+}
+
+/** Free the memory used by an acquisition plan.
+ *
+ * \param plan Acquisition plan initialised with acq_plan_init().
+ */
+void acq_plan_free(acq_plan_t *plan)
+{
+  free(plan->code_fft);
+  ca_code_resampled_free(&plan->codes);
+  fft_plan_destroy(plan->fft);
+}
+
+/** Number of samples read by acq_search().
+ *
+ * \param plan          Acquisition plan.
+ * \param n_coherent    Code periods integrated coherently.
+ * \param n_noncoherent Coherent integrations summed non-coherently.
+ * \return Number of samples.
+ */
+u32 acq_samples_needed(const acq_plan_t *plan,
+                       u32 n_coherent, u32 n_noncoherent)
+{
+  return plan->n * n_coherent * n_noncoherent;
+}
+
+/** Get the conjugated code spectrum for a PRN, computing it on first use.
+ * Safe to race between threads sharing the plan. */
+static const fft_cpx_t *code_spectrum(acq_plan_t *plan, u8 prn,
+                                      fft_cpx_t *work)
+{
+  fft_cpx_t *spec = &plan->code_fft[prn * plan->n_fft];
+
+  if (__atomic_load_n(&plan->code_fft_state[prn], __ATOMIC_ACQUIRE)
+      == CODE_FFT_READY)
+    return spec;
+
+  u8 expected = CODE_FFT_EMPTY;
+  if (__atomic_compare_exchange_n(&plan->code_fft_state[prn], &expected,
+                                  CODE_FFT_BUILDING, false,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    const s8 *code = ca_code_resampled(&plan->codes, prn);
+    for (u32 i=0; i<plan->n_fft; i++) {
+      spec[i].re = code[i];
+      spec[i].im = 0;
+    }
+    fft_forward(plan->fft, spec, work);
+    for (u32 i=0; i<plan->n_fft; i++)
+      spec[i].im = -spec[i].im;
+    __atomic_store_n(&plan->code_fft_state[prn], CODE_FFT_READY,
+                     __ATOMIC_RELEASE);
+  } else {
+    /* Another thread is computing this spectrum, wait for it to finish. */
+    while (__atomic_load_n(&plan->code_fft_state[prn], __ATOMIC_ACQUIRE)
+           != CODE_FFT_READY)
+      ;
+  }
+
+  return spec;
+}
+
+/** Samples searched by acq_search() or acq_search_packed(). */
+typedef struct {
+  const s8 *samples; /**< Samples, or `NULL` if the samples are packed. */
+  const u64 *packed; /**< Packed samples. */
+  u8 bits;           /**< Bits per packed sample. */
+  u32 start;         /**< Index of the first packed sample. */
+  s8 *scratch;       /**< One code period of unpacked samples. */
+} acq_source_t;
+
+/** One code period of samples starting at sample `offset`, packed samples
+ * are unpacked a period at a time into the scratch buffer. */
+static const s8 *source_period(const acq_source_t *src, u32 offset, u32 n)
+{
+  if (src->samples)
+    return &src->samples[offset];
+  packed_samples_unpack(src->packed, src->bits, src->start + offset, n,
+                        src->scratch);
+  return src->scratch;
+}
+
+/** Mix `n_coherent` code periods of samples starting at sample `offset`
+ * down by `freq` and sum them into one period of `n_fft` points.
+ *
+ * Point `j` of the output takes the sample nearest to it in time,
+ * `(j * n + n_fft / 2) / n_fft`. As `n_fft` is at least `n` the sample index
+ * advances by zero or one each point, which is tracked with an error term
+ * rather than a division. */
+static void mix_fold(const acq_plan_t *plan, const acq_source_t *src,
+                     u32 offset, u32 n_coherent, double freq, fft_cpx_t *out)
+{
+  u32 n = plan->n;
+  u32 n_fft = plan->n_fft;
+  memset(out, 0, n_fft * sizeof(fft_cpx_t));
+
+  if (freq == 0) {
+    for (u32 c=0; c<n_coherent; c++) {
+      const s8 *samples = source_period(src, offset + c*n, n);
+      u32 t = 0, err = n_fft / 2;
+      for (u32 j=0; j<n_fft; j++) {
+        out[j].re += samples[t];
+        err += n;
+        if (err >= n_fft) {
+          err -= n_fft;
+          t++;
+        }
+      }
+    }
+    return;
+  }
+
+  double step = -2*M_PI * freq / plan->fs;
+  double cos_delta = cos(step);
+  double sin_delta = sin(step);
+
+  for (u32 c=0; c<n_coherent; c++) {
+    const s8 *samples = source_period(src, offset + c*n, n);
+    /* Restart the carrier recurrence from the exact phase each period. */
+    double phase = fmod(step * c * n, 2*M_PI);
+    double carr_cos = cos(phase);
+    double carr_sin = sin(phase);
+    u32 t = 0, err = n_fft / 2;
+    for (u32 j=0; j<n_fft; j++) {
+      s8 s = samples[t];
+      out[j].re += s * carr_cos;
+      out[j].im += s * carr_sin;
+      err += n;
+      if (err >= n_fft) {
+        err -= n_fft;
+        t++;
+        double carr_cos_ = carr_cos*cos_delta - carr_sin*sin_delta;
+        carr_sin = carr_sin*cos_delta + carr_cos*sin_delta;
+        carr_cos = carr_cos_;
+      }
+    }
+  }
+}
+
+/** Conjugated products of two arrays of complex values. */
+static void mul_conj(u32 n, const fft_cpx_t *a, const fft_cpx_t *b,
+                     fft_cpx_t *prod)
+{
+  u32 j = 0;
+#ifdef __SSE3__
+  const __m128 neg_im = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+  for (; j+2<=n; j+=2) {
+    __m128 va = _mm_loadu_ps((const float *)&a[j]);
+    __m128 vb = _mm_loadu_ps((const float *)&b[j]);
+    __m128 b_re = _mm_moveldup_ps(vb);
+    __m128 b_im = _mm_movehdup_ps(vb);
+    __m128 a_swap = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 p = _mm_addsub_ps(_mm_mul_ps(va, b_re), _mm_mul_ps(a_swap, b_im));
+    _mm_storeu_ps((float *)&prod[j], _mm_xor_ps(p, neg_im));
+  }
+#endif
+  for (; j<n; j++) {
+    prod[j].re = a[j].re*b[j].re - a[j].im*b[j].im;
+    prod[j].im = -(a[j].re*b[j].im + a[j].im*b[j].re);
+  }
+}
+
+/** Multiply the sample spectrum shifted by `shift` bins by the conjugated
+ * code spectrum, conjugating the result so a forward FFT gives the
+ * (conjugated) circular correlation. */
+static void shift_mul(u32 n, const fft_cpx_t *spec, const fft_cpx_t *code,
+                      s32 shift, fft_cpx_t *prod)
+{
+  u32 k = ((shift % (s32)n) + n) % n;
+  mul_conj(n - k, &spec[k], code, prod);
+  mul_conj(k, spec, &code[n - k], &prod[n - k]);
+}
+
+/** Add the power of each correlation to `power`, or overwrite it if
+ * `first` is set. */
+static void power_acc(u32 n, const fft_cpx_t *x, float *power, bool first)
+{
+  u32 j = 0;
+#ifdef __SSE3__
+  for (; j+4<=n; j+=4) {
+    __m128 a = _mm_loadu_ps((const float *)&x[j]);
+    __m128 b = _mm_loadu_ps((const float *)&x[j+2]);
+    __m128 p = _mm_hadd_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b));
+    if (!first)
+      p = _mm_add_ps(p, _mm_loadu_ps(&power[j]));
+    _mm_storeu_ps(&power[j], p);
+  }
+#endif
+  for (; j<n; j++) {
+    float p = x[j].re*x[j].re + x[j].im*x[j].im;
+    power[j] = first ? p : power[j] + p;
+  }
+}
+
+/** Largest value in `power`, also adding all the values to `total`. */
+static float power_max(u32 n, const float *power, double *total)
+{
+  float max = 0, sum = 0;
+  u32 j = 0;
+#ifdef __SSE3__
+  __m128 vmax = _mm_setzero_ps();
+  __m128 vsum = _mm_setzero_ps();
+  for (; j+4<=n; j+=4) {
+    __m128 p = _mm_loadu_ps(&power[j]);
+    vmax = _mm_max_ps(vmax, p);
+    vsum = _mm_add_ps(vsum, p);
+  }
+  float m[4], t[4];
+  _mm_storeu_ps(m, vmax);
+  _mm_storeu_ps(t, vsum);
+  max = MAX(MAX(m[0], m[1]), MAX(m[2], m[3]));
+  sum = t[0] + t[1] + t[2] + t[3];
+#endif
+  for (; j<n; j++) {
+    max = MAX(max, power[j]);
+    sum += power[j];
+  }
+  *total += sum;
+  return max;
+}
+
+/** Largest value in the `len` values of `power` from index `start`,
+ * wrapping around the end. */
+static float window_max(u32 n, const float *power, u32 start, u32 len)
+{
+  float max = 0;
+  for (u32 j=0; j<len; j++)
+    max = MAX(max, power[(start + j) % n]);
+  return max;
+}
+
+/** Search the samples of `src`, see acq_search(). Only the `lag_len`
+ * correlation lags from `lag_start` are searched for the peak, all of them
+ * count towards the mean power. */
+static s8 search(acq_plan_t *plan, acq_source_t *src, u8 prn,
+                 float cf_min, float cf_max, float cf_bin_width,
+                 u32 n_coherent, u32 n_noncoherent,
+                 u32 lag_start, u32 lag_len,
+                 acq_result_t *result)
+{
+  u32 n = plan->n_fft;
+
+  if (n_coherent == 0 || n_noncoherent == 0 ||
+      !(cf_bin_width > 0) || cf_max < cf_min)
+    return -1;
+
+  u32 n_bins = (u32)floor((cf_max - cf_min) / cf_bin_width + 1e-3) + 1;
+
+  /* Sample spectra of each non-coherent block, followed by a product and a
+   * work buffer. */
+  fft_cpx_t *spec = malloc((n_noncoherent + 2) * n * sizeof(fft_cpx_t));
+  float *power = malloc(n * sizeof(float));
+  if (!src->samples)
+    src->scratch = malloc(plan->n);
+  if (!spec || !power || (!src->samples && !src->scratch)) {
+    free(spec);
+    free(power);
+    free(src->scratch);
+    return -2;
+  }
+  fft_cpx_t *prod = &spec[n_noncoherent * n];
+  fft_cpx_t *work = &prod[n];
+
+  const fft_cpx_t *code = code_spectrum(plan, prn, work);
+
+  /* When the bin width divides the FFT bin spacing, bins `period` apart
+   * differ by a whole number of FFT bins and share sample spectra. */
+  u32 period = n_bins;
+  double ratio = plan->bin_hz / cf_bin_width;
+  if (fabs(ratio - round(ratio)) < 1e-6 && round(ratio) < n_bins)
+    period = (u32)round(ratio);
+
+  double best = -1, total = 0;
+  u32 best_idx = 0;
+  double best_cf = 0;
+
+  double cf_mid = (cf_min + cf_max) / 2;
+
+  for (u32 i0=0; i0<period; i0++) {
+    double f0 = cf_min + i0 * cf_bin_width;
+    double mix = f0 + round((cf_mid - f0) / plan->bin_hz) * plan->bin_hz;
+
+    for (u32 m=0; m<n_noncoherent; m++) {
+      mix_fold(plan, src, m * plan->n * n_coherent, n_coherent, mix,
+               &spec[m * n]);
+      fft_forward(plan->fft, &spec[m * n], work);
+    }
+
+    for (u32 i=i0; i<n_bins; i+=period) {
+      double f = cf_min + i * cf_bin_width;
+      s32 shift = lround((f - mix) / plan->bin_hz);
+
+      for (u32 m=0; m<n_noncoherent; m++) {
+        shift_mul(n, &spec[m * n], code, shift, prod);
+        fft_forward(plan->fft, prod, work);
+        power_acc(n, prod, power, m == 0);
+      }
+
+      float bin_best = power_max(n, power, &total);
+      if (lag_len < n)
+        bin_best = window_max(n, power, lag_start, lag_len);
+      if (bin_best > best) {
+        best = bin_best;
+        best_cf = f;
+        for (best_idx=lag_start; power[best_idx % n] != bin_best; best_idx++)
+          ;
+        best_idx %= n;
+      }
+    }
+  }
+
+  free(spec);
+  free(power);
+  free(src->scratch);
+
+  result->cp = ((n - best_idx) % n) / plan->codes.samples_per_chip;
+  result->cf = best_cf;
+  result->snr = total > 0 ? best / (total / ((double)n_bins * n)) : 0;
+
+  return 0;
+}
+
+/** Search for a satellite over a range of Doppler frequencies.
+ *
+ * Finds the code phase and carrier frequency giving the largest correlation
+ * power over all code phases and the Doppler bins `cf_min`, `cf_min +
+ * cf_bin_width`, ... up to `cf_max`.
+ *
+ * `n_coherent` consecutive code periods are integrated coherently and the
+ * powers of `n_noncoherent` such integrations are summed, reading
+ * acq_samples_needed() samples in total. Coherent integration improves
+ * sensitivity more quickly but needs a bin width of around
+ * `500 / n_coherent` Hz and is limited by navigation data bit transitions.
+ *
+ * The reported `snr` is the peak correlation power divided by the mean
+ * power over the whole search grid.
+ *
+ * \param plan          Acquisition plan.
+ * \param samples       Samples to search.
+ * \param prn           PRN to search for (0-31).
+ * \param cf_min        Lowest carrier frequency to search in Hz.
+ * \param cf_max        Highest carrier frequency to search in Hz.
+ * \param cf_bin_width  Carrier frequency step in Hz.
+ * \param n_coherent    Code periods integrated coherently.
+ * \param n_noncoherent Coherent integrations summed non-coherently.
+ * \param result        Code phase, carrier frequency and SNR of the peak.
+ * \return `0` on success, `-1` if the search parameters are invalid, `-2`
+ *         if an allocation failed.
+ */
+s8 acq_search(acq_plan_t *plan, const s8 *samples, u8 prn,
+              float cf_min, float cf_max, float cf_bin_width,
+              u32 n_coherent, u32 n_noncoherent,
+              acq_result_t *result)
+{
+  acq_source_t src = {.samples = samples};
+  return search(plan, &src, prn, cf_min, cf_max, cf_bin_width,
+                n_coherent, n_noncoherent, 0, plan->n_fft, result);
+}
+
+/** Search for a satellite in bit-packed 1-bit or 2-bit samples.
+ *
+ * As acq_search(), but reads samples in the format of
+ * packed_samples_pack() starting at sample `start`. Each code period is
+ * unpacked only as it is mixed down, so a long packed capture can be
+ * searched without unpacking it.
+ *
+ * \param plan          Acquisition plan.
+ * \param packed        Packed samples.
+ * \param bits          Bits per sample, 1 or 2.
+ * \param start         Index of the first sample to search.
+ * \param prn           PRN to search for (0-31).
+ * \param cf_min        Lowest carrier frequency to search in Hz.
+ * \param cf_max        Highest carrier frequency to search in Hz.
+ * \param cf_bin_width  Carrier frequency step in Hz.
+ * \param n_coherent    Code periods integrated coherently.
+ * \param n_noncoherent Coherent integrations summed non-coherently.
+ * \param result        Code phase, carrier frequency and SNR of the peak.
+ * \return `0` on success, `-1` if the search parameters are invalid, `-2`
+ *         if an allocation failed.
+ */
+s8 acq_search_packed(acq_plan_t *plan, const u64 *packed, u8 bits,
+                     u32 start, u8 prn,
+                     float cf_min, float cf_max, float cf_bin_width,
+                     u32 n_coherent, u32 n_noncoherent,
+                     acq_result_t *result)
+{
+  if (bits != 1 && bits != 2)
+    return -1;
+
+  acq_source_t src = {.packed = packed, .bits = bits, .start = start};
+  return search(plan, &src, prn, cf_min, cf_max, cf_bin_width,
+                n_coherent, n_noncoherent, 0, plan->n_fft, result);
+}
+
+/** Search for a satellite that was recently tracked.
+ *
+ * When a channel loses lock for a short time, such as passing under a
+ * bridge, the code phase and carrier frequency of the satellite can be
+ * predicted from the last state of its tracking loop. Only the Doppler
+ * bins within `config->cf_window` of the last carrier frequency are
+ * searched, and only the code phases within `config->cp_window` of the
+ * predicted code phase are considered for the peak. This is a few FFTs
+ * instead of the one per Doppler bin of a full search, and ignoring code
+ * phases away from the prediction lowers the chance of a false peak.
+ *
+ * The code phase window is widened by the drift over `elapsed` that the
+ * carrier frequency uncertainty could cause, so it need only cover the
+ * uncertainty at the time lock was lost.
+ *
+ * If the peak in the window is below `config->snr_threshold` the satellite
+ * is searched for again over the full range from `config->cf_min` to
+ * `config->cf_max`, as acq_search().
+ *
+ * \param plan       Acquisition plan.
+ * \param samples    Samples to search, acq_samples_needed() of them.
+ * \param prn        PRN to search for (0-31).
+ * \param code_phase Code phase in chips at the last tracked sample.
+ * \param code_freq  Code frequency of the tracking loop in Hz, the offset
+ *                   from the nominal chipping rate as in `code_freq` of
+ *                   aided_tl_state_t and simple_tl_state_t.
+ * \param carr_freq  Carrier frequency of the tracking loop in Hz, the
+ *                   Doppler relative to `config->if_freq` as in `carr_freq`
+ *                   of aided_tl_state_t and simple_tl_state_t.
+ * \param elapsed    Time from the last tracked sample to the first sample
+ *                   of `samples` in seconds.
+ * \param config     Search windows, integration and threshold.
+ * \param result     Code phase, carrier frequency and SNR of the peak.
+ * \return `1` if the satellite was found in the window, `0` if the full
+ *         search was run, `-1` if the search parameters are invalid, `-2`
+ *         if an allocation failed.
+ */
+s8 acq_reacquire(acq_plan_t *plan, const s8 *samples, u8 prn,
+                 float code_phase, float code_freq, float carr_freq,
+                 double elapsed, const acq_reacq_config_t *config,
+                 acq_result_t *result)
+{
+  if (!(config->cp_window >= 0) || !(config->cf_window >= 0) ||
+      !(elapsed >= 0))
+    return -1;
+
+  double spc = plan->codes.samples_per_chip;
+  double cp = fmod(code_phase + (GPS_CA_CHIPPING_RATE + code_freq) * elapsed,
+                   1023);
+  if (cp < 0)
+    cp += 1023;
+  double cp_window = config->cp_window
+    + config->cf_window * elapsed * GPS_CA_CHIPPING_RATE / GPS_L1_HZ;
+
+  /* Correlation lag `(n - cp * spc) % n` has the peak at code phase `cp`,
+   * see search(). */
+  u32 n = plan->n_fft;
+  u32 lag = (n - (u32)lround(cp * spc) % n) % n;
+  double w = ceil(cp_window * spc);
+  u32 lag_len = w < n / 2 ? 2 * (u32)w + 1 : n;
+  u32 lag_start = lag_len < n ? (lag + n - (u32)w) % n : 0;
+
+  float cf = config->if_freq + carr_freq;
+  acq_source_t src = {.samples = samples};
+  s8 ret = search(plan, &src, prn,
+                  cf - config->cf_window, cf + config->cf_window,
+                  config->cf_bin_width,
+                  config->n_coherent, config->n_noncoherent,
+                  lag_start, lag_len, result);
+  if (ret < 0)
+    return ret;
+  if (result->snr >= config->snr_threshold)
+    return 1;
+
+  src = (acq_source_t){.samples = samples};
+  ret = search(plan, &src, prn,
+               config->cf_min, config->cf_max, config->cf_bin_width,
+               config->n_coherent, config->n_noncoherent,
+               0, n, result);
+  return ret < 0 ? ret : 0;
+}
+
+/** \} */
+
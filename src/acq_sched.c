@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acq_sched.h"
+
+/** \defgroup acq_sched Acquisition Scheduler
+ * Multi-threaded acquisition search across PRNs and Doppler bins.
+ *
+ * The search for each PRN is split into chunks of its Doppler range, each
+ * chunk being one acq_search() call. The chunks are dealt out in priority
+ * order to per-worker task queues, a worker takes tasks from the front of
+ * its own queue and once that is empty steals from the back of the other
+ * workers' queues, so all workers stay busy until the whole search is done.
+ *
+ * Completed chunks are passed back to the calling thread through a
+ * lock-free queue. When the queue is empty the calling thread sleeps on a
+ * condition variable, and only then do the workers take its lock to wake
+ * it. The calling thread merges the chunks of each PRN and tells the
+ * workers to skip the remaining chunks of a PRN once it is found, and all
+ * remaining work once enough satellites are found.
+ * \{ */
+
+/** Worker task queue.
+ * The task list is fixed when the search starts, `range` packs the index
+ * of the first remaining task in the upper 32 bits and one past the last
+ * in the lower 32 bits so both ends can be claimed with one CAS. */
+typedef struct {
+  u32 *tasks;
+  u64 range;
+} task_queue_t;
+
+/** Completion queue slot. */
+typedef struct {
+  u32 task;            /**< Task index. */
+  bool skipped;        /**< Task was cancelled before it was run. */
+  acq_result_t result; /**< Search result if the task was run. */
+  u8 ready;            /**< Slot has been written. */
+} completion_t;
+
+typedef struct {
+  acq_plan_t *plan;
+  const s8 *samples;
+  const acq_sched_config_t *config;
+  const u8 *prns;
+  u32 n_chunks;
+  u32 n_tasks;
+  u32 n_bins;
+
+  u8 n_workers;
+  task_queue_t *queues;
+
+  /* Completion queue, one slot per task so it never wraps. Producers claim
+   * slots with `write_idx`, the calling thread consumes them in order. */
+  completion_t *completions;
+  u32 write_idx;
+  pthread_mutex_t ready_lock; /**< Protects waiting on `ready_cond`. */
+  pthread_cond_t ready_cond;  /**< Signalled when a slot is written while
+                                   the calling thread waits. */
+  u8 waiting;                 /**< Calling thread is waiting. */
+
+  u8 stop;       /**< Skip all remaining tasks. */
+  u8 *prn_done;  /**< Skip remaining tasks for each PRN. */
+} sched_t;
+
+typedef struct {
+  sched_t *s;
+  u8 id;
+} worker_t;
+
+/** Progress of the search for one PRN, only used by the calling thread. */
+typedef struct {
+  u32 n_complete; /**< Chunks searched or skipped. */
+  bool skipped;   /**< At least one chunk was skipped. */
+} prn_progress_t;
+
+static bool queue_pop_front(task_queue_t *q, u32 *task)
+{
+  u64 r = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+  while ((r >> 32) < (r & 0xFFFFFFFF)) {
+    if (__atomic_compare_exchange_n(&q->range, &r, r + ((u64)1 << 32), true,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      *task = q->tasks[r >> 32];
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool queue_steal_back(task_queue_t *q, u32 *task)
+{
+  u64 r = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+  while ((r >> 32) < (r & 0xFFFFFFFF)) {
+    if (__atomic_compare_exchange_n(&q->range, &r, r - 1, true,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      *task = q->tasks[(r & 0xFFFFFFFF) - 1];
+      return true;
+    }
+  }
+  return false;
+}
+
+static void complete(sched_t *s, u32 task, bool skipped,
+                     const acq_result_t *result)
+{
+  u32 i = __atomic_fetch_add(&s->write_idx, 1, __ATOMIC_RELAXED);
+  completion_t *c = &s->completions[i];
+  c->task = task;
+  c->skipped = skipped;
+  if (!skipped)
+    c->result = *result;
+  __atomic_store_n(&c->ready, 1, __ATOMIC_SEQ_CST);
+
+  /* The calling thread sets `waiting` before checking `ready` and we set
+   * `ready` before checking `waiting`, so either it sees the slot or we see
+   * it waiting. Taking the lock orders the signal after its wait starts. */
+  if (__atomic_load_n(&s->waiting, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&s->ready_lock);
+    pthread_cond_signal(&s->ready_cond);
+    pthread_mutex_unlock(&s->ready_lock);
+  }
+}
+
+static void run_task(sched_t *s, u32 task)
+{
+  const acq_sched_config_t *cfg = s->config;
+  u32 p = task / s->n_chunks;
+  u32 chunk = task % s->n_chunks;
+
+  if (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE) ||
+      __atomic_load_n(&s->prn_done[p], __ATOMIC_ACQUIRE)) {
+    complete(s, task, true, NULL);
+    return;
+  }
+
+  /* Split the Doppler bins evenly between the chunks. */
+  u32 b0 = (u64)s->n_bins * chunk / s->n_chunks;
+  u32 b1 = (u64)s->n_bins * (chunk + 1) / s->n_chunks;
+
+  acq_result_t res;
+  if (acq_search(s->plan, s->samples, s->prns[p],
+                 cfg->cf_min + b0 * cfg->cf_bin_width,
+                 cfg->cf_min + (b1 - 1) * cfg->cf_bin_width,
+                 cfg->cf_bin_width, cfg->n_coherent, cfg->n_noncoherent,
+                 &res) < 0) {
+    complete(s, task, true, NULL);
+    return;
+  }
+  complete(s, task, false, &res);
+}
+
+static void *worker_thread(void *arg)
+{
+  worker_t *w = arg;
+  sched_t *s = w->s;
+  u32 task;
+
+  while (queue_pop_front(&s->queues[w->id], &task))
+    run_task(s, task);
+
+  /* Own queue is empty, steal from the others until they are all empty.
+   * Queues are never refilled so one pass finding nothing is final. */
+  bool found;
+  do {
+    found = false;
+    for (u8 i=1; i<s->n_workers; i++) {
+      if (queue_steal_back(&s->queues[(w->id + i) % s->n_workers], &task)) {
+        run_task(s, task);
+        found = true;
+        break;
+      }
+    }
+  } while (found);
+
+  return NULL;
+}
+
+/** Search for a list of satellites using a pool of worker threads.
+ *
+ * PRNs are searched in the order given, so put the satellites most likely
+ * to be visible first, e.g. ordered by the elevations from
+ * calc_sat_az_el_almanac(). The search for each PRN is split into
+ * `config->n_chunks` chunks of its Doppler range which are searched in
+ * parallel, see acq_search() for the other search parameters. Each chunk
+ * repeats the forward FFTs of the samples, so more than one chunk per PRN
+ * only pays off when there are few PRNs compared to threads.
+ *
+ * A PRN is found as soon as one of its chunks has an SNR of at least
+ * `config->snr_threshold`, its remaining chunks are then skipped. Once
+ * `config->n_wanted` satellites are found all remaining work is cancelled.
+ *
+ * As each PRN is resolved `callback`, if not `NULL`, is called from the
+ * calling thread with its result so tracking can be started while the rest
+ * of the search continues.
+ *
+ * \param plan     Acquisition plan, shared by all the workers.
+ * \param samples  Samples to search, see acq_samples_needed().
+ * \param config   Search configuration.
+ * \param n_prns   Number of PRNs to search.
+ * \param prns     PRNs to search, in priority order.
+ * \param results  Results for each of `prns`, in the same order. The
+ *                 result of a PRN is the chunk with the highest SNR.
+ * \param callback Function called as each PRN is resolved, or `NULL`.
+ * \param context  Passed to `callback`.
+ * \return Number of satellites found, `-1` if the configuration is
+ *         invalid or `-2` if an allocation or thread creation failed.
+ */
+s8 acq_sched_search(acq_plan_t *plan, const s8 *samples,
+                    const acq_sched_config_t *config,
+                    u8 n_prns, const u8 prns[],
+                    acq_sched_result_t results[],
+                    acq_sched_callback_t callback, void *context)
+{
+  if (config->n_chunks == 0 || !(config->cf_bin_width > 0) ||
+      config->cf_max < config->cf_min ||
+      config->n_coherent == 0 || config->n_noncoherent == 0)
+    return -1;
+
+  for (u8 i=0; i<n_prns; i++) {
+    results[i].prn = prns[i];
+    results[i].status = ACQ_SCHED_CANCELLED;
+    results[i].result.snr = 0;
+    results[i].result.cp = 0;
+    results[i].result.cf = 0;
+  }
+  if (n_prns == 0)
+    return 0;
+
+  sched_t s = {
+    .plan = plan,
+    .samples = samples,
+    .config = config,
+    .prns = prns,
+    .n_bins = (u32)floor((config->cf_max - config->cf_min)
+                         / config->cf_bin_width + 1e-3) + 1,
+    .write_idx = 0,
+    .ready_lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready_cond = PTHREAD_COND_INITIALIZER,
+    .waiting = 0,
+    .stop = 0,
+  };
+  /* Every chunk needs at least one Doppler bin. */
+  s.n_chunks = MIN(config->n_chunks, s.n_bins);
+  s.n_tasks = n_prns * s.n_chunks;
+
+  s.n_workers = config->n_threads;
+  if (s.n_workers == 0) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    s.n_workers = n_cpus > 0 ? MIN(n_cpus, 255) : 1;
+  }
+  s.n_workers = MIN(s.n_workers, s.n_tasks);
+
+  s.queues = calloc(s.n_workers, sizeof(task_queue_t));
+  u32 *tasks = malloc(s.n_tasks * sizeof(u32));
+  s.completions = calloc(s.n_tasks, sizeof(completion_t));
+  s.prn_done = calloc(n_prns, 1);
+  prn_progress_t *progress = calloc(n_prns, sizeof(prn_progress_t));
+  worker_t *workers = malloc(s.n_workers * sizeof(worker_t));
+  pthread_t *threads = malloc(s.n_workers * sizeof(pthread_t));
+
+  s8 ret = 0;
+  if (!s.queues || !tasks || !s.completions || !s.prn_done ||
+      !progress || !workers || !threads) {
+    ret = -2;
+    goto cleanup;
+  }
+
+  /* Deal the tasks round-robin so every worker's queue is in priority
+   * order and the highest priority tasks are started first. */
+  u32 per_worker = (s.n_tasks + s.n_workers - 1) / s.n_workers;
+  for (u8 i=0; i<s.n_workers; i++) {
+    s.queues[i].tasks = &tasks[i * per_worker];
+    u32 n = 0;
+    for (u32 t=i; t<s.n_tasks; t+=s.n_workers)
+      s.queues[i].tasks[n++] = t;
+    s.queues[i].range = n;
+  }
+
+  u8 n_started = 0;
+  for (; n_started<s.n_workers; n_started++) {
+    workers[n_started].s = &s;
+    workers[n_started].id = n_started;
+    if (pthread_create(&threads[n_started], NULL,
+                       worker_thread, &workers[n_started]) != 0)
+      break;
+  }
+  /* If only some workers could be started they will steal the tasks of
+   * the others. */
+  if (n_started == 0) {
+    ret = -2;
+    goto cleanup;
+  }
+
+  u8 n_found = 0;
+  u32 read_idx = 0;
+  while (read_idx < s.n_tasks) {
+    completion_t *c = &s.completions[read_idx];
+    if (!__atomic_load_n(&c->ready, __ATOMIC_ACQUIRE)) {
+      pthread_mutex_lock(&s.ready_lock);
+      __atomic_store_n(&s.waiting, 1, __ATOMIC_SEQ_CST);
+      while (!__atomic_load_n(&c->ready, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&s.ready_cond, &s.ready_lock);
+      __atomic_store_n(&s.waiting, 0, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&s.ready_lock);
+    }
+    read_idx++;
+
+    u32 p = c->task / s.n_chunks;
+    acq_sched_result_t *r = &results[p];
+
+    if (!c->skipped && c->result.snr > r->result.snr)
+      r->result = c->result;
+
+    bool resolved = false;
+    if (!c->skipped && c->result.snr >= config->snr_threshold &&
+        r->status != ACQ_SCHED_FOUND) {
+      r->status = ACQ_SCHED_FOUND;
+      __atomic_store_n(&s.prn_done[p], 1, __ATOMIC_RELEASE);
+      n_found++;
+      resolved = true;
+      if (config->n_wanted && n_found >= config->n_wanted)
+        __atomic_store_n(&s.stop, 1, __ATOMIC_RELEASE);
+    }
+
+    /* Without a skipped chunk a PRN is known to be absent once all its
+     * chunks are searched. */
+    progress[p].skipped |= c->skipped;
+    if (++progress[p].n_complete == s.n_chunks &&
+        r->status != ACQ_SCHED_FOUND && !progress[p].skipped) {
+      r->status = ACQ_SCHED_NOT_FOUND;
+      resolved = true;
+    }
+
+    if (resolved && callback)
+      callback(r, context);
+  }
+  ret = n_found;
+
+  for (u8 i=0; i<n_started; i++)
+    pthread_join(threads[i], NULL);
+
+cleanup:
+  pthread_cond_destroy(&s.ready_cond);
+  pthread_mutex_destroy(&s.ready_lock);
+  free(threads);
+  free(workers);
+  free(progress);
+  free(s.prn_done);
+  free(s.completions);
+  free(tasks);
+  free(s.queues);
+  return ret;
+}
+
+/** \} */
+
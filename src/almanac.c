@@ -11,6 +11,8 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "constants.h"
 #include "linear_algebra.h"
@@ -175,5 +177,152 @@ double calc_sat_doppler_almanac(almanac_t* alm, double t, s16 week,
   return GPS_L1_HZ * radial_velocity / GPS_C;
 }
 
+/** Propagate all the almanacs over a grid of times.
+ *
+ * The satellite states are calculated once here, so the views from any
+ * number of locations can be worked out from them with almanac_grid_look()
+ * without solving the orbits again. Only satellites with a valid, healthy
+ * almanac are propagated. Free the grid with almanac_grid_free().
+ *
+ * \param g       Grid to initialise.
+ * \param alm     Almanacs, indexed by PRN counting from 0.
+ * \param t0      GPS time of week of the first grid time [s].
+ * \param week    GPS week number modulo 1024, or -1, see
+ *                calc_sat_state_almanac().
+ * \param dt      Time between grid times [s].
+ * \param n_times Number of grid times.
+ * \return `0` on success, `-1` if `n_times` is zero, `-2` if the grid
+ *         couldn't be allocated.
+ */
+s8 almanac_grid_init(almanac_grid_t *g, const almanac_t alm[32],
+                     double t0, s16 week, double dt, u32 n_times)
+{
+  memset(g, 0, sizeof(*g));
+  if (n_times == 0)
+    return -1;
+
+  g->pos = calloc((size_t)n_times * 32, sizeof(g->pos[0]));
+  g->vel = calloc((size_t)n_times * 32, sizeof(g->vel[0]));
+  if (!g->pos || !g->vel) {
+    almanac_grid_free(g);
+    return -2;
+  }
+
+  g->t0 = t0;
+  g->week = week;
+  g->dt = dt;
+  g->n_times = n_times;
+
+  for (u8 p=0; p<32; p++) {
+    if (!alm[p].valid || !alm[p].healthy)
+      continue;
+    g->sats |= 1u << p;
+    almanac_t a = alm[p];
+    for (u32 i=0; i<n_times; i++)
+      calc_sat_state_almanac(&a, t0 + i*dt, week,
+                             g->pos[i*32 + p], g->vel[i*32 + p]);
+  }
+  return 0;
+}
+
+/** Free the states of a grid from almanac_grid_init().
+ *
+ * \param g Grid.
+ */
+void almanac_grid_free(almanac_grid_t *g)
+{
+  free(g->pos);
+  free(g->vel);
+  memset(g, 0, sizeof(*g));
+}
+
+/** Azimuth, elevation and Doppler shift of every satellite of a grid at
+ * every grid time, as seen from one location.
+ *
+ * Agrees with calc_sat_az_el_almanac() and calc_sat_doppler_almanac() to
+ * single precision. The rotation to the local frame is only worked out
+ * once per location.
+ *
+ * \param g    Grid, see almanac_grid_init().
+ * \param ref  ECEF coordinates of the location [m].
+ * \param look Array of `g->n_times * 32` entries, the view of PRN `p` at
+ *             grid time `i` is written to index `i*32 + p`. Entries of PRNs
+ *             not in `g->sats` are zeroed.
+ */
+void almanac_grid_look(const almanac_grid_t *g, const double ref[3],
+                       almanac_look_t look[])
+{
+  double M[3][3];
+  ecef2ned_matrix(ref, M);
+
+  for (u32 i=0; i<g->n_times; i++) {
+    for (u8 p=0; p<32; p++) {
+      almanac_look_t *l = &look[i*32 + p];
+      if (!(g->sats >> p & 1)) {
+        memset(l, 0, sizeof(*l));
+        continue;
+      }
+
+      const double *pos = g->pos[i*32 + p];
+      const double *vel = g->vel[i*32 + p];
+      double los[3], ned[3];
+      vector_subtract(3, pos, ref, los);
+      matrix_multiply(3, 3, 1, (double *)M, los, ned);
+      double range = vector_norm(3, los);
+
+      double az = atan2(ned[1], ned[0]);
+      if (az < 0)
+        az += 2*M_PI;
+      l->az = az;
+      l->el = asin(-ned[2] / range);
+      l->doppler = GPS_L1_HZ * (vector_dot(3, los, vel) / range) / GPS_C;
+    }
+  }
+}
+
+/** Find the passes of the satellites over a location, the spans of grid
+ * times each satellite is at or above an elevation mask.
+ *
+ * Passes are listed by PRN, then in time order. A pass under way at the
+ * start or end of the grid is cut short there.
+ *
+ * \param g          Grid, see almanac_grid_init().
+ * \param look       Views from the location, see almanac_grid_look().
+ * \param mask       Elevation mask [rad].
+ * \param passes     Array the passes are written to.
+ * \param max_passes Length of `passes`.
+ * \return Number of passes written to `passes`.
+ */
+u32 almanac_grid_passes(const almanac_grid_t *g, const almanac_look_t look[],
+                        double mask, almanac_pass_t passes[], u32 max_passes)
+{
+  u32 n = 0;
+  for (u8 p=0; p<32; p++) {
+    if (!(g->sats >> p & 1))
+      continue;
+
+    almanac_pass_t *pass = 0;
+    for (u32 i=0; i<g->n_times; i++) {
+      float el = look[i*32 + p].el;
+      if (el < mask) {
+        pass = 0;
+        continue;
+      }
+      if (!pass) {
+        if (n == max_passes)
+          return n;
+        pass = &passes[n++];
+        pass->prn = p;
+        pass->rise = i;
+        pass->max_el = el;
+      }
+      pass->set = i + 1;
+      if (el > pass->max_el)
+        pass->max_el = el;
+    }
+  }
+  return n;
+}
+
 /** \} */
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "almanac_survey.h"
+
+/** \defgroup almanac_survey Almanac Survey
+ * Satellite visibility over many locations, on several threads.
+ *
+ * The satellite states are propagated once into an almanac_grid_t. The
+ * locations are then shared between worker threads, each taking the next
+ * location from a shared counter so the work stays balanced. Each location
+ * is worked out with almanac_grid_look().
+ * \{ */
+
+typedef struct {
+  const almanac_grid_t *g;
+  u32 n_locs;
+  const double (*refs)[3];
+  double mask;
+  u8 *n_visible;
+  almanac_look_t *looks;
+  u32 next;    /**< Next location to survey. */
+  bool failed; /**< A worker couldn't allocate its buffer. */
+} survey_t;
+
+static void *survey_thread(void *arg)
+{
+  survey_t *s = arg;
+  const almanac_grid_t *g = s->g;
+  u32 n = g->n_times * 32;
+
+  /* Without `looks` to write to each worker has a buffer of its own. */
+  almanac_look_t *buf = 0;
+  if (!s->looks) {
+    buf = malloc(n * sizeof(almanac_look_t));
+    if (!buf) {
+      __atomic_store_n(&s->failed, true, __ATOMIC_RELAXED);
+      return 0;
+    }
+  }
+
+  while (true) {
+    u32 l = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED);
+    if (l >= s->n_locs)
+      break;
+
+    almanac_look_t *look = s->looks ? &s->looks[(size_t)l * n] : buf;
+    almanac_grid_look(g, s->refs[l], look);
+
+    if (s->n_visible) {
+      for (u32 i=0; i<g->n_times; i++) {
+        u8 n_vis = 0;
+        for (u8 p=0; p<32; p++)
+          n_vis += (g->sats >> p & 1) && look[i*32 + p].el >= s->mask;
+        s->n_visible[(size_t)l * g->n_times + i] = n_vis;
+      }
+    }
+  }
+
+  free(buf);
+  return 0;
+}
+
+/** Survey satellite visibility from many locations over a grid of times.
+ *
+ * \param g         Grid of satellite states, see almanac_grid_init().
+ * \param n_locs    Number of locations.
+ * \param refs      ECEF coordinates of each location [m].
+ * \param mask      Elevation mask [rad].
+ * \param n_threads Worker threads, `0` for one per online CPU.
+ * \param n_visible Number of satellites at or above the mask from location
+ *                  `l` at grid time `i` is written to index
+ *                  `l*g->n_times + i`. Ignored if NULL.
+ * \param looks     Views of each location, `g->n_times * 32` entries per
+ *                  location laid out as by almanac_grid_look(). Ignored if
+ *                  NULL.
+ * \return `0` on success, `-2` if memory couldn't be allocated or no
+ *         thread could be started.
+ */
+s8 almanac_survey(const almanac_grid_t *g, u32 n_locs,
+                  const double refs[][3], double mask, u8 n_threads,
+                  u8 n_visible[], almanac_look_t looks[])
+{
+  if (n_locs == 0)
+    return 0;
+
+  survey_t s = {
+    .g = g,
+    .n_locs = n_locs,
+    .refs = refs,
+    .mask = mask,
+    .n_visible = n_visible,
+    .looks = looks,
+    .next = 0,
+    .failed = false,
+  };
+
+  u32 n_workers = n_threads;
+  if (n_workers == 0) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_workers = n_cpus > 0 ? MIN(n_cpus, 255) : 1;
+  }
+  n_workers = MIN(n_workers, n_locs);
+
+  pthread_t *threads = malloc(n_workers * sizeof(pthread_t));
+  if (!threads)
+    return -2;
+
+  u32 n_started = 0;
+  for (; n_started<n_workers; n_started++)
+    if (pthread_create(&threads[n_started], NULL, survey_thread, &s) != 0)
+      break;
+  /* Any workers started share out all the locations. */
+  for (u32 i=0; i<n_started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+
+  if (n_started == 0)
+    return -2;
+  /* A worker that failed left its locations to the others, unless they
+   * all failed. */
+  if (s.failed && s.next < n_locs)
+    return -2;
+  return 0;
+}
+
+/** \} */
+
@@ -24,6 +24,7 @@
 #include <math.h>
 #include <linear_algebra.h>
 #include "constants.h"
+#include "diag.h"
 #include "track.h"
 #include "almanac.h"
 #include "gpstime.h"
@@ -19,6 +19,7 @@
 #include "ambiguity_test.h"
 #include "common.h"
 #include "constants.h"
+#include "diag.h"
 #include "linear_algebra.h"
 #include "single_diff.h"
 #include "amb_kf.h"
@@ -225,12 +226,15 @@ void update_ambiguity_test(double ref_ecef[3], double phase_var, double code_var
 
   /* Error */
   if (valid_sdiffs != 0) {
-    printf("update_ambiguity_test: Invalid sdiffs. return code: %i\n", valid_sdiffs);
-    for (u8 k=0; k < num_sdiffs; k++) {
-      printf("%u, ", sdiffs[k].prn);
+    DIAG(DIAG_ERROR, DIAG_EVENT_IAR_INVALID_SDIFFS,
+         "update_ambiguity_test: Invalid sdiffs. return code: %i", valid_sdiffs);
+    if (DEBUG_AMBIGUITY_TEST) {
+      for (u8 k=0; k < num_sdiffs; k++) {
+        printf("%u, ", sdiffs[k].prn);
+      }
+      printf("}\n");
+      print_sats_management_short(&amb_test->sats);
     }
-    printf("}\n");
-    print_sats_management_short(&amb_test->sats);
     return;
   }
 
@@ -424,7 +428,7 @@ void test_ambiguities(ambiguity_test_t *amb_test, double *dd_measurements)
     hypothesis_t *empty_element = (hypothesis_t *)memory_pool_add(amb_test->pool);
     /* Start with ll = 0, just for the sake of argument. */
     empty_element->ll = 0;
-    printf("TEST AMBIGUITIES\n");
+    DIAG(DIAG_INFO, DIAG_EVENT_IAR_RESET, "TEST AMBIGUITIES");
     amb_test->sats.num_sats = 0;
     amb_test->amb_check.initialized = 0;
   }
@@ -498,12 +502,15 @@ s8 make_dd_measurements_and_sdiffs(u8 ref_prn, u8 *non_ref_prns, u8 num_dds,
   }
 
   if (!is_prn_set(num_dds, non_ref_prns)) {
-    printf("There is disorder in the amb_test sats.\n");
-    printf("amb_test sat prns = {%u, ", ref_prn);
-    for (u8 k=0; k < num_dds; k++) {
-      printf("%u, ", non_ref_prns[k]);
+    DIAG(DIAG_ERROR, DIAG_EVENT_IAR_SATS_DISORDER,
+         "There is disorder in the amb_test sats.");
+    if (DEBUG_AMBIGUITY_TEST) {
+      printf("amb_test sat prns = {%u, ", ref_prn);
+      for (u8 k=0; k < num_dds; k++) {
+        printf("%u, ", non_ref_prns[k]);
+      }
+      printf("}\n");
     }
-    printf("}\n");
     return -2;
   }
 
@@ -850,12 +857,14 @@ u8 ambiguity_sat_projection(ambiguity_test_t *amb_test, const u8 num_dds_in_inte
   memcpy(intersection.intersection_ndxs, dd_intersection_ndxs, num_dds_in_intersection * sizeof(u8));
 
 
-  printf("IAR: %"PRIu32" hypotheses before projection\n", memory_pool_n_allocated(amb_test->pool));
+  DIAG(DIAG_INFO, DIAG_EVENT_IAR_HYPOTHESES,
+       "IAR: %"PRIu32" hypotheses before projection", memory_pool_n_allocated(amb_test->pool));
   memory_pool_group_by(amb_test->pool,
                        &intersection, &projection_comparator,
                        &intersection, sizeof(intersection),
                        &projection_aggregator);
-  printf("IAR: updates to %"PRIu32"\n", memory_pool_n_allocated(amb_test->pool));
+  DIAG(DIAG_INFO, DIAG_EVENT_IAR_HYPOTHESES,
+       "IAR: updates to %"PRIu32, memory_pool_n_allocated(amb_test->pool));
   u8 work_prns[MAX_CHANNELS];
   memcpy(work_prns, amb_test->sats.prns, amb_test->sats.num_sats * sizeof(u8));
   for (u8 i=0; i<num_dds_in_intersection; i++) {
@@ -1000,17 +1009,20 @@ static void remap_prns(ambiguity_test_t *amb_test, u8 ref_prn,
       j++;
       k++;
     } else {
-      printf("This method is being used improperly. This shouldn't happen.\n");
-      printf("old_prns = [");
-      for (u8 ii=0; ii < x->old_dim; ii++) {
-        printf("%d, ",old_prns[ii]);
-      }
-      printf("]\n");
-      printf("added_prns = [");
-      for (u8 jj=0; jj < x->old_dim; jj++) {
-        printf("%d, ", added_prns[jj]);
+      DIAG(DIAG_ERROR, DIAG_EVENT_IAR_MISUSE,
+           "This method is being used improperly. This shouldn't happen.");
+      if (DEBUG_AMBIGUITY_TEST) {
+        printf("old_prns = [");
+        for (u8 ii=0; ii < x->old_dim; ii++) {
+          printf("%d, ",old_prns[ii]);
+        }
+        printf("]\n");
+        printf("added_prns = [");
+        for (u8 jj=0; jj < x->old_dim; jj++) {
+          printf("%d, ", added_prns[jj]);
+        }
+        printf("]\n");
       }
-      printf("]\n");
       break;
     }
   }
@@ -1102,8 +1114,9 @@ s32 add_sats(ambiguity_test_t *amb_test,
                   &intersection_hypothesis_prod);
   (void) count;
   s32 num_hyps = memory_pool_n_allocated(amb_test->pool);
-  printf("IAR: updates to %"PRIu32"\n", num_hyps);
-  printf("add_sats. num sats: %i\n", amb_test->sats.num_sats);
+  DIAG(DIAG_INFO, DIAG_EVENT_IAR_HYPOTHESES,
+       "IAR: updates to %"PRIu32", add_sats. num sats: %i",
+       num_hyps, amb_test->sats.num_sats);
   return num_hyps;
 }
 
@@ -1862,17 +1875,20 @@ void add_sats_old(ambiguity_test_t *amb_test,
       j++;
       k++;
     } else {
-      printf("This method is being used improperly. This shouldn't happen.\n");
-      printf("old_prns = [");
-      for (u8 ii=0; ii < x0.num_old_dds; ii++) {
-        printf("%d, ",old_prns[ii]);
-      }
-      printf("]\n");
-      printf("added_prns = [");
-      for (u8 jj=0; jj < x0.num_old_dds; jj++) {
-        printf("%d, ", added_prns[jj]);
+      DIAG(DIAG_ERROR, DIAG_EVENT_IAR_MISUSE,
+           "This method is being used improperly. This shouldn't happen.");
+      if (DEBUG_AMBIGUITY_TEST) {
+        printf("old_prns = [");
+        for (u8 ii=0; ii < x0.num_old_dds; ii++) {
+          printf("%d, ",old_prns[ii]);
+        }
+        printf("]\n");
+        printf("added_prns = [");
+        for (u8 jj=0; jj < x0.num_old_dds; jj++) {
+          printf("%d, ", added_prns[jj]);
+        }
+        printf("]\n");
       }
-      printf("]\n");
       break;
     }
   }
@@ -1885,7 +1901,8 @@ void add_sats_old(ambiguity_test_t *amb_test,
     empty_element->ll = 0; // only in init
   }
 
-  printf("IAR: %"PRIu32" hypotheses before inclusion\n", memory_pool_n_allocated(amb_test->pool));
+  DIAG(DIAG_INFO, DIAG_EVENT_IAR_HYPOTHESES,
+       "IAR: %"PRIu32" hypotheses before inclusion", memory_pool_n_allocated(amb_test->pool));
   if (DEBUG_AMBIGUITY_TEST) {
     memory_pool_map(amb_test->pool, &x0.num_old_dds, &print_hyp);
   }
@@ -1893,7 +1910,8 @@ void add_sats_old(ambiguity_test_t *amb_test,
   /* Take the product of our current hypothesis state with the generator, recorrelating the new ones as we go. */
   memory_pool_product_generator(amb_test->pool, &x0, MAX_HYPOTHESES, sizeof(x0),
                                 &no_init, &generate_next_hypothesis, &hypothesis_prod);
-  printf("IAR: updates to %"PRIu32"\n", memory_pool_n_allocated(amb_test->pool));
+  DIAG(DIAG_INFO, DIAG_EVENT_IAR_HYPOTHESES,
+       "IAR: updates to %"PRIu32, memory_pool_n_allocated(amb_test->pool));
   if (DEBUG_AMBIGUITY_TEST) {
     memory_pool_map(amb_test->pool, &k, &print_hyp);
   }
@@ -225,7 +225,7 @@ void wgsecef2llh(const double ecef[3], double llh[3]) {
  *                 [X, Y, Z], all in meters.
  * \param M        3x3 matrix to be populated with rotation matrix.
  */
-static void ecef2ned_matrix(const double ref_ecef[3], double M[3][3]) {
+void ecef2ned_matrix(const double ref_ecef[3], double M[3][3]) {
   double hyp_az, hyp_el;
   double sin_el, cos_el, sin_az, cos_az;
 
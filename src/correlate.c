@@ -11,48 +11,81 @@
  */
 
 #include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef __SSSE3__
 #include <tmmintrin.h>
 #endif
 
+#include "cpu_features.h"
+#include "prns.h"
 #include "correlate.h"
 
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
 /** \defgroup corr Correlation
  * Correlators used for tracking.
  * \{ */
 
-#ifndef __SSSE3__
+/** Fractional bits of the fixed point code NCO. */
+#define CODE_NCO_FRAC_BITS 32
+/** One chip in code NCO units. */
+#define CODE_NCO_ONE ((u64)1 << CODE_NCO_FRAC_BITS)
 
-void track_correlate(s8* samples, s8* code,
-                     double* init_code_phase, double code_step, double* init_carr_phase, double carr_step,
-                     double* I_E, double* Q_E, double* I_P, double* Q_P, double* I_L, double* Q_L, u32* num_samples)
+/** Convert a code phase or code step in chips to fixed point code NCO
+ * units. */
+static inline u64 code_nco(double chips)
 {
-  double code_phase = *init_code_phase;
-  double carr_phase = *init_carr_phase;
+  return (u64)llround(chips * CODE_NCO_ONE);
+}
+
+/** Wrap a code phase below -0.5 chips, where the early chip would lie
+ * before the guard chip at the start of the replica and code_nco() would be
+ * given a negative value, forward into the code period it lies in. The
+ * correlators then integrate up to the end of that period. */
+static inline double code_phase_wrap(double code_phase)
+{
+  if (code_phase < -0.5)
+    code_phase += 1023 * ceil((-0.5 - code_phase) / 1023);
+  return code_phase;
+}
 
+static corr_mode_t corr_mode = CORR_MODE_FLOAT;
+
+#ifndef __SSSE3__
+
+/** Floating point correlator, correlates `n` samples into the I_E, Q_E, I_P,
+ * Q_P, I_L, Q_L accumulators `acc`. */
+static void corr_float(const s8* samples, const s8* code, u32 n,
+                       double code_phase, double code_step,
+                       double carr_phase, double carr_step,
+                       double acc[6])
+{
   double carr_sin = sin(carr_phase);
   double carr_cos = cos(carr_phase);
   double sin_delta = sin(carr_step);
   double cos_delta = cos(carr_step);
 
-  *I_E = *Q_E = *I_P = *Q_P = *I_L = *Q_L = 0;
+  double I_E = 0, Q_E = 0, I_P = 0, Q_P = 0, I_L = 0, Q_L = 0;
 
   double code_E, code_P, code_L;
   double baseband_Q, baseband_I;
 
-  *num_samples = (int)ceil((1023.0 - code_phase) / code_step);
+  /* Integer code NCO tracking the early code phase, the chip indices are
+   * then just shifts rather than float to int conversions. */
+  u64 nco = code_nco(code_phase + 0.5);
+  u64 nco_step = code_nco(code_step);
 
-  for (u32 i=0; i<*num_samples; i++) {
-    /*code_E = get_chip(code, (int)ceil(code_phase-0.5));*/
-    /*code_P = get_chip(code, (int)ceil(code_phase));*/
-    /*code_L = get_chip(code, (int)ceil(code_phase+0.5));*/
-    /*code_E = code[(int)ceil(code_phase-0.5)];*/
-    /*code_P = code[(int)ceil(code_phase)];*/
-    /*code_L = code[(int)ceil(code_phase+0.5)];*/
-    code_E = code[(int)(code_phase+0.5)];
-    code_P = code[(int)(code_phase+1.0)];
-    code_L = code[(int)(code_phase+1.5)];
+  for (u32 i=0; i<n; i++) {
+    code_E = code[nco >> CODE_NCO_FRAC_BITS];
+    code_P = code[(nco + CODE_NCO_ONE/2) >> CODE_NCO_FRAC_BITS];
+    code_L = code[(nco + CODE_NCO_ONE) >> CODE_NCO_FRAC_BITS];
 
     baseband_Q = carr_cos * samples[i];
     baseband_I = carr_sin * samples[i];
@@ -63,35 +96,38 @@ void track_correlate(s8* samples, s8* code,
     carr_sin = carr_sin_ * i_mag;
     carr_cos = carr_cos_ * i_mag;
 
-    *I_E += code_E * baseband_I;
-    *Q_E += code_E * baseband_Q;
-    *I_P += code_P * baseband_I;
-    *Q_P += code_P * baseband_Q;
-    *I_L += code_L * baseband_I;
-    *Q_L += code_L * baseband_Q;
+    I_E += code_E * baseband_I;
+    Q_E += code_E * baseband_Q;
+    I_P += code_P * baseband_I;
+    Q_P += code_P * baseband_Q;
+    I_L += code_L * baseband_I;
+    Q_L += code_L * baseband_Q;
 
-    code_phase += code_step;
-    carr_phase += carr_step;
+    nco += nco_step;
   }
-  *init_code_phase = code_phase - 1023;
-  *init_carr_phase = fmod(carr_phase, 2*M_PI);
+
+  acc[0] += I_E;
+  acc[1] += Q_E;
+  acc[2] += I_P;
+  acc[3] += Q_P;
+  acc[4] += I_L;
+  acc[5] += Q_L;
 }
 
 #else
 
-void track_correlate(s8* samples, s8* code,
-                     double* init_code_phase, double code_step, double* init_carr_phase, double carr_step,
-                     double* I_E, double* Q_E, double* I_P, double* Q_P, double* I_L, double* Q_L, u32* num_samples)
+/** Floating point correlator, correlates `n` samples into the I_E, Q_E, I_P,
+ * Q_P, I_L, Q_L accumulators `acc`. */
+static void corr_float(const s8* samples, const s8* code, u32 n,
+                       double code_phase, double code_step,
+                       double carr_phase, double carr_step,
+                       double acc[6])
 {
-  double code_phase = *init_code_phase;
-
-  float carr_sin = sin(*init_carr_phase);
-  float carr_cos = cos(*init_carr_phase);
+  float carr_sin = sin(carr_phase);
+  float carr_cos = cos(carr_phase);
   float sin_delta = sin(carr_step);
   float cos_delta = cos(carr_step);
 
-  *num_samples = (int)ceil((1023.0 - code_phase) / code_step);
-
   __m128 IE_QE_IP_QP;
   __m128 CE_CE_CP_CP;
   __m128 IL_QL_X_X;
@@ -106,14 +142,20 @@ void track_correlate(s8* samples, s8* code,
   S_C_S_C = _mm_set_ps(carr_sin, carr_cos, carr_sin, carr_cos);
   dC_dS_dS_dC = _mm_set_ps(cos_delta, sin_delta, sin_delta, cos_delta);
 
-  for (u32 i=0; i<*num_samples; i++) {
-    CE_CE_CP_CP = _mm_set_ps(code[(int)(code_phase+0.5)],
-                             code[(int)(code_phase+0.5)],
-                             code[(int)(code_phase+1.0)],
-                             code[(int)(code_phase+1.0)]);
-    CL_CL_X_X = _mm_set_ps(code[(int)(code_phase+1.5)],
-                           code[(int)(code_phase+1.5)],
-                           0, 0);
+  /* Integer code NCO tracking the early code phase, the chip indices are
+   * then just shifts rather than float to int conversions. */
+  u64 nco = code_nco(code_phase + 0.5);
+  u64 nco_step = code_nco(code_step);
+
+  /* The early, prompt and late chips are still read one at a time per
+   * sample, the integer NCO only saves the float to int conversions. Only
+   * the multi-channel kernels load the replica a vector at a time. */
+  for (u32 i=0; i<n; i++) {
+    float code_E = code[nco >> CODE_NCO_FRAC_BITS];
+    float code_P = code[(nco + CODE_NCO_ONE/2) >> CODE_NCO_FRAC_BITS];
+    float code_L = code[(nco + CODE_NCO_ONE) >> CODE_NCO_FRAC_BITS];
+    CE_CE_CP_CP = _mm_set_ps(code_E, code_E, code_P, code_P);
+    CL_CL_X_X = _mm_set_ps(code_L, code_L, 0, 0);
 
     /* Load sample and multiply by sin/cos carrier to mix down to baseband. */
     a1 = _mm_set1_ps((float)samples[i]); // S, S, S, S
@@ -135,25 +177,1299 @@ void track_correlate(s8* samples, s8* code,
     IE_QE_IP_QP = _mm_add_ps(IE_QE_IP_QP, a1);
     IL_QL_X_X   = _mm_add_ps(IL_QL_X_X, a2);
 
-    code_phase += code_step;
+    nco += nco_step;
   }
-  *init_code_phase = code_phase - 1023;
-  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
 
   float res[8];
   _mm_storeu_ps(res, IE_QE_IP_QP);
   _mm_storeu_ps(res+4, IL_QL_X_X);
 
-  *I_E = res[3];
-  *Q_E = res[2];
-  *I_P = res[1];
-  *Q_P = res[0];
-  *I_L = res[7];
-  *Q_L = res[6];
+  acc[0] += res[3];
+  acc[1] += res[2];
+  acc[2] += res[1];
+  acc[3] += res[0];
+  acc[4] += res[7];
+  acc[5] += res[6];
 }
 
 #endif /* !__SSSE3__ */
 
+/** Number of bits of carrier phase used to index the carrier lookup table. */
+#define CARR_LUT_BITS 8
+/** Amplitude of the carrier lookup table. */
+#define CARR_LUT_AMPL 127
+
+/* Carrier lookup tables, lround(CARR_LUT_AMPL * sin(2 pi i / 256)) and the
+ * same for cos. Constant so that they can be read from any thread. */
+static const s8 carr_lut_sin[1 << CARR_LUT_BITS] = {
+  0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34,
+  37, 40, 43, 46, 49, 51, 54, 57, 60, 63, 65, 68,
+  71, 73, 76, 78, 81, 83, 85, 88, 90, 92, 94, 96,
+  98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+  117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126,
+  126, 127, 127, 127, 127, 127, 127, 127, 126, 126, 126, 125,
+  125, 124, 123, 122, 122, 121, 120, 118, 117, 116, 115, 113,
+  112, 111, 109, 107, 106, 104, 102, 100, 98, 96, 94, 92,
+  90, 88, 85, 83, 81, 78, 76, 73, 71, 68, 65, 63,
+  60, 57, 54, 51, 49, 46, 43, 40, 37, 34, 31, 28,
+  25, 22, 19, 16, 12, 9, 6, 3, 0, -3, -6, -9,
+  -12, -16, -19, -22, -25, -28, -31, -34, -37, -40, -43, -46,
+  -49, -51, -54, -57, -60, -63, -65, -68, -71, -73, -76, -78,
+  -81, -83, -85, -88, -90, -92, -94, -96, -98, -100, -102, -104,
+  -106, -107, -109, -111, -112, -113, -115, -116, -117, -118, -120, -121,
+  -122, -122, -123, -124, -125, -125, -126, -126, -126, -127, -127, -127,
+  -127, -127, -127, -127, -126, -126, -126, -125, -125, -124, -123, -122,
+  -122, -121, -120, -118, -117, -116, -115, -113, -112, -111, -109, -107,
+  -106, -104, -102, -100, -98, -96, -94, -92, -90, -88, -85, -83,
+  -81, -78, -76, -73, -71, -68, -65, -63, -60, -57, -54, -51,
+  -49, -46, -43, -40, -37, -34, -31, -28, -25, -22, -19, -16,
+  -12, -9, -6, -3,
+};
+static const s8 carr_lut_cos[1 << CARR_LUT_BITS] = {
+  127, 127, 127, 127, 126, 126, 126, 125, 125, 124, 123, 122,
+  122, 121, 120, 118, 117, 116, 115, 113, 112, 111, 109, 107,
+  106, 104, 102, 100, 98, 96, 94, 92, 90, 88, 85, 83,
+  81, 78, 76, 73, 71, 68, 65, 63, 60, 57, 54, 51,
+  49, 46, 43, 40, 37, 34, 31, 28, 25, 22, 19, 16,
+  12, 9, 6, 3, 0, -3, -6, -9, -12, -16, -19, -22,
+  -25, -28, -31, -34, -37, -40, -43, -46, -49, -51, -54, -57,
+  -60, -63, -65, -68, -71, -73, -76, -78, -81, -83, -85, -88,
+  -90, -92, -94, -96, -98, -100, -102, -104, -106, -107, -109, -111,
+  -112, -113, -115, -116, -117, -118, -120, -121, -122, -122, -123, -124,
+  -125, -125, -126, -126, -126, -127, -127, -127, -127, -127, -127, -127,
+  -126, -126, -126, -125, -125, -124, -123, -122, -122, -121, -120, -118,
+  -117, -116, -115, -113, -112, -111, -109, -107, -106, -104, -102, -100,
+  -98, -96, -94, -92, -90, -88, -85, -83, -81, -78, -76, -73,
+  -71, -68, -65, -63, -60, -57, -54, -51, -49, -46, -43, -40,
+  -37, -34, -31, -28, -25, -22, -19, -16, -12, -9, -6, -3,
+  0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34,
+  37, 40, 43, 46, 49, 51, 54, 57, 60, 63, 65, 68,
+  71, 73, 76, 78, 81, 83, 85, 88, 90, 92, 94, 96,
+  98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+  117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126,
+  126, 127, 127, 127,
+};
+
+/** Convert a carrier phase or phase step in radians to 32-bit carrier NCO
+ * units, a full cycle wraps the accumulator. */
+static inline u32 carr_nco(double radians)
+{
+  double cycles = radians / (2*M_PI);
+  return (u32)(s64)llround((cycles - floor(cycles)) * 4294967296.0);
+}
+
+/** Index of the carrier lookup table entry nearest to a carrier NCO value. */
+static inline u32 carr_lut_idx(u32 nco)
+{
+  return (nco + (1u << (31 - CARR_LUT_BITS))) >> (32 - CARR_LUT_BITS);
+}
+
+/** NCO and accumulator state of the fixed point correlator. */
+typedef struct {
+  u64 code_nco;  /**< Early code phase, see code_nco(). */
+  u64 code_step; /**< Code NCO increment per sample. */
+  u32 carr_nco;  /**< Carrier phase, see carr_nco(). */
+  u32 carr_step; /**< Carrier NCO increment per sample. */
+  s32 acc[6];    /**< I_E, Q_E, I_P, Q_P, I_L, Q_L accumulators. */
+} corr_fixed_t;
+
+/** Reference fixed point correlator, correlates `n` samples.
+ * The SIMD kernels must agree with this exactly. */
+static void corr_fixed_generic(const s8* samples, const s8* code, u32 n,
+                               corr_fixed_t *f)
+{
+  for (u32 i=0; i<n; i++) {
+    s32 code_E = code[f->code_nco >> CODE_NCO_FRAC_BITS];
+    s32 code_P = code[(f->code_nco + CODE_NCO_ONE/2) >> CODE_NCO_FRAC_BITS];
+    s32 code_L = code[(f->code_nco + CODE_NCO_ONE) >> CODE_NCO_FRAC_BITS];
+
+    u32 idx = carr_lut_idx(f->carr_nco);
+    s32 baseband_I = carr_lut_sin[idx] * samples[i];
+    s32 baseband_Q = carr_lut_cos[idx] * samples[i];
+
+    f->acc[0] += code_E * baseband_I;
+    f->acc[1] += code_E * baseband_Q;
+    f->acc[2] += code_P * baseband_I;
+    f->acc[3] += code_P * baseband_Q;
+    f->acc[4] += code_L * baseband_I;
+    f->acc[5] += code_L * baseband_Q;
+
+    f->code_nco += f->code_step;
+    f->carr_nco += f->carr_step;
+  }
+}
+
+#ifdef CPU_FEATURES_X86
+
+/** SSSE3 fixed point correlator, correlates `n` samples.
+ *
+ * The carrier and code values for each block of 16 samples are looked up
+ * into small buffers, the sign of each sample is then moved onto the carrier
+ * so `pmaddubsw` can multiply the unsigned sample magnitudes by the signed
+ * carrier times code, giving pairwise sums which are widened and accumulated
+ * with `pmaddwd`. */
+__attribute__((target("ssse3")))
+static void corr_fixed_ssse3(const s8* samples, const s8* code, u32 n,
+                             corr_fixed_t *f)
+{
+  __m128i acc[6];
+  for (u32 j=0; j<6; j++)
+    acc[j] = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  s8 carr_sin[16] __attribute__((aligned(16)));
+  s8 carr_cos[16] __attribute__((aligned(16)));
+  s8 code_EPL[3][16] __attribute__((aligned(16)));
+
+  u32 i;
+  for (i=0; i+16<=n; i+=16) {
+    for (u32 k=0; k<16; k++) {
+      u32 idx = carr_lut_idx(f->carr_nco);
+      carr_sin[k] = carr_lut_sin[idx];
+      carr_cos[k] = carr_lut_cos[idx];
+      code_EPL[0][k] = code[f->code_nco >> CODE_NCO_FRAC_BITS];
+      code_EPL[1][k] = code[(f->code_nco + CODE_NCO_ONE/2)
+                            >> CODE_NCO_FRAC_BITS];
+      code_EPL[2][k] = code[(f->code_nco + CODE_NCO_ONE)
+                            >> CODE_NCO_FRAC_BITS];
+      f->code_nco += f->code_step;
+      f->carr_nco += f->carr_step;
+    }
+
+    __m128i s = _mm_loadu_si128((const __m128i *)&samples[i]);
+    __m128i s_abs = _mm_abs_epi8(s);
+    /* Carrier times the sign of the sample, the magnitude is applied by the
+     * multiply-add. Carrier values are at most 127 in magnitude so the
+     * pairwise sums of up to 128 * 127 can't saturate. */
+    __m128i bb_I = _mm_sign_epi8(_mm_load_si128((__m128i *)carr_sin), s);
+    __m128i bb_Q = _mm_sign_epi8(_mm_load_si128((__m128i *)carr_cos), s);
+
+    for (u32 j=0; j<3; j++) {
+      __m128i c = _mm_load_si128((__m128i *)code_EPL[j]);
+      __m128i p_I = _mm_maddubs_epi16(s_abs, _mm_sign_epi8(bb_I, c));
+      __m128i p_Q = _mm_maddubs_epi16(s_abs, _mm_sign_epi8(bb_Q, c));
+      acc[2*j] = _mm_add_epi32(acc[2*j], _mm_madd_epi16(p_I, ones));
+      acc[2*j+1] = _mm_add_epi32(acc[2*j+1], _mm_madd_epi16(p_Q, ones));
+    }
+  }
+
+  for (u32 j=0; j<6; j++) {
+    s32 lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc[j]);
+    f->acc[j] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+
+  corr_fixed_generic(&samples[i], code, n - i, f);
+}
+
+#endif /* CPU_FEATURES_X86 */
+
+/** Fixed point correlator, correlates `n` samples into the I_E, Q_E, I_P,
+ * Q_P, I_L, Q_L accumulators `acc`, scaled to match corr_float(). */
+static void corr_fixed(const s8* samples, const s8* code, u32 n,
+                       double code_phase, double code_step,
+                       double carr_phase, double carr_step,
+                       double acc[6])
+{
+  corr_fixed_t f = {
+    .code_nco = code_nco(code_phase + 0.5),
+    .code_step = code_nco(code_step),
+    .carr_nco = carr_nco(carr_phase),
+    .carr_step = carr_nco(carr_step),
+  };
+
+#ifdef CPU_FEATURES_X86
+  if (cpu_features() & CPU_FEATURE_SSSE3)
+    corr_fixed_ssse3(samples, code, n, &f);
+  else
+#endif
+    corr_fixed_generic(samples, code, n, &f);
+
+  for (u32 j=0; j<6; j++)
+    acc[j] += (double)f.acc[j] / CARR_LUT_AMPL;
+}
+
+/** Correlate `n` samples with the arithmetic selected by
+ * track_correlate_set_mode(), adding to the accumulators `acc`. */
+static void corr_samples(const s8* samples, const s8* code, u32 n,
+                         double code_phase, double code_step,
+                         double carr_phase, double carr_step,
+                         double acc[6])
+{
+  if (track_correlate_get_mode() == CORR_MODE_FIXED)
+    corr_fixed(samples, code, n, code_phase, code_step,
+               carr_phase, carr_step, acc);
+  else
+    corr_float(samples, code, n, code_phase, code_step,
+               carr_phase, carr_step, acc);
+}
+
+/** Select the arithmetic used by track_correlate() and
+ * track_correlate_multi().
+ *
+ * In `CORR_MODE_FIXED` the carrier is generated by a 32-bit phase
+ * accumulator indexing a 256 entry, 8-bit sin/cos table and the products
+ * are accumulated as integers. The correlations are scaled back to the same
+ * units as the floating point correlator, they agree to within the carrier
+ * table quantisation, i.e. well under 1% of the total sample magnitude.
+ *
+ * The integer accumulators are 32 bits, which limits a single call to
+ * around 130000 samples at full scale 8-bit input, far more than one code
+ * period at any practical sample rate.
+ *
+ * The mode is shared by all threads. Set it before starting any threads
+ * that correlate, e.g. acq_sched_search(), as a change part way through
+ * takes effect at each thread's next call.
+ *
+ * \param mode Correlator mode, `CORR_MODE_FLOAT` is the default.
+ */
+void track_correlate_set_mode(corr_mode_t mode)
+{
+  __atomic_store_n(&corr_mode, mode, __ATOMIC_RELAXED);
+}
+
+/** Get the correlator mode selected with track_correlate_set_mode().
+ *
+ * \return Current correlator mode.
+ */
+corr_mode_t track_correlate_get_mode(void)
+{
+  return __atomic_load_n(&corr_mode, __ATOMIC_RELAXED);
+}
+
+/** Correlate a block of samples against early, prompt and late code replicas.
+ *
+ * Mixes the samples down to baseband with a carrier NCO and correlates them
+ * against the code replica at half a chip early, prompt and half a chip late,
+ * integrating up to the next code rollover.
+ *
+ * The code replica is indexed with one guard chip at each end, i.e.
+ * `code[i+1]` is chip `i` of the code, `code[0]` is the last chip and
+ * `code[1024]` is the first chip again, 1025 entries in total. A code
+ * phase below -0.5 chips is wrapped forward by whole code periods, so the
+ * correlation runs to the end of the period that phase lies in.
+ *
+ * The arithmetic used is selected with track_correlate_set_mode().
+ *
+ * \param samples         Samples, starting at the first sample to correlate.
+ * \param code            Code replica with guard chips.
+ * \param init_code_phase Code phase in chips of the first sample, updated
+ *                        to the code phase after the rollover.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase in radians of the first sample,
+ *                        updated to the carrier phase after the last sample.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation.
+ * \param Q_E             Early quadrature correlation.
+ * \param I_P             Prompt in-phase correlation.
+ * \param Q_P             Prompt quadrature correlation.
+ * \param I_L             Late in-phase correlation.
+ * \param Q_L             Late quadrature correlation.
+ * \param num_samples     Number of samples correlated.
+ */
+void track_correlate(const s8* samples, const s8* code,
+                     double* init_code_phase, double code_step,
+                     double* init_carr_phase, double carr_step,
+                     double* I_E, double* Q_E,
+                     double* I_P, double* Q_P,
+                     double* I_L, double* Q_L,
+                     u32* num_samples)
+{
+  double code_phase = code_phase_wrap(*init_code_phase);
+  *num_samples = (int)ceil((1023.0 - code_phase) / code_step);
+
+  double acc[6] = {0};
+  corr_samples(samples, code, *num_samples, code_phase, code_step,
+               *init_carr_phase, carr_step, acc);
+
+  *I_E = acc[0];
+  *Q_E = acc[1];
+  *I_P = acc[2];
+  *Q_P = acc[3];
+  *I_L = acc[4];
+  *Q_L = acc[5];
+
+  *init_code_phase = code_phase + *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+}
+
+/** Correlate over several code periods in one call.
+ *
+ * Integrates `n_periods` code periods, handling the code rollovers
+ * internally, as if track_correlate() were called once per period. The
+ * integration can also be cut short after `max_samples` samples, in which
+ * case the last period is partial and the code phase is left part way
+ * through it, so a following call carries on from the next sample.
+ *
+ * The correlations of each period are returned unmodified so that bit
+ * synchronisation can still work period by period, while the totals have
+ * the navigation bit signs wiped off: bit `k` of `bit_signs` set negates
+ * period `k` before it is added in. Once the bit edges and the bits are
+ * known, a whole bit can then be integrated coherently in a single call.
+ *
+ * \param samples         Samples, starting at the first sample to correlate.
+ * \param code            Code replica with guard chips, see
+ *                        track_correlate().
+ * \param init_code_phase Code phase in chips of the first sample, updated
+ *                        to the code phase of the sample after the last,
+ *                        less 1023 chips if that ended a code period.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase in radians of the first sample,
+ *                        updated to the carrier phase after the last sample.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param n_periods       Number of code periods to integrate, at most
+ *                        `CORR_MAX_PERIODS`.
+ * \param max_samples     Maximum number of samples to correlate, 0 for no
+ *                        limit.
+ * \param bit_signs       Sign wipe-off mask, 0 to add all periods as they
+ *                        are.
+ * \param periods         Correlations of each period, or NULL if not
+ *                        wanted.
+ * \param total           Sum of the correlations of all the periods after
+ *                        sign wipe-off, and the total number of samples.
+ * \return Number of periods correlated, including a partial last period.
+ */
+u8 track_correlate_periods(const s8* samples, const s8* code,
+                           double* init_code_phase, double code_step,
+                           double* init_carr_phase, double carr_step,
+                           u8 n_periods, u32 max_samples, u32 bit_signs,
+                           corr_period_t periods[], corr_period_t* total)
+{
+  if (n_periods > CORR_MAX_PERIODS)
+    n_periods = CORR_MAX_PERIODS;
+
+  double total_acc[6] = {0};
+  u32 n_total = 0;
+  u8 k;
+
+  for (k=0; k<n_periods; k++) {
+    if (max_samples && n_total == max_samples)
+      break;
+
+    double code_phase = code_phase_wrap(*init_code_phase);
+    u32 n = (int)ceil((1023.0 - code_phase) / code_step);
+    bool rollover = true;
+    if (max_samples && n > max_samples - n_total) {
+      n = max_samples - n_total;
+      rollover = false;
+    }
+
+    double acc[6] = {0};
+    corr_samples(&samples[n_total], code, n, code_phase, code_step,
+                 *init_carr_phase, carr_step, acc);
+
+    double sign = (bit_signs >> k) & 1 ? -1 : 1;
+    for (u32 j=0; j<6; j++)
+      total_acc[j] += sign * acc[j];
+
+    if (periods)
+      periods[k] = (corr_period_t){
+        .I_E = acc[0], .Q_E = acc[1],
+        .I_P = acc[2], .Q_P = acc[3],
+        .I_L = acc[4], .Q_L = acc[5],
+        .num_samples = n,
+      };
+
+    n_total += n;
+    *init_code_phase = code_phase + n * code_step - (rollover ? 1023 : 0);
+    *init_carr_phase = fmod(*init_carr_phase + n*carr_step, 2*M_PI);
+  }
+
+  *total = (corr_period_t){
+    .I_E = total_acc[0], .Q_E = total_acc[1],
+    .I_P = total_acc[2], .Q_P = total_acc[3],
+    .I_L = total_acc[4], .Q_L = total_acc[5],
+    .num_samples = n_total,
+  };
+
+  return k;
+}
+
+/** Number of samples mixed down to baseband at a time by
+ * track_correlate_taps(). */
+#define TAPS_BLOCK_LEN 256
+
+/** Correlate a block of samples against any number of code replicas at
+ * arbitrary offsets.
+ *
+ * Works like track_correlate(), integrating up to the next code rollover,
+ * but instead of the fixed early, prompt and late replicas the samples are
+ * correlated against `n_taps` replicas offset from the prompt code phase by
+ * `tap_offsets`. The carrier is only mixed off once per sample however many
+ * taps there are, so very early and very late taps or a whole bank of taps
+ * tracing out the shape of the correlation peak, e.g. to detect multipath,
+ * can be computed in the same pass as the early, prompt and late taps that
+ * drive the tracking loops. The offsets can be any size, the code wraps
+ * around the code period.
+ *
+ * The correlations are always computed in floating point, whatever mode is
+ * set with track_correlate_set_mode().
+ *
+ * \param samples         Samples, starting at the first sample to correlate.
+ * \param code            Code replica with guard chips, see
+ *                        track_correlate().
+ * \param init_code_phase Prompt code phase in chips of the first sample,
+ *                        updated to the code phase after the rollover.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase in radians of the first sample,
+ *                        updated to the carrier phase after the last sample.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param n_taps          Number of taps, at most `CORR_MAX_TAPS`.
+ * \param tap_offsets     Offset of each tap from the prompt in chips,
+ *                        negative for early taps, e.g. -0.5, 0, 0.5 for the
+ *                        correlations given by track_correlate().
+ * \param corrs           Correlation of each tap.
+ * \param num_samples     Number of samples correlated.
+ */
+void track_correlate_taps(const s8* samples, const s8* code,
+                          double* init_code_phase, double code_step,
+                          double* init_carr_phase, double carr_step,
+                          u8 n_taps, const float tap_offsets[],
+                          correlation_t corrs[], u32* num_samples)
+{
+  if (n_taps > CORR_MAX_TAPS)
+    n_taps = CORR_MAX_TAPS;
+
+  double code_phase = code_phase_wrap(*init_code_phase);
+  *num_samples = (int)ceil((1023.0 - code_phase) / code_step);
+
+  /* Code NCO of each tap, offset by one chip so that, as for the early,
+   * prompt and late taps of track_correlate(), the replica index is just a
+   * shift. Taps are started within the first code period and wrapped back
+   * when they run off the guard chip at the end of the replica. */
+  u64 nco[CORR_MAX_TAPS];
+  u64 nco_step = code_nco(code_step);
+  for (u8 t=0; t<n_taps; t++) {
+    double start = fmod(code_phase + tap_offsets[t] + 1, 1023);
+    if (start < 0)
+      start += 1023;
+    nco[t] = code_nco(start);
+  }
+  const u64 wrap = 1024 * CODE_NCO_ONE;
+  const u64 period = 1023 * CODE_NCO_ONE;
+
+  float acc_I[CORR_MAX_TAPS] = {0}, acc_Q[CORR_MAX_TAPS] = {0};
+  float bb_I[TAPS_BLOCK_LEN], bb_Q[TAPS_BLOCK_LEN];
+  float tap_code[TAPS_BLOCK_LEN];
+
+  /* Carrier rotation from the start of a block to each sample in it, the
+   * carrier is then generated for a whole block without a dependency from
+   * one sample to the next. */
+  float rot_sin[TAPS_BLOCK_LEN], rot_cos[TAPS_BLOCK_LEN];
+  double r_sin = 0, r_cos = 1;
+  double sin_delta = sin(carr_step);
+  double cos_delta = cos(carr_step);
+  for (u32 k=0; k<TAPS_BLOCK_LEN; k++) {
+    rot_sin[k] = r_sin;
+    rot_cos[k] = r_cos;
+    double r_sin_ = r_sin*cos_delta + r_cos*sin_delta;
+    r_cos = r_cos*cos_delta - r_sin*sin_delta;
+    r_sin = r_sin_;
+  }
+
+  for (u32 i=0; i<*num_samples; i+=TAPS_BLOCK_LEN) {
+    u32 n = *num_samples - i;
+    if (n > TAPS_BLOCK_LEN)
+      n = TAPS_BLOCK_LEN;
+
+    /* Mix the block down to baseband once for all the taps. */
+    double carr_phase = *init_carr_phase + i*carr_step;
+    float carr_sin = sin(carr_phase);
+    float carr_cos = cos(carr_phase);
+    for (u32 k=0; k<n; k++) {
+      float s_k = carr_sin*rot_cos[k] + carr_cos*rot_sin[k];
+      float c_k = carr_cos*rot_cos[k] - carr_sin*rot_sin[k];
+      bb_I[k] = s_k * samples[i + k];
+      bb_Q[k] = c_k * samples[i + k];
+    }
+
+    for (u8 t=0; t<n_taps; t++) {
+      /* Look up the tap's code for the block, wrapping it back to the start
+       * of the replica when it runs off the guard chip at the end. */
+      u64 tap_nco = nco[t];
+      u32 k = 0;
+      while (k < n) {
+        u32 m = n;
+        if (tap_nco + (u64)(n - k) * nco_step >= wrap)
+          m = k + (wrap - 1 - tap_nco) / nco_step + 1;
+        for (; k<m; k++) {
+          tap_code[k] = code[tap_nco >> CODE_NCO_FRAC_BITS];
+          tap_nco += nco_step;
+        }
+        if (tap_nco >= wrap)
+          tap_nco -= period;
+      }
+      nco[t] = tap_nco;
+
+      /* Interleaved partial sums break the dependency between samples. */
+      float I[4] = {0}, Q[4] = {0};
+      for (k=0; k+4<=n; k+=4) {
+        for (u32 j=0; j<4; j++) {
+          I[j] += tap_code[k + j] * bb_I[k + j];
+          Q[j] += tap_code[k + j] * bb_Q[k + j];
+        }
+      }
+      for (; k<n; k++) {
+        I[0] += tap_code[k] * bb_I[k];
+        Q[0] += tap_code[k] * bb_Q[k];
+      }
+      acc_I[t] += (I[0] + I[1]) + (I[2] + I[3]);
+      acc_Q[t] += (Q[0] + Q[1]) + (Q[2] + Q[3]);
+    }
+  }
+
+  for (u8 t=0; t<n_taps; t++) {
+    corrs[t].I = acc_I[t];
+    corrs[t].Q = acc_Q[t];
+  }
+
+  *init_code_phase = code_phase + *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+}
+
+/** Largest code step supported by the vectorised multi-channel kernels, the
+ * code chips spanned by one vector of samples must fit in the code window
+ * loaded for that vector. */
+#define MULTI_MAX_CODE_STEP 1.5
+
+/** Number of samples converted and shared between channels at a time. */
+#define MULTI_BLOCK_LEN 512
+
+static void track_correlate_multi_generic(const s8* samples,
+                                          u8 n_channels,
+                                          corr_channel_t channels[])
+{
+  for (u8 i=0; i<n_channels; i++) {
+    corr_channel_t *c = &channels[i];
+    track_correlate(samples + c->start, c->code,
+                    &c->code_phase, c->code_step,
+                    &c->carr_phase, c->carr_step,
+                    &c->I_E, &c->Q_E, &c->I_P, &c->Q_P, &c->I_L, &c->Q_L,
+                    &c->num_samples);
+  }
+}
+
+#ifdef CPU_FEATURES_X86
+
+/** Working state for one channel of the vectorised multi-channel kernels.
+ * Vectors are stored as plain float arrays between blocks of samples. */
+typedef struct {
+  float acc[6][16];   /**< I_E, Q_E, I_P, Q_P, I_L, Q_L lane accumulators. */
+  float carr_sin[16]; /**< Carrier sine for each lane of the next vector. */
+  float carr_cos[16]; /**< Carrier cosine for each lane of the next vector. */
+  s8 tail[64];        /**< End of the code replica, zero padded. */
+  u32 end;            /**< Index one past the last sample to correlate. */
+  bool carr_init;     /**< Carrier lanes have been initialised. */
+} multi_chan_t;
+
+/** Prepare the working state of each channel and find the range of samples
+ * spanned by all the channels. */
+static void multi_setup(u8 n_channels, corr_channel_t channels[],
+                        multi_chan_t mc[], u32 window,
+                        u32 *lo, u32 *hi)
+{
+  *lo = UINT32_MAX;
+  *hi = 0;
+  for (u8 i=0; i<n_channels; i++) {
+    corr_channel_t *c = &channels[i];
+    c->code_phase = code_phase_wrap(c->code_phase);
+    c->num_samples = (int)ceil((1023.0 - c->code_phase) / c->code_step);
+    mc[i].end = c->start + c->num_samples;
+    mc[i].carr_init = false;
+    memset(mc[i].acc, 0, sizeof(mc[i].acc));
+    memset(mc[i].tail, 0, sizeof(mc[i].tail));
+    memcpy(mc[i].tail, &c->code[CA_CODE_REPLICA_LEN - window], window);
+    *lo = MIN(*lo, c->start);
+    *hi = MAX(*hi, mc[i].end);
+  }
+}
+
+/** Pointer to `window` chips of the code replica starting at index `b`,
+ * reading from the zero padded copy of the end of the replica where the
+ * window would run off the end. */
+static inline const s8* multi_code_window(const corr_channel_t *c,
+                                          const multi_chan_t *m,
+                                          s32 b, u32 window)
+{
+  if (b + window <= CA_CODE_REPLICA_LEN)
+    return &c->code[b];
+  return &m->tail[b - (CA_CODE_REPLICA_LEN - window)];
+}
+
+/** Initialise the carrier lanes of a channel for the vector of `lanes`
+ * samples starting at index `base`. */
+static void multi_carr_init(const corr_channel_t *c, multi_chan_t *m,
+                            u32 base, u32 lanes)
+{
+  for (u32 k=0; k<lanes; k++) {
+    double phase = c->carr_phase + ((double)base + k - c->start) * c->carr_step;
+    m->carr_sin[k] = sin(phase);
+    m->carr_cos[k] = cos(phase);
+  }
+  m->carr_init = true;
+}
+
+/** Write back the channel outputs from the lane accumulators. */
+static void multi_finish(u8 n_channels, corr_channel_t channels[],
+                         multi_chan_t mc[], u32 lanes)
+{
+  for (u8 i=0; i<n_channels; i++) {
+    corr_channel_t *c = &channels[i];
+    double sums[6];
+    for (u8 j=0; j<6; j++) {
+      sums[j] = 0;
+      for (u32 k=0; k<lanes; k++)
+        sums[j] += mc[i].acc[j][k];
+    }
+    c->I_E = sums[0];
+    c->Q_E = sums[1];
+    c->I_P = sums[2];
+    c->Q_P = sums[3];
+    c->I_L = sums[4];
+    c->Q_L = sums[5];
+    c->code_phase = c->code_phase + c->num_samples * c->code_step - 1023;
+    c->carr_phase = fmod(c->carr_phase + c->num_samples * c->carr_step,
+                         2*M_PI);
+  }
+}
+
+/** Convert up to `n` samples to float, zero padding up to `n_pad`. */
+static void multi_convert(const s8* samples, u32 n, u32 n_pad, float *buf)
+{
+  for (u32 k=0; k<n; k++)
+    buf[k] = samples[k];
+  for (u32 k=n; k<n_pad; k++)
+    buf[k] = 0;
+}
+
+__attribute__((target("avx2,fma")))
+static void track_correlate_multi_avx2(const s8* samples,
+                                       u8 n_channels,
+                                       corr_channel_t channels[])
+{
+  multi_chan_t mc[n_channels];
+  float buf[MULTI_BLOCK_LEN] __attribute__((aligned(32)));
+  u32 lo, hi;
+
+  multi_setup(n_channels, channels, mc, 16, &lo, &hi);
+
+  const __m256i lane_idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i seven = _mm256_set1_epi32(7);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+
+  for (u32 blk=lo; blk<hi; blk+=MULTI_BLOCK_LEN) {
+    u32 blk_len = MIN(MULTI_BLOCK_LEN, hi - blk);
+
+    /* Load and convert each sample once for all channels. */
+    u32 n_fast = blk_len & ~7;
+    for (u32 k=0; k<n_fast; k+=8) {
+      __m128i s = _mm_loadl_epi64((const __m128i *)&samples[blk + k]);
+      _mm256_store_ps(&buf[k], _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(s)));
+    }
+    multi_convert(&samples[blk + n_fast], blk_len - n_fast,
+                  MULTI_BLOCK_LEN - n_fast, &buf[n_fast]);
+
+    for (u8 i=0; i<n_channels; i++) {
+      corr_channel_t *c = &channels[i];
+      multi_chan_t *m = &mc[i];
+
+      u32 c_lo = MAX(c->start, blk);
+      u32 c_hi = MIN(m->end, blk + blk_len);
+      if (c_lo >= c_hi)
+        continue;
+
+      u32 base = blk + ((c_lo - blk) & ~7);
+      if (!m->carr_init)
+        multi_carr_init(c, m, base, 8);
+
+      __m256 IE = _mm256_loadu_ps(m->acc[0]);
+      __m256 QE = _mm256_loadu_ps(m->acc[1]);
+      __m256 IP = _mm256_loadu_ps(m->acc[2]);
+      __m256 QP = _mm256_loadu_ps(m->acc[3]);
+      __m256 IL = _mm256_loadu_ps(m->acc[4]);
+      __m256 QL = _mm256_loadu_ps(m->acc[5]);
+      __m256 carr_sin = _mm256_loadu_ps(m->carr_sin);
+      __m256 carr_cos = _mm256_loadu_ps(m->carr_cos);
+
+      const __m256 sin_delta = _mm256_set1_ps(sin(8*c->carr_step));
+      const __m256 cos_delta = _mm256_set1_ps(cos(8*c->carr_step));
+      const __m256 k_step = _mm256_mul_ps(_mm256_cvtepi32_ps(lane_idx),
+                                          _mm256_set1_ps(c->code_step));
+      const __m256i start = _mm256_set1_epi32(c->start - 1);
+      const __m256i end = _mm256_set1_epi32(m->end);
+
+      for (; base<c_hi; base+=8) {
+        /* Mask out lanes outside this channel's integration period. */
+        __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(base), lane_idx);
+        __m256 mask = _mm256_castsi256_ps(
+            _mm256_and_si256(_mm256_cmpgt_epi32(idx, start),
+                             _mm256_cmpgt_epi32(end, idx)));
+        __m256 s = _mm256_and_ps(_mm256_load_ps(&buf[base - blk]), mask);
+
+        /* Load a window of code chips covering this vector of samples,
+         * starting from the early chip of the first active lane. */
+        u32 k0 = (base < c->start) ? c->start - base : 0;
+        double p = c->code_phase + ((double)base - c->start) * c->code_step;
+        s32 b = (s32)(p + k0*c->code_step + 0.5);
+        __m128i wb = _mm_loadu_si128(
+            (const __m128i *)multi_code_window(c, m, b, 16));
+        __m256 w_lo = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(wb));
+        __m256 w_hi = _mm256_cvtepi32_ps(
+            _mm256_cvtepi8_epi32(_mm_srli_si128(wb, 8)));
+
+        /* Early, prompt and late chip offsets into the window. */
+        __m256 rel = _mm256_add_ps(_mm256_set1_ps(p + 0.5 - b), k_step);
+        __m256i off_E = _mm256_cvttps_epi32(rel);
+        __m256i off_P = _mm256_cvttps_epi32(_mm256_add_ps(rel, half));
+        __m256i off_L = _mm256_cvttps_epi32(_mm256_add_ps(rel, one));
+
+        __m256 code_E = _mm256_blendv_ps(
+            _mm256_permutevar8x32_ps(w_lo, off_E),
+            _mm256_permutevar8x32_ps(w_hi, off_E),
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(off_E, seven)));
+        __m256 code_P = _mm256_blendv_ps(
+            _mm256_permutevar8x32_ps(w_lo, off_P),
+            _mm256_permutevar8x32_ps(w_hi, off_P),
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(off_P, seven)));
+        __m256 code_L = _mm256_blendv_ps(
+            _mm256_permutevar8x32_ps(w_lo, off_L),
+            _mm256_permutevar8x32_ps(w_hi, off_L),
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(off_L, seven)));
+
+        /* Mix down to baseband. */
+        __m256 BI = _mm256_mul_ps(s, carr_sin);
+        __m256 BQ = _mm256_mul_ps(s, carr_cos);
+
+        IE = _mm256_fmadd_ps(code_E, BI, IE);
+        QE = _mm256_fmadd_ps(code_E, BQ, QE);
+        IP = _mm256_fmadd_ps(code_P, BI, IP);
+        QP = _mm256_fmadd_ps(code_P, BQ, QP);
+        IL = _mm256_fmadd_ps(code_L, BI, IL);
+        QL = _mm256_fmadd_ps(code_L, BQ, QL);
+
+        /* Rotate the carrier lanes on by eight samples and renormalise. */
+        __m256 sin_ = _mm256_fmadd_ps(carr_sin, cos_delta,
+                                      _mm256_mul_ps(carr_cos, sin_delta));
+        __m256 cos_ = _mm256_fmsub_ps(carr_cos, cos_delta,
+                                      _mm256_mul_ps(carr_sin, sin_delta));
+        __m256 mag2 = _mm256_fmadd_ps(sin_, sin_, _mm256_mul_ps(cos_, cos_));
+        __m256 gain = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(3.f), mag2),
+                                    half);
+        carr_sin = _mm256_mul_ps(sin_, gain);
+        carr_cos = _mm256_mul_ps(cos_, gain);
+      }
+
+      _mm256_storeu_ps(m->acc[0], IE);
+      _mm256_storeu_ps(m->acc[1], QE);
+      _mm256_storeu_ps(m->acc[2], IP);
+      _mm256_storeu_ps(m->acc[3], QP);
+      _mm256_storeu_ps(m->acc[4], IL);
+      _mm256_storeu_ps(m->acc[5], QL);
+      _mm256_storeu_ps(m->carr_sin, carr_sin);
+      _mm256_storeu_ps(m->carr_cos, carr_cos);
+    }
+  }
+
+  multi_finish(n_channels, channels, mc, 8);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512dq,avx512vl")))
+static void track_correlate_multi_avx512(const s8* samples,
+                                         u8 n_channels,
+                                         corr_channel_t channels[])
+{
+  multi_chan_t mc[n_channels];
+  float buf[MULTI_BLOCK_LEN] __attribute__((aligned(64)));
+  u32 lo, hi;
+
+  multi_setup(n_channels, channels, mc, 32, &lo, &hi);
+
+  const __m512i lane_idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                             8, 9, 10, 11, 12, 13, 14, 15);
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 one = _mm512_set1_ps(1.0f);
+
+  for (u32 blk=lo; blk<hi; blk+=MULTI_BLOCK_LEN) {
+    u32 blk_len = MIN(MULTI_BLOCK_LEN, hi - blk);
+
+    /* Load and convert each sample once for all channels. */
+    u32 n_fast = blk_len & ~15;
+    for (u32 k=0; k<n_fast; k+=16) {
+      __m128i s = _mm_loadu_si128((const __m128i *)&samples[blk + k]);
+      _mm512_store_ps(&buf[k], _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(s)));
+    }
+    multi_convert(&samples[blk + n_fast], blk_len - n_fast,
+                  MULTI_BLOCK_LEN - n_fast, &buf[n_fast]);
+
+    for (u8 i=0; i<n_channels; i++) {
+      corr_channel_t *c = &channels[i];
+      multi_chan_t *m = &mc[i];
+
+      u32 c_lo = MAX(c->start, blk);
+      u32 c_hi = MIN(m->end, blk + blk_len);
+      if (c_lo >= c_hi)
+        continue;
+
+      u32 base = blk + ((c_lo - blk) & ~15);
+      if (!m->carr_init)
+        multi_carr_init(c, m, base, 16);
+
+      __m512 IE = _mm512_loadu_ps(m->acc[0]);
+      __m512 QE = _mm512_loadu_ps(m->acc[1]);
+      __m512 IP = _mm512_loadu_ps(m->acc[2]);
+      __m512 QP = _mm512_loadu_ps(m->acc[3]);
+      __m512 IL = _mm512_loadu_ps(m->acc[4]);
+      __m512 QL = _mm512_loadu_ps(m->acc[5]);
+      __m512 carr_sin = _mm512_loadu_ps(m->carr_sin);
+      __m512 carr_cos = _mm512_loadu_ps(m->carr_cos);
+
+      const __m512 sin_delta = _mm512_set1_ps(sin(16*c->carr_step));
+      const __m512 cos_delta = _mm512_set1_ps(cos(16*c->carr_step));
+      const __m512 k_step = _mm512_mul_ps(_mm512_cvtepi32_ps(lane_idx),
+                                          _mm512_set1_ps(c->code_step));
+      const __m512i start = _mm512_set1_epi32(c->start);
+      const __m512i end = _mm512_set1_epi32(m->end);
+
+      for (; base<c_hi; base+=16) {
+        /* Mask out lanes outside this channel's integration period. */
+        __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(base), lane_idx);
+        __mmask16 mask = _mm512_cmpge_epi32_mask(idx, start) &
+                         _mm512_cmplt_epi32_mask(idx, end);
+        __m512 s = _mm512_maskz_load_ps(mask, &buf[base - blk]);
+
+        /* Load a window of code chips covering this vector of samples,
+         * starting from the early chip of the first active lane. */
+        u32 k0 = (base < c->start) ? c->start - base : 0;
+        double p = c->code_phase + ((double)base - c->start) * c->code_step;
+        s32 b = (s32)(p + k0*c->code_step + 0.5);
+        __m256i wb = _mm256_loadu_si256(
+            (const __m256i *)multi_code_window(c, m, b, 32));
+        __m512 w_lo = _mm512_cvtepi32_ps(
+            _mm512_cvtepi8_epi32(_mm256_castsi256_si128(wb)));
+        __m512 w_hi = _mm512_cvtepi32_ps(
+            _mm512_cvtepi8_epi32(_mm256_extracti128_si256(wb, 1)));
+
+        /* Early, prompt and late chip offsets into the window. */
+        __m512 rel = _mm512_add_ps(_mm512_set1_ps(p + 0.5 - b), k_step);
+        __m512i off_E = _mm512_cvttps_epi32(rel);
+        __m512i off_P = _mm512_cvttps_epi32(_mm512_add_ps(rel, half));
+        __m512i off_L = _mm512_cvttps_epi32(_mm512_add_ps(rel, one));
+
+        __m512 code_E = _mm512_permutex2var_ps(w_lo, off_E, w_hi);
+        __m512 code_P = _mm512_permutex2var_ps(w_lo, off_P, w_hi);
+        __m512 code_L = _mm512_permutex2var_ps(w_lo, off_L, w_hi);
+
+        /* Mix down to baseband. */
+        __m512 BI = _mm512_mul_ps(s, carr_sin);
+        __m512 BQ = _mm512_mul_ps(s, carr_cos);
+
+        IE = _mm512_fmadd_ps(code_E, BI, IE);
+        QE = _mm512_fmadd_ps(code_E, BQ, QE);
+        IP = _mm512_fmadd_ps(code_P, BI, IP);
+        QP = _mm512_fmadd_ps(code_P, BQ, QP);
+        IL = _mm512_fmadd_ps(code_L, BI, IL);
+        QL = _mm512_fmadd_ps(code_L, BQ, QL);
+
+        /* Rotate the carrier lanes on by sixteen samples and renormalise. */
+        __m512 sin_ = _mm512_fmadd_ps(carr_sin, cos_delta,
+                                      _mm512_mul_ps(carr_cos, sin_delta));
+        __m512 cos_ = _mm512_fmsub_ps(carr_cos, cos_delta,
+                                      _mm512_mul_ps(carr_sin, sin_delta));
+        __m512 mag2 = _mm512_fmadd_ps(sin_, sin_, _mm512_mul_ps(cos_, cos_));
+        __m512 gain = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(3.f), mag2),
+                                    half);
+        carr_sin = _mm512_mul_ps(sin_, gain);
+        carr_cos = _mm512_mul_ps(cos_, gain);
+      }
+
+      _mm512_storeu_ps(m->acc[0], IE);
+      _mm512_storeu_ps(m->acc[1], QE);
+      _mm512_storeu_ps(m->acc[2], IP);
+      _mm512_storeu_ps(m->acc[3], QP);
+      _mm512_storeu_ps(m->acc[4], IL);
+      _mm512_storeu_ps(m->acc[5], QL);
+      _mm512_storeu_ps(m->carr_sin, carr_sin);
+      _mm512_storeu_ps(m->carr_cos, carr_cos);
+    }
+  }
+
+  multi_finish(n_channels, channels, mc, 16);
+}
+
+#endif /* CPU_FEATURES_X86 */
+
+/** Correlate one block of samples against many channels in a single pass.
+ *
+ * Equivalent to calling track_correlate() for each channel with
+ * `samples + channels[i].start`, but each sample is loaded and converted
+ * only once and then correlated against every channel whose integration
+ * period covers it. The `samples` buffer must extend to the code rollover
+ * of every channel.
+ *
+ * AVX2 or AVX-512 kernels are used when available, see cpu_features(),
+ * otherwise the channels are correlated one at a time. Results agree with
+ * track_correlate() to within single precision rounding. In
+ * `CORR_MODE_FIXED` the channels are always correlated one at a time with
+ * the fixed point correlator.
+ *
+ * \param samples    Block of samples shared by all the channels.
+ * \param n_channels Number of channels.
+ * \param channels   Array of channel states, the code and carrier phases
+ *                   and correlation outputs are updated for each channel.
+ */
+void track_correlate_multi(const s8* samples,
+                           u8 n_channels, corr_channel_t channels[])
+{
+  if (n_channels == 0)
+    return;
+
+#ifdef CPU_FEATURES_X86
+  /* The vectorised kernels are floating point only. */
+  bool vector_ok = (track_correlate_get_mode() == CORR_MODE_FLOAT);
+  for (u8 i=0; i<n_channels; i++)
+    if (channels[i].code_step >= MULTI_MAX_CODE_STEP)
+      vector_ok = false;
+
+  if (vector_ok) {
+    u32 f = cpu_features();
+    if (f & CPU_FEATURE_AVX512) {
+      track_correlate_multi_avx512(samples, n_channels, channels);
+      return;
+    }
+    if (f & CPU_FEATURE_AVX2) {
+      track_correlate_multi_avx2(samples, n_channels, channels);
+      return;
+    }
+  }
+#endif
+
+  track_correlate_multi_generic(samples, n_channels, channels);
+}
+
+/** Words of the bit-packed sample format processed per block, see
+ * track_correlate_packed(). */
+#define PACKED_BLOCK_WORDS 64
+
+/** Sample bit planes, replicas and valid sample mask for one block of
+ * samples. A set sign bit means a negative value for the samples, the code
+ * chips and the carrier alike, so the sign of a product is the XOR of the
+ * signs. */
+typedef struct {
+  u64 sign[PACKED_BLOCK_WORDS];    /**< Sample sign bits. */
+  u64 mag[PACKED_BLOCK_WORDS];     /**< Sample magnitude bits. */
+  u64 valid[PACKED_BLOCK_WORDS];   /**< Samples to be correlated. */
+  u64 code[3][PACKED_BLOCK_WORDS]; /**< Early, prompt and late code. */
+  u64 carr[2][PACKED_BLOCK_WORDS]; /**< Sign of the carrier sin and cos. */
+} packed_block_t;
+
+/** Read the `plane` bits of `n` (1 to 64) samples starting at sample `pos`
+ * of `bits` bit packed samples, touching only the words holding them. */
+static inline u64 packed_bits(const u64 *packed, u8 bits, u8 plane,
+                              u32 pos, u32 n)
+{
+  const u64 *words = &packed[(pos / 64) * bits + plane];
+  u32 b = pos % 64;
+  u64 x = words[0] >> b;
+  if (b && n > 64 - b)
+    x |= words[bits] << (64 - b);
+  return n < 64 ? x & (((u64)1 << n) - 1) : x;
+}
+
+/** Mask of `n` (1 to 64) bits starting at bit `k`. */
+static inline u64 packed_run_mask(u32 k, u32 n)
+{
+  return (~(u64)0 >> (64 - n)) << k;
+}
+
+/** Build `n` bits of a bit-packed code replica from the packed C/A code.
+ * `nco` is in units of the guarded code replica index, see track_correlate(),
+ * and is advanced by `n` samples. The chip is constant over runs of
+ * samples so the word is filled a run at a time. */
+static u64 packed_code_word(const u8 *code, u64 *nco, u64 step, u32 n)
+{
+  u64 word = 0;
+  u32 k = 0;
+  while (k < n) {
+    u64 frac = *nco & (CODE_NCO_ONE - 1);
+    u64 run = (CODE_NCO_ONE - frac + step - 1) / step;
+    if (run > n - k)
+      run = n - k;
+
+    s32 chip = (s32)(*nco >> CODE_NCO_FRAC_BITS) - 1;
+    if (chip < 0)
+      chip += 1023;
+    else if (chip >= 1023)
+      chip -= 1023;
+    if ((code[chip / 8] >> (7 - chip % 8)) & 1)
+      word |= packed_run_mask(k, run);
+
+    k += run;
+    *nco += run * step;
+  }
+  return word;
+}
+
+/** Build one word each of the sign of the carrier sin and cos. `nco` is a
+ * carrier NCO value, see carr_nco(), and is advanced by 64 samples. The sin
+ * is negative whenever the top bit of the NCO is set and the cos a quarter
+ * of a cycle later. */
+static void packed_carr_words(u32 *nco, u32 step, u64 *sin_word, u64 *cos_word)
+{
+  u64 s = 0, c = 0;
+#ifdef __SSE2__
+  /* The top bit of each 32-bit lane is the sign of a float, so movmskps
+   * extracts four carrier signs at once. */
+  __m128i phase = _mm_set_epi32(*nco + 3*step, *nco + 2*step,
+                                *nco + step, *nco);
+  __m128i phase_step = _mm_set1_epi32(4*step);
+  __m128i quarter = _mm_set1_epi32(1u << 30);
+  for (u32 k=0; k<64; k+=4) {
+    s |= (u64)_mm_movemask_ps(_mm_castsi128_ps(phase)) << k;
+    c |= (u64)_mm_movemask_ps(
+           _mm_castsi128_ps(_mm_add_epi32(phase, quarter))) << k;
+    phase = _mm_add_epi32(phase, phase_step);
+  }
+  *nco += 64*step;
+#else
+  for (u32 k=0; k<64; k++) {
+    s |= (u64)(*nco >> 31) << k;
+    c |= (u64)((*nco + (1u << 30)) >> 31) << k;
+    *nco += step;
+  }
+#endif
+  *sin_word = s;
+  *cos_word = c;
+}
+
+/** Count the negative products of one block. `acc[0]` to `acc[5]` are the
+ * weighted number of negative products for I_E, Q_E, I_P, Q_P, I_L and Q_L
+ * and `acc[6]` the total weight, a magnitude bit weighs 2 on top of the
+ * sample's weight of 1. */
+static inline __attribute__((always_inline))
+void packed_count_body(const packed_block_t *b, u32 n_words, u32 acc[7])
+{
+  for (u32 w=0; w<n_words; w++) {
+    u64 valid = b->valid[w];
+    u64 mag = b->mag[w] & valid;
+    u64 s_sin = b->sign[w] ^ b->carr[0][w];
+    u64 s_cos = b->sign[w] ^ b->carr[1][w];
+
+    acc[6] += __builtin_popcountll(valid) + 2*__builtin_popcountll(mag);
+    for (u32 r=0; r<3; r++) {
+      u64 x_I = (s_sin ^ b->code[r][w]) & valid;
+      u64 x_Q = (s_cos ^ b->code[r][w]) & valid;
+      acc[2*r]   += __builtin_popcountll(x_I) + 2*__builtin_popcountll(x_I & mag);
+      acc[2*r+1] += __builtin_popcountll(x_Q) + 2*__builtin_popcountll(x_Q & mag);
+    }
+  }
+}
+
+static void packed_count_generic(const packed_block_t *b, u32 n_words,
+                                 u32 acc[7])
+{
+  packed_count_body(b, n_words, acc);
+}
+
+#ifdef CPU_FEATURES_X86
+
+__attribute__((target("popcnt")))
+static void packed_count_popcnt(const packed_block_t *b, u32 n_words,
+                                u32 acc[7])
+{
+  packed_count_body(b, n_words, acc);
+}
+
+/** AVX-512 VPOPCNTDQ counting kernel, counts eight words of each output at
+ * a time. */
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void packed_count_avx512(const packed_block_t *b, u32 n_words,
+                                u32 acc[7])
+{
+  __m512i sum[7];
+  for (u32 o=0; o<7; o++)
+    sum[o] = _mm512_setzero_si512();
+
+  for (u32 w=0; w<n_words; w+=8) {
+    __mmask8 lanes = n_words - w >= 8 ? 0xFF : (1 << (n_words - w)) - 1;
+    __m512i valid = _mm512_maskz_loadu_epi64(lanes, &b->valid[w]);
+    __m512i sign = _mm512_maskz_loadu_epi64(lanes, &b->sign[w]);
+    __m512i mag = _mm512_and_si512(
+                    _mm512_maskz_loadu_epi64(lanes, &b->mag[w]), valid);
+    __m512i s_sin = _mm512_xor_si512(
+                      sign, _mm512_maskz_loadu_epi64(lanes, &b->carr[0][w]));
+    __m512i s_cos = _mm512_xor_si512(
+                      sign, _mm512_maskz_loadu_epi64(lanes, &b->carr[1][w]));
+
+    sum[6] = _mm512_add_epi64(sum[6], _mm512_popcnt_epi64(valid));
+    sum[6] = _mm512_add_epi64(sum[6],
+               _mm512_slli_epi64(_mm512_popcnt_epi64(mag), 1));
+    for (u32 r=0; r<3; r++) {
+      __m512i code = _mm512_maskz_loadu_epi64(lanes, &b->code[r][w]);
+      __m512i x_I = _mm512_and_si512(_mm512_xor_si512(s_sin, code), valid);
+      __m512i x_Q = _mm512_and_si512(_mm512_xor_si512(s_cos, code), valid);
+      sum[2*r] = _mm512_add_epi64(sum[2*r], _mm512_popcnt_epi64(x_I));
+      sum[2*r] = _mm512_add_epi64(sum[2*r], _mm512_slli_epi64(
+                   _mm512_popcnt_epi64(_mm512_and_si512(x_I, mag)), 1));
+      sum[2*r+1] = _mm512_add_epi64(sum[2*r+1], _mm512_popcnt_epi64(x_Q));
+      sum[2*r+1] = _mm512_add_epi64(sum[2*r+1], _mm512_slli_epi64(
+                     _mm512_popcnt_epi64(_mm512_and_si512(x_Q, mag)), 1));
+    }
+  }
+
+  for (u32 o=0; o<7; o++)
+    acc[o] += (u32)_mm512_reduce_add_epi64(sum[o]);
+}
+
+#endif /* CPU_FEATURES_X86 */
+
+/** Pack samples into the bit-packed format used by track_correlate_packed().
+ *
+ * Samples are packed 64 to a group of `bits` words, sample `i` is bit
+ * `i % 64` of the words of group `i / 64`. The first word of a group holds
+ * the sign bits, set for negative samples. For 2-bit samples the second
+ * word holds the magnitude bits, set for samples of magnitude 2 or more, so
+ * the packed values are ±1 and ±3. Bits past the last sample are cleared.
+ *
+ * \param samples Samples to pack.
+ * \param n       Number of samples.
+ * \param bits    Bits per sample, 1 or 2.
+ * \param packed  Packed samples, PACKED_SAMPLES_WORDS() words.
+ */
+void packed_samples_pack(const s8* samples, u32 n, u8 bits, u64* packed)
+{
+  for (u32 w=0; w<(n + 63) / 64; w++) {
+    u64 s = 0, m = 0;
+    for (u32 k=0; k<64 && w*64 + k < n; k++) {
+      s8 x = samples[w*64 + k];
+      s |= (u64)(x < 0) << k;
+      m |= (u64)(x >= 2 || x <= -2) << k;
+    }
+    packed[w*bits] = s;
+    if (bits == 2)
+      packed[w*bits + 1] = m;
+  }
+}
+
+/** Unpack bit-packed samples, see packed_samples_pack().
+ *
+ * \param packed  Packed samples.
+ * \param bits    Bits per sample, 1 or 2.
+ * \param start   Index of the first sample to unpack.
+ * \param n       Number of samples to unpack.
+ * \param samples Unpacked samples, ±1 or ±3.
+ */
+void packed_samples_unpack(const u64* packed, u8 bits, u32 start, u32 n,
+                           s8* samples)
+{
+  for (u32 i=0; i<n; i+=64) {
+    u32 len = n - i < 64 ? n - i : 64;
+    u64 s = packed_bits(packed, bits, 0, start + i, len);
+    u64 m = bits == 2 ? packed_bits(packed, bits, 1, start + i, len) : 0;
+    for (u32 k=0; k<len; k++) {
+      s8 x = ((m >> k) & 1) ? 3 : 1;
+      samples[i + k] = ((s >> k) & 1) ? -x : x;
+    }
+  }
+}
+
+/** Correlate bit-packed 1-bit or 2-bit samples against early, prompt and
+ * late code replicas.
+ *
+ * The packed equivalent of track_correlate(), the code and carrier phase
+ * arguments and outputs have the same meaning. The code replica is built
+ * bit-packed straight from the packed C/A code, see ca_code(), and the
+ * carrier is reduced to its sign, so each product is an XOR of sign bits
+ * and the correlation is a weighted count of the negative products,
+ * 64 samples at a time with `popcnt` or 512 at a time with AVX-512
+ * VPOPCNTDQ when available, see cpu_features().
+ *
+ * The sign-only carrier is a square wave whose fundamental has an amplitude
+ * of 4/π; the correlations are scaled by π/4 so that they are comparable to
+ * the track_correlate() outputs for the unpacked samples. The square wave's
+ * harmonics cost about 0.9 dB of SNR, the same as a 1-bit carrier in a
+ * hardware correlator.
+ *
+ * \param packed          Packed samples, see packed_samples_pack().
+ * \param bits            Bits per sample, 1 or 2.
+ * \param start           Index of the first sample to correlate.
+ * \param code            Packed C/A code, see ca_code().
+ * \param init_code_phase Code phase in chips of the first sample, updated
+ *                        to the code phase after the rollover.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase in radians of the first sample,
+ *                        updated to the carrier phase after the last sample.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation.
+ * \param Q_E             Early quadrature correlation.
+ * \param I_P             Prompt in-phase correlation.
+ * \param Q_P             Prompt quadrature correlation.
+ * \param I_L             Late in-phase correlation.
+ * \param Q_L             Late quadrature correlation.
+ * \param num_samples     Number of samples correlated.
+ */
+void track_correlate_packed(const u64* packed, u8 bits, u32 start,
+                            const u8* code,
+                            double* init_code_phase, double code_step,
+                            double* init_carr_phase, double carr_step,
+                            double* I_E, double* Q_E,
+                            double* I_P, double* Q_P,
+                            double* I_L, double* Q_L,
+                            u32* num_samples)
+{
+  double code_phase = code_phase_wrap(*init_code_phase);
+  u32 n = (int)ceil((1023.0 - code_phase) / code_step);
+
+  void (*count)(const packed_block_t *, u32, u32 *) = packed_count_generic;
+#ifdef CPU_FEATURES_X86
+  u32 features = cpu_features();
+  if (features & CPU_FEATURE_AVX512_VPOPCNTDQ)
+    count = packed_count_avx512;
+  else if (features & CPU_FEATURE_POPCNT)
+    count = packed_count_popcnt;
+#endif
+
+  u64 step = code_nco(code_step);
+  u64 nco[3];
+  nco[0] = code_nco(code_phase + 0.5);
+  nco[1] = nco[0] + CODE_NCO_ONE/2;
+  nco[2] = nco[0] + CODE_NCO_ONE;
+  u32 carr = carr_nco(*init_carr_phase);
+  u32 carr_step_nco = carr_nco(carr_step);
+
+  packed_block_t b;
+  u32 acc[7] = {0};
+
+  for (u32 i=0; i<n; i+=64*PACKED_BLOCK_WORDS) {
+    u32 n_words = 0;
+    for (u32 j=i; j<n && n_words<PACKED_BLOCK_WORDS; j+=64, n_words++) {
+      u32 w = n_words;
+      u32 len = n - j < 64 ? n - j : 64;
+      b.sign[w] = packed_bits(packed, bits, 0, start + j, len);
+      b.mag[w] = bits == 2 ? packed_bits(packed, bits, 1, start + j, len) : 0;
+      b.valid[w] = packed_run_mask(0, len);
+      for (u32 r=0; r<3; r++)
+        b.code[r][w] = packed_code_word(code, &nco[r], step, len);
+      packed_carr_words(&carr, carr_step_nco, &b.carr[0][w], &b.carr[1][w]);
+    }
+    count(&b, n_words, acc);
+  }
+
+  double out[6];
+  for (u32 o=0; o<6; o++)
+    out[o] = M_PI/4 * ((double)acc[6] - 2.0*acc[o]);
+  *I_E = out[0];
+  *Q_E = out[1];
+  *I_P = out[2];
+  *Q_P = out[3];
+  *I_L = out[4];
+  *Q_L = out[5];
+
+  *num_samples = n;
+  *init_code_phase = code_phase + n * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + n*carr_step, 2*M_PI);
+}
+
 /** \} */
 
 
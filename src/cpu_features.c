@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "cpu_features.h"
+
+/** \defgroup cpu_features CPU Features
+ * Runtime detection of the SIMD instruction sets available to the library.
+ *
+ * The library is built for a conservative baseline architecture, kernels for
+ * newer instruction sets are compiled alongside and selected at runtime using
+ * cpu_features().
+ * \{ */
+
+static u32 features_mask = CPU_FEATURES_ALL;
+
+static u32 detect_features(void)
+{
+  u32 f = 0;
+#ifdef CPU_FEATURES_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3"))
+    f |= CPU_FEATURE_SSSE3;
+  if (__builtin_cpu_supports("popcnt"))
+    f |= CPU_FEATURE_POPCNT;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    f |= CPU_FEATURE_AVX2;
+  if ((f & CPU_FEATURE_AVX2) &&
+      __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512dq") &&
+      __builtin_cpu_supports("avx512vl"))
+    f |= CPU_FEATURE_AVX512;
+  if ((f & CPU_FEATURE_AVX512) &&
+      __builtin_cpu_supports("avx512vpopcntdq"))
+    f |= CPU_FEATURE_AVX512_VPOPCNTDQ;
+#endif
+  return f;
+}
+
+/** Get the SIMD features available on this machine.
+ * The features are detected on the first call. The result is restricted by
+ * any mask set with cpu_features_set_mask().
+ *
+ * \return Bitmask of `CPU_FEATURE_*` flags.
+ */
+u32 cpu_features(void)
+{
+  /* Detection gives the same result on every thread, so threads racing on
+   * the first call can each store it. */
+  static s32 detected = -1;
+  s32 f = __atomic_load_n(&detected, __ATOMIC_RELAXED);
+  if (f < 0) {
+    f = (s32)detect_features();
+    __atomic_store_n(&detected, f, __ATOMIC_RELAXED);
+  }
+  return (u32)f & __atomic_load_n(&features_mask, __ATOMIC_RELAXED);
+}
+
+/** Restrict the SIMD features the library will use.
+ * Kernels are selected from the features in `mask` that are also available
+ * on the machine, mostly useful for testing the fallback paths. Pass
+ * `CPU_FEATURES_ALL` to restore the default.
+ *
+ * \param mask Bitmask of `CPU_FEATURE_*` flags to allow.
+ */
+void cpu_features_set_mask(u32 mask)
+{
+  __atomic_store_n(&features_mask, mask, __ATOMIC_RELAXED);
+}
+
+/** \} */
+
@@ -13,6 +13,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "amb_kf.h"
+#include "diag.h"
 #include "stupid_filter.h"
 #include "single_diff.h"
 #include "dgnss_management.h"
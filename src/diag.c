@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "diag.h"
+
+/** \defgroup diag Diagnostics
+ * Diagnostic messages and event counters.
+ *
+ * The library reports problems and progress with the DIAG() macro rather
+ * than printing them. Each report counts an event code, readable with
+ * diag_event_count(), and its message goes to the sink registered with
+ * diag_set_sink(). There is no sink until one is registered, so nothing is
+ * formatted or printed and the message arguments aren't even evaluated.
+ * Host programs wanting the messages the library used to print should
+ * register diag_sink_stdio().
+ *
+ * Messages below the level set with diag_set_level() are dropped before
+ * formatting, and messages below `DIAG_MIN_LEVEL` are compiled out. Each
+ * call site passes on its first messages up to the burst set with
+ * diag_set_rate_limit() and after that only its 2^k-th message, so a call
+ * site hit on every update produces a logarithmic trickle of messages. The
+ * counts are kept with atomic operations and DIAG() may be used from any
+ * thread, the sink must then be thread safe.
+ * \{ */
+
+/** Length of the message buffer, longer messages are truncated. */
+#define DIAG_MSG_LEN 256
+
+static diag_sink_t diag_sink = 0;
+static void *diag_context = 0;
+static diag_level_t diag_level = DIAG_INFO;
+static u32 diag_burst = 10;
+static u32 diag_counts[DIAG_N_EVENTS];
+
+static const char *diag_event_names[DIAG_N_EVENTS] = {
+  [DIAG_EVENT_TRACE] = "trace",
+  [DIAG_EVENT_NAV_PHASE_FLIP] = "nav_phase_flip",
+  [DIAG_EVENT_NAV_PARITY_ERROR] = "nav_parity_error",
+  [DIAG_EVENT_NAV_NO_EPHEMERIS] = "nav_no_ephemeris",
+  [DIAG_EVENT_EPHEMERIS_STALE] = "ephemeris_stale",
+  [DIAG_EVENT_IAR_RESET] = "iar_reset",
+  [DIAG_EVENT_IAR_HYPOTHESES] = "iar_hypotheses",
+  [DIAG_EVENT_IAR_INVALID_SDIFFS] = "iar_invalid_sdiffs",
+  [DIAG_EVENT_IAR_SATS_DISORDER] = "iar_sats_disorder",
+  [DIAG_EVENT_IAR_MISUSE] = "iar_misuse",
+  [DIAG_EVENT_LAMBDA_LD_ERROR] = "lambda_ld_error",
+  [DIAG_EVENT_LAMBDA_OVERFLOW] = "lambda_overflow",
+  [DIAG_EVENT_MATRIX_SINGULAR] = "matrix_singular",
+  [DIAG_EVENT_FILTER_UPDATE] = "filter_update",
+};
+
+static const char *diag_level_names[DIAG_NONE] = {
+  "DEBUG", "INFO", "WARN", "ERROR"
+};
+
+/** Register the sink for diagnostic messages.
+ *
+ * Should be called before the library is used from other threads.
+ *
+ * \param sink    Function called with each message passed on, or NULL to
+ *                drop all the messages.
+ * \param context Passed to the sink.
+ */
+void diag_set_sink(diag_sink_t sink, void *context)
+{
+  diag_sink = sink;
+  diag_context = context;
+}
+
+/** Set the lowest level of the messages passed to the sink, `DIAG_INFO`
+ * to start with.
+ *
+ * \param level Lowest level passed on, `DIAG_NONE` to drop all messages.
+ */
+void diag_set_level(diag_level_t level)
+{
+  diag_level = level;
+}
+
+/** Set the number of messages each call site passes on before the rate
+ * limit starts, 10 to start with.
+ *
+ * \param burst Messages passed on before only every 2^k-th is, `0` to
+ *              pass on every message.
+ */
+void diag_set_rate_limit(u32 burst)
+{
+  diag_burst = burst;
+}
+
+/** Sink printing messages to `stdout`, for use with diag_set_sink().
+ *
+ * \param msg     Message.
+ * \param context Unused.
+ */
+void diag_sink_stdio(const diag_msg_t *msg, void *context)
+{
+  (void)context;
+  if (msg->suppressed)
+    printf("%s: %s (%u more suppressed)\n", diag_level_names[msg->level],
+           msg->text, (unsigned int)msg->suppressed);
+  else
+    printf("%s: %s\n", diag_level_names[msg->level], msg->text);
+}
+
+/** Count an event without a message, see DIAG().
+ *
+ * \param event Event code.
+ */
+void diag_count(diag_event_t event)
+{
+  if (event < DIAG_N_EVENTS)
+    __atomic_fetch_add(&diag_counts[event], 1, __ATOMIC_RELAXED);
+}
+
+/** Whether messages of a level would be passed to a sink, see DIAG().
+ *
+ * \param level Severity.
+ * \return `true` if there is a sink and `level` is at least that set with
+ *         diag_set_level().
+ */
+bool diag_enabled(diag_level_t level)
+{
+  return diag_sink && level >= diag_level;
+}
+
+/** Pass a message on to the sink, use through DIAG(), which also counts
+ * the event.
+ *
+ * \param site  Rate limiting state of the call site.
+ * \param level Severity.
+ * \param event Event code.
+ * \param func  Function reporting the event.
+ * \param fmt   printf style format of the message.
+ */
+void diag_log(diag_site_t *site, diag_level_t level, diag_event_t event,
+              const char *func, const char *fmt, ...)
+{
+  diag_sink_t sink = diag_sink;
+  if (!sink || level < diag_level)
+    return;
+
+  u32 count = __atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED);
+  if (diag_burst && count > diag_burst && (count & (count - 1)))
+    return;
+  u32 passed = __atomic_exchange_n(&site->passed, count, __ATOMIC_RELAXED);
+
+  char text[DIAG_MSG_LEN];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(text, sizeof(text), fmt, args);
+  va_end(args);
+
+  diag_msg_t msg = {
+    .level = level,
+    .event = event,
+    .func = func,
+    .text = text,
+    .suppressed = count > passed ? count - passed - 1 : 0,
+  };
+  sink(&msg, diag_context);
+}
+
+/** Number of times an event has been reported since the start or the last
+ * diag_reset_counts().
+ *
+ * \param event Event code.
+ * \return Event count.
+ */
+u32 diag_event_count(diag_event_t event)
+{
+  if (event >= DIAG_N_EVENTS)
+    return 0;
+  return __atomic_load_n(&diag_counts[event], __ATOMIC_RELAXED);
+}
+
+/** Reset all the event counts to zero. */
+void diag_reset_counts(void)
+{
+  for (u32 i=0; i<DIAG_N_EVENTS; i++)
+    __atomic_store_n(&diag_counts[i], 0, __ATOMIC_RELAXED);
+}
+
+/** Short name of an event code, for logs and metrics.
+ *
+ * \param event Event code.
+ * \return Name of the event, or `"unknown"`.
+ */
+const char *diag_event_name(diag_event_t event)
+{
+  if (event >= DIAG_N_EVENTS)
+    return "unknown";
+  return diag_event_names[event];
+}
+
+/** \} */
+
@@ -10,15 +10,75 @@
  * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
  */
 
+#include "cpu_features.h"
+#include "diag.h"
 #include "linear_algebra.h"
 #include "ephemeris.h"
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define NAV_OMEGAE_DOT 7.2921151467e-005
 #define NAV_GM 3.986005e14
 
+/** Hash of the parameters of an ephemeris that its prepared constants are
+ * derived from (64-bit FNV-1a over whole words). Changing any one of them
+ * changes the hash. */
+static u64 prepare_key(const ephemeris_t *e)
+{
+  const double src[] = {e->sqrta, e->dn, e->ecc, e->omega0, e->omegadot,
+                        e->w, e->toe.tow};
+  u64 key = 0xcbf29ce484222325ULL;
+  for (u8 i=0; i<sizeof(src)/sizeof(src[0]); i++) {
+    u64 x;
+    memcpy(&x, &src[i], sizeof(x));
+    key = (key ^ x) * 0x100000001b3ULL;
+  }
+  return key;
+}
+
+/** Work out the constants derived from an ephemeris. */
+static void prepare(const ephemeris_t *e, ephemeris_prepared_t *p)
+{
+  p->key = prepare_key(e);
+  double a = e->sqrta * e->sqrta;
+  p->a = a;
+  p->ma_dot = sqrt(NAV_GM / (a * a * a)) + e->dn;
+  p->sqrt_1_ecc2 = sqrt(1.0 - e->ecc * e->ecc);
+  p->rel = -4.442807633E-10 * e->ecc * e->sqrta;
+  p->om0 = e->omega0 - NAV_OMEGAE_DOT * e->toe.tow;
+  p->om_dot = e->omegadot - NAV_OMEGAE_DOT;
+  p->sin_w = sin(e->w);
+  p->cos_w = cos(e->w);
+}
+
+/** Derive the constants used to evaluate an ephemeris, so they are worked
+ * out once rather than on every calc_sat_pos() call.
+ *
+ * Ephemerides decoded by process_subframe() are already prepared. The
+ * constants are checked against a hash of the parameters they depend on,
+ * so an ephemeris that hasn't been prepared, or has been changed since, can
+ * still be used and the constants are then worked out on each call.
+ *
+ * \param e Ephemeris, `e->prepared` is filled in.
+ */
+void ephemeris_prepare(ephemeris_t *e)
+{
+  prepare(e, &e->prepared);
+}
+
+/** Prepared constants of an ephemeris, worked out into `tmp` if it hasn't
+ * been prepared since it was last changed. */
+static const ephemeris_prepared_t *prepared(const ephemeris_t *e,
+                                            ephemeris_prepared_t *tmp)
+{
+  if (e->prepared.key == prepare_key(e))
+    return &e->prepared;
+  prepare(e, tmp);
+  return tmp;
+}
+
 int calc_sat_pos(double pos[3], double vel[3],
              double *clock_err, double *clock_rate_err,
              const ephemeris_t *ephemeris,
@@ -64,11 +124,15 @@ int calc_sat_pos(double pos[3], double vel[3],
   // new one? At least let's warn the user.
   // TODO: this doesn't exclude ephemerides older than a week so could be made better.
   if (fabs(tdiff) > 4*3600)
-    printf(" WARNING: using ephemeris older (or newer!) than 4 hours.\n");
+    DIAG(DIAG_WARN, DIAG_EVENT_EPHEMERIS_STALE,
+         "Using ephemeris older (or newer!) than 4 hours");
+
+  ephemeris_prepared_t tmp;
+  const ephemeris_prepared_t *p = prepared(ephemeris, &tmp);
 
   // Calculate position per IS-GPS-200D p 97 Table 20-IV
-  a = ephemeris->sqrta * ephemeris->sqrta;  // [m] Semi-major axis
-  ma_dot = sqrt (NAV_GM / (a * a * a)) + ephemeris->dn; // [rad/sec] Corrected mean motion
+  a = p->a;  // [m] Semi-major axis
+  ma_dot = p->ma_dot; // [rad/sec] Corrected mean motion
   ma = ephemeris->m0 + ma_dot * tdiff;  // [rad] Corrected mean anomaly
 
   // Iteratively solve for the Eccentric Anomaly (from Keith Alter and David Johnston)
@@ -89,10 +153,10 @@ int calc_sat_pos(double pos[3], double vel[3],
   ea_dot = ma_dot / tempd1;
 
   // Relativistic correction term
-  einstein = -4.442807633E-10 * ecc * ephemeris->sqrta * sin (ea);
+  einstein = p->rel * sin (ea);
 
   // Begin calc for True Anomaly and Argument of Latitude
-  tempd2 = sqrt (1.0 - ecc * ecc);
+  tempd2 = p->sqrt_1_ecc2;
   al = atan2 (tempd2 * sin (ea), cos (ea) - ecc) + ephemeris->w; // [rad] Argument of Latitude = True Anomaly + Argument of Perigee
   al_dot = tempd2 * ea_dot / tempd1;
 
@@ -127,8 +191,8 @@ int calc_sat_pos(double pos[3], double vel[3],
   y_dot = r_dot * sin (cal) + x * cal_dot;
 
   // Corrected longitude of ascenting node
-  om_dot = ephemeris->omegadot - NAV_OMEGAE_DOT;
-  om = ephemeris->omega0 + tdiff * om_dot - NAV_OMEGAE_DOT * ephemeris->toe.tow;
+  om_dot = p->om_dot;
+  om = p->om0 + tdiff * om_dot;
 
   // Compute the satellite's position in Earth-Centered Earth-Fixed coordiates
   pos[0] = x * cos (om) - y * cos (inc) * sin (om);
@@ -147,6 +211,294 @@ int calc_sat_pos(double pos[3], double vel[3],
   return 0;
 }
 
+/* Batch satellite position calculation.
+ *
+ * calc_sat_pos_batch() evaluates the equations of calc_sat_pos() for eight
+ * satellites at a time. The kernel is written with eight wide GCC vector
+ * types, compiled once for plain SSE2 and again for AVX2 and AVX-512, and
+ * avoids calls to the math library: sin and cos are evaluated together by
+ * sincos_v8(), Kepler's equation is solved with a fixed number of Newton
+ * iterations and the true anomaly is only needed through its sine and
+ * cosine, so there is no atan2. */
+
+/** Satellites evaluated together by the batch kernel. */
+#define SAT_POS_LANES 8
+
+/** Newton iterations of Kepler's equation in calc_sat_pos_batch(). From
+ * E = M the error is below 1e-11 rad after two iterations and at the limit
+ * of double precision after three for the eccentricities up to 0.03 of the
+ * GPS ICD, the fourth leaves a margin. */
+#define KEPLER_ITERATIONS 4
+
+typedef double v8df __attribute__((vector_size(64)));
+typedef s64 v8di __attribute__((vector_size(64)));
+
+/* pi/2 in three parts, q * PIO2_1 and q * PIO2_2 are exact for the small
+ * quadrant numbers q seen here (Cephes). */
+#define PIO2_1 1.57079625129699707031E0
+#define PIO2_2 7.54978941586159635336E-8
+#define PIO2_3 5.39030285815811905290E-15
+
+/** Round to the nearest integer, for |x| < 2^51. */
+#define ROUND_V8(x) (((x) + 0x1.8p52) - 0x1.8p52)
+
+/** Sine and cosine of eight angles, to within a few ulp for |x| < 1e5.
+ * Reduces to |z| <= pi/4 and uses the Cephes sin and cos polynomials. */
+static inline __attribute__((always_inline))
+void sincos_v8(const v8df *x, v8df *s, v8df *c)
+{
+  v8df q = ROUND_V8(*x * M_2_PI);
+  v8df z = ((*x - q * PIO2_1) - q * PIO2_2) - q * PIO2_3;
+  v8df zz = z * z;
+
+  v8df ps = (v8df){0} + 1.58962301576546568060E-10;
+  ps = ps * zz - 2.50507477628578072866E-8;
+  ps = ps * zz + 2.75573136213857245213E-6;
+  ps = ps * zz - 1.98412698295895385996E-4;
+  ps = ps * zz + 8.33333333332211858878E-3;
+  ps = ps * zz - 1.66666666666666307295E-1;
+  ps = z + z * zz * ps;
+
+  v8df pc = (v8df){0} - 1.13585365213876817300E-11;
+  pc = pc * zz + 2.08757008419747316778E-9;
+  pc = pc * zz - 2.75573141792967388112E-7;
+  pc = pc * zz + 2.48015872888517045348E-5;
+  pc = pc * zz - 1.38888888888730564116E-3;
+  pc = pc * zz + 4.16666666666665929218E-2;
+  pc = 1.0 - 0.5 * zz + zz * zz * pc;
+
+  /* Quadrant q mod 4, using floor(q/4) = round(q/4 - 3/8) for integer q. */
+  v8df q4 = q - 4.0 * ROUND_V8(q * 0.25 - 0.375);
+  v8di swap = (q4 == 1.0) | (q4 == 3.0);
+  v8di neg_s = q4 >= 2.0;
+  v8di neg_c = (q4 == 1.0) | (q4 == 2.0);
+  v8di sign = (v8di){0} + INT64_MIN;
+
+  v8di is = (v8di)ps, ic = (v8di)pc;
+  *s = (v8df)(((is & ~swap) | (ic & swap)) ^ (neg_s & sign));
+  *c = (v8df)(((ic & ~swap) | (is & swap)) ^ (neg_c & sign));
+}
+
+/** Load eight doubles, without alignment requirements. */
+#define LOAD_V8(p) ({ v8df v_; memcpy(&v_, (p), sizeof(v_)); v_; })
+
+/** Satellite positions of a batch at `tk` seconds from toe and `tc`
+ * seconds from toc. `out` receives the ECEF position and velocity
+ * components, clock error and clock rate error of each satellite. */
+static inline __attribute__((always_inline))
+void sat_pos_body(const ephemeris_batch_t *b, const double tk[],
+                  const double tc[], double out[8][EPHEMERIS_BATCH_MAX])
+{
+  for (u32 i=0; i<b->n; i+=SAT_POS_LANES) {
+    v8df t = LOAD_V8(&tk[i]);
+    v8df ecc = LOAD_V8(&b->ecc[i]);
+    v8df ma_dot = LOAD_V8(&b->ma_dot[i]);
+    v8df ma = LOAD_V8(&b->m0[i]) + ma_dot * t;
+
+    v8df ea = ma, sin_ea, cos_ea;
+    for (u32 k=0; k<KEPLER_ITERATIONS; k++) {
+      sincos_v8(&ea, &sin_ea, &cos_ea);
+      ea = ea + (ma - ea + ecc * sin_ea) / (1.0 - ecc * cos_ea);
+    }
+    sincos_v8(&ea, &sin_ea, &cos_ea);
+    v8df tempd1 = 1.0 - ecc * cos_ea;
+    v8df ea_dot = ma_dot / tempd1;
+    v8df einstein = LOAD_V8(&b->rel[i]) * sin_ea;
+
+    /* Sine and cosine of the true anomaly, then of the argument of
+     * latitude and twice it. */
+    v8df tempd2 = LOAD_V8(&b->sqrt_1_ecc2[i]);
+    v8df sin_nu = tempd2 * sin_ea / tempd1;
+    v8df cos_nu = (cos_ea - ecc) / tempd1;
+    v8df sin_w = LOAD_V8(&b->sin_w[i]), cos_w = LOAD_V8(&b->cos_w[i]);
+    v8df sin_al = sin_nu * cos_w + cos_nu * sin_w;
+    v8df cos_al = cos_nu * cos_w - sin_nu * sin_w;
+    v8df sin_2al = 2.0 * sin_al * cos_al;
+    v8df cos_2al = cos_al * cos_al - sin_al * sin_al;
+    v8df al_dot = tempd2 * ea_dot / tempd1;
+
+    v8df cus = LOAD_V8(&b->cus[i]), cuc = LOAD_V8(&b->cuc[i]);
+    v8df du = cus * sin_2al + cuc * cos_2al;
+    v8df cal_dot = al_dot * (1.0 + 2.0 * (cus * cos_2al - cuc * sin_2al));
+
+    v8df crs = LOAD_V8(&b->crs[i]), crc = LOAD_V8(&b->crc[i]);
+    v8df a = LOAD_V8(&b->a[i]);
+    v8df r = a * tempd1 + crc * cos_2al + crs * sin_2al;
+    v8df r_dot = a * ecc * sin_ea * ea_dot
+                 + 2.0 * al_dot * (crs * cos_2al - crc * sin_2al);
+
+    v8df cis = LOAD_V8(&b->cis[i]), cic = LOAD_V8(&b->cic[i]);
+    v8df inc_dot0 = LOAD_V8(&b->inc_dot[i]);
+    v8df inc = LOAD_V8(&b->inc[i]) + inc_dot0 * t
+               + cic * cos_2al + cis * sin_2al;
+    v8df inc_dot = inc_dot0 + 2.0 * al_dot * (cis * cos_2al - cic * sin_2al);
+
+    /* Corrected argument of latitude, al + du. */
+    v8df sin_du, cos_du;
+    sincos_v8(&du, &sin_du, &cos_du);
+    v8df sin_cal = sin_al * cos_du + cos_al * sin_du;
+    v8df cos_cal = cos_al * cos_du - sin_al * sin_du;
+
+    v8df x = r * cos_cal;
+    v8df y = r * sin_cal;
+    v8df x_dot = r_dot * cos_cal - y * cal_dot;
+    v8df y_dot = r_dot * sin_cal + x * cal_dot;
+
+    v8df om_dot = LOAD_V8(&b->om_dot[i]);
+    v8df om = LOAD_V8(&b->om0[i]) + t * om_dot;
+    v8df sin_om, cos_om, sin_inc, cos_inc;
+    sincos_v8(&om, &sin_om, &cos_om);
+    sincos_v8(&inc, &sin_inc, &cos_inc);
+
+    v8df pos0 = x * cos_om - y * cos_inc * sin_om;
+    v8df pos1 = x * sin_om + y * cos_inc * cos_om;
+    v8df pos2 = y * sin_inc;
+    v8df tempd3 = y_dot * cos_inc - y * sin_inc * inc_dot;
+    v8df vel0 = -om_dot * pos1 + x_dot * cos_om - tempd3 * sin_om;
+    v8df vel1 = om_dot * pos0 + x_dot * sin_om + tempd3 * cos_om;
+    v8df vel2 = y * cos_inc * inc_dot + y_dot * sin_inc;
+
+    v8df c = LOAD_V8(&tc[i]);
+    v8df af1 = LOAD_V8(&b->af1[i]), af2 = LOAD_V8(&b->af2[i]);
+    v8df clock_err = LOAD_V8(&b->af0[i]) + c * (af1 + c * af2)
+                     - LOAD_V8(&b->tgd[i]) + einstein;
+    v8df clock_rate_err = af1 + 2.0 * c * af2;
+
+    memcpy(&out[0][i], &pos0, sizeof(pos0));
+    memcpy(&out[1][i], &pos1, sizeof(pos1));
+    memcpy(&out[2][i], &pos2, sizeof(pos2));
+    memcpy(&out[3][i], &vel0, sizeof(vel0));
+    memcpy(&out[4][i], &vel1, sizeof(vel1));
+    memcpy(&out[5][i], &vel2, sizeof(vel2));
+    memcpy(&out[6][i], &clock_err, sizeof(clock_err));
+    memcpy(&out[7][i], &clock_rate_err, sizeof(clock_rate_err));
+  }
+}
+
+static void sat_pos_generic(const ephemeris_batch_t *b, const double tk[],
+                            const double tc[],
+                            double out[8][EPHEMERIS_BATCH_MAX])
+{
+  sat_pos_body(b, tk, tc, out);
+}
+
+#ifdef CPU_FEATURES_X86
+
+__attribute__((target("avx2,fma")))
+static void sat_pos_avx2(const ephemeris_batch_t *b, const double tk[],
+                         const double tc[],
+                         double out[8][EPHEMERIS_BATCH_MAX])
+{
+  sat_pos_body(b, tk, tc, out);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512dq,avx512vl")))
+static void sat_pos_avx512(const ephemeris_batch_t *b, const double tk[],
+                           const double tc[],
+                           double out[8][EPHEMERIS_BATCH_MAX])
+{
+  sat_pos_body(b, tk, tc, out);
+}
+
+#endif
+
+/** Fill in a batch of ephemerides for calc_sat_pos_batch().
+ *
+ * \param b           Batch to fill in.
+ * \param n           Number of ephemerides, at most `EPHEMERIS_BATCH_MAX`.
+ * \param ephemerides Array of pointers to the ephemerides.
+ * \return `0` on success, `-1` if `n` is too large.
+ */
+s8 ephemeris_batch_set(ephemeris_batch_t *b, u8 n,
+                       ephemeris_t *ephemerides[])
+{
+  if (n > EPHEMERIS_BATCH_MAX)
+    return -1;
+
+  memset(b, 0, sizeof(*b));
+  b->n = n;
+  for (u8 i=0; i<n; i++) {
+    const ephemeris_t *e = ephemerides[i];
+    ephemeris_prepared_t tmp;
+    const ephemeris_prepared_t *p = prepared(e, &tmp);
+    b->a[i] = p->a;
+    b->ma_dot[i] = p->ma_dot;
+    b->m0[i] = e->m0;
+    b->ecc[i] = e->ecc;
+    b->sqrt_1_ecc2[i] = p->sqrt_1_ecc2;
+    b->rel[i] = p->rel;
+    b->sin_w[i] = p->sin_w;
+    b->cos_w[i] = p->cos_w;
+    b->crs[i] = e->crs;
+    b->crc[i] = e->crc;
+    b->cus[i] = e->cus;
+    b->cuc[i] = e->cuc;
+    b->cis[i] = e->cis;
+    b->cic[i] = e->cic;
+    b->inc[i] = e->inc;
+    b->inc_dot[i] = e->inc_dot;
+    b->om0[i] = p->om0;
+    b->om_dot[i] = p->om_dot;
+    b->af0[i] = e->af0;
+    b->af1[i] = e->af1;
+    b->af2[i] = e->af2;
+    b->tgd[i] = e->tgd;
+    b->toe[i] = e->toe;
+    b->toc[i] = e->toc;
+  }
+  return 0;
+}
+
+/** Calculate the positions, velocities and clock errors of a batch of
+ * satellites, each at its own time of transmission.
+ *
+ * Equivalent to calc_sat_pos() for each satellite of the batch, with
+ * results agreeing to well under a millimetre. AVX2 or AVX-512 kernels are
+ * used when available, see cpu_features().
+ *
+ * \param b              Batch of ephemerides, see ephemeris_batch_set().
+ * \param tot            Time of transmission of each satellite.
+ * \param pos            Satellite ECEF positions [m].
+ * \param vel            Satellite ECEF velocities [m/s].
+ * \param clock_err      Satellite clock errors [s].
+ * \param clock_rate_err Satellite clock rate errors [s/s].
+ */
+void calc_sat_pos_batch(const ephemeris_batch_t *b, const gps_time_t tot[],
+                        double pos[][3], double vel[][3],
+                        double clock_err[], double clock_rate_err[])
+{
+  double tk[EPHEMERIS_BATCH_MAX] = {0};
+  double tc[EPHEMERIS_BATCH_MAX] = {0};
+  double out[8][EPHEMERIS_BATCH_MAX];
+
+  for (u8 i=0; i<b->n; i++) {
+    tk[i] = gpsdifftime(tot[i], b->toe[i]);
+    tc[i] = gpsdifftime(tot[i], b->toc[i]);
+    if (fabs(tk[i]) > 4*3600)
+      DIAG(DIAG_WARN, DIAG_EVENT_EPHEMERIS_STALE,
+           "Using ephemeris older (or newer!) than 4 hours");
+  }
+
+#ifdef CPU_FEATURES_X86
+  u32 f = cpu_features();
+  if (f & CPU_FEATURE_AVX512)
+    sat_pos_avx512(b, tk, tc, out);
+  else if (f & CPU_FEATURE_AVX2)
+    sat_pos_avx2(b, tk, tc, out);
+  else
+#endif
+    sat_pos_generic(b, tk, tc, out);
+
+  for (u8 i=0; i<b->n; i++) {
+    for (u8 j=0; j<3; j++) {
+      pos[i][j] = out[j][i];
+      vel[i][j] = out[3 + j][i];
+    }
+    clock_err[i] = out[6][i];
+    clock_rate_err[i] = out[7][i];
+  }
+}
+
 double predict_range(double rx_pos[3],
                      gps_time_t tot,
                      ephemeris_t *ephemeris)
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "ephemeris_store.h"
+
+/** \defgroup ephemeris_store Ephemeris Store
+ * Ephemerides of all the satellites, shared between threads.
+ *
+ * The store keeps the current and the previous issue of each satellite's
+ * ephemeris, so measurements made just before a new issue was decoded can
+ * still be processed with the issue they were made with.
+ * ephemeris_store_get() picks the issue closest to a given time, and
+ * ephemeris_store_get_iode() the issue with a given IODE.
+ *
+ * Updates come from one thread at a time, usually the one decoding the
+ * navigation messages, while any number of threads read without locking.
+ * Each satellite has two records. An update writes the issues to the
+ * record that isn't published and then publishes it by storing its
+ * version, in the manner of RCU. Readers copy the ephemeris out of the
+ * published record and check its version afterwards, so a read that
+ * overlapped the record being reused by the next update but one is
+ * retried, as with a seqlock. Updates are hours apart, so in practice
+ * readers never wait.
+ * \{ */
+
+/** Are two ephemerides the same issue? */
+static bool same_issue(const ephemeris_t *a, const ephemeris_t *b)
+{
+  return a->iode == b->iode && a->toe.wn == b->toe.wn &&
+         a->toe.tow == b->toe.tow;
+}
+
+/** Choice of an issue from a record, returning its index or `-1`. */
+typedef s8 (*pick_t)(const ephemeris_store_record_t *r, const void *arg);
+
+/** Issue closest to time `*arg` within `EPHEMERIS_STORE_MAX_AGE`. */
+static s8 pick_time(const ephemeris_store_record_t *r, const void *arg)
+{
+  gps_time_t t = *(const gps_time_t *)arg;
+  s8 best = -1;
+  double best_dt = EPHEMERIS_STORE_MAX_AGE;
+  for (u8 i=0; i<r->n_issues && i<EPHEMERIS_STORE_ISSUES; i++) {
+    double dt = fabs(gpsdifftime(t, r->issue[i].toe));
+    if (dt < best_dt) {
+      best = i;
+      best_dt = dt;
+    }
+  }
+  return best;
+}
+
+/** Issue with IODE `*arg`. */
+static s8 pick_iode(const ephemeris_store_record_t *r, const void *arg)
+{
+  u8 iode = *(const u8 *)arg;
+  for (u8 i=0; i<r->n_issues && i<EPHEMERIS_STORE_ISSUES; i++)
+    if (r->issue[i].iode == iode)
+      return i;
+  return -1;
+}
+
+/** Copy the issue chosen by `pick` out of the published record of a
+ * satellite, retrying if the record was reused while it was read. */
+static s8 read_issue(const ephemeris_store_t *s, u8 prn, pick_t pick,
+                     const void *arg, ephemeris_t *e)
+{
+  if (prn >= EPHEMERIS_STORE_N_SATS)
+    return -1;
+  const ephemeris_store_sat_t *sat = &s->sat[prn];
+
+  while (true) {
+    u32 v = __atomic_load_n(&sat->version, __ATOMIC_ACQUIRE);
+    if (v == 0)
+      return -1;
+    const ephemeris_store_record_t *r = &sat->rec[v % EPHEMERIS_STORE_VERSIONS];
+    if (__atomic_load_n(&r->version, __ATOMIC_ACQUIRE) != v)
+      continue;
+
+    s8 i = pick(r, arg);
+    if (i >= 0)
+      memcpy(e, &r->issue[i], sizeof(*e));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&r->version, __ATOMIC_RELAXED) == v)
+      return i >= 0 ? 0 : -1;
+  }
+}
+
+/** Initialise an empty ephemeris store.
+ *
+ * \param s Ephemeris store.
+ */
+void ephemeris_store_init(ephemeris_store_t *s)
+{
+  memset(s, 0, sizeof(*s));
+}
+
+/** Add a newly decoded ephemeris to the store.
+ *
+ * The previous issue is kept along with the new one. Updates must not be
+ * made from more than one thread at a time, reads may be made from any
+ * thread at any time.
+ *
+ * \param s Ephemeris store.
+ * \param e Ephemeris, stored by `e->prn`.
+ * \return `1` if a new issue was stored, `0` if the issue was already in
+ *         the store, `-1` if the ephemeris is invalid or its PRN is out of
+ *         range.
+ */
+s8 ephemeris_store_update(ephemeris_store_t *s, const ephemeris_t *e)
+{
+  if (e->prn >= EPHEMERIS_STORE_N_SATS || !e->valid)
+    return -1;
+  ephemeris_store_sat_t *sat = &s->sat[e->prn];
+
+  /* Only this thread changes the version. */
+  u32 v = sat->version;
+  const ephemeris_store_record_t *cur = 0;
+  if (v) {
+    cur = &sat->rec[v % EPHEMERIS_STORE_VERSIONS];
+    for (u8 i=0; i<cur->n_issues; i++)
+      if (same_issue(&cur->issue[i], e))
+        return 0;
+  }
+
+  /* Skipping version 0 keeps the new record apart from the current one. */
+  u32 next = v + 1;
+  if (next == 0)
+    next = EPHEMERIS_STORE_VERSIONS;
+  ephemeris_store_record_t *r = &sat->rec[next % EPHEMERIS_STORE_VERSIONS];
+
+  __atomic_store_n(&r->version, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  r->issue[0] = *e;
+  r->n_issues = 1;
+  if (cur) {
+    r->issue[1] = cur->issue[0];
+    r->n_issues = 2;
+    /* Out of order updates, e.g. replayed ones, keep the latest first. */
+    if (gpsdifftime(e->toe, cur->issue[0].toe) < 0) {
+      r->issue[0] = cur->issue[0];
+      r->issue[1] = *e;
+    }
+  }
+
+  __atomic_store_n(&r->version, next, __ATOMIC_RELEASE);
+  __atomic_store_n(&sat->version, next, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/** Best ephemeris of a satellite at a given time, the issue stored with
+ * its toe closest to the time.
+ *
+ * \param s   Ephemeris store.
+ * \param prn PRN of the satellite, counting from 0.
+ * \param t   Time the ephemeris is to be used for.
+ * \param e   Set to a copy of the ephemeris.
+ * \return `0` on success, `-1` if there is no issue within
+ *         `EPHEMERIS_STORE_MAX_AGE` of `t`.
+ */
+s8 ephemeris_store_get(const ephemeris_store_t *s, u8 prn, gps_time_t t,
+                       ephemeris_t *e)
+{
+  return read_issue(s, prn, pick_time, &t, e);
+}
+
+/** Ephemeris of a satellite with a given issue of data.
+ *
+ * \param s    Ephemeris store.
+ * \param prn  PRN of the satellite, counting from 0.
+ * \param iode Issue of data, ephemeris (IODE).
+ * \param e    Set to a copy of the ephemeris.
+ * \return `0` on success, `-1` if the issue is not in the store.
+ */
+s8 ephemeris_store_get_iode(const ephemeris_store_t *s, u8 prn, u8 iode,
+                            ephemeris_t *e)
+{
+  return read_issue(s, prn, pick_iode, &iode, e);
+}
+
+/** \} */
+
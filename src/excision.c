@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "excision.h"
+
+/** \defgroup excision Interference excision
+ * Frequency domain excision of narrowband interference.
+ *
+ * The sample stream is split into blocks overlapping by half a block,
+ * each weighted by a square root Hann window and transformed to the
+ * frequency domain. Frequency bins standing out above the noise floor of
+ * the averaged power spectrum are zeroed and the blocks are transformed
+ * back, weighted by the window again and overlap-added. The squared window
+ * sums to one over the overlapping blocks so with nothing excised the
+ * samples come out unchanged, up to quantisation.
+ *
+ * The GNSS signals are well below the noise so only interference stands
+ * out. Zeroing a few bins removes a narrowband interferer together with a
+ * negligible fraction of the signal power, so the correlators downstream
+ * see the noise floor rather than the interferer.
+ *
+ * The input is real so two consecutive blocks are transformed at once, as
+ * the real and imaginary parts of one complex FFT. Both blocks get the same
+ * excision mask, symmetric in frequency, so they separate again after the
+ * inverse transform.
+ * \{ */
+
+/** Weight of the latest block in the averaged power spectrum. */
+#define EXCISION_AVG_GAIN 0.125f
+
+/** Bins above this multiple of the mean power are left out of the noise
+ * floor estimate. */
+#define EXCISION_FLOOR_CLIP 3.0f
+
+/** Output samples are clipped to this magnitude. */
+#define EXCISION_OUT_MAX 127
+
+/** Initialise an interference excision stage.
+ *
+ * \param ex           Excision state to initialise.
+ * \param fs           Sample rate in Hz.
+ * \param n            Block length, even. The FFT is fastest for lengths
+ *                     with only small prime factors and the frequency
+ *                     resolution is `fs / n`.
+ * \param threshold_db Power above the noise floor at which a frequency bin
+ *                     is excised, in dB.
+ * \return `0` on success, `-1` if the parameters are invalid or `-2` if an
+ *         allocation failed.
+ */
+s8 excision_init(excision_t *ex, double fs, u32 n, float threshold_db)
+{
+  memset(ex, 0, sizeof(*ex));
+
+  if (fs <= 0 || n < 16 || n % 2 || threshold_db <= 0)
+    return -1;
+
+  u32 h = n / 2;
+  ex->fs = fs;
+  ex->n = n;
+  ex->threshold = powf(10, threshold_db / 10);
+  ex->fft = fft_plan_new(n);
+  ex->window = malloc(n * sizeof(float));
+  ex->buf = calloc(3 * h, sizeof(float));
+  ex->ola = calloc(3 * h, sizeof(float));
+  ex->avg = malloc((h + 1) * sizeof(float));
+  ex->spec = malloc(n * sizeof(fft_cpx_t));
+  ex->work = malloc(n * sizeof(fft_cpx_t));
+  ex->out = calloc(n, 1);
+  if (!ex->fft || !ex->window || !ex->buf || !ex->ola || !ex->avg ||
+      !ex->spec || !ex->work || !ex->out) {
+    excision_free(ex);
+    return -2;
+  }
+
+  for (u32 k=0; k<n; k++)
+    ex->window[k] = sin(M_PI * k / n);
+
+  /* The stream is preceded by half a block of zeros so that every sample
+   * is covered by two blocks. */
+  ex->fill = h;
+
+  return 0;
+}
+
+/** Free the memory held by an interference excision stage.
+ *
+ * \param ex Excision state initialised with excision_init().
+ */
+void excision_free(excision_t *ex)
+{
+  if (ex->fft)
+    fft_plan_destroy(ex->fft);
+  free(ex->window);
+  free(ex->buf);
+  free(ex->ola);
+  free(ex->avg);
+  free(ex->spec);
+  free(ex->work);
+  free(ex->out);
+  ex->fft = 0;
+  ex->window = ex->buf = ex->ola = ex->avg = 0;
+  ex->spec = ex->work = 0;
+  ex->out = 0;
+}
+
+/** Record an interferer, keeping the list sorted strongest first. */
+static void add_interferer(excision_t *ex, float freq, float power,
+                           u32 n_bins)
+{
+  u8 i = ex->n_interferers;
+  if (i == EXCISION_MAX_INTERFERERS) {
+    if (power <= ex->interferers[i - 1].power)
+      return;
+    i--;
+  } else {
+    ex->n_interferers++;
+  }
+  for (; i > 0 && ex->interferers[i - 1].power < power; i--)
+    ex->interferers[i] = ex->interferers[i - 1];
+  ex->interferers[i] = (excision_interferer_t){
+    .freq = freq, .power = power, .n_bins = n_bins
+  };
+}
+
+/** Zero frequency bin `k` of both blocks. */
+static void excise_bin(excision_t *ex, u32 k)
+{
+  ex->spec[k].re = ex->spec[k].im = 0;
+  ex->spec[(ex->n - k) % ex->n].re = ex->spec[(ex->n - k) % ex->n].im = 0;
+}
+
+/** Find the bins of the averaged power spectrum above the threshold and
+ * excise them, with one bin either side to cover the window's leakage. */
+static void excise(excision_t *ex)
+{
+  u32 h = ex->n / 2;
+
+  float mean = 0;
+  for (u32 k=1; k<h; k++)
+    mean += ex->avg[k];
+  mean /= h - 1;
+  float floor_sum = 0;
+  u32 floor_n = 0;
+  for (u32 k=1; k<h; k++) {
+    if (ex->avg[k] < EXCISION_FLOOR_CLIP * mean) {
+      floor_sum += ex->avg[k];
+      floor_n++;
+    }
+  }
+  float noise_floor = floor_n ? floor_sum / floor_n : mean;
+  float thres = ex->threshold * noise_floor;
+
+  ex->n_interferers = 0;
+  for (u32 k=0; k<=h; k++) {
+    if (ex->avg[k] <= thres)
+      continue;
+
+    /* Run of bins above the threshold and its peak. */
+    u32 start = k, peak = k;
+    for (; k<=h && ex->avg[k] > thres; k++)
+      if (ex->avg[k] > ex->avg[peak])
+        peak = k;
+    u32 lo = start ? start - 1 : 0;
+    u32 hi = k <= h ? k : h;
+    for (u32 j=lo; j<=hi; j++)
+      excise_bin(ex, j);
+
+    /* Interpolate the peak frequency with a parabola through the peak
+     * and its neighbours. */
+    float delta = 0;
+    if (peak > 0 && peak < h) {
+      float a = ex->avg[peak - 1], b = ex->avg[peak], c = ex->avg[peak + 1];
+      float d = a - 2*b + c;
+      if (d < 0)
+        delta = 0.5f * (a - c) / d;
+    }
+    add_interferer(ex, (peak + delta) * ex->fs / ex->n,
+                   10 * log10f(ex->avg[peak] / noise_floor), hi - lo + 1);
+  }
+}
+
+/** Excise interference from the two blocks held in the input buffer,
+ * adding them to the overlap-add accumulator. */
+static void process_blocks(excision_t *ex)
+{
+  u32 n = ex->n, h = n / 2;
+
+  for (u32 k=0; k<n; k++) {
+    ex->spec[k].re = ex->window[k] * ex->buf[k];
+    ex->spec[k].im = ex->window[k] * ex->buf[h + k];
+  }
+  fft_forward(ex->fft, ex->spec, ex->work);
+
+  /* Power of both blocks in each positive frequency bin, the spectra of
+   * the real blocks are conjugate symmetric so the positive and negative
+   * frequency bins of the packed transform together hold both. */
+  for (u32 k=0; k<=h; k++) {
+    fft_cpx_t a = ex->spec[k], b = ex->spec[(n - k) % n];
+    float p = a.re*a.re + a.im*a.im + b.re*b.re + b.im*b.im;
+    if (ex->avg_init)
+      ex->avg[k] += EXCISION_AVG_GAIN * (p - ex->avg[k]);
+    else
+      ex->avg[k] = p;
+  }
+  ex->avg_init = true;
+
+  excise(ex);
+
+  fft_inverse(ex->fft, ex->spec, ex->work);
+  float scale = 1.0f / n;
+  for (u32 k=0; k<n; k++) {
+    float w = scale * ex->window[k];
+    ex->ola[k] += w * ex->spec[k].re;
+    ex->ola[h + k] += w * ex->spec[k].im;
+  }
+}
+
+/** Excise narrowband interference from a block of samples.
+ *
+ * Processes the samples as a continuation of the stream passed to previous
+ * calls, so the input can be split into blocks of any size. There is one
+ * output sample per input sample, delayed by one and a half blocks: output
+ * sample `i` of the stream is input sample `i - 3 * ex->n / 2`, and the
+ * first `3 * ex->n / 2` outputs are zero. The output never gets ahead of
+ * the input so `out` may be the same buffer as `in`.
+ *
+ * After each pair of blocks the interferers found are updated in
+ * `ex->interferers`, see excision_interferer_t.
+ *
+ * \param ex  Excision state initialised with excision_init().
+ * \param in  Input samples.
+ * \param n   Number of input samples and of output samples.
+ * \param out Output samples.
+ */
+void excision_process(excision_t *ex, const s8 *in, u32 n, s8 *out)
+{
+  u32 h = ex->n / 2;
+
+  for (u32 i=0; i<n; ) {
+    /* Up to the end of the blocks being collected, which is also the end of
+     * the finished output. */
+    u32 m = 3*h - ex->fill;
+    if (m > n - i)
+      m = n - i;
+    for (u32 k=0; k<m; k++)
+      ex->buf[ex->fill + k] = in[i + k];
+    memcpy(&out[i], &ex->out[ex->fill - h], m);
+    ex->fill += m;
+    i += m;
+    if (ex->fill < 3*h)
+      break;
+
+    process_blocks(ex);
+
+    /* The first block's worth of the accumulator now has all its
+     * contributions. */
+    for (u32 k=0; k<2*h; k++) {
+      float v = ex->ola[k];
+      if (v > EXCISION_OUT_MAX)
+        v = EXCISION_OUT_MAX;
+      if (v < -EXCISION_OUT_MAX)
+        v = -EXCISION_OUT_MAX;
+      ex->out[k] = (s8)lrintf(v);
+    }
+
+    memmove(ex->buf, &ex->buf[2*h], h * sizeof(float));
+    memmove(ex->ola, &ex->ola[2*h], h * sizeof(float));
+    memset(&ex->ola[h], 0, 2 * h * sizeof(float));
+    ex->fill = h;
+  }
+}
+
+/** \} */
+
@@ -0,0 +1,523 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE3__
+#include <pmmintrin.h>
+#endif
+
+#include "fft.h"
+
+/** \defgroup fft FFT
+ * Mixed radix complex FFT.
+ *
+ * A self-sorting (Stockham) FFT for any length. The length is factored into
+ * radix 4 and 2 stages followed by odd prime radix stages, each stage reads
+ * one buffer and writes the other so no bit reversal pass is needed. Radix 2
+ * and 4 have dedicated butterflies. Odd radices up to ODD_RADIX_SYM_MAX use
+ * a symmetric butterfly, which still takes O(p^2) operations per radix p
+ * butterfly, and larger ones a direct DFT, so lengths with only small prime
+ * factors are fastest.
+ *
+ * With SSE3 each butterfly works on two adjacent strided transforms at once,
+ * which is possible in every stage after the first when the length is even.
+ * \{ */
+
+static void factorise(u32 n, u8 *n_stages, u32 radices[])
+{
+  *n_stages = 0;
+  while (n % 4 == 0) {
+    radices[(*n_stages)++] = 4;
+    n /= 4;
+  }
+  if (n % 2 == 0) {
+    radices[(*n_stages)++] = 2;
+    n /= 2;
+  }
+  for (u32 p=3; n > 1; p+=2) {
+    if (p*p > n)
+      p = n;
+    while (n % p == 0) {
+      radices[(*n_stages)++] = p;
+      n /= p;
+    }
+  }
+}
+
+/** Create a plan for FFTs of length `n`.
+ *
+ * Any length is supported, but lengths with large prime factors are slow as
+ * the cost per sample of each stage is proportional to its radix.
+ *
+ * \param n Transform length.
+ * \return Pointer to the new plan, or `NULL` if the allocation failed.
+ */
+fft_plan_t *fft_plan_new(u32 n)
+{
+  if (n == 0)
+    return NULL;
+
+  fft_plan_t *plan = malloc(sizeof(fft_plan_t));
+  if (!plan)
+    return NULL;
+
+  u32 radices[FFT_MAX_STAGES];
+  plan->n = n;
+  factorise(n, &plan->n_stages, radices);
+
+  /* Each stage needs (radix - 1) * m twiddles plus radix roots. */
+  u32 total = 0;
+  for (u8 i=0; i<plan->n_stages; i++)
+    total += 2*radices[i];
+  total += 2*n;
+  plan->buf = malloc(total * sizeof(fft_cpx_t));
+  if (!plan->buf) {
+    free(plan);
+    return NULL;
+  }
+
+  fft_cpx_t *b = plan->buf;
+  u32 s = 1;
+  for (u8 i=0; i<plan->n_stages; i++) {
+    fft_stage_t *st = &plan->stages[i];
+    u32 p = radices[i];
+    u32 len = n / s;
+    st->radix = p;
+    st->m = len / p;
+    st->s = s;
+
+    st->tw = b;
+    for (u32 j=0; j<st->m; j++) {
+      for (u32 k=1; k<p; k++) {
+        double a = -2*M_PI * (double)((u64)j*k % len) / len;
+        b->re = cos(a);
+        b->im = sin(a);
+        b++;
+      }
+    }
+
+    st->roots = b;
+    for (u32 k=0; k<p; k++) {
+      double a = -2*M_PI * k / p;
+      b->re = cos(a);
+      b->im = sin(a);
+      b++;
+    }
+
+    s *= p;
+  }
+
+  return plan;
+}
+
+/** Free an FFT plan created with fft_plan_new().
+ *
+ * \param plan FFT plan.
+ */
+void fft_plan_destroy(fft_plan_t *plan)
+{
+  free(plan->buf);
+  free(plan);
+}
+
+static inline fft_cpx_t cmul(fft_cpx_t a, fft_cpx_t b)
+{
+  fft_cpx_t r = {
+    .re = a.re*b.re - a.im*b.im,
+    .im = a.re*b.im + a.im*b.re
+  };
+  return r;
+}
+
+static void radix2(const fft_stage_t *st, u32 j,
+                   const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 s = st->s, m = st->m;
+  fft_cpx_t w = st->tw[j];
+  for (u32 q=0; q<s; q++) {
+    fft_cpx_t a = x[q + s*j];
+    fft_cpx_t b = x[q + s*(j + m)];
+    fft_cpx_t d = {a.re - b.re, a.im - b.im};
+    y[q + s*(2*j)].re = a.re + b.re;
+    y[q + s*(2*j)].im = a.im + b.im;
+    y[q + s*(2*j + 1)] = cmul(d, w);
+  }
+}
+
+static void radix4(const fft_stage_t *st, u32 j,
+                   const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 s = st->s, m = st->m;
+  const fft_cpx_t *w = &st->tw[3*j];
+  for (u32 q=0; q<s; q++) {
+    fft_cpx_t a = x[q + s*j];
+    fft_cpx_t b = x[q + s*(j + m)];
+    fft_cpx_t c = x[q + s*(j + 2*m)];
+    fft_cpx_t d = x[q + s*(j + 3*m)];
+    fft_cpx_t apc = {a.re + c.re, a.im + c.im};
+    fft_cpx_t amc = {a.re - c.re, a.im - c.im};
+    fft_cpx_t bpd = {b.re + d.re, b.im + d.im};
+    /* -j * (b - d) */
+    fft_cpx_t jbmd = {b.im - d.im, d.re - b.re};
+    fft_cpx_t A1 = {amc.re + jbmd.re, amc.im + jbmd.im};
+    fft_cpx_t A2 = {apc.re - bpd.re, apc.im - bpd.im};
+    fft_cpx_t A3 = {amc.re - jbmd.re, amc.im - jbmd.im};
+    y[q + s*(4*j)].re = apc.re + bpd.re;
+    y[q + s*(4*j)].im = apc.im + bpd.im;
+    y[q + s*(4*j + 1)] = cmul(A1, w[0]);
+    y[q + s*(4*j + 2)] = cmul(A2, w[1]);
+    y[q + s*(4*j + 3)] = cmul(A3, w[2]);
+  }
+}
+
+/** Largest odd radix using the symmetric butterfly, larger radices use a
+ * direct DFT. */
+#define ODD_RADIX_SYM_MAX 65
+
+/* Odd radix butterflies pair up inputs r and p-r, with
+ * u_r = a_r + a_{p-r} and v_r = a_r - a_{p-r} outputs k and p-k are
+ *
+ *   A_k, A_{p-k} = a_0 + sum_r u_r cos(2 pi r k / p)
+ *                      -/+ i sum_r v_r sin(2 pi r k / p)
+ *
+ * which needs a quarter of the multiplies of a direct DFT. */
+
+static void radix_odd(const fft_stage_t *st, u32 j,
+                      const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 s = st->s, m = st->m, p = st->radix, h = (p - 1) / 2;
+  const fft_cpx_t *w = &st->tw[(p-1)*j];
+  fft_cpx_t u[ODD_RADIX_SYM_MAX / 2], v[ODD_RADIX_SYM_MAX / 2];
+
+  for (u32 q=0; q<s; q++) {
+    fft_cpx_t a0 = x[q + s*j];
+
+    if (p > ODD_RADIX_SYM_MAX) {
+      for (u32 k=0; k<p; k++) {
+        fft_cpx_t acc = {0, 0};
+        u32 t = 0;
+        for (u32 r=0; r<p; r++) {
+          fft_cpx_t c = cmul(x[q + s*(j + r*m)], st->roots[t]);
+          acc.re += c.re;
+          acc.im += c.im;
+          t += k;
+          if (t >= p)
+            t -= p;
+        }
+        y[q + s*(p*j + k)] = k ? cmul(acc, w[k-1]) : acc;
+      }
+      continue;
+    }
+
+    fft_cpx_t A0 = a0;
+    for (u32 r=1; r<=h; r++) {
+      fft_cpx_t a = x[q + s*(j + r*m)];
+      fft_cpx_t b = x[q + s*(j + (p-r)*m)];
+      u[r-1].re = a.re + b.re;
+      u[r-1].im = a.im + b.im;
+      v[r-1].re = a.re - b.re;
+      v[r-1].im = a.im - b.im;
+      A0.re += u[r-1].re;
+      A0.im += u[r-1].im;
+    }
+    y[q + s*(p*j)] = A0;
+
+    for (u32 k=1; k<=h; k++) {
+      fft_cpx_t C = a0, D = {0, 0};
+      u32 t = 0;
+      for (u32 r=1; r<=h; r++) {
+        t += k;
+        if (t >= p)
+          t -= p;
+        /* roots[t] = cos(2 pi t / p) - i sin(2 pi t / p) */
+        C.re += u[r-1].re * st->roots[t].re;
+        C.im += u[r-1].im * st->roots[t].re;
+        D.re -= v[r-1].re * st->roots[t].im;
+        D.im -= v[r-1].im * st->roots[t].im;
+      }
+      fft_cpx_t Ak = {C.re + D.im, C.im - D.re};
+      fft_cpx_t Apk = {C.re - D.im, C.im + D.re};
+      y[q + s*(p*j + k)] = cmul(Ak, w[k-1]);
+      y[q + s*(p*j + p - k)] = cmul(Apk, w[p-k-1]);
+    }
+  }
+}
+
+#ifdef __SSE3__
+
+/** Multiply two pairs of complex values. */
+static inline __m128 cmul_ps(__m128 a, __m128 b)
+{
+  __m128 b_re = _mm_moveldup_ps(b);
+  __m128 b_im = _mm_movehdup_ps(b);
+  __m128 a_swap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_addsub_ps(_mm_mul_ps(a, b_re), _mm_mul_ps(a_swap, b_im));
+}
+
+/** Load a complex value into both halves of a vector. */
+static inline __m128 cdup_ps(const fft_cpx_t *w)
+{
+  return _mm_castpd_ps(_mm_load1_pd((const double *)w));
+}
+
+static inline __m128 cload(const fft_cpx_t *x)
+{
+  return _mm_loadu_ps((const float *)x);
+}
+
+static inline void cstore(fft_cpx_t *y, __m128 v)
+{
+  _mm_storeu_ps((float *)y, v);
+}
+
+/* The vector butterflies handle an even number of strided transforms. */
+
+static void radix2_sse(const fft_stage_t *st, u32 j,
+                       const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 s = st->s, m = st->m;
+  __m128 w = cdup_ps(&st->tw[j]);
+  for (u32 q=0; q<s; q+=2) {
+    __m128 a = cload(&x[q + s*j]);
+    __m128 b = cload(&x[q + s*(j + m)]);
+    cstore(&y[q + s*(2*j)], _mm_add_ps(a, b));
+    cstore(&y[q + s*(2*j + 1)], cmul_ps(_mm_sub_ps(a, b), w));
+  }
+}
+
+static void radix4_sse(const fft_stage_t *st, u32 j,
+                       const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 s = st->s, m = st->m;
+  __m128 w1 = cdup_ps(&st->tw[3*j]);
+  __m128 w2 = cdup_ps(&st->tw[3*j + 1]);
+  __m128 w3 = cdup_ps(&st->tw[3*j + 2]);
+  const __m128 neg_im = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+  for (u32 q=0; q<s; q+=2) {
+    __m128 a = cload(&x[q + s*j]);
+    __m128 b = cload(&x[q + s*(j + m)]);
+    __m128 c = cload(&x[q + s*(j + 2*m)]);
+    __m128 d = cload(&x[q + s*(j + 3*m)]);
+    __m128 apc = _mm_add_ps(a, c);
+    __m128 amc = _mm_sub_ps(a, c);
+    __m128 bpd = _mm_add_ps(b, d);
+    __m128 bmd = _mm_sub_ps(b, d);
+    /* -j * (b - d) */
+    __m128 jbmd = _mm_xor_ps(_mm_shuffle_ps(bmd, bmd, _MM_SHUFFLE(2, 3, 0, 1)),
+                             neg_im);
+    cstore(&y[q + s*(4*j)], _mm_add_ps(apc, bpd));
+    cstore(&y[q + s*(4*j + 1)], cmul_ps(_mm_add_ps(amc, jbmd), w1));
+    cstore(&y[q + s*(4*j + 2)], cmul_ps(_mm_sub_ps(apc, bpd), w2));
+    cstore(&y[q + s*(4*j + 3)], cmul_ps(_mm_sub_ps(amc, jbmd), w3));
+  }
+}
+
+/* In the first stage the stride is one, so the vector butterflies instead
+ * work on two adjacent butterflies with their own twiddles. */
+
+static inline __m128 cload2(const fft_cpx_t *a, const fft_cpx_t *b)
+{
+  __m128 v = _mm_setzero_ps();
+  v = _mm_loadl_pi(v, (const __m64 *)a);
+  return _mm_loadh_pi(v, (const __m64 *)b);
+}
+
+static inline void cstore2(fft_cpx_t *a, fft_cpx_t *b, __m128 v)
+{
+  _mm_storel_pi((__m64 *)a, v);
+  _mm_storeh_pi((__m64 *)b, v);
+}
+
+static void radix2_sse_first(const fft_stage_t *st,
+                             const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 m = st->m, j;
+  for (j=0; j+1<m; j+=2) {
+    __m128 w = cload(&st->tw[j]);
+    __m128 a = cload(&x[j]);
+    __m128 b = cload(&x[j + m]);
+    __m128 d = cmul_ps(_mm_sub_ps(a, b), w);
+    cstore2(&y[2*j], &y[2*j + 2], _mm_add_ps(a, b));
+    cstore2(&y[2*j + 1], &y[2*j + 3], d);
+  }
+  for (; j<m; j++)
+    radix2(st, j, x, y);
+}
+
+static void radix4_sse_first(const fft_stage_t *st,
+                             const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 m = st->m, j;
+  const fft_cpx_t *tw = st->tw;
+  const __m128 neg_im = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+  for (j=0; j+1<m; j+=2) {
+    __m128 w1 = cload2(&tw[3*j], &tw[3*j + 3]);
+    __m128 w2 = cload2(&tw[3*j + 1], &tw[3*j + 4]);
+    __m128 w3 = cload2(&tw[3*j + 2], &tw[3*j + 5]);
+    __m128 a = cload(&x[j]);
+    __m128 b = cload(&x[j + m]);
+    __m128 c = cload(&x[j + 2*m]);
+    __m128 d = cload(&x[j + 3*m]);
+    __m128 apc = _mm_add_ps(a, c);
+    __m128 amc = _mm_sub_ps(a, c);
+    __m128 bpd = _mm_add_ps(b, d);
+    __m128 bmd = _mm_sub_ps(b, d);
+    __m128 jbmd = _mm_xor_ps(_mm_shuffle_ps(bmd, bmd, _MM_SHUFFLE(2, 3, 0, 1)),
+                             neg_im);
+    cstore2(&y[4*j], &y[4*j + 4], _mm_add_ps(apc, bpd));
+    cstore2(&y[4*j + 1], &y[4*j + 5], cmul_ps(_mm_add_ps(amc, jbmd), w1));
+    cstore2(&y[4*j + 2], &y[4*j + 6], cmul_ps(_mm_sub_ps(apc, bpd), w2));
+    cstore2(&y[4*j + 3], &y[4*j + 7], cmul_ps(_mm_sub_ps(amc, jbmd), w3));
+  }
+  for (; j<m; j++)
+    radix4(st, j, x, y);
+}
+
+static void radix_odd_sse(const fft_stage_t *st, u32 j,
+                          const fft_cpx_t *x, fft_cpx_t *y)
+{
+  u32 s = st->s, m = st->m, p = st->radix, h = (p - 1) / 2;
+  const fft_cpx_t *w = &st->tw[(p-1)*j];
+  __m128 u[ODD_RADIX_SYM_MAX / 2], v[ODD_RADIX_SYM_MAX / 2];
+  /* Swaps real and imaginary parts and negates the new imaginary part,
+   * i.e. multiplies by -i. */
+  const __m128 neg_im = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+
+  for (u32 q=0; q<s; q+=2) {
+    __m128 a0 = cload(&x[q + s*j]);
+
+    if (p > ODD_RADIX_SYM_MAX) {
+      for (u32 k=0; k<p; k++) {
+        __m128 acc = _mm_setzero_ps();
+        u32 t = 0;
+        for (u32 r=0; r<p; r++) {
+          acc = _mm_add_ps(acc, cmul_ps(cload(&x[q + s*(j + r*m)]),
+                                        cdup_ps(&st->roots[t])));
+          t += k;
+          if (t >= p)
+            t -= p;
+        }
+        if (k)
+          acc = cmul_ps(acc, cdup_ps(&w[k-1]));
+        cstore(&y[q + s*(p*j + k)], acc);
+      }
+      continue;
+    }
+
+    __m128 A0 = a0;
+    for (u32 r=1; r<=h; r++) {
+      __m128 a = cload(&x[q + s*(j + r*m)]);
+      __m128 b = cload(&x[q + s*(j + (p-r)*m)]);
+      u[r-1] = _mm_add_ps(a, b);
+      v[r-1] = _mm_sub_ps(a, b);
+      A0 = _mm_add_ps(A0, u[r-1]);
+    }
+    cstore(&y[q + s*(p*j)], A0);
+
+    for (u32 k=1; k<=h; k++) {
+      __m128 C = a0, D = _mm_setzero_ps();
+      u32 t = 0;
+      for (u32 r=1; r<=h; r++) {
+        t += k;
+        if (t >= p)
+          t -= p;
+        C = _mm_add_ps(C, _mm_mul_ps(u[r-1], _mm_set1_ps(st->roots[t].re)));
+        D = _mm_sub_ps(D, _mm_mul_ps(v[r-1], _mm_set1_ps(st->roots[t].im)));
+      }
+      __m128 mjD = _mm_xor_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(2, 3, 0, 1)),
+                              neg_im);
+      cstore(&y[q + s*(p*j + k)], cmul_ps(_mm_add_ps(C, mjD), cdup_ps(&w[k-1])));
+      cstore(&y[q + s*(p*j + p - k)],
+             cmul_ps(_mm_sub_ps(C, mjD), cdup_ps(&w[p-k-1])));
+    }
+  }
+}
+
+#endif /* __SSE3__ */
+
+static void run_stage(const fft_stage_t *st, const fft_cpx_t *x, fft_cpx_t *y)
+{
+#ifdef __SSE3__
+  if (st->s == 1 && st->radix == 2) {
+    radix2_sse_first(st, x, y);
+    return;
+  }
+  if (st->s == 1 && st->radix == 4) {
+    radix4_sse_first(st, x, y);
+    return;
+  }
+#endif
+  for (u32 j=0; j<st->m; j++) {
+#ifdef __SSE3__
+    if (st->s % 2 == 0) {
+      switch (st->radix) {
+      case 2: radix2_sse(st, j, x, y); break;
+      case 4: radix4_sse(st, j, x, y); break;
+      default: radix_odd_sse(st, j, x, y); break;
+      }
+      continue;
+    }
+#endif
+    switch (st->radix) {
+    case 2: radix2(st, j, x, y); break;
+    case 4: radix4(st, j, x, y); break;
+    default: radix_odd(st, j, x, y); break;
+    }
+  }
+}
+
+/** Compute the forward FFT of `x` in place.
+ *
+ * \f[ X_k = \sum_{t=0}^{n-1} x_t e^{-2 \pi i t k / n} \f]
+ *
+ * \param plan FFT plan for the length of `x`.
+ * \param x    Data to transform, replaced by its FFT.
+ * \param work Scratch buffer of the same length as `x`.
+ */
+void fft_forward(const fft_plan_t *plan, fft_cpx_t *x, fft_cpx_t *work)
+{
+  fft_cpx_t *in = x, *out = work;
+  for (u8 i=0; i<plan->n_stages; i++) {
+    run_stage(&plan->stages[i], in, out);
+    fft_cpx_t *t = in;
+    in = out;
+    out = t;
+  }
+  if (in != x)
+    memcpy(x, in, plan->n * sizeof(fft_cpx_t));
+}
+
+/** Compute the unnormalised inverse FFT of `x` in place.
+ *
+ * \f[ x_t = \sum_{k=0}^{n-1} X_k e^{2 \pi i t k / n} \f]
+ *
+ * i.e. the result of fft_forward() followed by fft_inverse() is the original
+ * data scaled by `n`.
+ *
+ * \param plan FFT plan for the length of `x`.
+ * \param x    Data to transform, replaced by its inverse FFT.
+ * \param work Scratch buffer of the same length as `x`.
+ */
+void fft_inverse(const fft_plan_t *plan, fft_cpx_t *x, fft_cpx_t *work)
+{
+  for (u32 i=0; i<plan->n; i++)
+    x[i].im = -x[i].im;
+  fft_forward(plan, x, work);
+  for (u32 i=0; i<plan->n; i++)
+    x[i].im = -x[i].im;
+}
+
+/** \} */
+
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_features.h"
+#include "frontend.h"
+
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+/** \defgroup frontend Front end
+ * Down-conversion, filtering and decimation of IF samples.
+ *
+ * High rate IF samples are mixed down to complex baseband, low-pass
+ * filtered and decimated, then shifted back up to an IF of a quarter of the
+ * output sample rate and returned as real `s8` samples, ready for the
+ * correlators at a fraction of the input rate. The correlator cost is
+ * linear in the sample rate so decimating early multiplies the number of
+ * channels that can be tracked.
+ *
+ * The FIR filter is evaluated in polyphase form, i.e. only at the output
+ * samples, over a history of the baseband samples kept between calls so
+ * that a stream can be processed in blocks of any size.
+ * \{ */
+
+/** Output samples are clipped to this magnitude. */
+#define FRONTEND_OUT_MAX 127
+
+/** Initialise a front end stage.
+ *
+ * The FIR filter is a Blackman windowed sinc, low-pass with a cutoff of
+ * `bandwidth`. As the output is real with an IF of a quarter of the output
+ * sample rate the bandwidth can be at most a quarter of the output sample
+ * rate either side of the carrier, i.e. `fs / (4 * decimation)`.
+ *
+ * The filter is scaled so that white noise at the input comes out at the
+ * same RMS level, the signal to noise ratio of each sample increases by the
+ * ratio of the input bandwidth to the filter bandwidth.
+ *
+ * \param fe         Front end state to initialise.
+ * \param fs         Input sample rate in Hz.
+ * \param if_freq    Input intermediate frequency in Hz.
+ * \param decimation Input samples per output sample.
+ * \param bandwidth  Filter cutoff frequency in Hz.
+ * \param n_taps     FIR filter length, at most `FRONTEND_MAX_TAPS`.
+ * \return `0` on success, `-1` if the parameters are invalid or `-2` if an
+ *         allocation failed.
+ */
+s8 frontend_init(frontend_t *fe, double fs, double if_freq,
+                 u32 decimation, double bandwidth, u32 n_taps)
+{
+  memset(fe, 0, sizeof(*fe));
+
+  if (decimation == 0 || n_taps == 0 || n_taps > FRONTEND_MAX_TAPS ||
+      bandwidth <= 0 || bandwidth > fs / (4 * decimation) ||
+      if_freq < 0 || if_freq >= fs / 2)
+    return -1;
+
+  fe->fs = fs;
+  fe->fs_out = fs / decimation;
+  fe->if_out = fe->fs_out / 4;
+  fe->decimation = decimation;
+  fe->n_taps = (n_taps + 7) & ~7;
+  fe->lo_step = 2*M_PI * if_freq / fs;
+
+  u32 buf_len = fe->n_taps + FRONTEND_BLOCK_LEN;
+  fe->taps = malloc(fe->n_taps * sizeof(float));
+  fe->lo_sin = malloc(FRONTEND_BLOCK_LEN * sizeof(float));
+  fe->lo_cos = malloc(FRONTEND_BLOCK_LEN * sizeof(float));
+  fe->buf_I = malloc(buf_len * sizeof(float));
+  fe->buf_Q = malloc(buf_len * sizeof(float));
+  if (!fe->taps || !fe->lo_sin || !fe->lo_cos || !fe->buf_I || !fe->buf_Q) {
+    frontend_free(fe);
+    return -2;
+  }
+
+  /* Windowed sinc, normalised to unit gain at DC. */
+  double h[FRONTEND_MAX_TAPS];
+  double sum = 0;
+  double fc = bandwidth / fs;
+  for (u32 k=0; k<n_taps; k++) {
+    double t = k - (n_taps - 1) / 2.0;
+    double w = n_taps == 1 ? 1 :
+               0.42 - 0.5 * cos(2*M_PI * k / (n_taps - 1))
+                    + 0.08 * cos(4*M_PI * k / (n_taps - 1));
+    h[k] = w * (t == 0 ? 2*fc : sin(2*M_PI * fc * t) / (M_PI * t));
+    sum += h[k];
+  }
+  double sum_sq = 0;
+  for (u32 k=0; k<n_taps; k++) {
+    h[k] /= sum;
+    sum_sq += h[k] * h[k];
+  }
+
+  /* Mixing halves the noise power in each of I and Q, the filter then
+   * scales it by the sum of the squared taps. */
+  double gain = sqrt(2 / sum_sq);
+
+  /* Taps are stored in time order against the history, oldest first, with
+   * the padding at the oldest end. */
+  u32 pad = fe->n_taps - n_taps;
+  for (u32 j=0; j<fe->n_taps; j++)
+    fe->taps[j] = j < pad ? 0 : gain * h[fe->n_taps - 1 - j];
+
+  /* Rotation of the LO from the start of a block to each of its samples. */
+  double r_sin = 0, r_cos = 1;
+  double sin_delta = sin(fe->lo_step), cos_delta = cos(fe->lo_step);
+  for (u32 k=0; k<FRONTEND_BLOCK_LEN; k++) {
+    fe->lo_sin[k] = r_sin;
+    fe->lo_cos[k] = r_cos;
+    double r_sin_ = r_sin*cos_delta + r_cos*sin_delta;
+    r_cos = r_cos*cos_delta - r_sin*sin_delta;
+    r_sin = r_sin_;
+  }
+
+  return 0;
+}
+
+/** Free the memory held by a front end stage.
+ *
+ * \param fe Front end state initialised with frontend_init().
+ */
+void frontend_free(frontend_t *fe)
+{
+  free(fe->taps);
+  free(fe->lo_sin);
+  free(fe->lo_cos);
+  free(fe->buf_I);
+  free(fe->buf_Q);
+  fe->taps = fe->lo_sin = fe->lo_cos = fe->buf_I = fe->buf_Q = 0;
+}
+
+/** Mix a block of samples down to baseband onto the end of the buffers. */
+static void frontend_mix(frontend_t *fe, const s8 *in, u32 n)
+{
+  float lo_sin = sin(fe->lo_phase);
+  float lo_cos = cos(fe->lo_phase);
+  float *I = &fe->buf_I[fe->n_buf];
+  float *Q = &fe->buf_Q[fe->n_buf];
+
+  for (u32 k=0; k<n; k++) {
+    float s = lo_sin*fe->lo_cos[k] + lo_cos*fe->lo_sin[k];
+    float c = lo_cos*fe->lo_cos[k] - lo_sin*fe->lo_sin[k];
+    I[k] = c * in[k];
+    Q[k] = -s * in[k];
+  }
+
+  fe->n_buf += n;
+  fe->lo_phase = fmod(fe->lo_phase + n * fe->lo_step, 2*M_PI);
+}
+
+/** Shift a filtered baseband sample back up to a quarter of the output
+ * sample rate, multiplying by \f$ j^m \f$ for output sample \f$ m \f$,
+ * and quantise the real part. */
+static inline s8 frontend_output(frontend_t *fe, float yi, float yq)
+{
+  float v;
+  switch (fe->quarter) {
+  case 0: v = yi; break;
+  case 1: v = -yq; break;
+  case 2: v = -yi; break;
+  default: v = yq; break;
+  }
+  fe->quarter = (fe->quarter + 1) & 3;
+
+  if (v > FRONTEND_OUT_MAX)
+    v = FRONTEND_OUT_MAX;
+  if (v < -FRONTEND_OUT_MAX)
+    v = -FRONTEND_OUT_MAX;
+  return (s8)lrintf(v);
+}
+
+/** Filter the buffered baseband samples at every output sample whose taps
+ * are all available, writing the outputs to `out`. Generic version. */
+static u32 frontend_fir_generic(frontend_t *fe, s8 *out)
+{
+  u32 n_out = 0;
+  for (; fe->next + fe->n_taps <= fe->n_buf; fe->next += fe->decimation) {
+    const float *I = &fe->buf_I[fe->next];
+    const float *Q = &fe->buf_Q[fe->next];
+    float acc_I[8] = {0}, acc_Q[8] = {0};
+    for (u32 j=0; j<fe->n_taps; j+=8) {
+      for (u32 k=0; k<8; k++) {
+        acc_I[k] += fe->taps[j + k] * I[j + k];
+        acc_Q[k] += fe->taps[j + k] * Q[j + k];
+      }
+    }
+    float yi = 0, yq = 0;
+    for (u32 k=0; k<8; k++) {
+      yi += acc_I[k];
+      yq += acc_Q[k];
+    }
+    out[n_out++] = frontend_output(fe, yi, yq);
+  }
+  return n_out;
+}
+
+#ifdef CPU_FEATURES_X86
+
+/** Filter the buffered baseband samples at every output sample whose taps
+ * are all available, writing the outputs to `out`. AVX2 version, must
+ * agree with frontend_fir_generic() up to rounding. */
+__attribute__((target("avx2,fma")))
+static u32 frontend_fir_avx2(frontend_t *fe, s8 *out)
+{
+  u32 n_out = 0;
+  for (; fe->next + fe->n_taps <= fe->n_buf; fe->next += fe->decimation) {
+    const float *I = &fe->buf_I[fe->next];
+    const float *Q = &fe->buf_Q[fe->next];
+    __m256 acc_I = _mm256_setzero_ps(), acc_Q = _mm256_setzero_ps();
+    for (u32 j=0; j<fe->n_taps; j+=8) {
+      __m256 h = _mm256_loadu_ps(&fe->taps[j]);
+      acc_I = _mm256_fmadd_ps(h, _mm256_loadu_ps(&I[j]), acc_I);
+      acc_Q = _mm256_fmadd_ps(h, _mm256_loadu_ps(&Q[j]), acc_Q);
+    }
+    /* Horizontal sums of I and Q together. */
+    __m256 s = _mm256_hadd_ps(acc_I, acc_Q);
+    s = _mm256_hadd_ps(s, s);
+    __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(s),
+                           _mm256_extractf128_ps(s, 1));
+    float yi = _mm_cvtss_f32(s4);
+    float yq = _mm_cvtss_f32(_mm_shuffle_ps(s4, s4, 1));
+
+    out[n_out++] = frontend_output(fe, yi, yq);
+  }
+  return n_out;
+}
+
+#endif /* CPU_FEATURES_X86 */
+
+/** Down-convert, filter and decimate a block of samples.
+ *
+ * Processes the samples as a continuation of the stream passed to previous
+ * calls, so the input can be split into blocks of any size. Output sample
+ * `m` of the stream is the filter output with its last tap on input sample
+ * `m * decimation + n_taps - 1`, where `n_taps` is the padded FIR length.
+ *
+ * The output is real, with the baseband signal shifted up to an IF of a
+ * quarter of the output sample rate, see `frontend_t.if_out`.
+ *
+ * The output never gets ahead of the input so `out` may be the same buffer
+ * as `in`, decimating the samples in place.
+ *
+ * \param fe  Front end state initialised with frontend_init().
+ * \param in  Input samples.
+ * \param n   Number of input samples.
+ * \param out Output samples, room for `n / decimation + 1` samples.
+ * \return Number of output samples written.
+ */
+u32 frontend_process(frontend_t *fe, const s8 *in, u32 n, s8 *out)
+{
+  u32 n_out = 0;
+
+  for (u32 i=0; i<n; ) {
+    u32 m = n - i;
+    if (m > FRONTEND_BLOCK_LEN)
+      m = FRONTEND_BLOCK_LEN;
+    frontend_mix(fe, &in[i], m);
+    i += m;
+
+#ifdef CPU_FEATURES_X86
+    if (cpu_features() & CPU_FEATURE_AVX2)
+      n_out += frontend_fir_avx2(fe, &out[n_out]);
+    else
+#endif
+      n_out += frontend_fir_generic(fe, &out[n_out]);
+
+    /* Keep the history needed for the next outputs. */
+    if (fe->next >= fe->n_buf) {
+      fe->next -= fe->n_buf;
+      fe->n_buf = 0;
+    } else {
+      u32 keep = fe->n_buf - fe->next;
+      memmove(fe->buf_I, &fe->buf_I[fe->next], keep * sizeof(float));
+      memmove(fe->buf_Q, &fe->buf_Q[fe->next], keep * sizeof(float));
+      fe->n_buf = keep;
+      fe->next = 0;
+    }
+  }
+
+  return n_out;
+}
+
+/** \} */
+
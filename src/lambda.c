@@ -20,6 +20,7 @@
 #include <cblas.h>
 #include <clapack.h>
 #include "amb_kf.h"
+#include "diag.h"
 
 /* constants/macros ----------------------------------------------------------*/
 
@@ -93,7 +94,8 @@ int LD(int n, const double *Q, double *L, double *D)
         for (j=0;j<=i;j++) L[i+j*n]/=L[i+i*n];
     }
     if (info) {
-        printf("%s : LD factorization error, trying UD from Gibbs (col major UD = LD)\n",__FILE__);
+        DIAG(DIAG_WARN, DIAG_EVENT_LAMBDA_LD_ERROR,
+             "%s : LD factorization error, trying UD from Gibbs (col major UD = LD)",__FILE__);
         double Qcopy[n * n];
         memcpy(Qcopy, Q, n * n * sizeof(double));
         udu2(n, Qcopy, L, D);
@@ -205,7 +207,8 @@ static int search(int n, int m, const double *L, const double *D,
     }
 
     if (c>=LOOPMAX) {
-        fprintf(stderr,"%s : search loop count overflow\n",__FILE__);
+        DIAG(DIAG_ERROR, DIAG_EVENT_LAMBDA_OVERFLOW,
+             "%s : search loop count overflow",__FILE__);
         return -1;
     }
     return 0;
@@ -15,6 +15,7 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "diag.h"
 
 #include "linear_algebra.h"
 
@@ -114,7 +115,8 @@ s32 qrdecomp(const double *a, u32 rows, u32 cols, double *qt, double *r) {
     if (fabs(scale) < MATRIX_EPSILON) {
       sing = -1;
       c[k] = d[k] = 0.0;
-      printf("Column %u is singular to machine precision.\n", (unsigned int) k);
+      DIAG(DIAG_WARN, DIAG_EVENT_MATRIX_SINGULAR,
+           "Column %u is singular to machine precision.", (unsigned int) k);
     } else {
       /* scale this column to 1 */
       for (i = k; i < rows; i++) r[i*cols + k] /= scale;
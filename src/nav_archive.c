@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nav_archive.h"
+
+/** \defgroup nav_archive Subframe Archive
+ * Append-only archive of parity checked subframes.
+ *
+ * The archive file is a short header followed by nav_msg_subframe_t
+ * records, 36 bytes each, stored as they are in memory so the file is
+ * only portable between machines of the same endianness. Each subframe is
+ * appended with a single write so a crash can at most leave the last
+ * record incomplete, which is dropped when the archive is next opened.
+ *
+ * For reading, the whole file is memory mapped and the records are used in
+ * place. Replaying the subframes with nav_archive_replay() rebuilds the
+ * ephemerides and almanacs without waiting for them to be broadcast again,
+ * and replaying recorded nav data is a quick regression test of the
+ * subframe decoding.
+ * \{ */
+
+/** Archive file header. */
+typedef struct {
+  char magic[8];   /**< NAV_ARCHIVE_MAGIC. */
+  u32 version;     /**< NAV_ARCHIVE_VERSION. */
+  u32 record_size; /**< Bytes per record, `sizeof(nav_msg_subframe_t)`. */
+} nav_archive_header_t;
+
+#define NAV_ARCHIVE_MAGIC "SNAVSFRM"
+#define NAV_ARCHIVE_VERSION 1
+
+/** Read the header of an archive file of `size` bytes, returning true if
+ * it is valid. */
+static bool header_check(int fd, u64 size)
+{
+  nav_archive_header_t h;
+  if (size < sizeof(h) || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h))
+    return false;
+  return memcmp(h.magic, NAV_ARCHIVE_MAGIC, sizeof(h.magic)) == 0 &&
+         h.version == NAV_ARCHIVE_VERSION &&
+         h.record_size == sizeof(nav_msg_subframe_t);
+}
+
+/** Open a subframe archive for appending, creating it if it doesn't exist.
+ *
+ * \param ar   Archive to initialise.
+ * \param path Path of the archive file.
+ * \return `0` on success, `-1` if the file can't be opened or created, or
+ *         exists but is not a subframe archive.
+ */
+s8 nav_archive_open(nav_archive_t *ar, const char *path)
+{
+  memset(ar, 0, sizeof(*ar));
+  ar->fd = -1;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  u64 size = st.st_size;
+  if (size == 0) {
+    nav_archive_header_t h;
+    memcpy(h.magic, NAV_ARCHIVE_MAGIC, sizeof(h.magic));
+    h.version = NAV_ARCHIVE_VERSION;
+    h.record_size = sizeof(nav_msg_subframe_t);
+    if (write(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)) {
+      close(fd);
+      return -1;
+    }
+  } else {
+    if (!header_check(fd, size)) {
+      close(fd);
+      return -1;
+    }
+    /* Drop a record left incomplete by an interrupted append. */
+    u64 tail = (size - sizeof(nav_archive_header_t))
+               % sizeof(nav_msg_subframe_t);
+    if (tail && ftruncate(fd, size - tail) != 0) {
+      close(fd);
+      return -1;
+    }
+  }
+
+  ar->fd = fd;
+  return 0;
+}
+
+/** Append a subframe to an archive.
+ *
+ * \param ar Archive opened with nav_archive_open().
+ * \param sf Subframe, see nav_msg_subframe_get().
+ * \return `0` on success, `-1` if the archive isn't open for appending or
+ *         the write failed.
+ */
+s8 nav_archive_append(nav_archive_t *ar, const nav_msg_subframe_t *sf)
+{
+  if (ar->fd < 0)
+    return -1;
+  if (write(ar->fd, sf, sizeof(*sf)) != (ssize_t)sizeof(*sf))
+    return -1;
+  return 0;
+}
+
+/** Map a subframe archive for reading.
+ *
+ * The records are then in `ar->records`, in the order they were appended.
+ * Subframes appended after the archive is mapped are not seen.
+ *
+ * \param ar   Archive to initialise.
+ * \param path Path of the archive file.
+ * \return `0` on success, `-1` if the file can't be opened or mapped or is
+ *         not a subframe archive.
+ */
+s8 nav_archive_map(nav_archive_t *ar, const char *path)
+{
+  memset(ar, 0, sizeof(*ar));
+  ar->fd = -1;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !header_check(fd, st.st_size)) {
+    close(fd);
+    return -1;
+  }
+
+  void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  /* The mapping holds its own reference to the file. */
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+  /* Archives are replayed front to back. */
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  ar->map = map;
+  ar->map_size = st.st_size;
+  ar->records = (const nav_msg_subframe_t *)
+                ((const u8 *)map + sizeof(nav_archive_header_t));
+  ar->n_records = (ar->map_size - sizeof(nav_archive_header_t))
+                  / sizeof(nav_msg_subframe_t);
+  return 0;
+}
+
+/** Close an archive opened with nav_archive_open() or nav_archive_map().
+ *
+ * \param ar Archive.
+ */
+void nav_archive_close(nav_archive_t *ar)
+{
+  if (ar->fd >= 0)
+    close(ar->fd);
+  if (ar->map)
+    munmap(ar->map, ar->map_size);
+  memset(ar, 0, sizeof(*ar));
+  ar->fd = -1;
+}
+
+/** Replay the subframes of a mapped archive through the subframe decoding.
+ *
+ * Each record is passed to nav_msg_replay_subframe() in turn, starting
+ * from record `first`. Records with an invalid PRN are skipped.
+ *
+ * \param ar    Archive mapped with nav_archive_map().
+ * \param first Index of the first record to replay.
+ * \param r     Replay state, see nav_msg_replay_init().
+ * \param e     Ephemerides, indexed by PRN counting from 0.
+ * \param a     Store of the data decoded from subframes 4 and 5, or NULL to
+ *              skip them.
+ * \return Number of subframes that completed an ephemeris or updated `a`.
+ */
+u64 nav_archive_replay(const nav_archive_t *ar, u64 first,
+                       nav_msg_replay_t *r, ephemeris_t e[32],
+                       nav_msg_almanac_t *a)
+{
+  u64 n_decoded = 0;
+  for (u64 i=first; i<ar->n_records; i++) {
+    const nav_msg_subframe_t *sf = &ar->records[i];
+    if (sf->prn >= 32)
+      continue;
+    n_decoded += nav_msg_replay_subframe(r, sf, &e[sf->prn], a) > 0;
+  }
+  return n_decoded;
+}
+
+/** \} */
+
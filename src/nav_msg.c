@@ -11,14 +11,25 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
 #include "constants.h"
+#include "cpu_features.h"
+#include "diag.h"
 #include "nav_msg.h"
 
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
 #define NAV_MSG_BIT_PHASE_THRES 5
 
+/* Histogram bit sync locks once the peak bin exceeds the next highest by
+ * this many standard deviations of its count. */
+#define NAV_MSG_BIT_SYNC_HIST_SIGMAS 3
+
 void nav_msg_init(nav_msg_t *n)
 {
   /* Initialize the necessary parts of the nav message state structure. */
@@ -27,42 +38,100 @@ void nav_msg_init(nav_msg_t *n)
   n->bit_phase_ref = 0;
   n->bit_phase_count = 0;
   n->nav_bit_integrate = 0;
+  n->bit_sync = NAV_MSG_BIT_SYNC_EDGES;
+  memset(n->bit_sync_hist, 0, sizeof(n->bit_sync_hist));
+  n->tow_single = 0;
   n->subframe_start_index = 0;
   memset(n->subframe_bits, 0, sizeof(n->subframe_bits));
   n->next_subframe_id = 1;
 }
 
-static u32 extract_word(nav_msg_t *n, u16 bit_index, u8 n_bits, u8 invert)
+/** Initialise the nav message state with a choice of bit sync method.
+ *
+ * nav_msg_init() uses `NAV_MSG_BIT_SYNC_EDGES`, which waits for
+ * NAV_MSG_BIT_PHASE_THRES sign changes in a row spaced by whole bits and
+ * starts again on any sign change in between, so a noisy prompt
+ * correlation or long runs of identical bits delay the lock.
+ *
+ * `NAV_MSG_BIT_SYNC_HISTOGRAM` instead counts the sign changes of the
+ * prompt correlation at each of the 20 bit phases and never discards them.
+ * Under noise the counts are spread evenly over the bins, and the bit
+ * edges pile up in one. Lock is declared once the peak bin stands
+ * NAV_MSG_BIT_SYNC_HIST_SIGMAS standard deviations of a Poisson count
+ * above the next highest bin, which is after three edges for a clean
+ * signal.
+ *
+ * \param n        Nav message state to initialise.
+ * \param bit_sync Bit sync method.
+ */
+void nav_msg_init_bit_sync(nav_msg_t *n, nav_msg_bit_sync_t bit_sync)
+{
+  nav_msg_init(n);
+  n->bit_sync = bit_sync;
+}
+
+static bool bit_sync_histogram(u8 *hist, u8 bit_phase, u8 *bit_phase_ref)
+{
+  /* Count a sign change at the start of this ms in the histogram, returning
+   * true when the bit phase is locked and setting *bit_phase_ref to the
+   * phase of the last ms of each bit. */
+  u8 bin = (bit_phase + 19) % 20;
+
+  if (hist[bin] == 0xFF)
+    for (u8 i=0; i<20; i++)
+      hist[i] /= 2;
+  hist[bin]++;
+
+  /* Only the peak bin gaining can lock, the next highest is the noise. */
+  u8 second = 0;
+  for (u8 i=0; i<20; i++) {
+    if (hist[i] > hist[bin])
+      return false;
+    if (i != bin && hist[i] > second)
+      second = hist[i];
+  }
+
+  s32 margin = hist[bin] - second;
+  if (margin * margin < NAV_MSG_BIT_SYNC_HIST_SIGMAS *
+                        NAV_MSG_BIT_SYNC_HIST_SIGMAS * (second + 1))
+    return false;
+
+  *bit_phase_ref = bin;
+  return true;
+}
+
+static u32 bits_extract(const u32 *subframe_bits, s16 subframe_start_index,
+                        u16 bit_index, u8 n_bits, u8 invert)
 {
   /* Extract a word of n_bits length (n_bits <= 32) at position bit_index into
-   * the subframe. Takes account of the offset stored in n, and the circular
-   * nature of the n->subframe_bits buffer. */
+   * the subframe. Takes account of the subframe start offset, and the
+   * circular nature of the subframe_bits buffer. */
 
   /* Offset for the start of the subframe in the buffer. */
-  if (n->subframe_start_index) {
-    if (n->subframe_start_index > 0)
-      bit_index += n->subframe_start_index; /* Standard. */
+  if (subframe_start_index) {
+    if (subframe_start_index > 0)
+      bit_index += subframe_start_index; /* Standard. */
     else {
-      bit_index -= n->subframe_start_index; /* Bits are inverse! */
+      bit_index -= subframe_start_index; /* Bits are inverse! */
       invert = !invert;
     }
 
     bit_index--;
   }
 
-  /* Wrap if necessary. */
-  if (bit_index > NAV_MSG_SUBFRAME_BITS_LEN*32)
-    bit_index -= NAV_MSG_SUBFRAME_BITS_LEN*32;
+  /* Wrap if necessary, the start offset and bit index can together pass
+   * the end of the buffer more than once. */
+  bit_index %= NAV_MSG_SUBFRAME_BITS_LEN*32;
 
   u8 bix_hi = bit_index >> 5;
   u8 bix_lo = bit_index & 0x1F;
-  u32 word = n->subframe_bits[bix_hi] << bix_lo;
+  u32 word = subframe_bits[bix_hi] << bix_lo;
 
   if (bix_lo) {
     bix_hi++;
     if (bix_hi == NAV_MSG_SUBFRAME_BITS_LEN)
       bix_hi = 0;
-    word |=  n->subframe_bits[bix_hi] >> (32 - bix_lo);
+    word |=  subframe_bits[bix_hi] >> (32 - bix_lo);
   }
 
   if (invert)
@@ -71,6 +140,86 @@ static u32 extract_word(nav_msg_t *n, u16 bit_index, u8 n_bits, u8 invert)
   return word >> (32 - n_bits);
 }
 
+static u32 extract_word(nav_msg_t *n, u16 bit_index, u8 n_bits, u8 invert)
+{
+  return bits_extract(n->subframe_bits, n->subframe_start_index,
+                      bit_index, n_bits, invert);
+}
+
+static s32 preamble_confirm(const u32 *subframe_bits,
+                            s16 *subframe_start_index)
+{
+  /* Confirm a preamble found at *subframe_start_index, returning the TOW or
+   * -1 and clearing *subframe_start_index if it doesn't check out. */
+  s16 start = *subframe_start_index;
+  s32 TOW_ms = -1;
+
+  // Looks like we found a preamble, but let's confirm.
+  if (bits_extract(subframe_bits, start, 300, 8, 0) == 0x8B) {
+    // There's another preamble in the following subframe.  Looks good so far.
+    // Extract the TOW:
+
+    unsigned int TOW_trunc = bits_extract(subframe_bits, start, 30, 17,
+        bits_extract(subframe_bits, start, 29, 1, 0)); // bit 29 is D30* for the second word, where the TOW resides.
+    TOW_trunc++;  // Increment it, to see what we expect at the start of the next subframe
+    if (TOW_trunc >= 7*24*60*10)  // Handle end of week rollover
+      TOW_trunc = 0;
+
+    if (TOW_trunc == bits_extract(subframe_bits, start, 330, 17,
+                                  bits_extract(subframe_bits, start, 329, 1, 0))) {
+      // We got two appropriately spaced preambles, and two matching TOW counts.  Pretty certain now.
+
+      // The TOW in the message is for the start of the NEXT subframe.
+      // That is, 240 nav bits' time from now, since we are 60 nav bits into the second subframe that we recorded.
+      if (TOW_trunc)
+        TOW_ms = TOW_trunc * 6000 - (300-60)*20;
+      else  // end of week special case
+        TOW_ms = 7*24*60*60*1000 - (300-60)*20;
+      //printf("TOW = hh:%02d:%02d.%03d\n", (int) (TOW_ms / 60000 % 60), (int)(TOW_ms / 1000 % 60), (int)(TOW_ms % 1000));
+
+    } else
+      *subframe_start_index = 0;  // the TOW counts didn't match - disregard.
+  } else
+    *subframe_start_index = 0;    // didn't find a second preamble in the right spot - disregard.
+
+  return TOW_ms;
+}
+
+static s32 tow_single(const u32 *subframe_bits, u16 subframe_bit_index)
+{
+  /* Look for a TLM and HOW that have just been received, with the preamble
+   * 60 nav bits ago, returning the TOW if both words pass the parity check
+   * or -1. */
+  u16 start = subframe_bit_index + NAV_MSG_SUBFRAME_BITS_LEN*32 - 60;
+
+  u8 invert;
+  u8 preamble = bits_extract(subframe_bits, 0, start, 8, 0);
+  if (preamble == 0x8B)
+    invert = 0;
+  else if (preamble == 0x74)
+    invert = 1;
+  else
+    return -1;
+
+  /* Words with D29* and D30* of the word before, see nav_parity(). */
+  u32 tlm = bits_extract(subframe_bits, 0, start - 2, 32, invert);
+  u32 how = bits_extract(subframe_bits, 0, start + 28, 32, invert);
+  if (nav_parity(&tlm) || nav_parity(&how) || (tlm >> 22 & 0xFF) != 0x8B)
+    return -1;
+
+  /* The last two bits of the HOW are zero, and the TOW and subframe ID
+   * must be in range. */
+  u32 TOW_trunc = how >> 13 & 0x1FFFF;
+  u8 sf_id = how >> 8 & 0x07;
+  if ((how & 3) || TOW_trunc >= 7*24*60*10 || sf_id < 1 || sf_id > 5)
+    return -1;
+
+  /* The TOW in the HOW is for the start of the next subframe, 240 nav bits
+   * from now, as in preamble_confirm(). */
+  if (TOW_trunc)
+    return TOW_trunc * 6000 - (300-60)*20;
+  return 7*24*60*60*1000 - (300-60)*20;
+}
 
 s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
 {
@@ -87,7 +236,14 @@ s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
   if (n->bit_phase_count < NAV_MSG_BIT_PHASE_THRES) {
 
     /* No bit phase lock yet. */
-    if ((n->nav_bit_integrate > 0) != (corr_prompt_real > 0)) {
+    if (n->bit_sync == NAV_MSG_BIT_SYNC_HISTOGRAM) {
+      /* A zero integrator, as before the first correlation, has no sign. */
+      if (n->nav_bit_integrate &&
+          (n->nav_bit_integrate > 0) != (corr_prompt_real > 0) &&
+          bit_sync_histogram(n->bit_sync_hist, n->bit_phase,
+                             &n->bit_phase_ref))
+        n->bit_phase_count = NAV_MSG_BIT_PHASE_THRES;
+    } else if ((n->nav_bit_integrate > 0) != (corr_prompt_real > 0)) {
       /* Edge detected. */
       if ((n->bit_phase - 1) % 20 == n->bit_phase_ref)
         /* This edge came N*20 ms after the last one. */
@@ -129,6 +285,11 @@ s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
   if (n->subframe_bit_index == NAV_MSG_SUBFRAME_BITS_LEN*32)
     n->subframe_bit_index = 0;
 
+  /* Optionally take the TOW from the subframe just started, one subframe
+   * before the check of two consecutive preambles below can. */
+  if (n->tow_single)
+    TOW_ms = tow_single(n->subframe_bits, n->subframe_bit_index);
+
   /* Yo dawg, are we still looking for the preamble? */
   if (!n->subframe_start_index) {
     /* We're going to look for the preamble at a time 360 nav bits ago,
@@ -147,31 +308,10 @@ s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
     }
 
     if (n->subframe_start_index) {
-      // Looks like we found a preamble, but let's confirm.
-      if (extract_word(n, 300, 8, 0) == 0x8B) {
-        // There's another preamble in the following subframe.  Looks good so far.
-        // Extract the TOW:
-
-        unsigned int TOW_trunc = extract_word(n,30,17,extract_word(n,29,1,0)); // bit 29 is D30* for the second word, where the TOW resides.
-        TOW_trunc++;  // Increment it, to see what we expect at the start of the next subframe
-        if (TOW_trunc >= 7*24*60*10)  // Handle end of week rollover
-          TOW_trunc = 0;
-
-        if (TOW_trunc == extract_word(n,330,17,extract_word(n,329,1,0))) {
-          // We got two appropriately spaced preambles, and two matching TOW counts.  Pretty certain now.
-
-          // The TOW in the message is for the start of the NEXT subframe.
-          // That is, 240 nav bits' time from now, since we are 60 nav bits into the second subframe that we recorded.
-          if (TOW_trunc)
-            TOW_ms = TOW_trunc * 6000 - (300-60)*20;
-          else  // end of week special case
-            TOW_ms = 7*24*60*60*1000 - (300-60)*20;
-          //printf("TOW = hh:%02d:%02d.%03d\n", (int) (TOW_ms / 60000 % 60), (int)(TOW_ms / 1000 % 60), (int)(TOW_ms % 1000));
-
-        } else
-          n->subframe_start_index = 0;  // the TOW counts didn't match - disregard.
-      } else
-        n->subframe_start_index = 0;    // didn't find a second preamble in the right spot - disregard.
+      s32 TOW_confirmed = preamble_confirm(n->subframe_bits,
+                                           &n->subframe_start_index);
+      if (TOW_confirmed >= 0)
+        TOW_ms = TOW_confirmed;
     }
   }
   return TOW_ms;
@@ -220,59 +360,260 @@ int nav_parity(u32 *word) {
   return 0;
 }
 
+/** Cross-check times of week taken from single subframes.
+ *
+ * With `tow_single` set, nav_msg_update() reports the TOW of a channel
+ * from one subframe's TLM and HOW. Those two words are checked only by
+ * their parity and the preamble, so before a TOW is used to compute
+ * measurements it should be confirmed by another source. This function
+ * confirms each channel's TOW against an a-priori time of week if there is
+ * one, or otherwise against the TOW of any other channel.
+ *
+ * The TOWs should all refer to the same receiver time, propagated from
+ * the time each was reported. They then differ only by the spread in the
+ * signal travel times of the satellites, up to about 20 ms.
+ *
+ * \param n              Number of channels.
+ * \param TOW_ms         TOW of each channel in ms, negative if none.
+ * \param TOW_apriori_ms A-priori TOW in ms, negative if unknown.
+ * \param tolerance_ms   Largest accepted difference between two TOWs in ms,
+ *                       to cover the travel time spread and the
+ *                       uncertainty of the a-priori time.
+ * \param ok             Output, whether each channel's TOW is confirmed.
+ * \return Number of channels with a confirmed TOW.
+ */
+u8 nav_msg_tow_check(u8 n, const s32 TOW_ms[], s32 TOW_apriori_ms,
+                     u32 tolerance_ms, bool ok[])
+{
+  const s32 week_ms = 7*24*60*60*1000;
+  u8 n_ok = 0;
+
+  for (u8 i=0; i<n; i++) {
+    ok[i] = false;
+    if (TOW_ms[i] < 0)
+      continue;
+
+    for (u8 j=0; j<=n; j++) {
+      s32 other;
+      if (j == n)
+        other = TOW_apriori_ms;
+      else if (j != i && TOW_apriori_ms < 0)
+        other = TOW_ms[j];
+      else
+        continue;
+      if (other < 0)
+        continue;
+
+      /* Difference across the week rollover. */
+      s32 d = abs(TOW_ms[i] - other) % week_ms;
+      if (d > week_ms / 2)
+        d = week_ms - d;
+      if ((u32)d <= tolerance_ms) {
+        ok[i] = true;
+        break;
+      }
+    }
+    n_ok += ok[i];
+  }
+
+  return n_ok;
+}
+
 bool subframe_ready(nav_msg_t *n) {
   return (n->subframe_start_index != 0);
 }
 
-s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
-  // Check parity and parse out the ephemeris from the most recently received subframe
+/** \defgroup nav_msg_almanac Almanac Decoding
+ * Decoding of the almanac, ionospheric model and UTC parameters from
+ * subframes 4 and 5.
+ *
+ * Subframes 4 and 5 each cycle through 25 pages over 12.5 minutes. Word 3
+ * of each page starts with the data ID and the SV ID which identifies the
+ * contents of the page, see IS-GPS-200 20.3.3.5. The pages with SV IDs 1
+ * to 32 hold the almanac of that satellite, SV ID 56 in subframe 4 the
+ * ionospheric model and UTC parameters, and SV ID 51 in subframe 5 the
+ * almanac reference time and week. The health summaries of pages 25 are
+ * not decoded as each almanac page carries the health of its satellite,
+ * and the other pages are ignored.
+ *
+ * The almanac pages only give the time of applicability. The week of the
+ * almanacs with the time of applicability of subframe 5 page 25 is
+ * resolved from its 8 bit almanac week once the week number has also been
+ * seen in subframe 1. Until then almanac_t::week is zero and the almanac
+ * functions should be passed a week of `-1`.
+ * \{ */
 
-  // First things first - check the parity, and invert bits if necessary.
-  // process the data, skipping the first word, TLM, and starting with HOW
+/** Data ID of the GPS navigation message, in word 3 of subframes 4 and 5. */
+#define NAV_MSG_DATA_ID 1
 
-  // printf("  %d  ", (n->subframe_start_index > 0));
+/** SV ID of subframe 5 page 25, the almanac reference time and week. */
+#define NAV_MSG_SV_ID_ALMANAC_TIME 51
 
-  /* TODO: Check if inverted has changed and detect half cycle slip. */
-  if (n->inverted != (n->subframe_start_index < 0))
-    printf("Nav phase flip\n");
-  n->inverted = (n->subframe_start_index < 0);
+/** SV ID of subframe 4 page 18, the ionospheric and UTC parameters. */
+#define NAV_MSG_SV_ID_IONO_UTC 56
 
-  if (!e) {
-    printf(" process_subframe: CALLED WITH e = NULL!\n");
-    n->subframe_start_index = 0;  // Mark the subframe as processed
-    n->next_subframe_id = 1;      // Make sure we start again next time
-    return -1;
+/** Initialise the store of data decoded from subframes 4 and 5.
+ *
+ * \param a Store to initialise.
+ */
+void nav_msg_almanac_init(nav_msg_almanac_t *a)
+{
+  memset(a, 0, sizeof(*a));
+  a->week = -1;
+  a->wna = -1;
+}
+
+/** Bits `first` to `last` of word `w` of a subframe, numbered from 1 at
+ * the most significant as in IS-GPS-200. `words` holds words 2 to 10. */
+static u32 sf_bits(const u32 words[9], u8 w, u8 first, u8 last)
+{
+  return words[w - 2] >> (30 - last) & (0xFFFFFFFF >> (31 - last + first));
+}
+
+/** Sign extend the `n` bit two's complement value `x`. */
+static s32 sign_extend(u32 x, u8 n)
+{
+  return (s32)(x << (32 - n)) >> (32 - n);
+}
+
+/** Set the week of the almanacs referenced to the time of applicability of
+ * subframe 5 page 25, once both its almanac week and the current week are
+ * known. */
+static void almanac_week(nav_msg_almanac_t *a)
+{
+  if (a->week < 0 || a->wna < 0)
+    return;
+
+  /* The almanac week is within half of 256 weeks of the current week. */
+  s16 week = (a->week & ~0xFF) | a->wna;
+  if (week > a->week + 128)
+    week -= 256;
+  else if (week <= a->week - 128)
+    week += 256;
+  week = (week + 1024) % 1024;
+
+  for (u8 i=0; i<32; i++)
+    if (a->almanac[i].valid && a->almanac[i].toa == a->toa)
+      a->almanac[i].week = week;
+}
+
+/** Decode an almanac page, IS-GPS-200 Table 20-VI. */
+static void decode_almanac(const u32 words[9], u8 prn, almanac_t *alm)
+{
+  alm->ecc = sf_bits(words, 3, 9, 24) * pow(2,-21);
+  alm->toa = sf_bits(words, 4, 1, 8) * pow(2,12);
+  /* Inclination relative to 0.3 semi-circles. */
+  alm->inc = (0.3 + sign_extend(sf_bits(words, 4, 9, 24), 16) * pow(2,-19))
+             * GPS_PI;
+  alm->rora = sign_extend(sf_bits(words, 5, 1, 16), 16) * pow(2,-38) * GPS_PI;
+  alm->healthy = sf_bits(words, 5, 17, 24) == 0;
+  double sqrta = sf_bits(words, 6, 1, 24) * pow(2,-11);
+  alm->a = sqrta * sqrta;
+  alm->raaw = sign_extend(sf_bits(words, 7, 1, 24), 24) * pow(2,-23) * GPS_PI;
+  alm->argp = sign_extend(sf_bits(words, 8, 1, 24), 24) * pow(2,-23) * GPS_PI;
+  alm->ma = sign_extend(sf_bits(words, 9, 1, 24), 24) * pow(2,-23) * GPS_PI;
+  /* a_f0 is split around a_f1 in word 10. */
+  alm->af0 = sign_extend(sf_bits(words, 10, 1, 8) << 3
+                         | sf_bits(words, 10, 20, 22), 11) * pow(2,-20);
+  alm->af1 = sign_extend(sf_bits(words, 10, 9, 19), 11) * pow(2,-38);
+  alm->week = 0;
+  alm->prn = prn;
+  alm->valid = 1;
+}
+
+/** Decode the ionospheric and UTC parameters of subframe 4 page 18,
+ * IS-GPS-200 Table 20-X. */
+static void decode_iono_utc(const u32 words[9], ionosphere_t *iono,
+                            utc_params_t *utc)
+{
+  iono->a0 = sign_extend(sf_bits(words, 3, 9, 16), 8) * pow(2,-30);
+  iono->a1 = sign_extend(sf_bits(words, 3, 17, 24), 8) * pow(2,-27);
+  iono->a2 = sign_extend(sf_bits(words, 4, 1, 8), 8) * pow(2,-24);
+  iono->a3 = sign_extend(sf_bits(words, 4, 9, 16), 8) * pow(2,-24);
+  iono->b0 = sign_extend(sf_bits(words, 4, 17, 24), 8) * pow(2,11);
+  iono->b1 = sign_extend(sf_bits(words, 5, 1, 8), 8) * pow(2,14);
+  iono->b2 = sign_extend(sf_bits(words, 5, 9, 16), 8) * pow(2,16);
+  iono->b3 = sign_extend(sf_bits(words, 5, 17, 24), 8) * pow(2,16);
+  iono->valid = 1;
+
+  utc->a1 = sign_extend(sf_bits(words, 6, 1, 24), 24) * pow(2,-50);
+  /* A_0 is split over words 7 and 8. */
+  utc->a0 = sign_extend(sf_bits(words, 7, 1, 24) << 8
+                        | sf_bits(words, 8, 1, 8), 32) * pow(2,-30);
+  utc->tot = sf_bits(words, 8, 9, 16) << 12;
+  utc->wnt = sf_bits(words, 8, 17, 24);
+  utc->dt_ls = sign_extend(sf_bits(words, 9, 1, 8), 8);
+  utc->wn_lsf = sf_bits(words, 9, 9, 16);
+  utc->dn = sf_bits(words, 9, 17, 24);
+  utc->dt_lsf = sign_extend(sf_bits(words, 10, 1, 8), 8);
+  utc->valid = 1;
+}
+
+/** Decode a page of subframe 4 or 5 whose words passed the parity check,
+ * returning 2 if it updated the store or 0 if the page isn't decoded. */
+static s8 decode_sf45(const u32 words[9], u8 sf_id, nav_msg_almanac_t *a)
+{
+  if (sf_bits(words, 3, 1, 2) != NAV_MSG_DATA_ID)
+    return 0;
+
+  u8 sv_id = sf_bits(words, 3, 3, 8);
+  if (sv_id >= 1 && sv_id <= 32) {
+    decode_almanac(words, sv_id - 1, &a->almanac[sv_id - 1]);
+  } else if (sf_id == 4 && sv_id == NAV_MSG_SV_ID_IONO_UTC) {
+    decode_iono_utc(words, &a->iono, &a->utc);
+  } else if (sf_id == 5 && sv_id == NAV_MSG_SV_ID_ALMANAC_TIME) {
+    a->toa = sf_bits(words, 3, 9, 16) << 12;
+    a->wna = sf_bits(words, 3, 17, 24);
+  } else {
+    return 0;
   }
-  u32 sf_word2 = extract_word(n, 28, 32, 0);
-  if (nav_parity(&sf_word2)) {
-      printf("SUBFRAME PARITY ERROR (word 2)\n");
-      n->subframe_start_index = 0;  // Mark the subframe as processed
-      n->next_subframe_id = 1;      // Make sure we start again next time
+
+  almanac_week(a);
+  return 2;
+}
+
+/** \} */
+
+static s8 handle_subframe(u32 frame_words[3][8], u8 *next_subframe_id,
+                          s16 *subframe_start_index,
+                          const u32 words[9], const u8 parity_errors[9],
+                          ephemeris_t *e, nav_msg_almanac_t *a)
+{
+  /* Process the HOW and words 3 to 10 of a subframe, already passed through
+   * nav_parity() which left its result for each word in parity_errors. */
+
+  if (parity_errors[0]) {
+      DIAG(DIAG_WARN, DIAG_EVENT_NAV_PARITY_ERROR,
+           "SUBFRAME PARITY ERROR (word 2)");
+      *subframe_start_index = 0;  // Mark the subframe as processed
+      *next_subframe_id = 1;      // Make sure we start again next time
       return -2;
   }
+  u32 sf_word2 = words[0];
 
   u8 sf_id = sf_word2 >> 8 & 0x07;    // Which of 5 possible subframes is it?
 
-  /*printf("sf_id = %d, nsf = %d\n",sf_id, n->next_subframe_id);*/
+  /*printf("sf_id = %d, nsf = %d\n",sf_id, *next_subframe_id);*/
 
-  if (sf_id <= 3 && sf_id == n->next_subframe_id) {  // Is it the one that we want next?
+  if (sf_id <= 3 && sf_id == *next_subframe_id) {  // Is it the one that we want next?
 
     for (int w = 0; w < 8; w++) {   // For words 3..10
-      n->frame_words[sf_id-1][w] = extract_word(n, 30*(w+2) - 2, 32, 0);    // Get the bits
+      frame_words[sf_id-1][w] = words[w+1];    // Get the bits
       // MSBs are D29* and D30*.  LSBs are D1...D30
-      if (nav_parity(&n->frame_words[sf_id-1][w])) {  // Check parity and invert bits if D30*
-        printf("SUBFRAME PARITY ERROR (word %d)\n", w+3);
-        n->next_subframe_id = 1;      // Make sure we start again next time
-        n->subframe_start_index = 0;  // Mark the subframe as processed
+      if (parity_errors[w+1]) {  // Parity checked and bits inverted if D30*
+        DIAG(DIAG_WARN, DIAG_EVENT_NAV_PARITY_ERROR,
+             "SUBFRAME PARITY ERROR (word %d)", w+3);
+        *next_subframe_id = 1;      // Make sure we start again next time
+        *subframe_start_index = 0;  // Mark the subframe as processed
         return -3;
       }
     }
-    n->subframe_start_index = 0;  // Mark the subframe as processed
-    n->next_subframe_id++;
+    *subframe_start_index = 0;  // Mark the subframe as processed
+    (*next_subframe_id)++;
 
     if (sf_id == 3) {
       // Got all of subframes 1 to 3
-      n->next_subframe_id = 1;      // Make sure we start again next time
+      *next_subframe_id = 1;      // Make sure we start again next time
 
       // Now let's actually go through the parameters...
 
@@ -296,24 +637,27 @@ s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
 
       // Subframe 1: SV health, T_GD, t_oc, a_f2, a_f1, a_f0
 
-      e->toe.wn = (n->frame_words[0][3-3] >> (30-10) & 0x3FF);       // GPS week number (mod 1024): Word 3, bits 20-30
+      e->toe.wn = (frame_words[0][3-3] >> (30-10) & 0x3FF);       // GPS week number (mod 1024): Word 3, bits 20-30
       e->toe.wn += GPS_WEEK_CYCLE*1024;
       e->toc.wn = e->toe.wn;
 
-      e->healthy = !(n->frame_words[0][3-3] >> (30-17) & 1);     // Health flag: Word 3, bit 17
+      e->healthy = !(frame_words[0][3-3] >> (30-17) & 1);     // Health flag: Word 3, bit 17
 
-      onebyte.u8 = n->frame_words[0][7-3] >> (30-24) & 0xFF;  // t_gd: Word 7, bits 17-24
+      onebyte.u8 = frame_words[0][7-3] >> (30-24) & 0xFF;  // t_gd: Word 7, bits 17-24
       e->tgd = onebyte.s8 * pow(2,-31);
 
-      e->toc.tow = (n->frame_words[0][8-3] >> (30-24) & 0xFFFF) * 16;   // t_oc: Word 8, bits 8-24
+      e->iodc = (frame_words[0][3-3] >> (30-24) & 0x3) << 8    // IODC: Word 3, bits 23-24
+              | (frame_words[0][8-3] >> (30-8) & 0xFF);        // and word 8, bits 1-8
+
+      e->toc.tow = (frame_words[0][8-3] >> (30-24) & 0xFFFF) * 16;   // t_oc: Word 8, bits 8-24
 
-      onebyte.u8 = n->frame_words[0][9-3] >> (30-8) & 0xFF;         // a_f2: Word 9, bits 1-8
+      onebyte.u8 = frame_words[0][9-3] >> (30-8) & 0xFF;         // a_f2: Word 9, bits 1-8
       e->af2 = onebyte.s8 * pow(2,-55);
 
-      twobyte.u16 = n->frame_words[0][9-3] >> (30-24) & 0xFFFF;     // a_f1: Word 9, bits 9-24
+      twobyte.u16 = frame_words[0][9-3] >> (30-24) & 0xFFFF;     // a_f1: Word 9, bits 9-24
       e->af1 = twobyte.s16 * pow(2,-43);
 
-      fourbyte.u32 = n->frame_words[0][10-3] >> (30-22) & 0x3FFFFF; // a_f0: Word 10, bits 1-22
+      fourbyte.u32 = frame_words[0][10-3] >> (30-22) & 0x3FFFFF; // a_f0: Word 10, bits 1-22
       fourbyte.u32 <<= 10; // Shift to the left for sign extension
       fourbyte.s32 >>= 10; // Carry the sign bit back down and reduce to signed 22 bit value
       e->af0 = fourbyte.s32 * pow(2,-31);
@@ -321,72 +665,80 @@ s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
 
       // Subframe 2: crs, dn, m0, cuc, ecc, cus, sqrta, toe
 
-      twobyte.u16 = n->frame_words[1][3-3] >> (30-24) & 0xFFFF;     // crs: Word 3, bits 9-24
+      e->iode = frame_words[1][3-3] >> (30-8) & 0xFF;            // IODE: Word 3, bits 1-8
+
+      twobyte.u16 = frame_words[1][3-3] >> (30-24) & 0xFFFF;     // crs: Word 3, bits 9-24
       e->crs = twobyte.s16 * pow(2,-5);
 
-      twobyte.u16 = n->frame_words[1][4-3] >> (30-16) & 0xFFFF;     // dn: Word 4, bits 1-16
+      twobyte.u16 = frame_words[1][4-3] >> (30-16) & 0xFFFF;     // dn: Word 4, bits 1-16
       e->dn = twobyte.s16 * pow(2,-43) * GPS_PI;
 
-      fourbyte.u32 = ((n->frame_words[1][4-3] >> (30-24) & 0xFF) << 24) // m0: Word 4, bits 17-24
-                  | (n->frame_words[1][5-3] >> (30-24) & 0xFFFFFF);     // and word 5, bits 1-24
+      fourbyte.u32 = ((frame_words[1][4-3] >> (30-24) & 0xFF) << 24) // m0: Word 4, bits 17-24
+                  | (frame_words[1][5-3] >> (30-24) & 0xFFFFFF);     // and word 5, bits 1-24
       e->m0 = fourbyte.s32 * pow(2,-31) * GPS_PI;
 
-      twobyte.u16 = n->frame_words[1][6-3] >> (30-16) & 0xFFFF;    // cuc: Word 6, bits 1-16
+      twobyte.u16 = frame_words[1][6-3] >> (30-16) & 0xFFFF;    // cuc: Word 6, bits 1-16
       e->cuc = twobyte.s16 * pow(2,-29);
 
-      fourbyte.u32 = ((n->frame_words[1][6-3] >> (30-24) & 0xFF) << 24) // ecc: Word 6, bits 17-24
-                  | (n->frame_words[1][7-3] >> (30-24) & 0xFFFFFF);     // and word 7, bits 1-24
+      fourbyte.u32 = ((frame_words[1][6-3] >> (30-24) & 0xFF) << 24) // ecc: Word 6, bits 17-24
+                  | (frame_words[1][7-3] >> (30-24) & 0xFFFFFF);     // and word 7, bits 1-24
       e->ecc = fourbyte.u32 * pow(2,-33);
 
 
-      twobyte.u16 = n->frame_words[1][8-3] >> (30-16) & 0xFFFF;   // cus: Word 8, bits 1-16
+      twobyte.u16 = frame_words[1][8-3] >> (30-16) & 0xFFFF;   // cus: Word 8, bits 1-16
       e->cus = twobyte.s16 * pow(2,-29);
 
 
-      fourbyte.u32 = ((n->frame_words[1][8-3] >> (30-24) & 0xFF) << 24) // sqrta: Word 8, bits 17-24
-                  | (n->frame_words[1][9-3] >> (30-24) & 0xFFFFFF);     // and word 9, bits 1-24
+      fourbyte.u32 = ((frame_words[1][8-3] >> (30-24) & 0xFF) << 24) // sqrta: Word 8, bits 17-24
+                  | (frame_words[1][9-3] >> (30-24) & 0xFFFFFF);     // and word 9, bits 1-24
       e->sqrta = fourbyte.u32 * pow(2,-19);
 
-      e->toe.tow = (n->frame_words[1][10-3] >> (30-16) & 0xFFFF) * 16;   // t_oe: Word 10, bits 1-16
+      e->toe.tow = (frame_words[1][10-3] >> (30-16) & 0xFFFF) * 16;   // t_oe: Word 10, bits 1-16
 
 
       // Subframe 3: cic, omega0, cis, inc, crc, w, omegadot, inc_dot
 
-      twobyte.u16 = n->frame_words[2][3-3] >> (30-16) & 0xFFFF;   // cic: Word 3, bits 1-16
+      twobyte.u16 = frame_words[2][3-3] >> (30-16) & 0xFFFF;   // cic: Word 3, bits 1-16
       e->cic = twobyte.s16 * pow(2,-29);
 
-      fourbyte.u32 = ((n->frame_words[2][3-3] >> (30-24) & 0xFF) << 24) // omega0: Word 3, bits 17-24
-                  | (n->frame_words[2][4-3] >> (30-24) & 0xFFFFFF);     // and word 4, bits 1-24
+      fourbyte.u32 = ((frame_words[2][3-3] >> (30-24) & 0xFF) << 24) // omega0: Word 3, bits 17-24
+                  | (frame_words[2][4-3] >> (30-24) & 0xFFFFFF);     // and word 4, bits 1-24
       e->omega0 = fourbyte.s32 * pow(2,-31) * GPS_PI;
 
-      twobyte.u16 = n->frame_words[2][5-3] >> (30-16) & 0xFFFF; // cis: Word 5, bits 1-16
+      twobyte.u16 = frame_words[2][5-3] >> (30-16) & 0xFFFF; // cis: Word 5, bits 1-16
       e->cis = twobyte.s16 * pow(2,-29);
 
-      fourbyte.u32 = ((n->frame_words[2][5-3] >> (30-24) & 0xFF) << 24) // inc (i0): Word 5, bits 17-24
-                  | (n->frame_words[2][6-3] >> (30-24) & 0xFFFFFF);     // and word 6, bits 1-24
+      fourbyte.u32 = ((frame_words[2][5-3] >> (30-24) & 0xFF) << 24) // inc (i0): Word 5, bits 17-24
+                  | (frame_words[2][6-3] >> (30-24) & 0xFFFFFF);     // and word 6, bits 1-24
       e->inc = fourbyte.s32 * pow(2,-31) * GPS_PI;
 
-      twobyte.u16 = n->frame_words[2][7-3] >> (30-16) & 0xFFFF; // crc: Word 7, bits 1-16
+      twobyte.u16 = frame_words[2][7-3] >> (30-16) & 0xFFFF; // crc: Word 7, bits 1-16
       e->crc = twobyte.s16 * pow(2,-5);
 
-      fourbyte.u32 = ((n->frame_words[2][7-3] >> (30-24) & 0xFF) << 24) // w (omega): Word 7, bits 17-24
-                  | (n->frame_words[2][8-3] >> (30-24) & 0xFFFFFF);     // and word 8, bits 1-24
+      fourbyte.u32 = ((frame_words[2][7-3] >> (30-24) & 0xFF) << 24) // w (omega): Word 7, bits 17-24
+                  | (frame_words[2][8-3] >> (30-24) & 0xFFFFFF);     // and word 8, bits 1-24
       e->w = fourbyte.s32 * pow(2,-31) * GPS_PI;
 
-      fourbyte.u32 = n->frame_words[2][9-3] >> (30-24) & 0xFFFFFF;     // Omega_dot: Word 9, bits 1-24
+      fourbyte.u32 = frame_words[2][9-3] >> (30-24) & 0xFFFFFF;     // Omega_dot: Word 9, bits 1-24
       fourbyte.u32 <<= 8; // shift left for sign extension
       fourbyte.s32 >>= 8; // sign-extend it
       e->omegadot = fourbyte.s32 * pow(2,-43) * GPS_PI;
 
 
-      twobyte.u16 = n->frame_words[2][10-3] >> (30-22) & 0x3FFF;  // inc_dot (IDOT): Word 10, bits 9-22
+      twobyte.u16 = frame_words[2][10-3] >> (30-22) & 0x3FFF;  // inc_dot (IDOT): Word 10, bits 9-22
       twobyte.u16 <<= 2;
       twobyte.s16 >>= 2;  // sign-extend
       e->inc_dot = twobyte.s16 * pow(2,-43) * GPS_PI;
 
 
+      ephemeris_prepare(e);
       e->valid = 1;
 
+      if (a) {
+        a->week = e->toe.wn % 1024;
+        almanac_week(a);
+      }
+
       /*printf("Health %d\n", e->healthy);*/
       /*printf("TGD %16g\n", e->tgd);*/
       /*printf("TOC %16u\n", (unsigned int)e->toc);*/
@@ -413,12 +765,576 @@ s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
 
     }
   } else {  // didn't get the subframe that we want next
-      n->next_subframe_id = 1;      // Make sure we start again next time
-      n->subframe_start_index = 0;  // Mark the subframe as processed
+      *next_subframe_id = 1;      // Make sure we start again next time
+      *subframe_start_index = 0;  // Mark the subframe as processed
+
+      if (a && (sf_id == 4 || sf_id == 5)) {
+        for (int w = 0; w < 8; w++) {   // For words 3..10
+          if (parity_errors[w+1]) {
+            DIAG(DIAG_WARN, DIAG_EVENT_NAV_PARITY_ERROR,
+                 "SUBFRAME PARITY ERROR (word %d)", w+3);
+            return -3;
+          }
+        }
+        return decode_sf45(words, sf_id, a);
+      }
+  }
+
+  return 0;
+
+
+}
+
+s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
+  return process_subframe_almanac(n, e, 0);
+}
+
+/** Process the most recently received subframe as process_subframe(), also
+ * decoding subframes 4 and 5.
+ *
+ * Subframes 1 to 3 update the ephemeris as process_subframe(), and the
+ * week number of subframe 1 is also recorded in `a`. Subframe 4 and 5
+ * pages update the almanac, ionospheric or UTC data in `a`, see
+ * \ref nav_msg_almanac.
+ *
+ * \param n Nav message state.
+ * \param e Ephemeris of the channel's satellite.
+ * \param a Store of the data decoded from subframes 4 and 5, shared by all
+ *          the channels. If NULL subframes 4 and 5 are skipped, as with
+ *          process_subframe().
+ * \return As process_subframe(), or `2` if a page of subframe 4 or 5
+ *         updated `a`. A parity error in subframe 4 or 5 returns `-3`.
+ */
+s8 process_subframe_almanac(nav_msg_t *n, ephemeris_t *e,
+                            nav_msg_almanac_t *a)
+{
+  // Check parity and parse out the ephemeris from the most recently received subframe
+
+  // First things first - check the parity, and invert bits if necessary.
+  // process the data, skipping the first word, TLM, and starting with HOW
+
+  // printf("  %d  ", (n->subframe_start_index > 0));
+
+  /* TODO: Check if inverted has changed and detect half cycle slip. */
+  if (n->inverted != (n->subframe_start_index < 0))
+    DIAG(DIAG_INFO, DIAG_EVENT_NAV_PHASE_FLIP, "Nav phase flip");
+  n->inverted = (n->subframe_start_index < 0);
+
+  if (!e) {
+    DIAG(DIAG_ERROR, DIAG_EVENT_NAV_NO_EPHEMERIS,
+         "process_subframe: CALLED WITH e = NULL!");
+    n->subframe_start_index = 0;  // Mark the subframe as processed
+    n->next_subframe_id = 1;      // Make sure we start again next time
+    return -1;
+  }
+
+  u32 words[9];
+  u8 parity_errors[9];
+  for (int w = 0; w < 9; w++) {   // For words 2..10
+    words[w] = extract_word(n, 30*(w+1) - 2, 32, 0);
+    // MSBs are D29* and D30*.  LSBs are D1...D30
+    parity_errors[w] = nav_parity(&words[w]);  // Check parity and invert bits if D30*
+  }
+
+  return handle_subframe(n->frame_words, &n->next_subframe_id,
+                         &n->subframe_start_index, words, parity_errors, e,
+                         a);
+}
+
+/** \defgroup nav_msg_replay Subframe Replay
+ * Recording parity checked subframes and decoding them again later.
+ *
+ * nav_msg_subframe_get() takes a copy of a received subframe, keeping
+ * only the data bits of its ten words after the parity check, together
+ * with the satellite and time of week. The copies can be archived, see
+ * \ref nav_archive, and decoded with nav_msg_replay_subframe() exactly as
+ * process_subframe_almanac() decodes them as they are received.
+ * \{ */
+
+/** Take a copy of the subframe ready in a channel's nav message state.
+ *
+ * Call before process_subframe(), which marks the subframe as processed.
+ *
+ * \param n   Nav message state for which subframe_ready() is true.
+ * \param prn PRN of the channel's satellite, counting from 0.
+ * \param sf  Output subframe.
+ * \return `0` on success, `-1` if no subframe is ready or any of its words
+ *         fails the parity check.
+ */
+s8 nav_msg_subframe_get(const nav_msg_t *n, u8 prn, nav_msg_subframe_t *sf)
+{
+  if (!n->subframe_start_index)
+    return -1;
+
+  for (u8 w=0; w<10; w++) {
+    /* Starting with D29* and D30* of the word before, the TLM's wrapping
+     * round to the end of the buffer. */
+    u16 bit_index = w ? 30*w - 2 : NAV_MSG_SUBFRAME_BITS_LEN*32 - 2;
+    u32 word = bits_extract(n->subframe_bits, n->subframe_start_index,
+                            bit_index, 32, 0);
+    if (nav_parity(&word))
+      return -1;
+    u32 data = word >> 6 & 0xFFFFFF;
+    sf->data[3*w] = data >> 16;
+    sf->data[3*w + 1] = data >> 8;
+    sf->data[3*w + 2] = data;
+  }
+
+  /* The HOW holds the TOW count of the start of the next subframe. */
+  u32 TOW_trunc = sf->data[3] << 9 | sf->data[4] << 1 | sf->data[5] >> 7;
+  sf->tow = (TOW_trunc ? TOW_trunc : 7*24*60*10) * 6 - 6;
+  sf->sf_id = sf->data[5] >> 2 & 0x07;
+  sf->prn = prn;
+  return 0;
+}
+
+/** Initialise the state for replaying subframes.
+ *
+ * \param r Replay state to initialise.
+ */
+void nav_msg_replay_init(nav_msg_replay_t *r)
+{
+  memset(r, 0, sizeof(*r));
+  for (u8 i=0; i<32; i++)
+    r->next_subframe_id[i] = 1;
+}
+
+/** Decode a subframe taken with nav_msg_subframe_get().
+ *
+ * Replaying the subframes received by a channel, in order, decodes them
+ * as process_subframe_almanac() did when they were received. Subframes
+ * 1 to 3 of each satellite are only combined when they are consecutive in
+ * time, as the subframes of the different satellites may be interleaved.
+ *
+ * \param r  Replay state.
+ * \param sf Subframe.
+ * \param e  Ephemeris of the subframe's satellite.
+ * \param a  Store of the data decoded from subframes 4 and 5, or NULL to
+ *           skip them.
+ * \return As process_subframe_almanac(), or `-1` if the PRN is invalid.
+ */
+s8 nav_msg_replay_subframe(nav_msg_replay_t *r, const nav_msg_subframe_t *sf,
+                           ephemeris_t *e, nav_msg_almanac_t *a)
+{
+  if (sf->prn >= 32)
+    return -1;
+
+  /* Start again after a gap. */
+  if (sf->tow != r->next_tow[sf->prn])
+    r->next_subframe_id[sf->prn] = 1;
+  r->next_tow[sf->prn] = (sf->tow + 6) % (7*24*60*60);
+
+  u32 words[9];
+  const u8 parity_errors[9] = {0};
+  for (u8 w=0; w<9; w++) {
+    const u8 *d = &sf->data[3*(w + 1)];
+    words[w] = (u32)d[0] << 22 | (u32)d[1] << 14 | (u32)d[2] << 6;
   }
 
+  s16 subframe_start_index = 0;
+  return handle_subframe(r->frame_words[sf->prn],
+                         &r->next_subframe_id[sf->prn],
+                         &subframe_start_index, words, parity_errors, e, a);
+}
+
+/** \} */
+
+/** \defgroup nav_msg_batch Batch Navigation Message Decoding
+ * Navigation message bit sync, preamble search and subframe decoding for
+ * many channels at once.
+ *
+ * A batch holds the decoder state of channels all updated at the same
+ * rate, one array per field, and behaves exactly as nav_msg_update() and
+ * process_subframe() run on each channel in turn.
+ *
+ * Each update advances the bit phases and integrators of all the channels
+ * together, eight at a time with AVX2 when available, and only the
+ * channels at the end of a nav bit or without bit phase lock go on to the
+ * rest of the update.
+ *
+ * Rather than extracting the byte 360 bits back and comparing it with the
+ * preamble as each bit arrives, each word of the bit buffer is searched
+ * once for the preamble at all 32 bit offsets with shifts and compares
+ * over whole words when the word after it is complete. Each new bit then
+ * only tests a bit of the resulting preamble mask.
+ *
+ * The subframes of all the channels ready at an update are parity checked
+ * together, each word's six parity equations being evaluated with `popcnt`
+ * when available, see cpu_features().
+ * \{ */
+
+/** Masks of the bits entering each of the parity equations for D25 to D30,
+ * see nav_parity(). */
+static const u32 parity_masks[6] = {
+  0xBB1F34A0, 0x5D8F9A50, 0xAEC7CD08, 0x5763E684, 0x6BB1F342, 0x8B7A89C1
+};
+
+/** Initialise a batch of channels, each as nav_msg_init().
+ *
+ * \param b          Batch to initialise.
+ * \param n_channels Number of channels, at most NAV_MSG_BATCH_MAX_CHANNELS.
+ * \return `0` on success, `-1` if there are too many channels.
+ */
+s8 nav_msg_batch_init(nav_msg_batch_t *b, u8 n_channels)
+{
+  memset(b, 0, sizeof(*b));
+  if (n_channels > NAV_MSG_BATCH_MAX_CHANNELS)
+    return -1;
+
+  b->n_channels = n_channels;
+  for (u8 i=0; i<n_channels; i++)
+    b->next_subframe_id[i] = 1;
   return 0;
+}
+
+/** Positions in word `w` of a bit buffer where an upright or inverted
+ * preamble starts, bit `31 - j` being set for a preamble starting at bit
+ * `j` of the word.
+ *
+ * Shifting the word and the start of the next one left by `k` bits brings
+ * bit `j + k` of the word to bit `31 - j`, so ANDing the shifted words, or
+ * their complements where the preamble bit `k` is clear, over the eight
+ * bits of the preamble leaves the positions where all of them match. */
+static u32 preamble_scan(const u32 *subframe_bits, u8 w)
+{
+  u64 x = (u64)subframe_bits[w] << 32
+        | subframe_bits[(w + 1) % NAV_MSG_SUBFRAME_BITS_LEN];
+  u64 upright = ~0ULL, inverted = ~0ULL;
+  for (u8 k=0; k<8; k++) {
+    u64 y = x << k;
+    if (0x8B & (0x80 >> k)) {
+      upright &= y;
+      inverted &= ~y;
+    } else {
+      upright &= ~y;
+      inverted &= y;
+    }
+  }
+  return (upright | inverted) >> 32;
+}
 
+/** Load the state of channel `i` of a batch from a per-channel decoder.
+ *
+ * \param b Batch.
+ * \param i Channel index.
+ * \param n Decoder state, see nav_msg_init().
+ */
+void nav_msg_batch_set(nav_msg_batch_t *b, u8 i, const nav_msg_t *n)
+{
+  memcpy(b->subframe_bits[i], n->subframe_bits, sizeof(n->subframe_bits));
+  b->subframe_bit_index[i] = n->subframe_bit_index;
+  b->subframe_start_index[i] = n->subframe_start_index;
+  b->bit_phase[i] = n->bit_phase;
+  b->bit_phase_ref[i] = n->bit_phase_ref;
+  b->bit_phase_count[i] = n->bit_phase_count;
+  b->nav_bit_integrate[i] = n->nav_bit_integrate;
+  b->bit_sync[i] = n->bit_sync;
+  memcpy(b->bit_sync_hist[i], n->bit_sync_hist, sizeof(n->bit_sync_hist));
+  b->tow_single[i] = n->tow_single;
+  memcpy(b->frame_words[i], n->frame_words, sizeof(n->frame_words));
+  b->next_subframe_id[i] = n->next_subframe_id;
+  b->inverted[i] = n->inverted;
+
+  for (u8 w=0; w<NAV_MSG_SUBFRAME_BITS_LEN; w++)
+    b->preambles[i][w] = preamble_scan(b->subframe_bits[i], w);
+}
+
+/** Store the state of channel `i` of a batch in a per-channel decoder.
+ *
+ * \param b Batch.
+ * \param i Channel index.
+ * \param n Decoder state to fill.
+ */
+void nav_msg_batch_get(const nav_msg_batch_t *b, u8 i, nav_msg_t *n)
+{
+  memcpy(n->subframe_bits, b->subframe_bits[i], sizeof(n->subframe_bits));
+  n->subframe_bit_index = b->subframe_bit_index[i];
+  n->subframe_start_index = b->subframe_start_index[i];
+  n->bit_phase = b->bit_phase[i];
+  n->bit_phase_ref = b->bit_phase_ref[i];
+  n->bit_phase_count = b->bit_phase_count[i];
+  n->nav_bit_integrate = b->nav_bit_integrate[i];
+  n->bit_sync = b->bit_sync[i];
+  memcpy(n->bit_sync_hist, b->bit_sync_hist[i], sizeof(n->bit_sync_hist));
+  n->tow_single = b->tow_single[i];
+  memcpy(n->frame_words, b->frame_words[i], sizeof(n->frame_words));
+  n->next_subframe_id = b->next_subframe_id[i];
+  n->inverted = b->inverted[i];
+}
+
+/** Advance the bit phase of all the channels of a batch by `ms` and
+ * integrate the correlations of the channels with bit phase lock.
+ * \return Mask of the channels without bit phase lock or at the end of a
+ *         bit, which need the rest of nav_msg_update(). */
+static u32 advance_generic(nav_msg_batch_t *b, const s32 corr[], u8 ms)
+{
+  u32 flagged = 0;
+  for (u32 i=0; i<b->n_channels; i++) {
+    s32 bit_phase = (u8)(b->bit_phase[i] + ms) % 20;
+    b->bit_phase[i] = bit_phase;
+    s32 locked = b->bit_phase_count[i] >= NAV_MSG_BIT_PHASE_THRES;
+    b->nav_bit_integrate[i] += corr[i] & -locked;
+    flagged |= (u32)(!locked | (bit_phase == b->bit_phase_ref[i])) << i;
+  }
+  return flagged;
+}
+
+#ifdef CPU_FEATURES_X86
+
+/** AVX2 version of advance_generic(), eight channels at a time. `corr` is
+ * padded with zeros to a whole number of vectors, the padding channels
+ * are updated but never used. */
+__attribute__((target("avx2")))
+static u32 advance_avx2(nav_msg_batch_t *b, const s32 corr[], u8 ms)
+{
+  const __m256i v_ms = _mm256_set1_epi32(ms);
+  const __m256i v_byte = _mm256_set1_epi32(0xFF);
+  /* floor(x * 3277 / 2^16) is floor(x / 20) for 0 <= x < 256. */
+  const __m256i v_div20 = _mm256_set1_epi32(3277);
+  const __m256i v_20 = _mm256_set1_epi32(20);
+  const __m256i v_thres = _mm256_set1_epi32(NAV_MSG_BIT_PHASE_THRES - 1);
+  const __m256i v_ones = _mm256_set1_epi32(-1);
+
+  u32 flagged = 0;
+  for (u32 i=0; i<b->n_channels; i+=8) {
+    __m256i phase = _mm256_loadu_si256((__m256i *)&b->bit_phase[i]);
+    phase = _mm256_and_si256(_mm256_add_epi32(phase, v_ms), v_byte);
+    __m256i q = _mm256_srli_epi32(_mm256_mullo_epi32(phase, v_div20), 16);
+    phase = _mm256_sub_epi32(phase, _mm256_mullo_epi32(q, v_20));
+    _mm256_storeu_si256((__m256i *)&b->bit_phase[i], phase);
+
+    __m256i count = _mm256_loadu_si256((__m256i *)&b->bit_phase_count[i]);
+    __m256i locked = _mm256_cmpgt_epi32(count, v_thres);
+    __m256i integ = _mm256_loadu_si256((__m256i *)&b->nav_bit_integrate[i]);
+    __m256i c = _mm256_loadu_si256((const __m256i *)&corr[i]);
+    integ = _mm256_add_epi32(integ, _mm256_and_si256(c, locked));
+    _mm256_storeu_si256((__m256i *)&b->nav_bit_integrate[i], integ);
+
+    __m256i ref = _mm256_loadu_si256((__m256i *)&b->bit_phase_ref[i]);
+    __m256i dump = _mm256_cmpeq_epi32(phase, ref);
+    __m256i flag = _mm256_or_si256(_mm256_andnot_si256(locked, v_ones), dump);
+    flagged |= (u32)_mm256_movemask_ps(_mm256_castsi256_ps(flag)) << i;
+  }
+
+  if (b->n_channels < 32)
+    flagged &= (1u << b->n_channels) - 1;
+  return flagged;
+}
+
+#endif
+
+/** Advance all the channels of a batch, see advance_generic(). */
+static u32 advance(nav_msg_batch_t *b, const s32 corr_prompt_real[], u8 ms)
+{
+#ifdef CPU_FEATURES_X86
+  if (cpu_features() & CPU_FEATURE_AVX2) {
+    s32 corr[NAV_MSG_BATCH_MAX_CHANNELS] = {0};
+    memcpy(corr, corr_prompt_real, b->n_channels * sizeof(s32));
+    return advance_avx2(b, corr, ms);
+  }
+#endif
+
+  return advance_generic(b, corr_prompt_real, ms);
+}
+
+/** Update the navigation message decoders of all the channels of a batch.
+ *
+ * Equivalent to `TOW_ms[i] = nav_msg_update(n_i, corr_prompt_real[i], ms)`
+ * for each channel `i`.
+ *
+ * \param b                Batch.
+ * \param corr_prompt_real In-phase prompt correlation of each channel.
+ * \param ms               Milliseconds since the last update.
+ * \param TOW_ms           Output, the time of week of each channel in ms
+ *                         as nav_msg_update(), or `-1`.
+ */
+void nav_msg_batch_update(nav_msg_batch_t *b, const s32 corr_prompt_real[],
+                          u8 ms, s32 TOW_ms[])
+{
+  u32 n = b->n_channels;
+  u32 flagged = advance(b, corr_prompt_real, ms);
+
+  for (u32 i=0; i<n; i++)
+    TOW_ms[i] = -1;
+
+  for (; flagged; flagged &= flagged - 1) {
+    u32 i = __builtin_ctz(flagged);
+
+    if (b->bit_phase_count[i] < NAV_MSG_BIT_PHASE_THRES) {
+      s32 corr = corr_prompt_real[i];
+      if (b->bit_sync[i] == NAV_MSG_BIT_SYNC_HISTOGRAM) {
+        u8 ref;
+        if (b->nav_bit_integrate[i] &&
+            (b->nav_bit_integrate[i] > 0) != (corr > 0) &&
+            bit_sync_histogram(b->bit_sync_hist[i], b->bit_phase[i], &ref)) {
+          b->bit_phase_ref[i] = ref;
+          b->bit_phase_count[i] = NAV_MSG_BIT_PHASE_THRES;
+        }
+      } else if ((b->nav_bit_integrate[i] > 0) != (corr > 0)) {
+        /* Negative for a bit phase of zero, which never matches, as in
+         * nav_msg_update(). */
+        int ref = (b->bit_phase[i] - 1) % 20;
+        if (ref == b->bit_phase_ref[i]) {
+          b->bit_phase_count[i]++;
+        } else {
+          b->bit_phase_ref[i] = (u8)ref;
+          b->bit_phase_count[i] = 1;
+        }
+      }
+      b->nav_bit_integrate[i] = corr;
+      continue;
+    }
+
+    u32 *bits = b->subframe_bits[i];
+    u16 index = b->subframe_bit_index[i];
+    u32 mask = 1u << (31 - (index & 0x1F));
+    if (b->nav_bit_integrate[i] > 0)
+      bits[index >> 5] |= mask;
+    else
+      bits[index >> 5] &= ~mask;
+    b->nav_bit_integrate[i] = 0;
+
+    if (++index == NAV_MSG_SUBFRAME_BITS_LEN*32)
+      index = 0;
+    b->subframe_bit_index[i] = index;
+
+    /* A word and the start of the next one are complete, search the word
+     * for preambles. */
+    if ((index & 0x1F) == 0) {
+      u8 w = (index/32 + NAV_MSG_SUBFRAME_BITS_LEN - 2)
+             % NAV_MSG_SUBFRAME_BITS_LEN;
+      b->preambles[i][w] = preamble_scan(bits, w);
+    }
+
+    if (b->tow_single[i])
+      TOW_ms[i] = tow_single(bits, index);
+
+    if (b->subframe_start_index[i])
+      continue;
+
+    /* Look for the preamble 360 bits ago, as nav_msg_update(). */
+    u16 start = index + SUBFRAME_START_BUFFER_OFFSET;
+    u16 pos = start % (NAV_MSG_SUBFRAME_BITS_LEN*32);
+    if (!(b->preambles[i][pos >> 5] & (1u << (31 - (pos & 0x1F)))))
+      continue;
+
+    if (bits_extract(bits, 0, start, 8, 0) == 0x8B)
+      b->subframe_start_index[i] = start + 1;
+    else
+      b->subframe_start_index[i] = -(start + 1);
+    s32 TOW_confirmed = preamble_confirm(bits, &b->subframe_start_index[i]);
+    if (TOW_confirmed >= 0)
+      TOW_ms[i] = TOW_confirmed;
+  }
+}
+
+/** Check the parity of words, see nav_parity_batch(). All six parity
+ * equations are evaluated for each word, the first failing one is found
+ * from the bits of the syndrome. */
+static inline __attribute__((always_inline))
+void nav_parity_body(u32 n, u32 words[], u8 errors[])
+{
+  for (u32 j=0; j<n; j++) {
+    u32 word = words[j];
+    if (word & 1<<30)
+      word ^= 0x3FFFFFC0;
+    words[j] = word;
+
+    u32 syndrome = 0;
+    for (u8 k=0; k<6; k++)
+      syndrome |= (__builtin_popcount(word & parity_masks[k]) & 1) << k;
+    errors[j] = syndrome ? 25 + __builtin_ctz(syndrome) : 0;
+  }
+}
+
+static void nav_parity_generic(u32 n, u32 words[], u8 errors[])
+{
+  nav_parity_body(n, words, errors);
+}
+
+#ifdef CPU_FEATURES_X86
+
+__attribute__((target("popcnt")))
+static void nav_parity_popcnt(u32 n, u32 words[], u8 errors[])
+{
+  nav_parity_body(n, words, errors);
+}
+
+#endif
+
+/** Check the parity of many navigation message words at once.
+ *
+ * Equivalent to `errors[j] = nav_parity(&words[j])` for each word,
+ * inverting the data bits of the words whose D30* bit is set.
+ *
+ * \param n      Number of words.
+ * \param words  Words laid out as for nav_parity(), inverted in place.
+ * \param errors Output, `0` for each word passing the parity check or the
+ *               number of the first failing parity bit, 25 to 30.
+ */
+void nav_parity_batch(u32 n, u32 words[], u8 errors[])
+{
+#ifdef CPU_FEATURES_X86
+  if (cpu_features() & CPU_FEATURE_POPCNT) {
+    nav_parity_popcnt(n, words, errors);
+    return;
+  }
+#endif
+
+  nav_parity_generic(n, words, errors);
+}
+
+/** Process the subframes ready on the channels of a batch.
+ *
+ * Equivalent to `ret[i] = process_subframe_almanac(n_i, &e[i], a)` for
+ * each channel `i` for which subframe_ready() would be true. The words of
+ * all the ready subframes are parity checked together with
+ * nav_parity_batch().
+ *
+ * \param b   Batch.
+ * \param e   Ephemeris of each channel, updated as process_subframe().
+ * \param a   Store of the data decoded from subframes 4 and 5, or NULL to
+ *            skip them.
+ * \param ret Output, the process_subframe_almanac() result of each channel
+ *            that had a subframe ready.
+ * \return Mask of the channels that had a subframe ready, bit `i` for
+ *         channel `i`.
+ */
+u32 nav_msg_batch_process(nav_msg_batch_t *b, ephemeris_t e[],
+                          nav_msg_almanac_t *a, s8 ret[])
+{
+  u32 words[NAV_MSG_BATCH_MAX_CHANNELS][9];
+  u8 errors[NAV_MSG_BATCH_MAX_CHANNELS][9];
+  u8 ready[NAV_MSG_BATCH_MAX_CHANNELS];
+  u8 n_ready = 0;
+  u32 mask = 0;
+
+  for (u8 i=0; i<b->n_channels; i++) {
+    s16 start = b->subframe_start_index[i];
+    if (!start)
+      continue;
+
+    if (b->inverted[i] != (start < 0))
+      DIAG(DIAG_INFO, DIAG_EVENT_NAV_PHASE_FLIP, "Nav phase flip");
+    b->inverted[i] = (start < 0);
+
+    for (u8 w=0; w<9; w++)
+      words[n_ready][w] = bits_extract(b->subframe_bits[i], start,
+                                       30*(w+1) - 2, 32, 0);
+    ready[n_ready++] = i;
+    mask |= 1u << i;
+  }
+
+  nav_parity_batch(9 * n_ready, &words[0][0], &errors[0][0]);
+
+  for (u8 k=0; k<n_ready; k++) {
+    u8 i = ready[k];
+    ret[i] = handle_subframe(b->frame_words[i], &b->next_subframe_id[i],
+                             &b->subframe_start_index[i],
+                             words[k], errors[k], &e[i], a);
+  }
 
+  return mask;
 }
 
+/** \} */
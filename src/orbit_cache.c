@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "orbit_cache.h"
+
+/** \defgroup orbit_cache Orbit Cache
+ * Satellite orbits interpolated with Chebyshev series.
+ *
+ * When the same satellites are evaluated many times a second the full
+ * orbit model of calc_sat_pos() is mostly repeated work. The orbit cache
+ * splits time into windows, `ORBIT_CACHE_WINDOW` long by default and
+ * aligned to the start of the GPS week, and over the window in use fits a
+ * Chebyshev series to each position and velocity component and the clock
+ * errors of each satellite, from calc_sat_pos() at the Chebyshev nodes.
+ * Each evaluation is then a few multiply-adds per coefficient.
+ *
+ * Each fit is checked against the full model at the points between the
+ * nodes, where the interpolation error peaks. If the position, velocity,
+ * clock or clock rate error is over its bound, `ORBIT_CACHE_MAX_POS_ERR`
+ * and so on, the satellite is evaluated with the full model until the
+ * window ends. A satellite is fitted again when its window
+ * ends or when it is given a different ephemeris.
+ * \{ */
+
+/** Are two ephemerides the same broadcast? */
+static bool same_ephemeris(const ephemeris_t *a, const ephemeris_t *b)
+{
+  /* The broadcast parameters are the doubles from tgd to af2. */
+  return memcmp(&a->tgd, &b->tgd,
+                offsetof(ephemeris_t, toe) - offsetof(ephemeris_t, tgd)) == 0 &&
+         a->toe.wn == b->toe.wn && a->toe.tow == b->toe.tow &&
+         a->toc.wn == b->toc.wn && a->toc.tow == b->toc.tow;
+}
+
+/** Full orbit model of one satellite, as the series of the cache. */
+static void model(const ephemeris_t *e, gps_time_t t,
+                  double f[ORBIT_CACHE_N_SERIES])
+{
+  calc_sat_pos(&f[0], &f[3], &f[6], &f[7], e, t);
+}
+
+/** Evaluate the series of a satellite at `x`, from -1 at the start of the
+ * window to 1 at the end, with Clenshaw's recurrence. */
+static void evaluate(const orbit_cache_sat_t *s, double x,
+                     double f[ORBIT_CACHE_N_SERIES])
+{
+  double b1[ORBIT_CACHE_N_SERIES] = {0}, b2[ORBIT_CACHE_N_SERIES] = {0};
+
+  for (u32 k=ORBIT_CACHE_N_COEFFS-1; k>=1; k--) {
+    for (u32 j=0; j<ORBIT_CACHE_N_SERIES; j++) {
+      double b = 2.0 * x * b1[j] - b2[j] + s->c[k][j];
+      b2[j] = b1[j];
+      b1[j] = b;
+    }
+  }
+  for (u32 j=0; j<ORBIT_CACHE_N_SERIES; j++)
+    f[j] = x * b1[j] - b2[j] + 0.5 * s->c[0][j];
+}
+
+/** Time at `x` in the window starting at `t0`. */
+static gps_time_t window_time(gps_time_t t0, double window, double x)
+{
+  t0.tow += 0.5 * (x + 1.0) * window;
+  return normalize_gps_time(t0);
+}
+
+/** Fit the series of a satellite over the window starting at `t0`. */
+static void fit(orbit_cache_t *c, orbit_cache_sat_t *s, const ephemeris_t *e,
+                gps_time_t t0)
+{
+  const u32 n = ORBIT_CACHE_N_COEFFS;
+
+  s->eph = *e;
+  s->t0 = t0;
+  memset(s->c, 0, sizeof(s->c));
+  c->n_fits++;
+
+  /* Coefficients from the values at the Chebyshev nodes,
+   * x_i = cos(pi (i + 1/2) / n). */
+  for (u32 i=0; i<n; i++) {
+    double theta = M_PI * (i + 0.5) / n;
+    double f[ORBIT_CACHE_N_SERIES];
+    model(e, window_time(t0, c->window, cos(theta)), f);
+    for (u32 k=0; k<n; k++) {
+      double w = 2.0 / n * cos(k * theta);
+      for (u32 j=0; j<ORBIT_CACHE_N_SERIES; j++)
+        s->c[k][j] += w * f[j];
+    }
+  }
+
+  /* Check against the full model at the extrema of T_n, between the nodes
+   * and at the ends of the window. */
+  s->max_err = 0;
+  s->max_vel_err = 0;
+  s->max_clock_err = 0;
+  s->max_clock_rate_err = 0;
+  for (u32 i=0; i<=n; i++) {
+    double x = cos(M_PI * i / n);
+    double f[ORBIT_CACHE_N_SERIES], f_fit[ORBIT_CACHE_N_SERIES];
+    model(e, window_time(t0, c->window, x), f);
+    evaluate(s, x, f_fit);
+    double d[ORBIT_CACHE_N_SERIES];
+    for (u32 j=0; j<ORBIT_CACHE_N_SERIES; j++)
+      d[j] = f_fit[j] - f[j];
+    s->max_err = fmax(s->max_err,
+                      sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]));
+    s->max_vel_err = fmax(s->max_vel_err,
+                          sqrt(d[3]*d[3] + d[4]*d[4] + d[5]*d[5]));
+    s->max_clock_err = fmax(s->max_clock_err, fabs(d[6]));
+    s->max_clock_rate_err = fmax(s->max_clock_rate_err, fabs(d[7]));
+  }
+
+  if (s->max_err <= ORBIT_CACHE_MAX_POS_ERR &&
+      s->max_vel_err <= ORBIT_CACHE_MAX_VEL_ERR &&
+      s->max_clock_err <= ORBIT_CACHE_MAX_CLOCK_ERR &&
+      s->max_clock_rate_err <= ORBIT_CACHE_MAX_CLOCK_RATE_ERR)
+    s->state = ORBIT_CACHE_FITTED;
+  else
+    s->state = ORBIT_CACHE_UNFIT;
+}
+
+/** Initialise an orbit cache.
+ *
+ * \param c      Orbit cache.
+ * \param window Length of the fit windows [s], or `0` for
+ *               `ORBIT_CACHE_WINDOW`.
+ */
+void orbit_cache_init(orbit_cache_t *c, double window)
+{
+  memset(c, 0, sizeof(*c));
+  c->window = window > 0 ? window : ORBIT_CACHE_WINDOW;
+}
+
+/** Calculate satellite position, velocity and clock errors from the orbit
+ * cache, fitting the satellite's window first if needed.
+ *
+ * Agrees with calc_sat_pos() to within `ORBIT_CACHE_MAX_POS_ERR`,
+ * `ORBIT_CACHE_MAX_VEL_ERR`, `ORBIT_CACHE_MAX_CLOCK_ERR` and
+ * `ORBIT_CACHE_MAX_CLOCK_RATE_ERR`.
+ *
+ * \param c              Orbit cache.
+ * \param e              Ephemeris of the satellite, cached by `e->prn`.
+ * \param tot            Time of transmission.
+ * \param pos            Satellite ECEF position [m].
+ * \param vel            Satellite ECEF velocity [m/s].
+ * \param clock_err      Satellite clock error [s].
+ * \param clock_rate_err Satellite clock rate error [s/s].
+ * \return `0` on success, `-1` if the PRN is out of range.
+ */
+int orbit_cache_sat_pos(orbit_cache_t *c, const ephemeris_t *e,
+                        gps_time_t tot, double pos[3], double vel[3],
+                        double *clock_err, double *clock_rate_err)
+{
+  if (e->prn >= 32)
+    return -1;
+
+  orbit_cache_sat_t *s = &c->sat[e->prn];
+  double dt = gpsdifftime(tot, s->t0);
+
+  if (s->state == ORBIT_CACHE_EMPTY || dt < 0 || dt >= c->window ||
+      !same_ephemeris(&s->eph, e)) {
+    gps_time_t t0 = {.wn = tot.wn,
+                     .tow = floor(tot.tow / c->window) * c->window};
+    fit(c, s, e, t0);
+    dt = gpsdifftime(tot, t0);
+  }
+
+  double f[ORBIT_CACHE_N_SERIES];
+  if (s->state == ORBIT_CACHE_FITTED)
+    evaluate(s, 2.0 * dt / c->window - 1.0, f);
+  else
+    model(e, tot, f);
+
+  for (u8 j=0; j<3; j++) {
+    pos[j] = f[j];
+    vel[j] = f[3 + j];
+  }
+  *clock_err = f[6];
+  *clock_rate_err = f[7];
+  return 0;
+}
+
+/** \} */
+
@@ -10,6 +10,10 @@
  * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
  */
 
+#include <math.h>
+#include <stdlib.h>
+
+#include "constants.h"
 #include "prns.h"
 
 static const u8 ca_codes[32][128];
@@ -42,6 +46,134 @@ inline s8 get_chip(u8* code, u32 chip_num)
   return ((code[byte] >> bit) & 1) ? -1 : 1;
 }
 
+/** Number of chips in the C/A code. */
+#define CA_CODE_CHIPS 1023
+
+static s8 replicas[32][CA_CODE_REPLICA_LEN];
+
+/** Expansion state of each replica, see ca_code_replica(). */
+enum {
+  REPLICA_EMPTY = 0,
+  REPLICA_BUILDING,
+  REPLICA_READY,
+};
+static u8 replica_state[32];
+
+static s8 chip(u8 prn, s32 chip_num)
+{
+  /* Wrap the chip number into the code period. */
+  chip_num %= CA_CODE_CHIPS;
+  if (chip_num < 0)
+    chip_num += CA_CODE_CHIPS;
+  return get_chip((u8 *)ca_codes[prn], chip_num);
+}
+
+/** Returns the C/A code for a PRN expanded one chip per byte, as +/-1 values.
+ *
+ * The replica has one guard chip at each end so it can be indexed directly
+ * by the correlators, i.e. element `i+1` holds chip `i`, element `0` holds
+ * the last chip (1022) and element 1024 holds chip 0 again, see
+ * track_correlate().
+ *
+ * Each replica is expanded from the packed codes on first use and then
+ * shared, read-only, between all callers. Expansion is safe to race between
+ * threads, but ca_code_replicas_init() can be called at startup to build all
+ * of them up front.
+ *
+ * \param prn PRN number (0-31).
+ * \return Pointer to the `CA_CODE_REPLICA_LEN` element expanded replica.
+ */
+const s8* ca_code_replica(u8 prn)
+{
+  if (__atomic_load_n(&replica_state[prn], __ATOMIC_ACQUIRE) == REPLICA_READY)
+    return replicas[prn];
+
+  u8 expected = REPLICA_EMPTY;
+  if (__atomic_compare_exchange_n(&replica_state[prn], &expected,
+                                  REPLICA_BUILDING, false,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    for (s32 i=0; i<CA_CODE_REPLICA_LEN; i++)
+      replicas[prn][i] = chip(prn, i - 1);
+    __atomic_store_n(&replica_state[prn], REPLICA_READY, __ATOMIC_RELEASE);
+  } else {
+    /* Another thread is expanding this replica, wait for it to finish. */
+    while (__atomic_load_n(&replica_state[prn], __ATOMIC_ACQUIRE)
+           != REPLICA_READY)
+      ;
+  }
+
+  return replicas[prn];
+}
+
+/** Expand the code replicas for all PRNs.
+ * Optional, replicas are otherwise expanded on first use by
+ * ca_code_replica().
+ */
+void ca_code_replicas_init(void)
+{
+  for (u8 prn=0; prn<32; prn++)
+    ca_code_replica(prn);
+}
+
+/** Build C/A code replicas for all PRNs resampled at a fixed sample rate.
+ *
+ * Sample `k` of each replica holds the chip at code phase
+ * `k * GPS_CA_CHIPPING_RATE / fs`, for `k` from `-guard` up to
+ * `length + guard - 1`, wrapping around the code period. The `guard`
+ * samples cover one chip at each end.
+ *
+ * All 32 replicas are stored in one allocation which can be shared read-only
+ * between channels and threads once built. Free with
+ * ca_code_resampled_free().
+ *
+ * \param r  Resampled code table to initialise.
+ * \param fs Sample rate in Hz.
+ * \return `0` on success, `-1` if the allocation failed.
+ */
+s8 ca_code_resampled_init(ca_code_resampled_t *r, double fs)
+{
+  r->fs = fs;
+  r->samples_per_chip = fs / GPS_CA_CHIPPING_RATE;
+  r->length = (u32)ceil(CA_CODE_CHIPS * r->samples_per_chip);
+  r->guard = (u32)ceil(r->samples_per_chip);
+  r->stride = r->length + 2*r->guard;
+
+  r->buf = malloc(32 * r->stride);
+  if (!r->buf)
+    return -1;
+
+  for (u8 prn=0; prn<32; prn++) {
+    s8 *rep = &r->buf[prn * r->stride];
+    for (u32 k=0; k<r->stride; k++) {
+      double cp = ((double)k - r->guard) / r->samples_per_chip;
+      rep[k] = chip(prn, (s32)floor(cp));
+    }
+  }
+  return 0;
+}
+
+/** Get the resampled C/A code replica for a PRN.
+ *
+ * \param r   Resampled code table built by ca_code_resampled_init().
+ * \param prn PRN number (0-31).
+ * \return Pointer to sample 0 of the replica, the guard samples are at
+ *         negative indices and beyond `r->length`.
+ */
+const s8* ca_code_resampled(const ca_code_resampled_t *r, u8 prn)
+{
+  return &r->buf[prn * r->stride + r->guard];
+}
+
+/** Free a resampled code table built by ca_code_resampled_init().
+ *
+ * \param r Resampled code table.
+ */
+void ca_code_resampled_free(ca_code_resampled_t *r)
+{
+  free(r->buf);
+  r->buf = 0;
+}
+
 /** \} */
 
 /* {
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sample_source.h"
+
+/** \defgroup sample_source Sample Sources
+ * Zero-copy access to raw IF samples from capture files and live producers.
+ *
+ * Consumers ask a source for windows of consecutive samples by sample
+ * count and get back pointers straight into the source's storage, in a
+ * form that can be passed to track_correlate(), track_correlate_packed()
+ * or acq_search() without copying.
+ *
+ * Capture files are memory mapped, so reading them is limited only by the
+ * page cache and disk. Live producers write into a ring buffer whose first
+ * `window_max` samples are mirrored past its end, so every window is
+ * contiguous even where it wraps around the end of the ring.
+ * \{ */
+
+/** Samples in the smallest addressable group of a format. */
+static u32 group_samples(sample_format_t format)
+{
+  switch (format) {
+  case SAMPLE_FORMAT_PACKED_1BIT:
+  case SAMPLE_FORMAT_PACKED_2BIT:
+    return 64;
+  default:
+    return 1;
+  }
+}
+
+/** Bytes in the smallest addressable group of a format, 0 if the format is
+ * not valid. */
+static u32 group_bytes(sample_format_t format)
+{
+  switch (format) {
+  case SAMPLE_FORMAT_S8:
+    return 1;
+  case SAMPLE_FORMAT_PACKED_1BIT:
+    return 8;
+  case SAMPLE_FORMAT_PACKED_2BIT:
+    return 16;
+  case SAMPLE_FORMAT_IQ_S16:
+    return 2 * sizeof(s16);
+  default:
+    return 0;
+  }
+}
+
+/** Open a capture file as a sample source.
+ *
+ * The file is memory mapped read-only and holds raw samples in `format`
+ * from its first byte, any trailing partial sample group is ignored.
+ *
+ * \param src    Sample source to initialise.
+ * \param path   Path of the capture file.
+ * \param format Format of the samples in the file.
+ * \param fs     Sample rate in Hz.
+ * \return `0` on success, `-1` if the format is invalid or the file can't
+ *         be opened or mapped.
+ */
+s8 sample_source_file_init(sample_source_t *src, const char *path,
+                           sample_format_t format, double fs)
+{
+  u32 gb = group_bytes(format);
+  if (!gb)
+    return -1;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  memset(src, 0, sizeof(*src));
+  src->type = SAMPLE_SOURCE_FILE;
+  src->format = format;
+  src->fs = fs;
+  src->size = (u64)st.st_size - (u64)st.st_size % gb;
+  src->window_max = UINT32_MAX;
+  src->head = src->size / gb * group_samples(format);
+
+  if (src->size > 0) {
+    void *data = mmap(0, src->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    /* Captures are nearly always read front to back. */
+    madvise(data, src->size, MADV_SEQUENTIAL);
+    src->data = data;
+  }
+
+  /* The mapping holds its own reference to the file. */
+  close(fd);
+  return 0;
+}
+
+/** Bytes of the start of the ring buffer mirrored past its end. A window
+ * that starts part way through a group can touch one more group than its
+ * length alone needs. */
+static u64 ring_mirror(const sample_source_t *src)
+{
+  u32 gs = group_samples(src->format);
+  u64 mirror = ((u64)src->window_max + 2*gs - 2) / gs *
+               group_bytes(src->format);
+  return mirror > src->size ? src->size : mirror;
+}
+
+/** Initialise a ring buffer sample source for a live producer.
+ *
+ * The producer adds samples with sample_source_write(), the consumer reads
+ * windows of them and releases them once they are no longer needed, making
+ * room for the producer.
+ *
+ * \param src        Sample source to initialise.
+ * \param format     Format of the samples.
+ * \param fs         Sample rate in Hz.
+ * \param capacity   Samples held by the ring buffer, a multiple of 64 for
+ *                   the packed formats.
+ * \param window_max Longest window that will be requested, at most
+ *                   `capacity`.
+ * \return `0` on success, `-1` if the arguments are invalid, `-2` if an
+ *         allocation failed.
+ */
+s8 sample_source_ring_init(sample_source_t *src, sample_format_t format,
+                           double fs, u32 capacity, u32 window_max)
+{
+  u32 gs = group_samples(format);
+  u32 gb = group_bytes(format);
+  if (!gb || capacity == 0 || capacity % gs ||
+      window_max == 0 || window_max > capacity)
+    return -1;
+
+  memset(src, 0, sizeof(*src));
+  src->type = SAMPLE_SOURCE_RING;
+  src->format = format;
+  src->fs = fs;
+  src->size = (u64)capacity / gs * gb;
+  src->window_max = window_max;
+
+  src->data = malloc(src->size + ring_mirror(src));
+  if (!src->data)
+    return -2;
+
+  return 0;
+}
+
+/** Release the storage of a sample source, all its windows become invalid.
+ *
+ * \param src Sample source.
+ */
+void sample_source_free(sample_source_t *src)
+{
+  if (src->type == SAMPLE_SOURCE_FILE) {
+    if (src->data)
+      munmap(src->data, src->size);
+  } else {
+    free(src->data);
+  }
+  src->data = 0;
+  src->size = 0;
+  src->head = src->tail = 0;
+}
+
+/** Add samples to a ring buffer source.
+ *
+ * Called only from the producer. The samples become visible to the consumer
+ * once this returns.
+ *
+ * \param src  Ring buffer sample source.
+ * \param data Samples in the source's format.
+ * \param n    Number of samples, a multiple of 64 for the packed formats.
+ * \return `0` on success, `-1` if the source isn't a ring buffer or `n`
+ *         isn't a whole number of groups, `-2` if there isn't room for the
+ *         samples until the consumer releases some.
+ */
+s8 sample_source_write(sample_source_t *src, const void *data, u32 n)
+{
+  u32 gs = group_samples(src->format);
+  u32 gb = group_bytes(src->format);
+  if (src->type != SAMPLE_SOURCE_RING || n % gs)
+    return -1;
+
+  u64 capacity = src->size / gb * gs;
+  u64 head = src->head;
+  u64 tail = __atomic_load_n(&src->tail, __ATOMIC_ACQUIRE);
+  if (head + n > tail + capacity)
+    return -2;
+
+  const u8 *in = data;
+  u64 len = (u64)n / gs * gb;
+  u64 pos = head % capacity / gs * gb;
+  u64 mirror = ring_mirror(src);
+  while (len > 0) {
+    u64 chunk = src->size - pos < len ? src->size - pos : len;
+    memcpy(&src->data[pos], in, chunk);
+    if (pos < mirror)
+      memcpy(&src->data[src->size + pos], in,
+             mirror - pos < chunk ? mirror - pos : chunk);
+    in += chunk;
+    len -= chunk;
+    pos = 0;
+  }
+
+  __atomic_store_n(&src->head, head + n, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Number of samples available from a source, i.e. the sample count one
+ * past the last sample.
+ *
+ * \param src Sample source.
+ * \return Number of samples written to the source or held in the file.
+ */
+u64 sample_source_available(const sample_source_t *src)
+{
+  return __atomic_load_n(&src->head, __ATOMIC_ACQUIRE);
+}
+
+/** Get a window of samples without copying them.
+ *
+ * The window points into the source's storage and stays valid until
+ * sample_source_release() is called past its first sample.
+ *
+ * \param src Sample source.
+ * \param t   Sample count of the first sample.
+ * \param n   Number of samples, at most the source's `window_max`.
+ * \param w   Window to fill in.
+ * \return `0` on success, `-1` if the window is too long, has already been
+ *         released or runs past the end of a file, `-2` if the samples
+ *         haven't been written to a ring buffer yet.
+ */
+s8 sample_source_window(sample_source_t *src, u64 t, u32 n,
+                        sample_window_t *w)
+{
+  if (n == 0 || n > src->window_max)
+    return -1;
+  if (t < __atomic_load_n(&src->tail, __ATOMIC_ACQUIRE))
+    return -1;
+  if (t + n > sample_source_available(src))
+    return src->type == SAMPLE_SOURCE_RING ? -2 : -1;
+
+  u32 gs = group_samples(src->format);
+  u32 gb = group_bytes(src->format);
+  u64 group = t / gs;
+  if (src->type == SAMPLE_SOURCE_RING)
+    group %= src->size / gb;
+
+  w->t = t;
+  w->n = n;
+  w->format = src->format;
+  w->data = &src->data[group * gb];
+  w->start = t % gs;
+  return 0;
+}
+
+/** Get a window of whole milliseconds of samples, see
+ * sample_source_window().
+ *
+ * The window starts at the sample nearest to `ms` milliseconds after the
+ * first sample and ends at the sample nearest to `ms + n_ms` milliseconds,
+ * so consecutive windows tile the samples exactly even when the sample
+ * rate isn't a multiple of 1 kHz.
+ *
+ * \param src  Sample source.
+ * \param ms   Start of the window in milliseconds.
+ * \param n_ms Length of the window in milliseconds.
+ * \param w    Window to fill in.
+ * \return As for sample_source_window().
+ */
+s8 sample_source_window_ms(sample_source_t *src, u64 ms, u32 n_ms,
+                           sample_window_t *w)
+{
+  u64 t = (u64)llround(ms * src->fs / 1000);
+  u64 t_end = (u64)llround((ms + n_ms) * src->fs / 1000);
+  if (t_end - t > UINT32_MAX)
+    return -1;
+  return sample_source_window(src, t, (u32)(t_end - t), w);
+}
+
+/** Release the samples before sample count `t`.
+ *
+ * Called only from the consumer. Windows starting before `t` must no
+ * longer be used, for a ring buffer their storage may be reused by the
+ * producer straight away.
+ *
+ * \param src Sample source.
+ * \param t   Sample count of the first sample still needed.
+ */
+void sample_source_release(sample_source_t *src, u64 t)
+{
+  u64 head = sample_source_available(src);
+  if (t > head)
+    t = head;
+  if (t > src->tail)
+    __atomic_store_n(&src->tail, t, __ATOMIC_RELEASE);
+}
+
+/** \} */
+
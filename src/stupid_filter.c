@@ -16,6 +16,7 @@
 #include <stdio.h>
 
 #include "constants.h"
+#include "diag.h"
 #include "stupid_filter.h"
 #include "amb_kf.h"
 #include "linear_algebra.h"
@@ -160,7 +161,7 @@ void update_sats_stupid_filter(stupid_filter_state_t *s, u8 num_old, u8 *old_prn
       return;
   }
 
-  printf("====== UPDATE =======\n");
+  DIAG(DIAG_DEBUG, DIAG_EVENT_FILTER_UPDATE, "====== UPDATE =======");
 
   // ok to overwite s->N because we are going to call init in a second anyway
   memcpy(&(s->N), intersection_N, n_intersection*sizeof(s32));
@@ -16,6 +16,7 @@
 #include <float.h>
 
 #include "constants.h"
+#include "cpu_features.h"
 #include "prns.h"
 #include "track.h"
 #include "ephemeris.h"
@@ -630,6 +631,38 @@ void calc_navigation_measurement_(u8 n_channels, channel_measurement_t* meas[],
     nav_meas[i]->lock_counter = meas[i]->lock_counter;
   }
 
+#ifdef CPU_FEATURES_X86
+  /* Satellite positions are calculated a batch of channels at a time with
+   * the SIMD kernels. The batch takes several kB of stack, so targets
+   * without them keep the per-channel loop below. */
+  for (u32 lo=0; lo<n_channels; lo+=EPHEMERIS_BATCH_MAX) {
+    u8 n = MIN(n_channels - lo, EPHEMERIS_BATCH_MAX);
+    ephemeris_batch_t eb;
+    gps_time_t tot[EPHEMERIS_BATCH_MAX];
+    double sat_pos[EPHEMERIS_BATCH_MAX][3], sat_vel[EPHEMERIS_BATCH_MAX][3];
+    double clock_err[EPHEMERIS_BATCH_MAX], clock_rate_err[EPHEMERIS_BATCH_MAX];
+
+    ephemeris_batch_set(&eb, n, &ephemerides[lo]);
+    for (u8 k=0; k<n; k++)
+      tot[k] = nav_meas[lo + k]->tot;
+    calc_sat_pos_batch(&eb, tot, sat_pos, sat_vel, clock_err, clock_rate_err);
+
+    for (u8 k=0; k<n; k++) {
+      u8 i = lo + k;
+      nav_meas[i]->raw_pseudorange = (min_TOT - TOTs[i])*GPS_C + GPS_NOMINAL_RANGE;
+
+      memcpy(nav_meas[i]->sat_pos, sat_pos[k], sizeof(sat_pos[k]));
+      memcpy(nav_meas[i]->sat_vel, sat_vel[k], sizeof(sat_vel[k]));
+
+      nav_meas[i]->pseudorange = nav_meas[i]->raw_pseudorange \
+                                 + clock_err[k]*GPS_C;
+      nav_meas[i]->doppler = nav_meas[i]->raw_doppler + clock_rate_err[k]*GPS_L1_HZ;
+
+      nav_meas[i]->tot.tow -= clock_err[k];
+      nav_meas[i]->tot = normalize_gps_time(nav_meas[i]->tot);
+    }
+  }
+#else
   double clock_err, clock_rate_err;
 
   for (u8 i=0; i<n_channels; i++) {
@@ -644,6 +677,7 @@ void calc_navigation_measurement_(u8 n_channels, channel_measurement_t* meas[],
     nav_meas[i]->tot.tow -= clock_err;
     nav_meas[i]->tot = normalize_gps_time(nav_meas[i]->tot);
   }
+#endif
 }
 
 /** Compare navigation message by PRN.
@@ -0,0 +1,607 @@
+/*
+ * Copyright (C) 2014 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "cpu_features.h"
+#include "track_batch.h"
+
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+/** \defgroup track_batch Batch Tracking Loops
+ * Tracking loop and \f$ C / N_0 \f$ estimator updates for many channels at
+ * once.
+ *
+ * A batch holds the state of channels all running the same kind of
+ * tracking loop at the same rate, one array per state field. Each update
+ * runs the discriminators, loop filters and cn0_est() of every channel in
+ * one pass, eight channels at a time with AVX2 when available, see
+ * cpu_features().
+ *
+ * The arctangents and logarithm use approximations that vectorise well:
+ *  - The arctangent is reduced to an argument in \f$[0, 1]\f$ and evaluated
+ *    with the polynomial of Abramowitz and Stegun 4.4.49, whose error is
+ *    below \f$2 \times 10^{-8}\f$ rad, i.e. at the level of single
+ *    precision rounding.
+ *  - \f$\log_{10}\f$ splits the exponent off and evaluates the logarithm of
+ *    the mantissa, reduced to \f$[\sqrt{1/2}, \sqrt{2})\f$, with four terms
+ *    of the \f$2\,\mathrm{atanh}\f$ series, whose error is below
+ *    \f$3 \times 10^{-8}\f$, about \f$10^{-7}\f$ dB of \f$ C / N_0 \f$.
+ *
+ * The outputs therefore agree with simple_tl_update(), aided_tl_update(),
+ * comp_tl_update() and cn0_est() to within single precision rounding.
+ * \{ */
+
+/** Coefficients of x^2 to x^16 of the arctangent polynomial. */
+#define ATAN_A2  -0.3333314528f
+#define ATAN_A4   0.1999355085f
+#define ATAN_A6  -0.1420889944f
+#define ATAN_A8   0.1065626393f
+#define ATAN_A10 -0.0752896400f
+#define ATAN_A12  0.0429096138f
+#define ATAN_A14 -0.0161657367f
+#define ATAN_A16  0.0028662257f
+
+/** \f$ 10 / \ln 10 \f$, converts natural logarithms to dB. */
+#define DB_PER_NEPER 4.342944819f
+
+/** Initialise a batch of channels.
+ *
+ * The state of each channel is then set from per-channel state initialised
+ * as usual, e.g. with simple_tl_init() and cn0_est_init(), using
+ * track_batch_set_simple() or the equivalent for the batch's loop type.
+ *
+ * \param b          Batch to initialise.
+ * \param type       Tracking loop run by all the channels.
+ * \param n_channels Number of channels, up to `TRACK_BATCH_MAX_CHANNELS`.
+ * \return `0` on success, `-1` if there are too many channels.
+ */
+s8 track_batch_init(track_batch_t *b, track_loop_type_t type, u8 n_channels)
+{
+  if (n_channels > TRACK_BATCH_MAX_CHANNELS)
+    return -1;
+
+  /* Unused channels are updated along with the rest, zeroing them keeps
+   * the arithmetic on them harmless. */
+  memset(b, 0, sizeof(*b));
+  b->type = type;
+  b->n_channels = n_channels;
+  return 0;
+}
+
+static void set_code_filt(track_batch_t *b, u8 i, const simple_lf_state_t *f)
+{
+  b->code_b0[i] = f->b0;
+  b->code_b1[i] = f->b1;
+  b->code_prev_error[i] = f->prev_error;
+  b->code_y[i] = f->y;
+}
+
+static void get_code_filt(const track_batch_t *b, u8 i, simple_lf_state_t *f)
+{
+  f->b0 = b->code_b0[i];
+  f->b1 = b->code_b1[i];
+  f->prev_error = b->code_prev_error[i];
+  f->y = b->code_y[i];
+}
+
+static void set_carr_filt(track_batch_t *b, u8 i, const simple_lf_state_t *f)
+{
+  b->carr_b0[i] = f->b0;
+  b->carr_b1[i] = f->b1;
+  b->carr_prev_error[i] = f->prev_error;
+  b->carr_y[i] = f->y;
+}
+
+static void get_carr_filt(const track_batch_t *b, u8 i, simple_lf_state_t *f)
+{
+  f->b0 = b->carr_b0[i];
+  f->b1 = b->carr_b1[i];
+  f->prev_error = b->carr_prev_error[i];
+  f->y = b->carr_y[i];
+}
+
+static void set_cn0(track_batch_t *b, u8 i, const cn0_est_state_t *cn0)
+{
+  b->cn0_log_bw[i] = cn0->log_bw;
+  b->cn0_A[i] = cn0->A;
+  b->cn0_I_prev_abs[i] = cn0->I_prev_abs;
+  b->cn0_nsr[i] = cn0->nsr;
+}
+
+static void get_cn0(const track_batch_t *b, u8 i, cn0_est_state_t *cn0)
+{
+  cn0->log_bw = b->cn0_log_bw[i];
+  cn0->A = b->cn0_A[i];
+  cn0->I_prev_abs = b->cn0_I_prev_abs[i];
+  cn0->nsr = b->cn0_nsr[i];
+}
+
+/** Set the state of one channel of a `TRACK_LOOP_SIMPLE` batch.
+ *
+ * \param b   Batch.
+ * \param i   Channel index.
+ * \param s   Tracking loop state, see simple_tl_init().
+ * \param cn0 \f$ C / N_0 \f$ estimator state, see cn0_est_init().
+ */
+void track_batch_set_simple(track_batch_t *b, u8 i,
+                            const simple_tl_state_t *s,
+                            const cn0_est_state_t *cn0)
+{
+  b->code_freq[i] = s->code_freq;
+  b->carr_freq[i] = s->carr_freq;
+  set_code_filt(b, i, &s->code_filt);
+  set_carr_filt(b, i, &s->carr_filt);
+  set_cn0(b, i, cn0);
+}
+
+/** Get the state of one channel of a `TRACK_LOOP_SIMPLE` batch.
+ *
+ * \param b   Batch.
+ * \param i   Channel index.
+ * \param s   Tracking loop state.
+ * \param cn0 \f$ C / N_0 \f$ estimator state.
+ */
+void track_batch_get_simple(const track_batch_t *b, u8 i,
+                            simple_tl_state_t *s, cn0_est_state_t *cn0)
+{
+  s->code_freq = b->code_freq[i];
+  s->carr_freq = b->carr_freq[i];
+  get_code_filt(b, i, &s->code_filt);
+  get_carr_filt(b, i, &s->carr_filt);
+  get_cn0(b, i, cn0);
+}
+
+/** Set the state of one channel of a `TRACK_LOOP_AIDED` batch.
+ *
+ * \param b   Batch.
+ * \param i   Channel index.
+ * \param s   Tracking loop state, see aided_tl_init().
+ * \param cn0 \f$ C / N_0 \f$ estimator state, see cn0_est_init().
+ */
+void track_batch_set_aided(track_batch_t *b, u8 i,
+                           const aided_tl_state_t *s,
+                           const cn0_est_state_t *cn0)
+{
+  b->code_freq[i] = s->code_freq;
+  b->carr_freq[i] = s->carr_freq;
+  set_code_filt(b, i, &s->code_filt);
+  b->carr_b0[i] = s->carr_filt.b0;
+  b->carr_b1[i] = s->carr_filt.b1;
+  b->carr_prev_error[i] = s->carr_filt.prev_error;
+  b->carr_y[i] = s->carr_filt.y;
+  b->aiding_igain[i] = s->carr_filt.aiding_igain;
+  b->prev_I[i] = s->prev_I;
+  b->prev_Q[i] = s->prev_Q;
+  set_cn0(b, i, cn0);
+}
+
+/** Get the state of one channel of a `TRACK_LOOP_AIDED` batch.
+ *
+ * \param b   Batch.
+ * \param i   Channel index.
+ * \param s   Tracking loop state.
+ * \param cn0 \f$ C / N_0 \f$ estimator state.
+ */
+void track_batch_get_aided(const track_batch_t *b, u8 i,
+                           aided_tl_state_t *s, cn0_est_state_t *cn0)
+{
+  s->code_freq = b->code_freq[i];
+  s->carr_freq = b->carr_freq[i];
+  get_code_filt(b, i, &s->code_filt);
+  s->carr_filt.b0 = b->carr_b0[i];
+  s->carr_filt.b1 = b->carr_b1[i];
+  s->carr_filt.prev_error = b->carr_prev_error[i];
+  s->carr_filt.y = b->carr_y[i];
+  s->carr_filt.aiding_igain = b->aiding_igain[i];
+  s->prev_I = b->prev_I[i];
+  s->prev_Q = b->prev_Q[i];
+  get_cn0(b, i, cn0);
+}
+
+/** Set the state of one channel of a `TRACK_LOOP_COMP` batch.
+ *
+ * \param b   Batch.
+ * \param i   Channel index.
+ * \param s   Tracking loop state, see comp_tl_init().
+ * \param cn0 \f$ C / N_0 \f$ estimator state, see cn0_est_init().
+ */
+void track_batch_set_comp(track_batch_t *b, u8 i,
+                          const comp_tl_state_t *s,
+                          const cn0_est_state_t *cn0)
+{
+  b->code_freq[i] = s->code_freq;
+  b->carr_freq[i] = s->carr_freq;
+  set_code_filt(b, i, &s->code_filt);
+  set_carr_filt(b, i, &s->carr_filt);
+  b->comp_n[i] = s->n;
+  b->comp_sched[i] = s->sched;
+  b->comp_A[i] = s->A;
+  b->carr_to_code[i] = s->carr_to_code;
+  set_cn0(b, i, cn0);
+}
+
+/** Get the state of one channel of a `TRACK_LOOP_COMP` batch.
+ *
+ * \param b   Batch.
+ * \param i   Channel index.
+ * \param s   Tracking loop state.
+ * \param cn0 \f$ C / N_0 \f$ estimator state.
+ */
+void track_batch_get_comp(const track_batch_t *b, u8 i,
+                          comp_tl_state_t *s, cn0_est_state_t *cn0)
+{
+  s->code_freq = b->code_freq[i];
+  s->carr_freq = b->carr_freq[i];
+  get_code_filt(b, i, &s->code_filt);
+  get_carr_filt(b, i, &s->carr_filt);
+  s->n = b->comp_n[i];
+  s->sched = b->comp_sched[i];
+  s->A = b->comp_A[i];
+  s->carr_to_code = b->carr_to_code[i];
+  get_cn0(b, i, cn0);
+}
+
+/** Correlations of a batch, one array per correlator output. */
+typedef struct {
+  float I_E[TRACK_BATCH_MAX_CHANNELS];
+  float Q_E[TRACK_BATCH_MAX_CHANNELS];
+  float I_P[TRACK_BATCH_MAX_CHANNELS];
+  float Q_P[TRACK_BATCH_MAX_CHANNELS];
+  float I_L[TRACK_BATCH_MAX_CHANNELS];
+  float Q_L[TRACK_BATCH_MAX_CHANNELS];
+} batch_corr_t;
+
+/** Arctangent of `x` in \f$[0, 1]\f$. */
+static inline float atan_poly(float x)
+{
+  float x2 = x*x;
+  float p = ATAN_A16;
+  p = p*x2 + ATAN_A14;
+  p = p*x2 + ATAN_A12;
+  p = p*x2 + ATAN_A10;
+  p = p*x2 + ATAN_A8;
+  p = p*x2 + ATAN_A6;
+  p = p*x2 + ATAN_A4;
+  p = p*x2 + ATAN_A2;
+  p = p*x2 + 1.f;
+  return p*x;
+}
+
+/** Arctangent of `y / x` for `x >= 0`, zero when both are zero. */
+static inline float atan_half(float y, float x)
+{
+  float ay = fabsf(y);
+  bool swap = ay > x;
+  float num = swap ? x : ay;
+  float den = swap ? ay : x;
+  float a = atan_poly(den > 0 ? num / den : 0);
+  if (swap)
+    a = (float)M_PI_2 - a;
+  return copysignf(a, y);
+}
+
+/** \f$ 10 \log_{10} x \f$ for positive, normal `x`. */
+static inline float db(float x)
+{
+  u32 bits;
+  memcpy(&bits, &x, sizeof(bits));
+  float e = (float)((s32)(bits >> 23) - 127);
+  bits = (bits & 0x007FFFFF) | 0x3F800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  if (m > (float)M_SQRT2) {
+    m *= 0.5f;
+    e += 1.f;
+  }
+  float s = (m - 1.f) / (m + 1.f);
+  float s2 = s*s;
+  float ln_m = 2.f*s * (1.f + s2*(1.f/3 + s2*(1.f/5 + s2*(1.f/7))));
+  return DB_PER_NEPER * (e*(float)M_LN2 + ln_m);
+}
+
+static void track_batch_update_generic(track_batch_t *b,
+                                       const batch_corr_t *c)
+{
+  for (u32 i=0; i<b->n_channels; i++) {
+    /* DLL, as dll_discriminator(). */
+    float early_mag = sqrtf(c->I_E[i]*c->I_E[i] + c->Q_E[i]*c->Q_E[i]);
+    float late_mag = sqrtf(c->I_L[i]*c->I_L[i] + c->Q_L[i]*c->Q_L[i]);
+    float code_error = -0.5f * (early_mag - late_mag) / (early_mag + late_mag);
+    float code_update = b->code_b0[i]*code_error +
+                        b->code_b1[i]*b->code_prev_error[i];
+    b->code_prev_error[i] = code_error;
+
+    /* Costas, as costas_discriminator(). */
+    float I = c->I_P[i], Q = c->Q_P[i];
+    float carr_error = 0;
+    if (I != 0)
+      carr_error = atan_half(I < 0 ? -Q : Q, fabsf(I)) * (float)(1/(2*M_PI));
+    float carr_update = b->carr_b0[i]*carr_error +
+                        b->carr_b1[i]*b->carr_prev_error[i];
+    b->carr_prev_error[i] = carr_error;
+
+    switch (b->type) {
+    case TRACK_LOOP_SIMPLE:
+      b->code_freq[i] = b->code_y[i] += code_update;
+      b->carr_freq[i] = b->carr_y[i] += carr_update;
+      break;
+
+    case TRACK_LOOP_AIDED: {
+      /* FLL aiding, as frequency_discriminator(). */
+      float dot = fabsf(I * b->prev_I[i]) + fabsf(Q * b->prev_Q[i]);
+      float cross = b->prev_I[i] * Q - I * b->prev_Q[i];
+      float freq_error = atan_half(cross, dot) * (float)(1/M_PI);
+      b->prev_I[i] = I;
+      b->prev_Q[i] = Q;
+      b->carr_y[i] += carr_update + b->aiding_igain[i]*freq_error;
+      b->carr_freq[i] = b->carr_y[i];
+      b->code_freq[i] = b->code_y[i] += code_update;
+      break;
+    }
+
+    case TRACK_LOOP_COMP: {
+      b->carr_freq[i] = b->carr_y[i] += carr_update;
+      b->code_y[i] = code_update;
+      float A = b->comp_A[i];
+      if (b->comp_n[i] > b->comp_sched[i])
+        b->code_freq[i] = A*b->code_freq[i] + A*code_update +
+                          (1.f - A)*b->carr_to_code[i]*b->carr_freq[i];
+      else
+        b->code_freq[i] += code_update;
+      b->comp_n[i]++;
+      break;
+    }
+    }
+
+    /* C/N0, as cn0_est(). */
+    float I_abs = fabsf(I);
+    float I_prev_abs = b->cn0_I_prev_abs[i];
+    if (I_prev_abs >= 0.f) {
+      float P_n = I_abs - I_prev_abs;
+      P_n = P_n*P_n;
+      float P_s = 0.5f*(I*I + I_prev_abs*I_prev_abs);
+      b->cn0_nsr[i] = b->cn0_A[i] * (P_n / P_s) +
+                      (1.f - b->cn0_A[i]) * b->cn0_nsr[i];
+    }
+    b->cn0_I_prev_abs[i] = I_abs;
+    b->cn0[i] = b->cn0_log_bw[i] - db(b->cn0_nsr[i]);
+  }
+}
+
+#ifdef CPU_FEATURES_X86
+
+/** Vectorised atan_poly(). */
+__attribute__((target("avx2")))
+static inline __m256 atan_poly_avx2(__m256 x)
+{
+  __m256 x2 = _mm256_mul_ps(x, x);
+  __m256 p = _mm256_set1_ps(ATAN_A16);
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A14));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A12));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A10));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A8));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A6));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A4));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(ATAN_A2));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(1.f));
+  return _mm256_mul_ps(p, x);
+}
+
+/** Vectorised atan_half(). */
+__attribute__((target("avx2")))
+static inline __m256 atan_half_avx2(__m256 y, __m256 x)
+{
+  __m256 sign = _mm256_set1_ps(-0.f);
+  __m256 ay = _mm256_andnot_ps(sign, y);
+  __m256 swap = _mm256_cmp_ps(ay, x, _CMP_GT_OQ);
+  __m256 num = _mm256_blendv_ps(ay, x, swap);
+  __m256 den = _mm256_blendv_ps(x, ay, swap);
+  __m256 r = _mm256_and_ps(_mm256_div_ps(num, den),
+                           _mm256_cmp_ps(den, _mm256_setzero_ps(),
+                                         _CMP_GT_OQ));
+  __m256 a = atan_poly_avx2(r);
+  a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps((float)M_PI_2), a),
+                       swap);
+  return _mm256_or_ps(a, _mm256_and_ps(y, sign));
+}
+
+/** Vectorised db(). */
+__attribute__((target("avx2")))
+static inline __m256 db_avx2(__m256 x)
+{
+  __m256i bits = _mm256_castps_si256(x);
+  __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                                 _mm256_set1_epi32(127)));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+               _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+               _mm256_set1_epi32(0x3F800000)));
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps((float)M_SQRT2), _CMP_GT_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+  e = _mm256_add_ps(e, _mm256_and_ps(big, _mm256_set1_ps(1.f)));
+
+  __m256 one = _mm256_set1_ps(1.f);
+  __m256 s = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+  __m256 s2 = _mm256_mul_ps(s, s);
+  __m256 p = _mm256_set1_ps(1.f/7);
+  p = _mm256_add_ps(_mm256_mul_ps(p, s2), _mm256_set1_ps(1.f/5));
+  p = _mm256_add_ps(_mm256_mul_ps(p, s2), _mm256_set1_ps(1.f/3));
+  p = _mm256_add_ps(_mm256_mul_ps(p, s2), one);
+  __m256 ln_m = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2.f), s), p);
+  return _mm256_mul_ps(_mm256_set1_ps(DB_PER_NEPER),
+           _mm256_add_ps(_mm256_mul_ps(e, _mm256_set1_ps((float)M_LN2)),
+                         ln_m));
+}
+
+/** AVX2 batch update, eight channels at a time. Channels past
+ * `n_channels` up to the next multiple of eight are updated too, they are
+ * always within the arrays. */
+__attribute__((target("avx2")))
+static void track_batch_update_avx2(track_batch_t *b, const batch_corr_t *c)
+{
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.f);
+
+#define LD(x) _mm256_loadu_ps(&(x)[i])
+#define ST(x, v) _mm256_storeu_ps(&(x)[i], (v))
+
+  for (u32 i=0; i<b->n_channels; i+=8) {
+    __m256 I_E = LD(c->I_E), Q_E = LD(c->Q_E);
+    __m256 I_L = LD(c->I_L), Q_L = LD(c->Q_L);
+    __m256 I = LD(c->I_P), Q = LD(c->Q_P);
+
+    __m256 early_mag = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(I_E, I_E),
+                                                    _mm256_mul_ps(Q_E, Q_E)));
+    __m256 late_mag = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(I_L, I_L),
+                                                   _mm256_mul_ps(Q_L, Q_L)));
+    __m256 code_error = _mm256_div_ps(
+      _mm256_mul_ps(_mm256_set1_ps(-0.5f), _mm256_sub_ps(early_mag, late_mag)),
+      _mm256_add_ps(early_mag, late_mag));
+    __m256 code_update = _mm256_add_ps(
+      _mm256_mul_ps(LD(b->code_b0), code_error),
+      _mm256_mul_ps(LD(b->code_b1), LD(b->code_prev_error)));
+    ST(b->code_prev_error, code_error);
+
+    __m256 I_abs = _mm256_andnot_ps(sign, I);
+    __m256 carr_error = atan_half_avx2(
+      _mm256_xor_ps(Q, _mm256_and_ps(I, sign)), I_abs);
+    carr_error = _mm256_and_ps(
+      _mm256_mul_ps(carr_error, _mm256_set1_ps((float)(1/(2*M_PI)))),
+      _mm256_cmp_ps(I, zero, _CMP_NEQ_OQ));
+    __m256 carr_update = _mm256_add_ps(
+      _mm256_mul_ps(LD(b->carr_b0), carr_error),
+      _mm256_mul_ps(LD(b->carr_b1), LD(b->carr_prev_error)));
+    ST(b->carr_prev_error, carr_error);
+
+    switch (b->type) {
+    case TRACK_LOOP_SIMPLE: {
+      __m256 code_y = _mm256_add_ps(LD(b->code_y), code_update);
+      __m256 carr_y = _mm256_add_ps(LD(b->carr_y), carr_update);
+      ST(b->code_y, code_y);
+      ST(b->code_freq, code_y);
+      ST(b->carr_y, carr_y);
+      ST(b->carr_freq, carr_y);
+      break;
+    }
+
+    case TRACK_LOOP_AIDED: {
+      __m256 prev_I = LD(b->prev_I), prev_Q = LD(b->prev_Q);
+      __m256 dot = _mm256_add_ps(
+        _mm256_andnot_ps(sign, _mm256_mul_ps(I, prev_I)),
+        _mm256_andnot_ps(sign, _mm256_mul_ps(Q, prev_Q)));
+      __m256 cross = _mm256_sub_ps(_mm256_mul_ps(prev_I, Q),
+                                   _mm256_mul_ps(I, prev_Q));
+      __m256 freq_error = _mm256_mul_ps(atan_half_avx2(cross, dot),
+                                        _mm256_set1_ps((float)(1/M_PI)));
+      ST(b->prev_I, I);
+      ST(b->prev_Q, Q);
+      __m256 carr_y = _mm256_add_ps(LD(b->carr_y), _mm256_add_ps(carr_update,
+                        _mm256_mul_ps(LD(b->aiding_igain), freq_error)));
+      __m256 code_y = _mm256_add_ps(LD(b->code_y), code_update);
+      ST(b->carr_y, carr_y);
+      ST(b->carr_freq, carr_y);
+      ST(b->code_y, code_y);
+      ST(b->code_freq, code_y);
+      break;
+    }
+
+    case TRACK_LOOP_COMP: {
+      __m256 carr_y = _mm256_add_ps(LD(b->carr_y), carr_update);
+      ST(b->carr_y, carr_y);
+      ST(b->carr_freq, carr_y);
+      ST(b->code_y, code_update);
+
+      __m256i n = _mm256_loadu_si256((__m256i *)&b->comp_n[i]);
+      __m256i sched = _mm256_loadu_si256((__m256i *)&b->comp_sched[i]);
+      /* Unsigned n > sched, flipping the top bits for a signed compare. */
+      __m256i top = _mm256_set1_epi32((s32)0x80000000);
+      __m256 after = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                       _mm256_xor_si256(n, top), _mm256_xor_si256(sched, top)));
+      _mm256_storeu_si256((__m256i *)&b->comp_n[i],
+                          _mm256_add_epi32(n, _mm256_set1_epi32(1)));
+
+      __m256 A = LD(b->comp_A);
+      __m256 code_freq = LD(b->code_freq);
+      __m256 blended = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(A, code_freq),
+                      _mm256_mul_ps(A, code_update)),
+        _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(one, A),
+                                    LD(b->carr_to_code)), carr_y));
+      ST(b->code_freq, _mm256_blendv_ps(
+                         _mm256_add_ps(code_freq, code_update), blended, after));
+      break;
+    }
+    }
+
+    __m256 I_prev_abs = LD(b->cn0_I_prev_abs);
+    __m256 P_n = _mm256_sub_ps(I_abs, I_prev_abs);
+    P_n = _mm256_mul_ps(P_n, P_n);
+    __m256 P_s = _mm256_mul_ps(_mm256_set1_ps(0.5f),
+                               _mm256_add_ps(_mm256_mul_ps(I, I),
+                                 _mm256_mul_ps(I_prev_abs, I_prev_abs)));
+    __m256 A = LD(b->cn0_A);
+    __m256 nsr = LD(b->cn0_nsr);
+    __m256 nsr_new = _mm256_add_ps(_mm256_mul_ps(A, _mm256_div_ps(P_n, P_s)),
+                                   _mm256_mul_ps(_mm256_sub_ps(one, A), nsr));
+    nsr = _mm256_blendv_ps(nsr, nsr_new,
+                           _mm256_cmp_ps(I_prev_abs, zero, _CMP_GE_OQ));
+    ST(b->cn0_nsr, nsr);
+    ST(b->cn0_I_prev_abs, I_abs);
+    ST(b->cn0, _mm256_sub_ps(LD(b->cn0_log_bw), db_avx2(nsr)));
+  }
+
+#undef LD
+#undef ST
+}
+
+#endif /* CPU_FEATURES_X86 */
+
+/** Update the tracking loops and \f$ C / N_0 \f$ estimates of a batch.
+ *
+ * Equivalent to calling simple_tl_update(), aided_tl_update() or
+ * comp_tl_update() followed by `cn0_est(cs[i][1].I)` for each channel, see
+ * \ref track_batch for the accuracy. The updated code and carrier
+ * frequencies and \f$ C / N_0 \f$ are read from the batch's `code_freq`,
+ * `carr_freq` and `cn0` arrays.
+ *
+ * \param b  Batch.
+ * \param cs Early, prompt and late correlations of each channel.
+ */
+void track_batch_update(track_batch_t *b, const correlation_t cs[][3])
+{
+  batch_corr_t c;
+  memset(&c, 0, sizeof(c));
+  for (u32 i=0; i<b->n_channels; i++) {
+    c.I_E[i] = cs[i][0].I;
+    c.Q_E[i] = cs[i][0].Q;
+    c.I_P[i] = cs[i][1].I;
+    c.Q_P[i] = cs[i][1].Q;
+    c.I_L[i] = cs[i][2].I;
+    c.Q_L[i] = cs[i][2].Q;
+  }
+
+#ifdef CPU_FEATURES_X86
+  if (cpu_features() & CPU_FEATURE_AVX2) {
+    track_batch_update_avx2(b, &c);
+    return;
+  }
+#endif
+
+  track_batch_update_generic(b, &c);
+}
+
+/** \} */
+
@@ -0,0 +1,296 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <acq.h>
+#ifdef HAVE_PTHREADS
+#include <acq_sched.h>
+#endif
+#include <constants.h>
+#include <correlate.h>
+#include <prns.h>
+
+#define FS 4.092e6
+#define SIG_PRN 14
+#define SIG_CP 300.5
+/* Real samples, so the signal is at an intermediate frequency. */
+#define SIG_IF 1.023e6
+#define SIG_CF (SIG_IF + 1250.0)
+
+/* Second satellite, for the scheduler tests. */
+#define SIG2_PRN 20
+#define SIG2_CP 812.25
+#define SIG2_CF (SIG_IF - 3500.0)
+
+/* Generate samples of the first `n_sats` satellites' signals in noise. */
+static void make_signal(s8 *samples, u32 n, u8 n_sats)
+{
+  const u8 prns[2] = {SIG_PRN, SIG2_PRN};
+  const double cps[2] = {SIG_CP, SIG2_CP};
+  const double cfs[2] = {SIG_CF, SIG2_CF};
+  double chips_per_sample = GPS_CA_CHIPPING_RATE / FS;
+  srandom(1);
+  for (u32 t=0; t<n; t++) {
+    double s = frand(-8, 8);
+    for (u8 i=0; i<n_sats; i++) {
+      const s8 *code = ca_code_replica(prns[i]);
+      double cp = fmod(cps[i] + t * chips_per_sample, 1023);
+      s += 3 * code[(u32)cp + 1] * cos(2*M_PI * cfs[i] * t / FS + 0.7);
+    }
+    samples[t] = (s8)lround(s);
+  }
+}
+
+START_TEST(test_acq_search)
+{
+  /* Coherent and non-coherent integration, then both. */
+  const u32 n_coherent[] = {1, 2, 1, 2};
+  const u32 n_noncoherent[] = {1, 1, 2, 2};
+
+  acq_plan_t plan;
+  fail_unless(acq_plan_init(&plan, FS) == 0, "Failed to create plan");
+  fail_unless(plan.n == 4092, "Plan has %d samples per code period", plan.n);
+
+  u32 n = acq_samples_needed(&plan, n_coherent[_i], n_noncoherent[_i]);
+  s8 *samples = malloc(n);
+  make_signal(samples, n, 1);
+
+  acq_result_t res;
+  fail_unless(acq_search(&plan, samples, SIG_PRN,
+                         SIG_IF - 5000, SIG_IF + 5000, 250,
+                         n_coherent[_i], n_noncoherent[_i], &res) == 0,
+              "Search failed");
+
+  double cp_err = remainder(res.cp - SIG_CP, 1023);
+  fail_unless(fabs(cp_err) < 0.5,
+              "Code phase %f, expected %f", res.cp, SIG_CP);
+  fail_unless(res.cf == SIG_CF,
+              "Carrier frequency %f, expected %f", res.cf, SIG_CF);
+  fail_unless(res.snr > 20, "SNR of signal %f too low", res.snr);
+
+  /* A satellite that isn't there shouldn't stand out from the noise. */
+  acq_result_t res_noise;
+  fail_unless(acq_search(&plan, samples, SIG_PRN + 1,
+                         SIG_IF - 5000, SIG_IF + 5000, 250,
+                         n_coherent[_i], n_noncoherent[_i], &res_noise) == 0,
+              "Search failed");
+  fail_unless(res_noise.snr < res.snr / 2,
+              "SNR of missing satellite %f, signal %f",
+              res_noise.snr, res.snr);
+
+  free(samples);
+  acq_plan_free(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_search_packed)
+{
+  /* Loop index 0 tests 1-bit samples, 1 tests 2-bit samples. */
+  u8 bits = 1 + _i;
+  const u32 start = 29;
+
+  acq_plan_t plan;
+  fail_unless(acq_plan_init(&plan, FS) == 0, "Failed to create plan");
+
+  u32 n = acq_samples_needed(&plan, 2, 1);
+  s8 *samples = malloc(start + n);
+  u64 *packed = malloc(PACKED_SAMPLES_WORDS(start + n, bits) * sizeof(u64));
+  make_signal(&samples[start], n, 1);
+  for (u32 t=0; t<start + n; t++) {
+    s8 s = t < start ? 0 : samples[t];
+    samples[t] = (s < 0 ? -1 : 1) * (bits == 2 && abs(s) > 4 ? 3 : 1);
+  }
+  packed_samples_pack(samples, start + n, bits, packed);
+
+  acq_result_t res, res_unpacked;
+  fail_unless(acq_search_packed(&plan, packed, bits, start,
+                                SIG_PRN, SIG_IF - 5000, SIG_IF + 5000, 250,
+                                2, 1, &res) == 0,
+              "Search failed");
+  fail_unless(acq_search(&plan, &samples[start], SIG_PRN,
+                         SIG_IF - 5000, SIG_IF + 5000, 250,
+                         2, 1, &res_unpacked) == 0,
+              "Search failed");
+
+  fail_unless(res.cp == res_unpacked.cp && res.cf == res_unpacked.cf &&
+              res.snr == res_unpacked.snr,
+              "Packed search result differs from unpacked search");
+
+  double cp_err = remainder(res.cp - SIG_CP, 1023);
+  fail_unless(fabs(cp_err) < 0.5,
+              "Code phase %f, expected %f", res.cp, SIG_CP);
+  fail_unless(res.cf == SIG_CF,
+              "Carrier frequency %f, expected %f", res.cf, SIG_CF);
+
+  free(samples);
+  free(packed);
+  acq_plan_free(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_search_args)
+{
+  acq_plan_t plan;
+  fail_unless(acq_plan_init(&plan, FS) == 0, "Failed to create plan");
+
+  s8 samples[4092] = {0};
+  acq_result_t res;
+  fail_unless(acq_search(&plan, samples, 0, 0, 1000, 0, 1, 1, &res) == -1,
+              "Zero bin width not rejected");
+  fail_unless(acq_search(&plan, samples, 0, 1000, 0, 500, 1, 1, &res) == -1,
+              "Empty frequency range not rejected");
+  fail_unless(acq_search(&plan, samples, 0, 0, 1000, 500, 0, 1, &res) == -1,
+              "Zero integration not rejected");
+
+  acq_plan_free(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_reacquire)
+{
+  /* Good prediction, then Doppler and code phase predictions too far out
+   * which fall back to the full search. */
+  const float cf_errs[] = {0, 4000, 0};
+  const float cp_errs[] = {0, 0, 200};
+
+  acq_plan_t plan;
+  fail_unless(acq_plan_init(&plan, FS) == 0, "Failed to create plan");
+
+  u32 n = acq_samples_needed(&plan, 1, 1);
+  s8 *samples = malloc(n);
+  make_signal(samples, n, 1);
+
+  acq_reacq_config_t config = {
+    .if_freq = SIG_IF,
+    .cp_window = 2,
+    .cf_window = 500,
+    .cf_bin_width = 250,
+    .n_coherent = 1,
+    .n_noncoherent = 1,
+    .snr_threshold = 15,
+    .cf_min = SIG_IF - 5000,
+    .cf_max = SIG_IF + 5000,
+  };
+
+  /* Tracking stopped 20.3 ms before the samples, the code phase advances
+   * 20.3 code periods and some more. */
+  double elapsed = 20.3e-3;
+  float cp_last = fmod(SIG_CP - GPS_CA_CHIPPING_RATE * elapsed + 2*1023, 1023);
+
+  acq_result_t res;
+  s8 ret = acq_reacquire(&plan, samples, SIG_PRN, cp_last + cp_errs[_i], 0,
+                         SIG_CF - SIG_IF + cf_errs[_i], elapsed, &config,
+                         &res);
+  fail_unless(ret == (_i ? 0 : 1),
+              "Re-acquisition returned %d", ret);
+
+  double cp_err = remainder(res.cp - SIG_CP, 1023);
+  fail_unless(fabs(cp_err) < 0.5,
+              "Code phase %f, expected %f", res.cp, SIG_CP);
+  fail_unless(res.cf == SIG_CF,
+              "Carrier frequency %f, expected %f", res.cf, SIG_CF);
+  fail_unless(res.snr > config.snr_threshold,
+              "SNR of signal %f too low", res.snr);
+
+  fail_unless(acq_reacquire(&plan, samples, SIG_PRN, cp_last, 0, 0, -1,
+                            &config, &res) == -1,
+              "Negative elapsed time not rejected");
+
+  free(samples);
+  acq_plan_free(&plan);
+}
+END_TEST
+
+#ifdef HAVE_PTHREADS
+static u8 n_callbacks;
+
+static void count_callback(const acq_sched_result_t *result, void *context)
+{
+  (void)context;
+  fail_unless(result->status != ACQ_SCHED_CANCELLED,
+              "Callback for unresolved PRN %d", result->prn);
+  n_callbacks++;
+}
+
+START_TEST(test_acq_sched_search)
+{
+  acq_plan_t plan;
+  fail_unless(acq_plan_init(&plan, FS) == 0, "Failed to create plan");
+
+  u32 n = acq_samples_needed(&plan, 1, 1);
+  s8 *samples = malloc(n);
+  make_signal(samples, n, 2);
+
+  acq_sched_config_t config = {
+    .cf_min = SIG_IF - 5000,
+    .cf_max = SIG_IF + 5000,
+    .cf_bin_width = 250,
+    .n_coherent = 1,
+    .n_noncoherent = 1,
+    .n_chunks = 3,
+    .snr_threshold = 15,
+    /* Search everything on the first run, stop after two on the second. */
+    .n_wanted = _i == 0 ? 0 : 2,
+    .n_threads = 4,
+  };
+
+  const u8 prns[] = {3, SIG2_PRN, 7, 30, SIG_PRN, 0, 11, 25};
+  const u8 n_prns = sizeof(prns);
+  acq_sched_result_t results[sizeof(prns)];
+
+  n_callbacks = 0;
+  s8 n_found = acq_sched_search(&plan, samples, &config, n_prns, prns,
+                                results, count_callback, NULL);
+  fail_unless(n_found == 2, "Found %d satellites, expected 2", n_found);
+
+  u8 n_resolved = 0;
+  for (u8 i=0; i<n_prns; i++) {
+    fail_unless(results[i].prn == prns[i], "Results out of order");
+    if (prns[i] == SIG_PRN || prns[i] == SIG2_PRN) {
+      double cp = prns[i] == SIG_PRN ? SIG_CP : SIG2_CP;
+      double cf = prns[i] == SIG_PRN ? SIG_CF : SIG2_CF;
+      fail_unless(results[i].status == ACQ_SCHED_FOUND,
+                  "PRN %d not found", prns[i]);
+      fail_unless(fabs(remainder(results[i].result.cp - cp, 1023)) < 0.5 &&
+                  results[i].result.cf == cf,
+                  "PRN %d found at %f chips, %f Hz, expected %f, %f",
+                  prns[i], results[i].result.cp, results[i].result.cf,
+                  cp, cf);
+    } else {
+      fail_unless(results[i].status != ACQ_SCHED_FOUND,
+                  "PRN %d found but not present", prns[i]);
+      if (_i == 0)
+        fail_unless(results[i].status == ACQ_SCHED_NOT_FOUND,
+                    "PRN %d not fully searched", prns[i]);
+    }
+    if (results[i].status != ACQ_SCHED_CANCELLED)
+      n_resolved++;
+  }
+  fail_unless(n_callbacks == n_resolved,
+              "%d callbacks for %d resolved PRNs", n_callbacks, n_resolved);
+
+  free(samples);
+  acq_plan_free(&plan);
+}
+END_TEST
+#endif /* HAVE_PTHREADS */
+
+Suite* acq_suite(void)
+{
+  Suite *s = suite_create("Acquisition");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_loop_test(tc_core, test_acq_search, 0, 4);
+  tcase_add_loop_test(tc_core, test_acq_search_packed, 0, 2);
+  tcase_add_test(tc_core, test_acq_search_args);
+  tcase_add_loop_test(tc_core, test_acq_reacquire, 0, 3);
+#ifdef HAVE_PTHREADS
+  tcase_add_loop_test(tc_core, test_acq_sched_search, 0, 2);
+#endif
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
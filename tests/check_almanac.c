@@ -0,0 +1,159 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <almanac.h>
+#ifdef HAVE_PTHREADS
+#include <almanac_survey.h>
+#endif
+#include <coord_system.h>
+
+#define N_TIMES 288
+#define N_LOCS 5
+#define MASK (10 * M_PI / 180)
+
+/* 24 satellites in six planes, PRNs 24 and 25 without an almanac and 26
+ * unhealthy. */
+static void make_almanacs(almanac_t alm[32])
+{
+  memset(alm, 0, 32 * sizeof(almanac_t));
+  for (u8 p=0; p<27; p++) {
+    u8 plane = p % 6, slot = p / 6;
+    alm[p].prn = p;
+    alm[p].a = 26559.7e3;
+    alm[p].ecc = 0.001 * (1 + p % 7);
+    alm[p].inc = 0.96;
+    alm[p].raaw = plane * M_PI / 3;
+    alm[p].rora = -8e-9;
+    alm[p].argp = 0.1 * p;
+    alm[p].ma = slot * M_PI / 2 + plane * 0.26;
+    alm[p].week = 100;
+    alm[p].valid = p != 24 && p != 25;
+    alm[p].healthy = p != 26;
+  }
+}
+
+static void location(u32 l, double ref[3])
+{
+  double llh[3] = {(37.8 - 15 * l) * M_PI / 180, (-122.4 + 40 * l) * M_PI / 180,
+                   100 * l};
+  wgsllh2ecef(llh, ref);
+}
+
+START_TEST(test_almanac_grid)
+{
+  almanac_t alm[32];
+  make_almanacs(alm);
+
+  almanac_grid_t g;
+  fail_unless(almanac_grid_init(&g, alm, 0, 100, 300, 0) == -1,
+              "Empty grid accepted");
+  fail_unless(almanac_grid_init(&g, alm, 0, 100, 300, N_TIMES) == 0,
+              "Grid init failed");
+  fail_unless(g.sats == 0x00FFFFFF, "Satellite mask %08x", g.sats);
+
+  double ref[3];
+  location(0, ref);
+  static almanac_look_t look[N_TIMES * 32];
+  almanac_grid_look(&g, ref, look);
+
+  for (u32 i=0; i<N_TIMES; i+=7) {
+    for (u8 p=0; p<24; p++) {
+      double az, el;
+      calc_sat_az_el_almanac(&alm[p], i * 300.0, 100, ref, &az, &el);
+      double doppler = calc_sat_doppler_almanac(&alm[p], i * 300.0, 100, ref);
+      const almanac_look_t *l = &look[i*32 + p];
+      fail_unless(fabs(remainder(l->az - az, 2*M_PI)) < 1e-5 &&
+                  fabs(l->el - el) < 1e-5 && fabs(l->doppler - doppler) < 1e-2,
+                  "PRN %d at %d: %g %g %g, want %g %g %g", p, i, l->az, l->el,
+                  l->doppler, az, el, doppler);
+    }
+  }
+  fail_unless(look[5*32 + 26].el == 0, "Unhealthy satellite looked at");
+
+  /* Every grid time above the mask is in exactly one pass. */
+  static almanac_pass_t passes[32 * N_TIMES];
+  u32 n = almanac_grid_passes(&g, look, MASK, passes, 32 * N_TIMES);
+  fail_unless(n > 24, "Only %d passes", n);
+  static u8 in_pass[N_TIMES * 32];
+  memset(in_pass, 0, sizeof(in_pass));
+  for (u32 k=0; k<n; k++) {
+    const almanac_pass_t *pass = &passes[k];
+    fail_unless(pass->rise < pass->set && pass->set <= N_TIMES,
+                "Pass %d from %d to %d", k, pass->rise, pass->set);
+    float max_el = 0;
+    for (u32 i=pass->rise; i<pass->set; i++) {
+      in_pass[i*32 + pass->prn]++;
+      max_el = fmaxf(max_el, look[i*32 + pass->prn].el);
+    }
+    fail_unless(max_el == pass->max_el, "Pass %d max elevation", k);
+  }
+  for (u32 i=0; i<N_TIMES; i++)
+    for (u8 p=0; p<24; p++)
+      fail_unless(in_pass[i*32 + p] == (look[i*32 + p].el >= MASK),
+                  "PRN %d at %d in %d passes", p, i, in_pass[i*32 + p]);
+
+  fail_unless(almanac_grid_passes(&g, look, MASK, passes, 3) == 3,
+              "Passes overran the array");
+
+  almanac_grid_free(&g);
+  fail_unless(g.pos == 0 && g.n_times == 0, "Grid not freed");
+}
+END_TEST
+
+#ifdef HAVE_PTHREADS
+START_TEST(test_almanac_survey)
+{
+  almanac_t alm[32];
+  make_almanacs(alm);
+  almanac_grid_t g;
+  almanac_grid_init(&g, alm, 0, 100, 300, N_TIMES);
+
+  double refs[N_LOCS][3];
+  for (u32 l=0; l<N_LOCS; l++)
+    location(l, refs[l]);
+
+  static almanac_look_t looks[N_LOCS * N_TIMES * 32];
+  static almanac_look_t look[N_TIMES * 32];
+  static u8 n_visible[N_LOCS * N_TIMES], n_visible_nolook[N_LOCS * N_TIMES];
+  fail_unless(almanac_survey(&g, N_LOCS, refs, MASK, 3, n_visible, looks) == 0,
+              "Survey failed");
+  fail_unless(almanac_survey(&g, N_LOCS, refs, MASK, 0, n_visible_nolook,
+                             0) == 0, "Survey without looks failed");
+  fail_unless(memcmp(n_visible, n_visible_nolook, sizeof(n_visible)) == 0,
+              "Visible counts differ without looks");
+
+  for (u32 l=0; l<N_LOCS; l++) {
+    almanac_grid_look(&g, refs[l], look);
+    fail_unless(memcmp(look, &looks[l * N_TIMES * 32], sizeof(look)) == 0,
+                "Location %d looks differ", l);
+    for (u32 i=0; i<N_TIMES; i++) {
+      u8 n_vis = 0;
+      for (u8 p=0; p<24; p++)
+        n_vis += look[i*32 + p].el >= MASK;
+      fail_unless(n_visible[l * N_TIMES + i] == n_vis,
+                  "Location %d at %d: %d visible, want %d", l, i,
+                  n_visible[l * N_TIMES + i], n_vis);
+    }
+  }
+
+  almanac_grid_free(&g);
+}
+END_TEST
+#endif /* HAVE_PTHREADS */
+
+Suite* almanac_suite(void)
+{
+  Suite *s = suite_create("Almanac");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_almanac_grid);
+#ifdef HAVE_PTHREADS
+  tcase_add_test(tc_core, test_almanac_survey);
+#endif
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
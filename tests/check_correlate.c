@@ -0,0 +1,491 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <correlate.h>
+#include <cpu_features.h>
+#include <prns.h>
+
+#define CODE_LEN 1025
+#define NUM_SAMPLES 20000
+#define NUM_CHANNELS 5
+
+/* Correlations from different kernels are allowed to differ by this
+ * fraction of the total sample magnitude, allowing for single precision
+ * accumulation and the odd chip boundary rounding differently. */
+#define CORR_REL_TOL 2e-3
+
+/* The fixed point correlator quantises the carrier to 8 bits of phase and
+ * amplitude, allow for that as a fraction of the total sample magnitude. */
+#define CORR_FIXED_REL_TOL 5e-3
+
+/* The packed correlator reduces the carrier to its sign, the harmonics of
+ * the resulting square wave leave a residual against the sinusoidal carrier
+ * of the s8 correlator. */
+#define CORR_PACKED_REL_TOL 1e-2
+
+static s8 codes[NUM_CHANNELS][CODE_LEN];
+static s8 samples[NUM_SAMPLES];
+
+/* Build random code replicas with guard chips and a block of samples
+ * containing the first channel's signal in noise. */
+static void make_signal(void)
+{
+  srandom(1);
+  for (u32 c=0; c<NUM_CHANNELS; c++) {
+    for (u32 i=1; i<1024; i++)
+      codes[c][i] = (random() & 1) ? 1 : -1;
+    codes[c][0] = codes[c][1023];
+    codes[c][1024] = codes[c][1];
+  }
+  for (u32 i=0; i<NUM_SAMPLES; i++) {
+    double cp = fmod(100.3 + i*0.0625, 1023);
+    double s = 20 * codes[0][(int)cp + 1] * cos(0.3 + i*1.57)
+               + frand(-30, 30);
+    samples[i] = (s8)lround(s);
+  }
+}
+
+static void setup_channels(corr_channel_t channels[])
+{
+  const u32 starts[NUM_CHANNELS] = {0, 37, 123, 500, 999};
+  for (u32 c=0; c<NUM_CHANNELS; c++) {
+    channels[c].code = codes[c];
+    channels[c].start = starts[c];
+    channels[c].code_phase = frand(0, 1022);
+    channels[c].code_step = 0.0625 + frand(-1e-5, 1e-5);
+    channels[c].carr_phase = frand(0, 2*M_PI);
+    channels[c].carr_step = 1.57 + frand(-1e-3, 1e-3);
+  }
+  /* First channel is aligned with the signal. */
+  channels[0].code_phase = 100.3;
+  channels[0].code_step = 0.0625;
+  channels[0].carr_phase = 0.3;
+  channels[0].carr_step = 1.57;
+}
+
+START_TEST(test_track_correlate_multi)
+{
+  /* Loop over the available SIMD kernels. */
+  const u32 masks[] = {
+    CPU_FEATURES_ALL,
+    CPU_FEATURES_ALL & ~CPU_FEATURE_AVX512,
+    0
+  };
+  cpu_features_set_mask(masks[_i]);
+
+  make_signal();
+
+  corr_channel_t channels[NUM_CHANNELS];
+  setup_channels(channels);
+
+  corr_channel_t ref[NUM_CHANNELS];
+  memcpy(ref, channels, sizeof(ref));
+
+  track_correlate_multi(samples, NUM_CHANNELS, channels);
+
+  for (u32 c=0; c<NUM_CHANNELS; c++) {
+    track_correlate(samples + ref[c].start, ref[c].code,
+                    &ref[c].code_phase, ref[c].code_step,
+                    &ref[c].carr_phase, ref[c].carr_step,
+                    &ref[c].I_E, &ref[c].Q_E, &ref[c].I_P, &ref[c].Q_P,
+                    &ref[c].I_L, &ref[c].Q_L, &ref[c].num_samples);
+
+    fail_unless(channels[c].num_samples == ref[c].num_samples,
+                "Channel %d correlated %d samples, expected %d",
+                c, channels[c].num_samples, ref[c].num_samples);
+    fail_unless(fabs(channels[c].code_phase - ref[c].code_phase) < 1e-9,
+                "Channel %d code phase %f, expected %f",
+                c, channels[c].code_phase, ref[c].code_phase);
+    fail_unless(fabs(remainder(channels[c].carr_phase - ref[c].carr_phase,
+                               2*M_PI)) < 1e-6,
+                "Channel %d carrier phase %f, expected %f",
+                c, channels[c].carr_phase, ref[c].carr_phase);
+
+    double mag = 0;
+    for (u32 i=0; i<ref[c].num_samples; i++)
+      mag += abs(samples[ref[c].start + i]);
+    double tol = CORR_REL_TOL * mag;
+
+    double got[6] = {channels[c].I_E, channels[c].Q_E, channels[c].I_P,
+                     channels[c].Q_P, channels[c].I_L, channels[c].Q_L};
+    double want[6] = {ref[c].I_E, ref[c].Q_E, ref[c].I_P,
+                      ref[c].Q_P, ref[c].I_L, ref[c].Q_L};
+    for (u32 j=0; j<6; j++)
+      fail_unless(fabs(got[j] - want[j]) < tol,
+                  "Channel %d correlation %d is %f, expected %f (mask %x)",
+                  c, j, got[j], want[j], masks[_i]);
+  }
+
+  /* The first channel carries a signal, check it was actually found. */
+  fail_unless(hypot(channels[0].I_P, channels[0].Q_P) >
+              10 * hypot(channels[1].I_P, channels[1].Q_P),
+              "Prompt correlation of signal not above noise");
+
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+}
+END_TEST
+
+START_TEST(test_ca_code_replica)
+{
+  for (u8 prn=0; prn<32; prn++) {
+    const s8* rep = ca_code_replica(prn);
+    u8* packed = (u8*)ca_code(prn);
+    fail_unless(rep == ca_code_replica(prn),
+                "Replica for PRN %d rebuilt on second call", prn);
+    fail_unless(rep[0] == get_chip(packed, 1022) &&
+                rep[1024] == get_chip(packed, 0),
+                "Guard chips of PRN %d replica incorrect", prn);
+    for (u32 i=0; i<1023; i++)
+      fail_unless(rep[i+1] == get_chip(packed, i),
+                  "PRN %d replica chip %d incorrect", prn, i);
+  }
+}
+END_TEST
+
+START_TEST(test_ca_code_resampled)
+{
+  ca_code_resampled_t r;
+  fail_unless(ca_code_resampled_init(&r, 16.368e6) == 0,
+              "Resampled code allocation failed");
+  fail_unless(r.length == 16368 && r.guard == 16,
+              "Resampled code length %d, guard %d", r.length, r.guard);
+
+  for (u8 prn=0; prn<32; prn++) {
+    const s8* rep = ca_code_resampled(&r, prn);
+    const s8* ref = ca_code_replica(prn);
+    /* 16 samples per chip, guard samples wrap around the code period. */
+    for (s32 k=-(s32)r.guard; k<(s32)(r.length + r.guard); k++)
+      fail_unless(rep[k] == ref[((k + 16*1023) / 16) % 1023 + 1],
+                  "PRN %d resampled code sample %d incorrect", prn, k);
+  }
+
+  ca_code_resampled_free(&r);
+  fail_unless(r.buf == 0, "Resampled code not freed");
+}
+END_TEST
+
+static void correlate_channel(corr_channel_t *c)
+{
+  track_correlate(samples + c->start, c->code,
+                  &c->code_phase, c->code_step, &c->carr_phase, c->carr_step,
+                  &c->I_E, &c->Q_E, &c->I_P, &c->Q_P, &c->I_L, &c->Q_L,
+                  &c->num_samples);
+}
+
+START_TEST(test_track_correlate_fixed)
+{
+  make_signal();
+
+  corr_channel_t channels[NUM_CHANNELS];
+  setup_channels(channels);
+
+  for (u32 c=0; c<NUM_CHANNELS; c++) {
+    corr_channel_t flt = channels[c];
+    corr_channel_t fix = channels[c];
+    corr_channel_t fix_ref = channels[c];
+
+    track_correlate_set_mode(CORR_MODE_FLOAT);
+    correlate_channel(&flt);
+
+    track_correlate_set_mode(CORR_MODE_FIXED);
+    fail_unless(track_correlate_get_mode() == CORR_MODE_FIXED,
+                "Correlator mode not set");
+    correlate_channel(&fix);
+    /* Generic fixed point correlator is the bit exact reference for the
+     * SIMD kernels. */
+    cpu_features_set_mask(0);
+    correlate_channel(&fix_ref);
+    cpu_features_set_mask(CPU_FEATURES_ALL);
+    track_correlate_set_mode(CORR_MODE_FLOAT);
+
+    fail_unless(fix.num_samples == flt.num_samples &&
+                fix.code_phase == flt.code_phase &&
+                fix.carr_phase == flt.carr_phase,
+                "Channel %d fixed point NCO outputs differ from float", c);
+
+    double mag = 0;
+    for (u32 i=0; i<flt.num_samples; i++)
+      mag += abs(samples[flt.start + i]);
+    double tol = CORR_FIXED_REL_TOL * mag;
+
+    double got[6] = {fix.I_E, fix.Q_E, fix.I_P, fix.Q_P, fix.I_L, fix.Q_L};
+    double ref[6] = {fix_ref.I_E, fix_ref.Q_E, fix_ref.I_P,
+                     fix_ref.Q_P, fix_ref.I_L, fix_ref.Q_L};
+    double want[6] = {flt.I_E, flt.Q_E, flt.I_P, flt.Q_P, flt.I_L, flt.Q_L};
+    for (u32 j=0; j<6; j++) {
+      fail_unless(got[j] == ref[j],
+                  "Channel %d correlation %d is %f, reference %f",
+                  c, j, got[j], ref[j]);
+      fail_unless(fabs(got[j] - want[j]) < tol,
+                  "Channel %d correlation %d is %f, float %f",
+                  c, j, got[j], want[j]);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_track_correlate_negative_phase)
+{
+  make_signal();
+
+  /* A code phase before the start of the period is the same as the phase
+   * one or more periods later, in both modes. */
+  const double phases[] = {-0.75, -1023.75, -2046.75};
+  for (u8 mode=0; mode<2; mode++) {
+    track_correlate_set_mode(mode ? CORR_MODE_FIXED : CORR_MODE_FLOAT);
+    for (u8 j=0; j<3; j++) {
+      double ref[6], got[6];
+      double cp_ref = 1022.25, cp = phases[j];
+      double carr_ref = 0.3, carr = 0.3;
+      u32 n_ref, n;
+      track_correlate(samples, codes[0], &cp_ref, 0.0625, &carr_ref, 1.57,
+                      &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                      &n_ref);
+      track_correlate(samples, codes[0], &cp, 0.0625, &carr, 1.57,
+                      &got[0], &got[1], &got[2], &got[3], &got[4], &got[5],
+                      &n);
+      fail_unless(n == n_ref && cp == cp_ref &&
+                  memcmp(got, ref, sizeof(ref)) == 0,
+                  "Code phase %f correlated differently", phases[j]);
+    }
+  }
+  track_correlate_set_mode(CORR_MODE_FLOAT);
+}
+END_TEST
+
+START_TEST(test_track_correlate_periods)
+{
+  /* Loop index is the correlator mode. */
+  track_correlate_set_mode(_i ? CORR_MODE_FIXED : CORR_MODE_FLOAT);
+  make_signal();
+
+  /* Four code periods at a quarter chip per sample fit in the samples. */
+  const double code_step = 0.25 + 1e-6, carr_step = 1.2;
+  const u32 signs = 0x5;
+  double code_phase = 10.7, carr_phase = 0.4;
+
+  corr_period_t periods[4], total;
+  u8 n = track_correlate_periods(samples, codes[1], &code_phase, code_step,
+                                 &carr_phase, carr_step, 4, 0, signs,
+                                 periods, &total);
+  fail_unless(n == 4, "Correlated %d periods", n);
+
+  /* Same as one call per period, with the signs wiped off the total. */
+  double ref_code_phase = 10.7, ref_carr_phase = 0.4;
+  double want[6] = {0}, two_periods_code_phase = 0;
+  u32 start = 0, two_periods = 0;
+  for (u32 k=0; k<4; k++) {
+    corr_channel_t c = {.code = codes[1], .start = start,
+                        .code_phase = ref_code_phase, .code_step = code_step,
+                        .carr_phase = ref_carr_phase, .carr_step = carr_step};
+    correlate_channel(&c);
+    ref_code_phase = c.code_phase;
+    ref_carr_phase = c.carr_phase;
+    start += c.num_samples;
+    if (k == 1) {
+      two_periods = start;
+      two_periods_code_phase = c.code_phase;
+    }
+
+    fail_unless(periods[k].num_samples == c.num_samples &&
+                periods[k].I_P == c.I_P && periods[k].Q_L == c.Q_L,
+                "Period %d differs from track_correlate()", k);
+    double got[6] = {c.I_E, c.Q_E, c.I_P, c.Q_P, c.I_L, c.Q_L};
+    for (u32 j=0; j<6; j++)
+      want[j] += (signs >> k) & 1 ? -got[j] : got[j];
+  }
+  double got[6] = {total.I_E, total.Q_E, total.I_P,
+                   total.Q_P, total.I_L, total.Q_L};
+  for (u32 j=0; j<6; j++)
+    fail_unless(fabs(got[j] - want[j]) < 1e-6 * (1 + fabs(want[j])),
+                "Total correlation %d is %f, expected %f", j, got[j], want[j]);
+  fail_unless(total.num_samples == start &&
+              code_phase == ref_code_phase && carr_phase == ref_carr_phase,
+              "NCO outputs differ from track_correlate()");
+
+  /* Cut short part way through the second period, the next call finishes
+   * it and carries on with the following periods. */
+  code_phase = 10.7;
+  carr_phase = 0.4;
+  u32 max = periods[0].num_samples + 1000;
+  n = track_correlate_periods(samples, codes[1], &code_phase, code_step,
+                              &carr_phase, carr_step, 4, max, 0, 0, &total);
+  fail_unless(n == 2 && total.num_samples == max,
+              "Cut short after %d periods, %d samples",
+              n, total.num_samples);
+  fail_unless(fabs(code_phase - (10.7 + max * code_step - 1023)) < 1e-9,
+              "Code phase %f after partial period", code_phase);
+  n = track_correlate_periods(&samples[max], codes[1], &code_phase,
+                              code_step, &carr_phase, carr_step, 1, 0, 0,
+                              0, &total);
+  fail_unless(n == 1 && max + total.num_samples == two_periods &&
+              fabs(code_phase - two_periods_code_phase) < 1e-9,
+              "Partial period finished after %d samples, code phase %f",
+              max + total.num_samples, code_phase);
+
+  track_correlate_set_mode(CORR_MODE_FLOAT);
+}
+END_TEST
+
+START_TEST(test_track_correlate_taps)
+{
+  make_signal();
+
+  /* Early, prompt and late, then taps far enough out to wrap around the
+   * code period. */
+  const float offsets[] = {-0.5, 0, 0.5, -1.75, 2.25, -600.3, 1022.6};
+  const u8 n_taps = sizeof(offsets) / sizeof(offsets[0]);
+
+  corr_channel_t channels[NUM_CHANNELS];
+  setup_channels(channels);
+
+  for (u32 c=0; c<NUM_CHANNELS; c++) {
+    corr_channel_t epl = channels[c];
+    correlate_channel(&epl);
+
+    double code_phase = channels[c].code_phase;
+    double carr_phase = channels[c].carr_phase;
+    correlation_t corrs[7];
+    u32 num_samples;
+    track_correlate_taps(samples + channels[c].start, channels[c].code,
+                         &code_phase, channels[c].code_step,
+                         &carr_phase, channels[c].carr_step,
+                         n_taps, offsets, corrs, &num_samples);
+
+    fail_unless(num_samples == epl.num_samples &&
+                code_phase == epl.code_phase && carr_phase == epl.carr_phase,
+                "Channel %d NCO outputs differ from track_correlate()", c);
+
+    double mag = 0;
+    for (u32 i=0; i<num_samples; i++)
+      mag += abs(samples[channels[c].start + i]);
+    double tol = CORR_REL_TOL * mag;
+
+    /* Direct evaluation of each tap. */
+    for (u8 t=0; t<n_taps; t++) {
+      double I = 0, Q = 0;
+      for (u32 i=0; i<num_samples; i++) {
+        double cp = channels[c].code_phase + i*channels[c].code_step
+                    + offsets[t];
+        s32 chip = (s32)floor(cp) % 1023;
+        if (chip < 0)
+          chip += 1023;
+        double carr = channels[c].carr_phase + i*channels[c].carr_step;
+        s8 s = samples[channels[c].start + i];
+        I += channels[c].code[chip + 1] * sin(carr) * s;
+        Q += channels[c].code[chip + 1] * cos(carr) * s;
+      }
+      fail_unless(fabs(corrs[t].I - I) < tol && fabs(corrs[t].Q - Q) < tol,
+                  "Channel %d tap %d is (%f, %f), expected (%f, %f)",
+                  c, t, corrs[t].I, corrs[t].Q, I, Q);
+    }
+
+    double want[6] = {epl.I_E, epl.Q_E, epl.I_P, epl.Q_P, epl.I_L, epl.Q_L};
+    for (u32 j=0; j<6; j++) {
+      float got = j % 2 ? corrs[j / 2].Q : corrs[j / 2].I;
+      fail_unless(fabs(got - want[j]) < tol,
+                  "Channel %d correlation %d is %f, track_correlate() %f",
+                  c, j, got, want[j]);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_track_correlate_packed)
+{
+  /* Loop index 0 tests 1-bit samples, 1 tests 2-bit samples. */
+  u8 bits = 1 + _i;
+  const u8 prn = 7;
+  const u32 start = 45;
+  const double code_step = 0.0625, carr_step = 1.57;
+
+  static s8 quant[NUM_SAMPLES];
+  static s8 unpacked[NUM_SAMPLES];
+  static u64 packed[PACKED_SAMPLES_WORDS(NUM_SAMPLES, 2)];
+
+  const s8 *replica = ca_code_replica(prn);
+  srandom(2);
+  for (u32 i=0; i<NUM_SAMPLES; i++) {
+    double cp = fmod(200.7 + (i - (double)start)*code_step + 1023, 1023);
+    double s = 0.8 * replica[(int)cp + 1] * sin(0.5 + i*carr_step)
+               + frand(-2.5, 2.5);
+    quant[i] = (s < 0 ? -1 : 1) * (bits == 2 && fabs(s) > 1 ? 3 : 1);
+  }
+
+  packed_samples_pack(quant, NUM_SAMPLES, bits, packed);
+  packed_samples_unpack(packed, bits, start, NUM_SAMPLES - start, unpacked);
+  fail_unless(memcmp(unpacked, &quant[start], NUM_SAMPLES - start) == 0,
+              "Unpacked samples differ from the packed samples");
+
+  const u32 masks[3] = {0, CPU_FEATURE_POPCNT, CPU_FEATURES_ALL};
+  double got[3][6];
+  corr_channel_t pk;
+  for (u32 k=0; k<3; k++) {
+    pk.code_phase = 200.7;
+    pk.carr_phase = 0.5 + start*carr_step;
+    cpu_features_set_mask(masks[k]);
+    track_correlate_packed(packed, bits, start, ca_code(prn),
+                           &pk.code_phase, code_step,
+                           &pk.carr_phase, carr_step,
+                           &got[k][0], &got[k][1], &got[k][2],
+                           &got[k][3], &got[k][4], &got[k][5],
+                           &pk.num_samples);
+  }
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+
+  /* The s8 correlator on the unpacked samples is the reference. */
+  corr_channel_t ref = {
+    .code = replica, .code_phase = 200.7, .code_step = code_step,
+    .carr_phase = 0.5 + start*carr_step, .carr_step = carr_step,
+  };
+  track_correlate(unpacked, ref.code, &ref.code_phase, code_step,
+                  &ref.carr_phase, carr_step, &ref.I_E, &ref.Q_E,
+                  &ref.I_P, &ref.Q_P, &ref.I_L, &ref.Q_L, &ref.num_samples);
+
+  fail_unless(pk.num_samples == ref.num_samples &&
+              pk.code_phase == ref.code_phase &&
+              pk.carr_phase == ref.carr_phase,
+              "Packed NCO outputs differ from s8 correlator");
+
+  double sum_mag = 0;
+  for (u32 i=0; i<ref.num_samples; i++)
+    sum_mag += abs(unpacked[i]);
+  double tol = CORR_PACKED_REL_TOL * sum_mag;
+
+  double want[6] = {ref.I_E, ref.Q_E, ref.I_P, ref.Q_P, ref.I_L, ref.Q_L};
+  for (u32 j=0; j<6; j++) {
+    for (u32 k=1; k<3; k++)
+      fail_unless(got[k][j] == got[0][j],
+                  "Packed kernel %d correlation %d is %f, generic %f",
+                  k, j, got[k][j], got[0][j]);
+    fail_unless(fabs(got[0][j] - want[j]) < tol,
+                "Packed correlation %d is %f, s8 correlator %f",
+                j, got[0][j], want[j]);
+  }
+  fail_unless(fabs(ref.I_P) > 5 * tol,
+              "Signal not present in the prompt correlation");
+}
+END_TEST
+
+Suite* correlate_suite(void)
+{
+  Suite *s = suite_create("Correlators");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_ca_code_replica);
+  tcase_add_test(tc_core, test_ca_code_resampled);
+  tcase_add_loop_test(tc_core, test_track_correlate_multi, 0, 3);
+  tcase_add_test(tc_core, test_track_correlate_fixed);
+  tcase_add_test(tc_core, test_track_correlate_negative_phase);
+  tcase_add_loop_test(tc_core, test_track_correlate_periods, 0, 2);
+  tcase_add_test(tc_core, test_track_correlate_taps);
+  tcase_add_loop_test(tc_core, test_track_correlate_packed, 0, 2);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
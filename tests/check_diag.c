@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include <check.h>
+
+#include <diag.h>
+#include <nav_msg.h>
+
+/* Messages passed to the sink. */
+static u32 n_msgs;
+static diag_msg_t last_msg;
+static char last_text[256];
+
+static void capture(const diag_msg_t *msg, void *context)
+{
+  n_msgs++;
+  last_msg = *msg;
+  strcpy(last_text, msg->text);
+  last_msg.text = last_text;
+  (*(u32 *)context)++;
+}
+
+static void report(u32 i)
+{
+  DIAG(DIAG_WARN, DIAG_EVENT_NAV_PARITY_ERROR, "Report %u", (unsigned int)i);
+}
+
+/* Message argument with a side effect. */
+static u32 n_evaluated;
+
+static unsigned int evaluate(void)
+{
+  return n_evaluated++;
+}
+
+START_TEST(test_diag)
+{
+  u32 n_context = 0;
+  n_msgs = 0;
+  diag_reset_counts();
+
+  /* Without a sink events are only counted. */
+  diag_set_sink(0, 0);
+  report(0);
+  fail_unless(diag_event_count(DIAG_EVENT_NAV_PARITY_ERROR) == 1,
+              "Event not counted");
+
+  /* Nor are the message arguments evaluated without a sink or below the
+   * level. */
+  n_evaluated = 0;
+  DIAG(DIAG_WARN, DIAG_EVENT_TRACE, "%u", evaluate());
+  diag_set_sink(capture, &n_context);
+  diag_set_level(DIAG_ERROR);
+  DIAG(DIAG_WARN, DIAG_EVENT_TRACE, "%u", evaluate());
+  fail_unless(n_evaluated == 0 && n_msgs == 0 &&
+              diag_event_count(DIAG_EVENT_TRACE) == 2,
+              "Arguments evaluated %d times, %d messages, %d events",
+              n_evaluated, n_msgs, diag_event_count(DIAG_EVENT_TRACE));
+
+  diag_set_rate_limit(0);
+  report(1);
+  fail_unless(n_msgs == 0, "Message below the level passed on");
+  diag_set_level(DIAG_WARN);
+  report(2);
+  fail_unless(n_msgs == 1 && n_context == 1 &&
+              last_msg.level == DIAG_WARN &&
+              last_msg.event == DIAG_EVENT_NAV_PARITY_ERROR &&
+              strcmp(last_msg.text, "Report 2") == 0 &&
+              strcmp(last_msg.func, "report") == 0,
+              "Message %d \"%s\" from %s", n_msgs, last_msg.text,
+              last_msg.func);
+
+  /* After the burst only the 2^k-th message of the call site. */
+  diag_set_rate_limit(4);
+  n_msgs = 0;
+  for (u32 i=3; i<=100; i++)
+    report(i);
+  fail_unless(n_msgs == 7 && strcmp(last_text, "Report 65") == 0 &&
+              last_msg.suppressed == 31,
+              "%d messages, last \"%s\" after %d suppressed",
+              n_msgs, last_text, last_msg.suppressed);
+  fail_unless(diag_event_count(DIAG_EVENT_NAV_PARITY_ERROR) == 101,
+              "Counted %d events",
+              diag_event_count(DIAG_EVENT_NAV_PARITY_ERROR));
+
+  /* Reported by the library. */
+  nav_msg_t n;
+  nav_msg_init(&n);
+  process_subframe(&n, 0);
+  fail_unless(diag_event_count(DIAG_EVENT_NAV_NO_EPHEMERIS) == 1 &&
+              last_msg.event == DIAG_EVENT_NAV_NO_EPHEMERIS &&
+              last_msg.level == DIAG_ERROR,
+              "Library event not reported");
+  fail_unless(strcmp(diag_event_name(DIAG_EVENT_NAV_NO_EPHEMERIS),
+                     "nav_no_ephemeris") == 0 &&
+              strcmp(diag_event_name(DIAG_N_EVENTS), "unknown") == 0,
+              "Wrong event names");
+
+  diag_reset_counts();
+  fail_unless(diag_event_count(DIAG_EVENT_NAV_PARITY_ERROR) == 0,
+              "Counts not reset");
+
+  diag_set_sink(0, 0);
+  diag_set_level(DIAG_INFO);
+  diag_set_rate_limit(10);
+}
+END_TEST
+
+Suite* diag_suite(void)
+{
+  Suite *s = suite_create("Diagnostics");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_diag);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,141 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <cpu_features.h>
+#include <ephemeris.h>
+
+#define N_SATS 29
+#define N_EPOCHS 200
+
+static double frand(double lo, double hi)
+{
+  return lo + (hi - lo) * random() / (double)RAND_MAX;
+}
+
+/* Ephemeris with parameters in the range broadcast by GPS satellites. */
+static void random_ephemeris(ephemeris_t *e)
+{
+  e->sqrta = frand(5153.0, 5154.5);
+  e->ecc = frand(0, 0.03);
+  e->m0 = frand(-M_PI, M_PI);
+  e->w = frand(-M_PI, M_PI);
+  e->omega0 = frand(-M_PI, M_PI);
+  e->inc = frand(0.9, 1.0);
+  e->dn = frand(3e-9, 6e-9);
+  e->omegadot = frand(-9e-9, -7e-9);
+  e->inc_dot = frand(-5e-10, 5e-10);
+  e->crs = frand(-150, 150);
+  e->crc = frand(100, 350);
+  e->cus = frand(-1e-5, 1e-5);
+  e->cuc = frand(-1e-5, 1e-5);
+  e->cis = frand(-2e-7, 2e-7);
+  e->cic = frand(-2e-7, 2e-7);
+  e->af0 = frand(-1e-3, 1e-3);
+  e->af1 = frand(-1e-11, 1e-11);
+  e->af2 = 0;
+  e->tgd = frand(-1e-8, 1e-8);
+  e->toe.wn = 1800;
+  e->toe.tow = 16 * (random() % (7*24*3600 / 16));
+  e->toc = e->toe;
+  e->valid = 1;
+}
+
+START_TEST(test_calc_sat_pos_batch)
+{
+  static const u32 masks[] = {0, CPU_FEATURE_AVX2, CPU_FEATURES_ALL};
+  cpu_features_set_mask(masks[_i]);
+  srandom(1);
+
+  ephemeris_t e[N_SATS];
+  ephemeris_t *e_ptrs[N_SATS];
+  for (u8 i=0; i<N_SATS; i++) {
+    random_ephemeris(&e[i]);
+    e_ptrs[i] = &e[i];
+  }
+
+  ephemeris_batch_t b;
+  fail_unless(ephemeris_batch_set(&b, EPHEMERIS_BATCH_MAX + 1, e_ptrs) == -1,
+              "Batch larger than EPHEMERIS_BATCH_MAX accepted");
+  fail_unless(ephemeris_batch_set(&b, N_SATS, e_ptrs) == 0,
+              "Failed to set batch");
+
+  double max_pos = 0, max_vel = 0, max_clock = 0, max_rate = 0;
+  for (u32 k=0; k<N_EPOCHS; k++) {
+    gps_time_t tot[N_SATS];
+    double pos[N_SATS][3], vel[N_SATS][3];
+    double clock_err[N_SATS], clock_rate_err[N_SATS];
+
+    for (u8 i=0; i<N_SATS; i++) {
+      tot[i].wn = e[i].toe.wn;
+      tot[i].tow = e[i].toe.tow + frand(-4*3600, 4*3600);
+      tot[i] = normalize_gps_time(tot[i]);
+    }
+    calc_sat_pos_batch(&b, tot, pos, vel, clock_err, clock_rate_err);
+
+    for (u8 i=0; i<N_SATS; i++) {
+      double p[3], v[3], c, r;
+      calc_sat_pos(p, v, &c, &r, &e[i], tot[i]);
+      for (u8 j=0; j<3; j++) {
+        max_pos = fmax(max_pos, fabs(pos[i][j] - p[j]));
+        max_vel = fmax(max_vel, fabs(vel[i][j] - v[j]));
+      }
+      max_clock = fmax(max_clock, fabs(clock_err[i] - c));
+      max_rate = fmax(max_rate, fabs(clock_rate_err[i] - r));
+    }
+  }
+
+  fail_unless(max_pos < 1e-4, "Position error %g m", max_pos);
+  fail_unless(max_vel < 1e-7, "Velocity error %g m/s", max_vel);
+  fail_unless(max_clock < 1e-15 && max_rate < 1e-20,
+              "Clock errors %g s, %g s/s", max_clock, max_rate);
+
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+}
+END_TEST
+
+START_TEST(test_ephemeris_prepare)
+{
+  srandom(2);
+  for (u32 k=0; k<100; k++) {
+    ephemeris_t e;
+    memset(&e, 0, sizeof(e));
+    random_ephemeris(&e);
+    gps_time_t tot = {.wn = e.toe.wn, .tow = e.toe.tow + frand(-7200, 7200)};
+    tot = normalize_gps_time(tot);
+
+    double p[3], v[3], c, r, p_ref[3], v_ref[3], c_ref, r_ref;
+    calc_sat_pos(p_ref, v_ref, &c_ref, &r_ref, &e, tot);
+    ephemeris_prepare(&e);
+    fail_unless(e.prepared.a == e.sqrta * e.sqrta, "Ephemeris not prepared");
+    calc_sat_pos(p, v, &c, &r, &e, tot);
+    for (u8 j=0; j<3; j++)
+      fail_unless(fabs(p[j] - p_ref[j]) < 1e-6 && fabs(v[j] - v_ref[j]) < 1e-9,
+                  "Prepared ephemeris position %d differs by %g m", j,
+                  p[j] - p_ref[j]);
+    fail_unless(c == c_ref && r == r_ref, "Prepared clock errors differ");
+
+    /* Changed after it was prepared. */
+    e.ecc /= 2;
+    calc_sat_pos(p, v, &c, &r, &e, tot);
+    ephemeris_prepare(&e);
+    calc_sat_pos(p_ref, v_ref, &c_ref, &r_ref, &e, tot);
+    fail_unless(fabs(p[0] - p_ref[0]) < 1e-6 && c == c_ref,
+                "Stale prepared constants used");
+  }
+}
+END_TEST
+
+Suite* ephemeris_suite(void)
+{
+  Suite *s = suite_create("Ephemeris");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_ephemeris_prepare);
+  tcase_add_loop_test(tc_core, test_calc_sat_pos_batch, 0, 3);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
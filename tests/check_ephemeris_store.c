@@ -0,0 +1,145 @@
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#include <string.h>
+
+#include <check.h>
+
+#include <ephemeris_store.h>
+
+#define N_UPDATES 50000
+
+static ephemeris_store_t store;
+
+/* Ephemeris of issue `k`, every parameter set to `k` so a read mixing two
+ * issues can be spotted. */
+static void make_issue(ephemeris_t *e, u8 prn, u32 k, double toe_tow)
+{
+  memset(e, 0, sizeof(*e));
+  double *p = &e->tgd;
+  for (double *q = p; q <= &e->af2; q++)
+    *q = k;
+  e->iodc = k;
+  e->iode = k & 0xFF;
+  e->toe.wn = 1800;
+  e->toe.tow = toe_tow;
+  e->toc = e->toe;
+  e->prn = prn;
+  e->valid = 1;
+}
+
+START_TEST(test_ephemeris_store)
+{
+  ephemeris_store_init(&store);
+  ephemeris_t e, got;
+  gps_time_t t = {.wn = 1800, .tow = 10000};
+
+  fail_unless(ephemeris_store_get(&store, 5, t, &got) == -1,
+              "Ephemeris found in an empty store");
+
+  make_issue(&e, 5, 1, 7200);
+  fail_unless(ephemeris_store_update(&store, &e) == 1, "Issue 1 not stored");
+  fail_unless(ephemeris_store_update(&store, &e) == 0, "Issue 1 stored twice");
+  make_issue(&e, 5, 2, 14400);
+  fail_unless(ephemeris_store_update(&store, &e) == 1, "Issue 2 not stored");
+
+  /* Closest toe. */
+  fail_unless(ephemeris_store_get(&store, 5, t, &got) == 0 && got.iode == 1,
+              "Got issue %d at %g", got.iode, t.tow);
+  t.tow = 12000;
+  fail_unless(ephemeris_store_get(&store, 5, t, &got) == 0 && got.iode == 2,
+              "Got issue %d at %g", got.iode, t.tow);
+  t.tow = 14400 + EPHEMERIS_STORE_MAX_AGE + 1;
+  fail_unless(ephemeris_store_get(&store, 5, t, &got) == -1,
+              "Got issue %d after the last expired", got.iode);
+
+  fail_unless(ephemeris_store_get_iode(&store, 5, 1, &got) == 0 &&
+              got.toe.tow == 7200, "Issue 1 not found by IODE");
+
+  /* Three issues, the oldest dropped. An older issue arriving late is
+   * kept behind the latest. */
+  make_issue(&e, 5, 3, 21600);
+  ephemeris_store_update(&store, &e);
+  fail_unless(ephemeris_store_get_iode(&store, 5, 1, &got) == -1,
+              "Oldest issue kept");
+  make_issue(&e, 5, 1, 7200);
+  fail_unless(ephemeris_store_update(&store, &e) == 1, "Late issue not stored");
+  t.tow = 21000;
+  fail_unless(ephemeris_store_get(&store, 5, t, &got) == 0 && got.iode == 3,
+              "Late issue replaced the latest");
+
+  make_issue(&e, 32, 1, 7200);
+  fail_unless(ephemeris_store_update(&store, &e) == -1,
+              "Out of range PRN stored");
+  make_issue(&e, 6, 1, 7200);
+  e.valid = 0;
+  fail_unless(ephemeris_store_update(&store, &e) == -1,
+              "Invalid ephemeris stored");
+}
+END_TEST
+
+#ifdef HAVE_PTHREADS
+static bool consistent(const ephemeris_t *e)
+{
+  for (const double *q = &e->tgd; q <= &e->af2; q++)
+    if (*q != e->iodc)
+      return false;
+  return (e->iodc & 0xFF) == e->iode;
+}
+
+static void *reader(void *arg)
+{
+  u32 *n_torn = arg;
+  gps_time_t t = {.wn = 1800, .tow = 7200};
+  ephemeris_t e;
+  u32 last = 0;
+
+  while (true) {
+    if (ephemeris_store_get(&store, 0, t, &e) == 0) {
+      if (!consistent(&e) || e.iodc < last)
+        (*n_torn)++;
+      last = e.iodc;
+      if (e.iodc == N_UPDATES)
+        break;
+    }
+  }
+  return 0;
+}
+
+START_TEST(test_ephemeris_store_threads)
+{
+  ephemeris_store_init(&store);
+
+  pthread_t threads[2];
+  u32 n_torn[2] = {0, 0};
+  for (u8 i=0; i<2; i++)
+    pthread_create(&threads[i], 0, reader, &n_torn[i]);
+
+  ephemeris_t e;
+  for (u32 k=1; k<=N_UPDATES; k++) {
+    make_issue(&e, 0, k, 7200);
+    ephemeris_store_update(&store, &e);
+  }
+
+  for (u8 i=0; i<2; i++) {
+    pthread_join(threads[i], 0);
+    fail_unless(n_torn[i] == 0, "Reader %d saw %d torn ephemerides", i,
+                n_torn[i]);
+  }
+}
+END_TEST
+#endif /* HAVE_PTHREADS */
+
+Suite* ephemeris_store_suite(void)
+{
+  Suite *s = suite_create("Ephemeris store");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_ephemeris_store);
+#ifdef HAVE_PTHREADS
+  tcase_add_test(tc_core, test_ephemeris_store_threads);
+#endif
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
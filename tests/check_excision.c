@@ -0,0 +1,118 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <excision.h>
+
+#define FS 4.092e6
+#define BLOCK 1024
+#define DELAY (3 * BLOCK / 2)
+#define N_SAMPLES (100 * BLOCK)
+#define THRESHOLD_DB 15
+
+static s8 in[N_SAMPLES], out[N_SAMPLES];
+
+/* Noise plus tones at `freqs` with amplitudes `ampls`. */
+static void make_input(u8 n_tones, const double freqs[], const double ampls[])
+{
+  srandom(1);
+  for (u32 i=0; i<N_SAMPLES; i++) {
+    double s = frand(-20, 20);
+    for (u8 t=0; t<n_tones; t++)
+      s += ampls[t] * cos(2*M_PI * freqs[t] / FS * i + t);
+    in[i] = (s8)lround(s);
+  }
+}
+
+/* Excise the input in place, in chunks of random sizes. */
+static void run(excision_t *ex)
+{
+  memcpy(out, in, sizeof(in));
+  for (u32 i=0; i<N_SAMPLES; ) {
+    u32 len = 1 + random() % 2500;
+    if (len > N_SAMPLES - i)
+      len = N_SAMPLES - i;
+    excision_process(ex, &out[i], len, &out[i]);
+    i += len;
+  }
+}
+
+/* Amplitude of the output at `freq`, once the spectrum average settles. */
+static double tone_ampl(double freq)
+{
+  double I = 0, Q = 0;
+  u32 start = 20 * BLOCK;
+  for (u32 i=start; i<N_SAMPLES; i++) {
+    I += out[i] * cos(2*M_PI * freq / FS * i);
+    Q += out[i] * sin(2*M_PI * freq / FS * i);
+  }
+  return 2 * sqrt(I*I + Q*Q) / (N_SAMPLES - start);
+}
+
+START_TEST(test_excision_tones)
+{
+  excision_t ex;
+  fail_unless(excision_init(&ex, FS, 1001, THRESHOLD_DB) == -1,
+              "Odd block length accepted");
+  fail_unless(excision_init(&ex, FS, BLOCK, THRESHOLD_DB) == 0,
+              "Failed to initialise excision");
+
+  const double freqs[2] = {600.1e3, 1.3e6}, ampls[2] = {15, 30};
+  make_input(2, freqs, ampls);
+  run(&ex);
+
+  fail_unless(ex.n_interferers == 2,
+              "Found %d interferers", ex.n_interferers);
+  for (u8 t=0; t<2; t++) {
+    /* Strongest first. */
+    const excision_interferer_t *f = &ex.interferers[1 - t];
+    fail_unless(fabs(f->freq - freqs[t]) < FS / BLOCK / 2,
+                "Interferer %d at %f Hz, expected %f Hz",
+                t, f->freq, freqs[t]);
+    fail_unless(f->power > THRESHOLD_DB && f->n_bins >= 3,
+                "Interferer %d at %f dB over %d bins",
+                t, f->power, f->n_bins);
+    fail_unless(tone_ampl(freqs[t]) < 0.05 * ampls[t],
+                "Tone %d left with amplitude %f", t, tone_ampl(freqs[t]));
+  }
+
+  excision_free(&ex);
+}
+END_TEST
+
+START_TEST(test_excision_clean)
+{
+  /* Without interference the samples pass through, delayed. */
+  excision_t ex;
+  fail_unless(excision_init(&ex, FS, BLOCK, THRESHOLD_DB) == 0,
+              "Failed to initialise excision");
+
+  make_input(0, 0, 0);
+  run(&ex);
+
+  fail_unless(ex.n_interferers == 0,
+              "Found %d interferers in noise", ex.n_interferers);
+  for (u32 i=0; i<N_SAMPLES; i++) {
+    s8 want = i < DELAY ? 0 : in[i - DELAY];
+    fail_unless(abs(out[i] - want) <= 1,
+                "Output %d is %d, expected %d", i, out[i], want);
+  }
+
+  excision_free(&ex);
+}
+END_TEST
+
+Suite* excision_suite(void)
+{
+  Suite *s = suite_create("Interference excision");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_excision_tones);
+  tcase_add_test(tc_core, test_excision_clean);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
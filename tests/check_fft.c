@@ -0,0 +1,73 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <fft.h>
+
+/* Transform lengths covering the radix 4, 2 and odd radix stages, with and
+ * without the vector butterflies. */
+static const u32 lengths[] = {1, 2, 3, 8, 12, 15, 64, 67, 98, 134, 1023, 4092};
+
+START_TEST(test_fft_dft)
+{
+  u32 n = lengths[_i];
+  fft_plan_t *plan = fft_plan_new(n);
+  fail_unless(plan != NULL, "Failed to create plan for length %d", n);
+
+  fft_cpx_t *x = malloc(n * sizeof(fft_cpx_t));
+  fft_cpx_t *work = malloc(n * sizeof(fft_cpx_t));
+  double *x_re = malloc(n * sizeof(double));
+  double *x_im = malloc(n * sizeof(double));
+
+  double mag = 0;
+  for (u32 t=0; t<n; t++) {
+    x[t].re = x_re[t] = frand(-100, 100);
+    x[t].im = x_im[t] = frand(-100, 100);
+    mag += hypot(x_re[t], x_im[t]);
+  }
+
+  fft_forward(plan, x, work);
+
+  /* Compare against a direct DFT. */
+  for (u32 k=0; k<n; k++) {
+    double re = 0, im = 0;
+    for (u32 t=0; t<n; t++) {
+      double a = -2*M_PI * (double)((u64)t*k % n) / n;
+      re += x_re[t]*cos(a) - x_im[t]*sin(a);
+      im += x_re[t]*sin(a) + x_im[t]*cos(a);
+    }
+    fail_unless(hypot(x[k].re - re, x[k].im - im) < 1e-5 * mag,
+                "Length %d bin %d is %f%+fi, expected %f%+fi",
+                n, k, x[k].re, x[k].im, re, im);
+  }
+
+  /* Inverse transform should return the original data scaled by n. */
+  fft_inverse(plan, x, work);
+  for (u32 t=0; t<n; t++)
+    fail_unless(hypot(x[t].re / n - x_re[t], x[t].im / n - x_im[t])
+                < 1e-5 * mag / n + 1e-4,
+                "Length %d inverse sample %d is %f%+fi, expected %f%+fi",
+                n, t, x[t].re / n, x[t].im / n, x_re[t], x_im[t]);
+
+  free(x);
+  free(work);
+  free(x_re);
+  free(x_im);
+  fft_plan_destroy(plan);
+}
+END_TEST
+
+Suite* fft_suite(void)
+{
+  Suite *s = suite_create("FFT");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_loop_test(tc_core, test_fft_dft, 0,
+                      sizeof(lengths) / sizeof(lengths[0]));
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
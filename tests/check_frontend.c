@@ -0,0 +1,132 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <cpu_features.h>
+#include <frontend.h>
+
+#define FS 16.368e6
+#define IF 4.092e6
+#define DECIMATION 4
+#define BANDWIDTH 1e6
+#define N_TAPS 60
+#define N_IN 40000
+
+/* Input tone, real, at `freq` with amplitude `ampl`. */
+static void make_tone(s8 *in, double freq, double ampl)
+{
+  for (u32 i=0; i<N_IN; i++)
+    in[i] = (s8)lround(ampl * cos(2*M_PI * freq / FS * i + 0.3));
+}
+
+/* Amplitude of the output at `freq` and the RMS of the whole output,
+ * skipping the filter's start up. */
+static void measure(const s8 *out, u32 n, double fs_out, double freq,
+                    double *ampl, double *rms)
+{
+  double I = 0, Q = 0, p = 0;
+  u32 n_used = 0;
+  for (u32 m=N_TAPS; m<n; m++) {
+    I += out[m] * cos(2*M_PI * freq / fs_out * m);
+    Q += out[m] * sin(2*M_PI * freq / fs_out * m);
+    p += out[m] * out[m];
+    n_used++;
+  }
+  *ampl = 2 * sqrt(I*I + Q*Q) / n_used;
+  *rms = sqrt(p / n_used);
+}
+
+START_TEST(test_frontend_tones)
+{
+  /* Loop index selects the generic or SIMD filter. */
+  cpu_features_set_mask(_i ? CPU_FEATURES_ALL : 0);
+
+  frontend_t fe;
+  fail_unless(frontend_init(&fe, FS, IF, DECIMATION, FS / 2, N_TAPS) == -1,
+              "Bandwidth wider than the output accepted");
+  fail_unless(frontend_init(&fe, FS, IF, 0, BANDWIDTH, N_TAPS) == -1,
+              "Zero decimation accepted");
+
+  static s8 in[N_IN], out[N_IN / DECIMATION + 1];
+  const double offsets[] = {300e3, -700e3, 3e6};
+  for (u32 t=0; t<3; t++) {
+    fail_unless(frontend_init(&fe, FS, IF, DECIMATION, BANDWIDTH,
+                              N_TAPS) == 0,
+                "Failed to initialise front end");
+    fail_unless(fe.fs_out == FS / DECIMATION && fe.if_out == fe.fs_out / 4,
+                "Output rate %f, IF %f", fe.fs_out, fe.if_out);
+
+    make_tone(in, IF + offsets[t], 5);
+    u32 n = frontend_process(&fe, in, N_IN, out);
+    fail_unless(n == (N_IN - fe.n_taps) / DECIMATION + 1,
+                "Front end gave %d outputs", n);
+
+    double ampl, rms;
+    measure(out, n, fe.fs_out, fe.if_out + offsets[t], &ampl, &rms);
+    if (fabs(offsets[t]) < BANDWIDTH) {
+      /* In band, comes out on the right side of the new IF with all the
+       * power at that frequency. */
+      fail_unless(ampl > 5 && fabs(ampl - rms * sqrt(2)) < 0.1 * ampl,
+                  "Tone at %+.0f Hz has amplitude %f, RMS %f",
+                  offsets[t], ampl, rms);
+    } else {
+      fail_unless(rms < 0.5,
+                  "Out of band tone at %+.0f Hz passed with RMS %f",
+                  offsets[t], rms);
+    }
+    frontend_free(&fe);
+  }
+
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+}
+END_TEST
+
+START_TEST(test_frontend_stream)
+{
+  /* Decimating in place in blocks of varying size gives the same output
+   * as one call, up to float rounding about the quantisation steps. */
+  static s8 in[N_IN], ref[N_IN / 3 + 1];
+  srandom(1);
+  for (u32 i=0; i<N_IN; i++)
+    in[i] = (s8)lround(10 * cos(2*M_PI * (IF + 250e3) / FS * i)
+                       + frand(-20, 20));
+
+  frontend_t fe;
+  fail_unless(frontend_init(&fe, FS, IF, 3, 1e6, 33) == 0,
+              "Failed to initialise front end");
+  u32 n_ref = frontend_process(&fe, in, N_IN, ref);
+  frontend_free(&fe);
+
+  frontend_init(&fe, FS, IF, 3, 1e6, 33);
+  u32 n = 0, i = 0;
+  while (i < N_IN) {
+    u32 len = 1 + random() % 3000;
+    if (len > N_IN - i)
+      len = N_IN - i;
+    n += frontend_process(&fe, &in[i], len, &in[n]);
+    i += len;
+  }
+  frontend_free(&fe);
+
+  fail_unless(n == n_ref, "Streamed %d outputs, one call %d", n, n_ref);
+  for (u32 m=0; m<n; m++)
+    fail_unless(abs(in[m] - ref[m]) <= 1,
+                "Output %d is %d streamed, %d in one call",
+                m, in[m], ref[m]);
+}
+END_TEST
+
+Suite* frontend_suite(void)
+{
+  Suite *s = suite_create("Front end");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_loop_test(tc_core, test_frontend_tones, 0, 2);
+  tcase_add_test(tc_core, test_frontend_stream);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -21,6 +21,20 @@ int main(void)
   srunner_add_suite(sr, sbp_suite());
   srunner_add_suite(sr, coord_system_suite());
   srunner_add_suite(sr, linear_algebra_suite());
+  srunner_add_suite(sr, correlate_suite());
+  srunner_add_suite(sr, fft_suite());
+  srunner_add_suite(sr, acq_suite());
+  srunner_add_suite(sr, sample_source_suite());
+  srunner_add_suite(sr, track_batch_suite());
+  srunner_add_suite(sr, frontend_suite());
+  srunner_add_suite(sr, excision_suite());
+  srunner_add_suite(sr, nav_msg_suite());
+  srunner_add_suite(sr, nav_archive_suite());
+  srunner_add_suite(sr, diag_suite());
+  srunner_add_suite(sr, ephemeris_suite());
+  srunner_add_suite(sr, orbit_cache_suite());
+  srunner_add_suite(sr, ephemeris_store_suite());
+  srunner_add_suite(sr, almanac_suite());
 
   srunner_set_fork_status(sr, CK_NOFORK);
   srunner_run_all(sr, CK_NORMAL);
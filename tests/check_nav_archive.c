@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <nav_archive.h>
+
+#define N_RECORDS 100
+
+/* Subframe 5 holding the almanac page of SV ID `sv_id`, subframe `j` of
+ * PRN `prn`'s broadcast. */
+static void make_page(nav_msg_subframe_t *sf, u8 prn, u32 j, u8 sv_id)
+{
+  for (u8 b=0; b<sizeof(sf->data); b++)
+    sf->data[b] = random();
+  u32 tow = 1000 + j;
+  u32 how = (tow + 1) << 7 | 5 << 2;
+  sf->data[3] = how >> 16;
+  sf->data[4] = how >> 8;
+  sf->data[5] = how;
+  sf->data[6] = 1 << 6 | sv_id;
+  sf->tow = tow * 6;
+  sf->prn = prn;
+  sf->sf_id = 5;
+}
+
+START_TEST(test_nav_archive)
+{
+  char path[] = "/tmp/check_nav_archive_XXXXXX";
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0, "Failed to create archive file");
+  close(fd);
+
+  /* Not an archive. */
+  FILE *f = fopen(path, "w");
+  fputs("not an archive, not an archive", f);
+  fclose(f);
+  nav_archive_t ar;
+  fail_unless(nav_archive_open(&ar, path) == -1, "Opened a non-archive");
+  fail_unless(nav_archive_map(&ar, path) == -1, "Mapped a non-archive");
+  unlink(path);
+
+  /* Almanac pages of SV IDs 1 to 24 broadcast by two satellites, with an
+   * invalid PRN thrown in. */
+  srandom(1);
+  static nav_msg_subframe_t sf[N_RECORDS + 1];
+  for (u32 j=0; j<N_RECORDS; j++)
+    make_page(&sf[j], j % 2 ? 3 : 17, j / 2, j / 2 % 24 + 1);
+  sf[50].prn = 40;
+
+  fail_unless(nav_archive_open(&ar, path) == 0, "Failed to create archive");
+  for (u32 j=0; j<N_RECORDS/2; j++)
+    fail_unless(nav_archive_append(&ar, &sf[j]) == 0, "Append failed");
+  nav_archive_close(&ar);
+
+  /* An append cut short is dropped when the archive is reopened. */
+  f = fopen(path, "a");
+  fwrite(&sf[N_RECORDS/2], 10, 1, f);
+  fclose(f);
+  fail_unless(nav_archive_open(&ar, path) == 0, "Failed to reopen archive");
+  for (u32 j=N_RECORDS/2; j<N_RECORDS; j++)
+    fail_unless(nav_archive_append(&ar, &sf[j]) == 0, "Append failed");
+  nav_archive_close(&ar);
+
+  fail_unless(nav_archive_map(&ar, path) == 0, "Failed to map archive");
+  fail_unless(ar.n_records == N_RECORDS,
+              "Archive has %d records", (int)ar.n_records);
+  fail_unless(memcmp(ar.records, sf, N_RECORDS * sizeof(sf[0])) == 0,
+              "Archived subframes differ");
+  fail_unless(nav_archive_append(&ar, &sf[0]) == -1,
+              "Appended to a mapped archive");
+
+  /* Replay from part way through. */
+  ephemeris_t e[32];
+  nav_msg_almanac_t a;
+  nav_msg_replay_t r;
+  memset(e, 0, sizeof(e));
+  nav_msg_almanac_init(&a);
+  nav_msg_replay_init(&r);
+  u64 n = nav_archive_replay(&ar, 60, &r, e, &a);
+  fail_unless(n == N_RECORDS - 60, "Replayed %d pages", (int)n);
+  bool want[24] = {false};
+  for (u32 j=60; j<N_RECORDS; j++)
+    want[j / 2 % 24] = true;
+  for (u8 i=0; i<24; i++) {
+    fail_unless(a.almanac[i].valid == want[i],
+                "PRN %d almanac valid %d", i, a.almanac[i].valid);
+  }
+
+  /* The whole archive, skipping the invalid PRN. */
+  nav_msg_almanac_init(&a);
+  n = nav_archive_replay(&ar, 0, &r, e, &a);
+  fail_unless(n == N_RECORDS - 1, "Replayed %d pages", (int)n);
+  nav_archive_close(&ar);
+  unlink(path);
+}
+END_TEST
+
+Suite* nav_archive_suite(void)
+{
+  Suite *s = suite_create("Subframe archive");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_nav_archive);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,571 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <cpu_features.h>
+#include <nav_msg.h>
+
+#define N_CHANNELS 6
+#define N_SUBFRAMES 7
+#define N_BITS (N_SUBFRAMES * 300)
+#define N_UPDATES (N_BITS * 20 - 40)
+
+static const u32 parity_masks[6] = {
+  0xBB1F34A0, 0x5D8F9A50, 0xAEC7CD08, 0x5763E684, 0x6BB1F342, 0x8B7A89C1
+};
+
+/* Encode 24 data bits as a 30 bit word following the word `prev`, setting
+ * the parity bits and inverting the data if D30* is set. */
+static u32 encode_word(u32 prev, u32 data)
+{
+  u32 w = (prev & 3) << 30 | data << 6;
+  for (u8 k=0; k<6; k++)
+    w |= (__builtin_popcount(w & parity_masks[k]) & 1) << (5 - k);
+  if (w & 1<<30)
+    w ^= 0x3FFFFFC0;
+  return w & 0x3FFFFFFF;
+}
+
+/* Encode a word whose last two data bits are chosen to zero D29 and D30,
+ * as words 2 and 10 of a subframe. */
+static u32 encode_word_t(u32 prev, u32 data)
+{
+  for (u32 t=0; t<4; t++) {
+    u32 w = encode_word(prev, (data & ~3) | t);
+    if (!(w & 3))
+      return w;
+  }
+  fail_unless(0, "No choice of t bits zeroes D29 and D30");
+  return 0;
+}
+
+/* Bits of consecutive subframes starting at subframe `sf0`. Words 3 to 10
+ * of subframe `s` hold the data `pages[s]` if given and not all zero, or
+ * else random data. */
+static void make_bits(u8 *bits, u32 sf0, u32 tow0,
+                      const u32 pages[N_SUBFRAMES][8])
+{
+  u32 prev = 0, n = 0;
+  for (u32 s=0; s<N_SUBFRAMES; s++) {
+    u32 sf_id = (sf0 + s) % 5 + 1;
+    for (u32 w=0; w<10; w++) {
+      u32 data = random() & 0xFFFFFF;
+      if (w >= 2 && pages && pages[s][0])
+        data = pages[s][w - 2];
+      if (w == 0)
+        prev = encode_word(prev, 0x8B << 16 | (data & 0x3FFF) << 2);
+      else if (w == 1)
+        prev = encode_word_t(prev, (tow0 + s + 1) << 7 | sf_id << 2);
+      else if (w == 9)
+        prev = encode_word_t(prev, data);
+      else
+        prev = encode_word(prev, data);
+      for (s32 b=29; b>=0; b--)
+        bits[n++] = prev >> b & 1;
+    }
+  }
+}
+
+START_TEST(test_nav_parity_batch)
+{
+  /* Loop index selects the generic or popcnt parity check. */
+  cpu_features_set_mask(_i ? CPU_FEATURES_ALL : 0);
+
+  srandom(1);
+  u32 words[1000], ref[1000];
+  u8 errors[1000];
+  for (u32 j=0; j<1000; j++) {
+    /* Half valid words, half random ones. */
+    if (j % 2)
+      words[j] = encode_word(random(), random() & 0xFFFFFF)
+               | (random() & 3) << 30;
+    else
+      words[j] = random();
+    ref[j] = words[j];
+  }
+
+  nav_parity_batch(1000, words, errors);
+  for (u32 j=0; j<1000; j++) {
+    int want = nav_parity(&ref[j]);
+    fail_unless(errors[j] == want && words[j] == ref[j],
+                "Word %08x parity %d, nav_parity() %d",
+                ref[j], errors[j], want);
+  }
+
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+}
+END_TEST
+
+static void check_same(const nav_msg_t *a, const nav_msg_t *b, u32 k, u8 i)
+{
+  fail_unless(memcmp(a->subframe_bits, b->subframe_bits,
+                     sizeof(a->subframe_bits)) == 0 &&
+              a->subframe_bit_index == b->subframe_bit_index &&
+              a->subframe_start_index == b->subframe_start_index &&
+              a->bit_phase == b->bit_phase &&
+              a->bit_phase_ref == b->bit_phase_ref &&
+              a->bit_phase_count == b->bit_phase_count &&
+              a->nav_bit_integrate == b->nav_bit_integrate &&
+              a->next_subframe_id == b->next_subframe_id,
+              "Update %d channel %d state differs", k, i);
+}
+
+START_TEST(test_nav_msg_batch)
+{
+  /* Loop index selects the generic or SIMD kernels. */
+  cpu_features_set_mask(_i ? CPU_FEATURES_ALL : 0);
+
+  /* Bit edge offsets in ms, polarities and start subframes. */
+  const u32 offsets[N_CHANNELS] = {3, 7, 11, 15, 19, 0};
+  const s32 polarity[N_CHANNELS] = {1, -1, 1, -1, 1, 1};
+
+  static u8 bits[N_CHANNELS][N_BITS];
+  srandom(2);
+  for (u8 i=0; i<N_CHANNELS; i++)
+    make_bits(bits[i], i, 1000 * i + 7, 0);
+  /* Bit errors in a data word of subframe 2, the parity of a HOW and a
+   * preamble. */
+  bits[3][1030] ^= 1;
+  bits[5][654] ^= 1;
+  bits[5][1202] ^= 1;
+
+  nav_msg_t ref[N_CHANNELS];
+  ephemeris_t e_ref[N_CHANNELS], e[N_CHANNELS];
+  nav_msg_almanac_t a_ref, a;
+  nav_msg_almanac_init(&a_ref);
+  nav_msg_almanac_init(&a);
+  nav_msg_batch_t b;
+  fail_unless(nav_msg_batch_init(&b, N_CHANNELS) == 0,
+              "Failed to initialise batch");
+  for (u8 i=0; i<N_CHANNELS; i++) {
+    /* Both bit sync methods. */
+    nav_msg_init_bit_sync(&ref[i], i % 2 ? NAV_MSG_BIT_SYNC_HISTOGRAM
+                                         : NAV_MSG_BIT_SYNC_EDGES);
+    ref[i].inverted = 0;
+    ref[i].tow_single = i < 3;
+    nav_msg_batch_set(&b, i, &ref[i]);
+  }
+  memset(e_ref, 0, sizeof(e_ref));
+  memset(e, 0, sizeof(e));
+
+  u32 n_tow = 0, n_ready = 0;
+  for (u32 k=0; k<N_UPDATES; k++) {
+    s32 corr[N_CHANNELS], TOW_ms[N_CHANNELS];
+    for (u8 i=0; i<N_CHANNELS; i++) {
+      u8 bit = bits[i][(k + offsets[i]) / 20];
+      corr[i] = polarity[i] * (bit ? 100 : -100) + (s32)frand(-50, 50);
+    }
+
+    /* Reloading a channel mid-stream leaves it unchanged. */
+    if (k == N_UPDATES / 2) {
+      nav_msg_t n;
+      nav_msg_batch_get(&b, 2, &n);
+      nav_msg_batch_set(&b, 2, &n);
+    }
+
+    nav_msg_batch_update(&b, corr, 1, TOW_ms);
+
+    s8 ret[N_CHANNELS];
+    u32 ready = nav_msg_batch_process(&b, e, &a, ret);
+
+    for (u8 i=0; i<N_CHANNELS; i++) {
+      s32 want = nav_msg_update(&ref[i], corr[i], 1);
+      fail_unless(TOW_ms[i] == want,
+                  "Update %d channel %d TOW %d, nav_msg_update() %d",
+                  k, i, TOW_ms[i], want);
+      n_tow += want >= 0;
+
+      fail_unless(!(ready >> i & 1) == !subframe_ready(&ref[i]),
+                  "Update %d channel %d subframe readiness differs", k, i);
+      if (subframe_ready(&ref[i])) {
+        s8 want_ret = process_subframe_almanac(&ref[i], &e_ref[i], &a_ref);
+        fail_unless(ret[i] == want_ret,
+                    "Update %d channel %d processed %d, "
+                    "process_subframe_almanac() %d",
+                    k, i, ret[i], want_ret);
+        n_ready++;
+      }
+
+      nav_msg_t n;
+      nav_msg_batch_get(&b, i, &n);
+      check_same(&n, &ref[i], k, i);
+    }
+  }
+
+  fail_unless(n_tow >= N_CHANNELS && n_ready >= 3 * N_CHANNELS,
+              "Only %d TOWs and %d subframes", n_tow, n_ready);
+  for (u8 i=0; i<N_CHANNELS; i++) {
+    fail_unless(memcmp(&e[i], &e_ref[i], sizeof(ephemeris_t)) == 0,
+                "Channel %d ephemeris differs", i);
+  }
+  fail_unless(e[4].valid, "No ephemeris decoded");
+  fail_unless(e[4].prepared.a == e[4].sqrta * e[4].sqrta,
+              "Decoded ephemeris not prepared");
+  fail_unless(memcmp(&a, &a_ref, sizeof(a)) == 0, "Almanac store differs");
+
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+}
+END_TEST
+
+/* Update at which the bit phase locks, or `N_UPDATES` if it doesn't. */
+static u32 bit_sync_time(nav_msg_bit_sync_t bit_sync, const u8 *bits,
+                         u32 offset, double flip_prob, u8 *bit_phase_ref)
+{
+  nav_msg_t n;
+  nav_msg_init_bit_sync(&n, bit_sync);
+  srandom(3);
+  for (u32 k=0; k<N_UPDATES; k++) {
+    s32 corr = bits[(k + offset) / 20] ? 100 : -100;
+    if (frand(0, 1) < flip_prob)
+      corr = -corr;
+    nav_msg_update(&n, corr, 1);
+    if (n.bit_phase_count >= 5) {
+      *bit_phase_ref = n.bit_phase_ref;
+      return k;
+    }
+  }
+  return N_UPDATES;
+}
+
+START_TEST(test_nav_msg_bit_sync)
+{
+  static u8 bits[N_BITS];
+  srandom(4);
+  make_bits(bits, 0, 100, 0);
+
+  /* The last ms of each bit is at this bit phase. */
+  const u32 offset = 7;
+  u8 want_ref = (20 - offset) % 20;
+
+  /* Clean signal, the histogram locks at the third edge. */
+  u8 ref_edges = 0xFF, ref_hist = 0xFF;
+  u32 t_edges = bit_sync_time(NAV_MSG_BIT_SYNC_EDGES, bits, offset, 0,
+                              &ref_edges);
+  u32 t_hist = bit_sync_time(NAV_MSG_BIT_SYNC_HISTOGRAM, bits, offset, 0,
+                             &ref_hist);
+  fail_unless(t_edges < N_UPDATES && t_hist < N_UPDATES,
+              "No bit sync, edges at %d ms, histogram at %d ms",
+              t_edges, t_hist);
+  fail_unless(ref_edges == want_ref && ref_hist == want_ref,
+              "Bit phases %d and %d, expected %d",
+              ref_edges, ref_hist, want_ref);
+  fail_unless(t_hist < t_edges,
+              "Histogram locked at %d ms, edges at %d ms", t_hist, t_edges);
+  u32 n_edges = 0;
+  for (u32 j=1; (j*20 - offset) <= t_hist; j++)
+    n_edges += bits[j] != bits[j-1];
+  fail_unless(n_edges == 3, "Histogram locked after %d edges", n_edges);
+
+  /* One ms in twenty with the wrong sign keeps resetting the edge counter,
+   * the histogram still locks within seconds. */
+  t_edges = bit_sync_time(NAV_MSG_BIT_SYNC_EDGES, bits, offset, 0.05,
+                          &ref_edges);
+  ref_hist = 0xFF;
+  t_hist = bit_sync_time(NAV_MSG_BIT_SYNC_HISTOGRAM, bits, offset, 0.05,
+                         &ref_hist);
+  fail_unless(t_hist < N_UPDATES, "No bit sync in noise");
+  fail_unless(ref_hist == want_ref,
+              "Bit phase %d in noise, expected %d", ref_hist, want_ref);
+  fail_unless(t_hist < 3000 && t_hist < t_edges,
+              "Histogram locked at %d ms in noise, edges at %d ms",
+              t_hist, t_edges);
+}
+END_TEST
+
+START_TEST(test_nav_msg_tow_single)
+{
+  static u8 bits[N_BITS];
+  srandom(5);
+  make_bits(bits, 2, 5000, 0);
+
+  /* First TOW and the update it came at, from two subframes then one. */
+  s32 first_tow[2] = {-1, -1};
+  u32 first_k[2] = {0, 0};
+  for (u8 single=0; single<2; single++) {
+    nav_msg_t n;
+    nav_msg_init(&n);
+    n.tow_single = single;
+    for (u32 k=0; k<N_UPDATES; k++) {
+      s32 TOW_ms = nav_msg_update(&n, bits[(k + 11) / 20] ? 100 : -100, 1);
+      if (subframe_ready(&n)) {
+        ephemeris_t e;
+        process_subframe(&n, &e);
+      }
+      if (TOW_ms < 0)
+        continue;
+      if (first_tow[single] < 0) {
+        first_tow[single] = TOW_ms;
+        first_k[single] = k;
+      }
+      /* Every TOW reported runs on from the first. */
+      fail_unless(TOW_ms - first_tow[single] == (s32)(k - first_k[single]),
+                  "TOW %d at update %d inconsistent with %d at %d",
+                  TOW_ms, k, first_tow[single], first_k[single]);
+    }
+  }
+
+  fail_unless(first_tow[0] >= 0 && first_tow[1] >= 0, "No TOW");
+  fail_unless(first_k[0] - first_k[1] == 6000 &&
+              first_tow[0] - first_tow[1] == 6000,
+              "Single subframe TOW %d at update %d, two subframes %d at %d",
+              first_tow[1], first_k[1], first_tow[0], first_k[0]);
+}
+END_TEST
+
+START_TEST(test_nav_msg_tow_check)
+{
+  const s32 week_ms = 7*24*60*60*1000;
+  bool ok[4];
+
+  /* Two agreeing channels confirm each other, the outlier and the channel
+   * without a TOW are left out. */
+  const s32 tow[4] = {100000, 100015, 160000, -1};
+  fail_unless(nav_msg_tow_check(4, tow, -1, 20, ok) == 2 &&
+              ok[0] && ok[1] && !ok[2] && !ok[3],
+              "Cross-check without an a-priori time failed");
+
+  /* A lone channel needs an a-priori time, which then decides. */
+  fail_unless(nav_msg_tow_check(1, tow, -1, 20, ok) == 0 && !ok[0],
+              "Lone TOW confirmed");
+  fail_unless(nav_msg_tow_check(3, tow, 159990, 20, ok) == 1 &&
+              !ok[0] && !ok[1] && ok[2],
+              "Cross-check against an a-priori time failed");
+
+  /* Across the week rollover. */
+  const s32 tow_wrap[2] = {week_ms - 5, 3};
+  fail_unless(nav_msg_tow_check(2, tow_wrap, -1, 20, ok) == 2,
+              "Cross-check across the week rollover failed");
+}
+END_TEST
+
+/* Decode a stream of bits into `a`, returning the number of pages of
+ * subframes 4 and 5 decoded. */
+static u32 run_almanac(const u8 *bits, nav_msg_almanac_t *a)
+{
+  nav_msg_t n;
+  nav_msg_init(&n);
+  u32 n_pages = 0;
+  for (u32 k=0; k<N_UPDATES; k++) {
+    nav_msg_update(&n, bits[(k + 5) / 20] ? 100 : -100, 1);
+    if (subframe_ready(&n)) {
+      ephemeris_t e;
+      n_pages += process_subframe_almanac(&n, &e, a) == 2;
+    }
+  }
+  return n_pages;
+}
+
+#define CHECK_FIELD(x, want) \
+  fail_unless(fabs((x) - (want)) <= 1e-12 * fabs((double)(want)), \
+              #x " is %g, expected %g", (double)(x), (double)(want))
+
+START_TEST(test_nav_msg_almanac)
+{
+  /* Subframes 4 to 5 then 1 to 4. The first subframe is lost to bit sync
+   * and the last to the end of the stream. */
+  static u8 bits[N_BITS];
+  static const u32 week = 766;
+  static const u32 pages_a[N_SUBFRAMES][8] = {
+    [1] = {  /* Subframe 4 page 18, ionosphere and UTC. */
+      1<<22 | 56<<16 | 0x0B<<8 | 0xFF, 0xFC<<16 | 0x00<<8 | 0x50,
+      0x00<<16 | 0xFB<<8 | 0x01, 0xFFFFF0, 0xFFFFFF,
+      0xF4<<16 | 0x90<<8 | 0xFE, 18<<16 | 0x89<<8 | 7, 18<<16
+    },
+    [2] = {  /* Subframe 5, almanac of PRN 7. */
+      1<<22 | 7<<16 | 0x2345, 144<<16 | 0xF123, 0xFD10<<8 | 0,
+      0xA10DCD, 0x812345, 0x3456AB, 0xC00001,
+      (0x5A3>>3)<<16 | 0x7F0<<5 | (0x5A3&7)<<2
+    },
+    [3] = { week<<14 },  /* Subframe 1, week number. */
+  };
+  static const u32 pages_b[N_SUBFRAMES][8] = {
+    [1] = {  /* Subframe 4, almanac of PRN 27 with a health problem. */
+      1<<22 | 27<<16 | 0x0100, 144<<16, 0x0001<<8 | 0x20,
+      0xA10000, 0x000001, 0x7FFFFF, 0x400000, 0
+    },
+    [2] = {  /* Subframe 5 page 25, almanac reference time and week. */
+      1<<22 | 51<<16 | 144<<8 | (week & 0xFF)
+    },
+    [3] = { week<<14 },
+  };
+
+  nav_msg_almanac_t a;
+  nav_msg_almanac_init(&a);
+
+  srandom(6);
+  make_bits(bits, 2, 3000, pages_a);
+  fail_unless(run_almanac(bits, &a) == 2, "Pages of the first stream lost");
+
+  const ionosphere_t *iono = &a.iono;
+  fail_unless(iono->valid, "Ionosphere not decoded");
+  CHECK_FIELD(iono->a0, 11 * pow(2,-30));
+  CHECK_FIELD(iono->a1, -1 * pow(2,-27));
+  CHECK_FIELD(iono->a2, -4 * pow(2,-24));
+  CHECK_FIELD(iono->a3, 0);
+  CHECK_FIELD(iono->b0, 80 * pow(2,11));
+  CHECK_FIELD(iono->b1, 0);
+  CHECK_FIELD(iono->b2, -5 * pow(2,16));
+  CHECK_FIELD(iono->b3, 1 * pow(2,16));
+
+  const utc_params_t *utc = &a.utc;
+  fail_unless(utc->valid, "UTC parameters not decoded");
+  CHECK_FIELD(utc->a1, -16 * pow(2,-50));
+  CHECK_FIELD(utc->a0, -12 * pow(2,-30));
+  fail_unless(utc->tot == 0x90 * 4096 && utc->wnt == 0xFE &&
+              utc->dt_ls == 18 && utc->wn_lsf == 0x89 && utc->dn == 7 &&
+              utc->dt_lsf == 18, "UTC parameters decoded wrongly");
+
+  /* The almanac week is unknown until subframe 5 page 25. */
+  const almanac_t *alm = &a.almanac[6];
+  fail_unless(alm->valid && alm->prn == 6 && alm->healthy && alm->week == 0,
+              "PRN 7 almanac not decoded");
+  fail_unless(a.week == (s16)week, "Week %d, expected %d", a.week, week);
+  CHECK_FIELD(alm->ecc, 0x2345 * pow(2,-21));
+  CHECK_FIELD(alm->toa, 144 * 4096);
+  CHECK_FIELD(alm->inc, (0.3 + (0xF123 - 0x10000) * pow(2,-19)) * M_PI);
+  CHECK_FIELD(alm->rora, (0xFD10 - 0x10000) * pow(2,-38) * M_PI);
+  CHECK_FIELD(alm->a, pow(0xA10DCD * pow(2,-11), 2));
+  CHECK_FIELD(alm->raaw, (0x812345 - 0x1000000) * pow(2,-23) * M_PI);
+  CHECK_FIELD(alm->argp, 0x3456AB * pow(2,-23) * M_PI);
+  CHECK_FIELD(alm->ma, (0xC00001 - 0x1000000) * pow(2,-23) * M_PI);
+  CHECK_FIELD(alm->af0, (0x5A3 - 0x800) * pow(2,-20));
+  CHECK_FIELD(alm->af1, (0x7F0 - 0x800) * pow(2,-38));
+
+  make_bits(bits, 2, 4000, pages_b);
+  fail_unless(run_almanac(bits, &a) == 2, "Pages of the second stream lost");
+
+  fail_unless(a.wna == (s16)(week & 0xFF) && a.toa == 144 * 4096,
+              "Almanac reference week %d time %d", a.wna, a.toa);
+  alm = &a.almanac[26];
+  fail_unless(alm->valid && alm->prn == 26 && !alm->healthy,
+              "PRN 27 almanac not decoded");
+  fail_unless(a.almanac[6].week == (s16)week && alm->week == (s16)week,
+              "Almanac weeks %d and %d, expected %d",
+              a.almanac[6].week, alm->week, week);
+  CHECK_FIELD(alm->ecc, 0x0100 * pow(2,-21));
+  CHECK_FIELD(alm->inc, 0.3 * M_PI);
+  CHECK_FIELD(alm->argp, 0x7FFFFF * pow(2,-23) * M_PI);
+}
+END_TEST
+
+START_TEST(test_nav_msg_replay)
+{
+  /* Three satellites decoded as received, recording their subframes. */
+  static u8 bits[3][N_BITS];
+  srandom(7);
+  for (u8 i=0; i<3; i++)
+    make_bits(bits[i], 2 + i, 2000 + 100*i, 0);
+  /* A parity error, the subframe isn't recorded. */
+  bits[1][1000] ^= 1;
+
+  nav_msg_t n[3];
+  for (u8 i=0; i<3; i++)
+    nav_msg_init(&n[i]);
+  ephemeris_t e[32], e_replay[32];
+  memset(e, 0, sizeof(e));
+  memset(e_replay, 0, sizeof(e_replay));
+  nav_msg_almanac_t a, a_replay;
+  nav_msg_almanac_init(&a);
+  nav_msg_almanac_init(&a_replay);
+
+  static nav_msg_subframe_t sf[3 * N_SUBFRAMES];
+  s8 ret[3 * N_SUBFRAMES];
+  u32 n_sf = 0, n_lost = 0;
+  for (u32 k=0; k<N_UPDATES; k++) {
+    for (u8 i=0; i<3; i++) {
+      nav_msg_update(&n[i], bits[i][(k + 3*i) / 20] ? 100 : -100, 1);
+      if (!subframe_ready(&n[i]))
+        continue;
+      u8 prn = 10 + i;
+      if (nav_msg_subframe_get(&n[i], prn, &sf[n_sf]) == 0) {
+        u32 s = sf[n_sf].tow / 6 - (2000 + 100*i);
+        fail_unless(sf[n_sf].prn == prn && s < N_SUBFRAMES &&
+                    sf[n_sf].sf_id == (2 + i + s) % 5 + 1,
+                    "Subframe at TOW %d ID %d", sf[n_sf].tow, sf[n_sf].sf_id);
+        ret[n_sf++] = process_subframe_almanac(&n[i], &e[prn], &a);
+      } else {
+        n_lost++;
+        process_subframe_almanac(&n[i], &e[prn], &a);
+      }
+    }
+  }
+  fail_unless(n_lost == 1 && n_sf + n_lost >= 3 * (N_SUBFRAMES - 2),
+              "Recorded %d subframes, lost %d", n_sf, n_lost);
+
+  /* Replaying the interleaved subframes decodes the same. */
+  nav_msg_replay_t r;
+  nav_msg_replay_init(&r);
+  for (u32 j=0; j<n_sf; j++) {
+    s8 want = ret[j];
+    s8 got = nav_msg_replay_subframe(&r, &sf[j], &e_replay[sf[j].prn],
+                                     &a_replay);
+    fail_unless(got == want, "Subframe %d replayed %d, decoded %d",
+                j, got, want);
+  }
+  fail_unless(e[10].valid && e[12].valid, "No ephemeris decoded");
+  fail_unless(memcmp(e, e_replay, sizeof(e)) == 0, "Ephemerides differ");
+  fail_unless(memcmp(&a, &a_replay, sizeof(a)) == 0, "Almanac store differs");
+}
+END_TEST
+
+START_TEST(test_nav_msg_subframe_get)
+{
+  static u8 bits[N_BITS];
+  srandom(8);
+  make_bits(bits, 3, 500, 0);
+
+  nav_msg_t n;
+  nav_msg_init(&n);
+  nav_msg_subframe_t sf, sf_ref;
+  memset(&sf_ref, 0, sizeof(sf_ref));
+
+  /* Every start offset nav_msg_update() can set, upright and inverted. The
+   * two bits before the subframe are D29* and D30* of the word before,
+   * both zero in make_bits(). */
+  const u16 len = NAV_MSG_SUBFRAME_BITS_LEN*32;
+  for (s16 start=1; start<=len + 24; start++) {
+    for (u8 inv=0; inv<2; inv++) {
+      for (u16 b=0; b<len; b++) {
+        u16 pos = (b + start - 1) % len;
+        u8 bit = b < 300 ? bits[b] : b >= len - 2 ? 0 : random() & 1;
+        if (bit != inv)
+          n.subframe_bits[pos / 32] |= 1u << (31 - pos % 32);
+        else
+          n.subframe_bits[pos / 32] &= ~(1u << (31 - pos % 32));
+      }
+      n.subframe_start_index = inv ? -start : start;
+
+      fail_unless(nav_msg_subframe_get(&n, 5, &sf) == 0,
+                  "No subframe at start %d", n.subframe_start_index);
+      if (start == 1 && !inv) {
+        fail_unless(sf.tow == 500*6 && sf.sf_id == 4,
+                    "Subframe at TOW %d ID %d", sf.tow, sf.sf_id);
+        sf_ref = sf;
+      }
+      fail_unless(memcmp(&sf, &sf_ref, sizeof(sf)) == 0,
+                  "Subframe at start %d differs", n.subframe_start_index);
+    }
+  }
+}
+END_TEST
+
+Suite* nav_msg_suite(void)
+{
+  Suite *s = suite_create("Nav message");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_loop_test(tc_core, test_nav_parity_batch, 0, 2);
+  tcase_add_loop_test(tc_core, test_nav_msg_batch, 0, 2);
+  tcase_add_test(tc_core, test_nav_msg_bit_sync);
+  tcase_add_test(tc_core, test_nav_msg_tow_single);
+  tcase_add_test(tc_core, test_nav_msg_tow_check);
+  tcase_add_test(tc_core, test_nav_msg_almanac);
+  tcase_add_test(tc_core, test_nav_msg_replay);
+  tcase_add_test(tc_core, test_nav_msg_subframe_get);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,139 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <orbit_cache.h>
+
+static double frand(double lo, double hi)
+{
+  return lo + (hi - lo) * random() / (double)RAND_MAX;
+}
+
+static void make_ephemeris(ephemeris_t *e, u8 prn)
+{
+  memset(e, 0, sizeof(*e));
+  e->prn = prn;
+  e->sqrta = 5153.6;
+  e->ecc = frand(0, 0.02);
+  e->m0 = frand(-M_PI, M_PI);
+  e->w = frand(-M_PI, M_PI);
+  e->omega0 = frand(-M_PI, M_PI);
+  e->inc = 0.96;
+  e->dn = 4.5e-9;
+  e->omegadot = -8e-9;
+  e->inc_dot = 1e-10;
+  e->crs = 50;
+  e->crc = 250;
+  e->cus = 5e-6;
+  e->cuc = -3e-6;
+  e->cis = 1e-7;
+  e->cic = -1e-7;
+  e->af0 = frand(-1e-4, 1e-4);
+  e->af1 = 1e-12;
+  e->tgd = 5e-9;
+  e->toe.wn = 1800;
+  e->toe.tow = 7200;
+  e->toc = e->toe;
+  e->valid = 1;
+  ephemeris_prepare(e);
+}
+
+/* Largest differences between the cache and the full model at `n` times
+ * spread over `span` seconds from `t`. */
+static void compare(orbit_cache_t *c, const ephemeris_t *e, gps_time_t t,
+                    double span, u32 n, double err[4])
+{
+  for (u32 i=0; i<n; i++) {
+    gps_time_t tot = t;
+    tot.tow += span * i / n;
+    tot = normalize_gps_time(tot);
+
+    double p[3], v[3], clk, rate, p_ref[3], v_ref[3], clk_ref, rate_ref;
+    fail_unless(orbit_cache_sat_pos(c, e, tot, p, v, &clk, &rate) == 0,
+                "Cache evaluation failed");
+    calc_sat_pos(p_ref, v_ref, &clk_ref, &rate_ref, e, tot);
+    for (u8 j=0; j<3; j++) {
+      err[0] = fmax(err[0], fabs(p[j] - p_ref[j]));
+      err[1] = fmax(err[1], fabs(v[j] - v_ref[j]));
+    }
+    err[2] = fmax(err[2], fabs(clk - clk_ref));
+    err[3] = fmax(err[3], fabs(rate - rate_ref));
+  }
+}
+
+START_TEST(test_orbit_cache)
+{
+  srandom(1);
+  orbit_cache_t c;
+  orbit_cache_init(&c, 0);
+  fail_unless(c.window == ORBIT_CACHE_WINDOW, "Default window not used");
+
+  ephemeris_t e[4];
+  for (u8 i=0; i<4; i++)
+    make_ephemeris(&e[i], 3 + 7*i);
+
+  /* An hour, four windows, around toe. */
+  gps_time_t t = {.wn = 1800, .tow = 5400};
+  double err[4] = {0};
+  for (u8 i=0; i<4; i++)
+    compare(&c, &e[i], t, 3600, 2000, err);
+  fail_unless(c.n_fits == 16, "%d fits", (int)c.n_fits);
+  fail_unless(err[0] < ORBIT_CACHE_MAX_POS_ERR &&
+              err[1] < ORBIT_CACHE_MAX_VEL_ERR &&
+              err[2] < ORBIT_CACHE_MAX_CLOCK_ERR &&
+              err[3] < ORBIT_CACHE_MAX_CLOCK_RATE_ERR,
+              "Errors %g m, %g m/s, %g s, %g s/s",
+              err[0], err[1], err[2], err[3]);
+  for (u8 i=0; i<4; i++) {
+    const orbit_cache_sat_t *s = &c.sat[e[i].prn];
+    fail_unless(s->state == ORBIT_CACHE_FITTED &&
+                s->max_err < ORBIT_CACHE_MAX_POS_ERR &&
+                s->max_vel_err < ORBIT_CACHE_MAX_VEL_ERR &&
+                s->max_clock_err < ORBIT_CACHE_MAX_CLOCK_ERR &&
+                s->max_clock_rate_err < ORBIT_CACHE_MAX_CLOCK_RATE_ERR,
+                "PRN %d state %d, fit errors %g m, %g m/s, %g s, %g s/s",
+                e[i].prn, s->state, s->max_err, s->max_vel_err,
+                s->max_clock_err, s->max_clock_rate_err);
+  }
+
+  /* A new ephemeris within the window is fitted again. */
+  t.tow = 9000;
+  compare(&c, &e[0], t, 60, 10, err);
+  u32 n_fits = c.n_fits;
+  e[0].toe.tow = e[0].toc.tow = 9000;
+  e[0].m0 += 0.1;
+  ephemeris_prepare(&e[0]);
+  memset(err, 0, sizeof(err));
+  compare(&c, &e[0], t, 60, 10, err);
+  fail_unless(c.n_fits == n_fits + 1, "New ephemeris not fitted");
+  fail_unless(err[0] < ORBIT_CACHE_MAX_POS_ERR, "Error %g m", err[0]);
+
+  /* A window too long to fit falls back on the full model. */
+  orbit_cache_init(&c, 6*3600);
+  memset(err, 0, sizeof(err));
+  t.tow = 0;
+  compare(&c, &e[1], t, 6*3600, 100, err);
+  fail_unless(c.sat[e[1].prn].state == ORBIT_CACHE_UNFIT,
+              "Six hour fit within bounds");
+  fail_unless(err[0] == 0, "Full model not used");
+
+  ephemeris_t bad = e[1];
+  bad.prn = 32;
+  double p[3], v[3], clk, rate;
+  fail_unless(orbit_cache_sat_pos(&c, &bad, t, p, v, &clk, &rate) == -1,
+              "Out of range PRN accepted");
+}
+END_TEST
+
+Suite* orbit_cache_suite(void)
+{
+  Suite *s = suite_create("Orbit cache");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_orbit_cache);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
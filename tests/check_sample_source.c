@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <correlate.h>
+#include <sample_source.h>
+
+/* Write `len` bytes to a new temporary file, returning its path. */
+static void write_capture(char *path, const void *data, size_t len)
+{
+  strcpy(path, "/tmp/check_sample_source_XXXXXX");
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0, "Failed to create capture file");
+  fail_unless(write(fd, data, len) == (ssize_t)len,
+              "Failed to write capture file");
+  close(fd);
+}
+
+START_TEST(test_sample_source_file)
+{
+  char path[64];
+  sample_source_t src;
+  sample_window_t w;
+
+  /* s8 samples with a trailing partial group that must be ignored when read
+   * as I/Q pairs. */
+  s8 data[5001];
+  for (u32 i=0; i<sizeof(data); i++)
+    data[i] = (s8)(i * 7);
+  write_capture(path, data, sizeof(data));
+
+  fail_unless(sample_source_file_init(&src, path, SAMPLE_FORMAT_S8,
+                                      4.092e6) == 0,
+              "Failed to open capture");
+  fail_unless(sample_source_available(&src) == sizeof(data),
+              "Capture has %d samples", (int)sample_source_available(&src));
+
+  fail_unless(sample_source_window(&src, 1234, 100, &w) == 0,
+              "Failed to get window");
+  fail_unless(w.t == 1234 && w.n == 100 && w.start == 0 &&
+              memcmp(w.data, &data[1234], 100) == 0,
+              "Window doesn't match capture");
+  fail_unless(sample_source_window(&src, 4950, 100, &w) == -1,
+              "Window past the end of the capture accepted");
+
+  fail_unless(sample_source_window_ms(&src, 0, 1, &w) == 0,
+              "Failed to get 1 ms window");
+  fail_unless(w.t == 0 && w.n == 4092,
+              "1 ms window at sample %d, %d samples", (int)w.t, w.n);
+  fail_unless(sample_source_window_ms(&src, 1, 1, &w) == -1,
+              "1 ms window past the end of the capture accepted");
+  sample_source_free(&src);
+
+  fail_unless(sample_source_file_init(&src, path, SAMPLE_FORMAT_IQ_S16,
+                                      1e6) == 0,
+              "Failed to open capture");
+  fail_unless(sample_source_available(&src) == sizeof(data) / 4,
+              "Capture has %d I/Q samples",
+              (int)sample_source_available(&src));
+  fail_unless(sample_source_window(&src, 10, 5, &w) == 0,
+              "Failed to get window");
+  fail_unless(memcmp(w.data, &data[40], 20) == 0,
+              "I/Q window doesn't match capture");
+  sample_source_free(&src);
+  unlink(path);
+
+  fail_unless(sample_source_file_init(&src, path, SAMPLE_FORMAT_S8,
+                                      1e6) == -1,
+              "Opened missing capture");
+}
+END_TEST
+
+START_TEST(test_sample_source_ring)
+{
+  /* 2-bit samples through a ring of 256 samples, written 64 at a time and
+   * read in windows that straddle the packed groups and the wrap. */
+  const u32 capacity = 256, window = 100, total = 2048;
+  s8 samples[2048];
+  for (u32 i=0; i<total; i++)
+    samples[i] = (i % 3 ? 1 : -1) * (i % 5 ? 1 : 3);
+  u64 packed[PACKED_SAMPLES_WORDS(2048, 2)];
+  packed_samples_pack(samples, total, 2, packed);
+
+  sample_source_t src;
+  fail_unless(sample_source_ring_init(&src, SAMPLE_FORMAT_PACKED_2BIT, 1e6,
+                                      capacity, window) == 0,
+              "Failed to create ring");
+  fail_unless(sample_source_write(&src, packed, 10) == -1,
+              "Partial packed group accepted");
+
+  sample_window_t w;
+  u64 t = 0, written = 0;
+  while (t + window <= total) {
+    s8 ret = sample_source_window(&src, t, window, &w);
+    if (ret == -2) {
+      /* Not written yet, the producer fills as much as it can. */
+      while (written < total &&
+             sample_source_write(&src, &packed[written / 32], 64) == 0)
+        written += 64;
+      fail_unless(written - t <= capacity + 63,
+                  "Ring holds more samples than its capacity");
+      continue;
+    }
+    fail_unless(ret == 0, "Failed to get window at %d", (int)t);
+    fail_unless(w.t == t && w.start == t % 64,
+                "Window at %d has start %d", (int)t, w.start);
+
+    s8 got[100];
+    packed_samples_unpack(w.data, 2, w.start, window, got);
+    fail_unless(memcmp(got, &samples[t], window) == 0,
+                "Window at %d doesn't match samples", (int)t);
+
+    t += 37;
+    sample_source_release(&src, t);
+    fail_unless(sample_source_window(&src, t - 1, 10, &w) == -1,
+                "Released sample returned");
+  }
+
+  fail_unless(sample_source_window(&src, t, window + 1, &w) == -1,
+              "Window longer than maximum accepted");
+  sample_source_free(&src);
+}
+END_TEST
+
+Suite* sample_source_suite(void)
+{
+  Suite *s = suite_create("Sample source");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_sample_source_file);
+  tcase_add_test(tc_core, test_sample_source_ring);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -12,6 +12,20 @@ Suite* sbp_suite(void);
 Suite* edc_suite(void);
 Suite* linear_algebra_suite(void);
 Suite* ambiguity_test_suite(void);
+Suite* correlate_suite(void);
+Suite* fft_suite(void);
+Suite* acq_suite(void);
+Suite* sample_source_suite(void);
+Suite* track_batch_suite(void);
+Suite* frontend_suite(void);
+Suite* excision_suite(void);
+Suite* nav_msg_suite(void);
+Suite* nav_archive_suite(void);
+Suite* diag_suite(void);
+Suite* ephemeris_suite(void);
+Suite* orbit_cache_suite(void);
+Suite* ephemeris_store_suite(void);
+Suite* almanac_suite(void);
 
 #endif /* CHECK_SUITES_H */
 
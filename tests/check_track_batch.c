@@ -0,0 +1,141 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include "check_utils.h"
+
+#include <cpu_features.h>
+#include <track.h>
+#include <track_batch.h>
+
+#define N_CHANNELS 13
+#define N_UPDATES 500
+
+/* Loop outputs are compared relative to their magnitude, the batch differs
+ * from the per-channel loops only by single precision rounding. */
+#define FREQ_TOL 1e-4
+#define CN0_TOL 1e-3
+
+/* Correlations of a channel tracking a signal with a phase and code error
+ * that wander, in noise. */
+static void make_correlations(u32 k, u32 c, correlation_t cs[3])
+{
+  double amp = 200 + 40*c;
+  double phase = 0.3*sin(0.01*k + c) + (c == 4 ? M_PI/2 : 0);
+  double code_err = 0.1*cos(0.02*k + 2*c);
+  double shape[3] = {0.5 + code_err, 1, 0.5 - code_err};
+  for (u32 j=0; j<3; j++) {
+    cs[j].I = amp*shape[j]*cos(phase) + frand(-30, 30);
+    cs[j].Q = amp*shape[j]*sin(phase) + frand(-30, 30);
+  }
+  /* Exercise the Costas discriminator's zero case. */
+  if (c == 7 && k % 50 == 0)
+    cs[1].I = 0;
+}
+
+static void check_close(float got, float want, double tol,
+                        const char *what, u32 k, u32 c)
+{
+  fail_unless(fabs(got - want) <= tol * (1 + fabs(want)),
+              "Update %d channel %d %s is %f, per-channel %f",
+              k, c, what, got, want);
+}
+
+START_TEST(test_track_batch_update)
+{
+  /* Loop index is the loop type, each run with and without SIMD. */
+  track_loop_type_t type = _i / 2;
+  cpu_features_set_mask(_i % 2 ? CPU_FEATURES_ALL : 0);
+
+  simple_tl_state_t simple[N_CHANNELS];
+  aided_tl_state_t aided[N_CHANNELS];
+  comp_tl_state_t comp[N_CHANNELS];
+  cn0_est_state_t cn0[N_CHANNELS];
+
+  track_batch_t b;
+  fail_unless(track_batch_init(&b, type, TRACK_BATCH_MAX_CHANNELS + 1) == -1,
+              "Too many channels accepted");
+  fail_unless(track_batch_init(&b, type, N_CHANNELS) == 0,
+              "Failed to initialise batch");
+
+  srandom(1);
+  for (u32 c=0; c<N_CHANNELS; c++) {
+    float code_freq = frand(-5, 5), carr_freq = frand(-3000, 3000);
+    float code_bw = frand(1, 3), carr_bw = frand(15, 30);
+    cn0_est_init(&cn0[c], 1e3, 40, 5, 1e3);
+    switch (type) {
+    case TRACK_LOOP_SIMPLE:
+      simple_tl_init(&simple[c], 1e3, code_freq, code_bw, 0.7, 1,
+                     carr_freq, carr_bw, 0.7, 1);
+      track_batch_set_simple(&b, c, &simple[c], &cn0[c]);
+      break;
+    case TRACK_LOOP_AIDED:
+      aided_tl_init(&aided[c], 1e3, code_freq, code_bw, 0.7, 1,
+                    carr_freq, carr_bw, 0.7, 1, 5);
+      track_batch_set_aided(&b, c, &aided[c], &cn0[c]);
+      break;
+    case TRACK_LOOP_COMP:
+      comp_tl_init(&comp[c], 1e3, code_freq, code_bw, 0.7, 1,
+                   carr_freq, carr_bw, 0.7, 1, 0.005, 1540, 100 + 20*c);
+      track_batch_set_comp(&b, c, &comp[c], &cn0[c]);
+      break;
+    }
+  }
+
+  for (u32 k=0; k<N_UPDATES; k++) {
+    correlation_t cs[N_CHANNELS][3];
+    for (u32 c=0; c<N_CHANNELS; c++)
+      make_correlations(k, c, cs[c]);
+
+    track_batch_update(&b, cs);
+
+    for (u32 c=0; c<N_CHANNELS; c++) {
+      float code_freq = 0, carr_freq = 0;
+      switch (type) {
+      case TRACK_LOOP_SIMPLE:
+        simple_tl_update(&simple[c], cs[c]);
+        code_freq = simple[c].code_freq;
+        carr_freq = simple[c].carr_freq;
+        break;
+      case TRACK_LOOP_AIDED:
+        aided_tl_update(&aided[c], cs[c]);
+        code_freq = aided[c].code_freq;
+        carr_freq = aided[c].carr_freq;
+        break;
+      case TRACK_LOOP_COMP:
+        comp_tl_update(&comp[c], cs[c]);
+        code_freq = comp[c].code_freq;
+        carr_freq = comp[c].carr_freq;
+        break;
+      }
+      float cn0_want = cn0_est(&cn0[c], cs[c][1].I);
+
+      check_close(b.code_freq[c], code_freq, FREQ_TOL, "code_freq", k, c);
+      check_close(b.carr_freq[c], carr_freq, FREQ_TOL, "carr_freq", k, c);
+      check_close(b.cn0[c], cn0_want, CN0_TOL, "cn0", k, c);
+    }
+  }
+
+  /* The state read back carries on exactly like the batch. */
+  if (type == TRACK_LOOP_COMP) {
+    comp_tl_state_t s;
+    cn0_est_state_t e;
+    track_batch_get_comp(&b, 3, &s, &e);
+    fail_unless(s.n == comp[3].n && s.sched == comp[3].sched,
+                "Read back comp. loop counters differ");
+  }
+
+  cpu_features_set_mask(CPU_FEATURES_ALL);
+}
+END_TEST
+
+Suite* track_batch_suite(void)
+{
+  Suite *s = suite_create("Batch tracking loops");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_loop_test(tc_core, test_track_batch_update, 0, 6);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}